@@ -0,0 +1,17 @@
+#ifndef APPEXPORT_H
+#define APPEXPORT_H
+
+//******************************************************************************
+// DLL Export definitions of the application classes built into the dgvc library.
+// The application executable compiles the same sources without decoration
+//******************************************************************************
+#if (defined WIN32 || defined _WIN32 || defined WINCE) && defined APP_EXPORT
+#  define DGV_APP_EXPORT __declspec(dllexport)
+#elif (defined WIN32 || defined _WIN32 || defined WINCE) && defined APP_IMPORT
+#  define DGV_APP_EXPORT __declspec(dllimport)
+#else
+#  define DGV_APP_EXPORT
+#endif
+
+
+#endif // APPEXPORT_H
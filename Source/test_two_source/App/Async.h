@@ -0,0 +1,238 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+// Std
+#include <functional>
+
+// Qt
+#include <QObject>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
+#include <QTimer>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#define DGV_HAS_COROUTINES
+#endif
+
+namespace DGV
+{
+
+//******************************************************************************************
+/*!
+ * \brief The CancellationToken class is shared between the caller and the asynchronous tasks.
+ * Copies share the same state. Tasks check it before starting and between steps.
+ */
+class CancellationToken
+{
+public:
+    CancellationToken() :
+        _state(new QAtomicInt(0))
+    {}
+
+    void cancel()
+    { _state->store(1); }
+    bool isCancelled() const
+    { return _state->load() != 0; }
+
+private:
+    QSharedPointer<QAtomicInt> _state;
+};
+
+//******************************************************************************************
+/*!
+ * \brief The AsyncResult class is the handle of an asynchronous operation.
+ *
+ * No thread waits for the result : the continuation given to then() is called once the operation
+ * is finished or cancelled. If the result has an executor context (a QObject), the continuation
+ * runs on the thread of the context through its event loop, otherwise it runs on the worker thread
+ * which finished the operation. If the context is destroyed before the continuation runs, the
+ * continuation is still called once, with a cancelled result, when the posted call is dropped
+ * (or on the worker thread if the context is already destroyed) : awaiting coroutines are
+ * always resumed.
+ *
+ * With C++20 coroutines, the result can be awaited : the coroutine is resumed on the executor
+ * context thread.
+ *
+ *  AsyncResult<FrameResult> r = pipeline.detectCardsAsync(frame, this);
+ *  r.then([](const AsyncResult<FrameResult> & r) { if (!r.isCancelled()) show(r.result()); });
+ *  // or, in a coroutine :
+ *  AsyncResult<FrameResult> done = co_await pipeline.detectCardsAsync(frame, this);
+ */
+template<typename T>
+class AsyncResult
+{
+public:
+    typedef std::function<void(const AsyncResult<T> &)> Continuation;
+
+    AsyncResult(QObject * context=0) :
+        _state(new State(context))
+    {}
+
+    bool isFinished() const
+    {
+        QMutexLocker locker(&_state->mutex);
+        return _state->finished;
+    }
+
+    bool isCancelled() const
+    {
+        QMutexLocker locker(&_state->mutex);
+        return _state->cancelled;
+    }
+
+    T result() const
+    {
+        QMutexLocker locker(&_state->mutex);
+        return _state->value;
+    }
+
+    QObject * context() const
+    { return _state->context.data(); }
+
+    void then(const Continuation & continuation)
+    {
+        QMutexLocker locker(&_state->mutex);
+        if (!_state->finished)
+        {
+            _state->continuation = continuation;
+            return;
+        }
+        locker.unlock();
+        deliver(continuation);
+    }
+
+    // Producer side
+    void finish(const T & value)
+    {
+        complete(&value);
+    }
+
+    void cancel()
+    {
+        complete(0);
+    }
+
+protected:
+
+    struct State
+    {
+        State(QObject * ctx) :
+            context(ctx), hasContext(ctx != 0), finished(false), cancelled(false)
+        {}
+        QMutex mutex;
+        QPointer<QObject> context;
+        bool hasContext;
+        bool finished;
+        bool cancelled;
+        T value;
+        Continuation continuation;
+    };
+
+    void complete(const T * value)
+    {
+        Continuation continuation;
+        {
+            QMutexLocker locker(&_state->mutex);
+            if (_state->finished)
+                return;
+            if (value)
+                _state->value = *value;
+            else
+                _state->cancelled = true;
+            _state->finished = true;
+            continuation.swap(_state->continuation);
+        }
+        if (continuation)
+            deliver(continuation);
+    }
+
+    //! Continuation posted to the context thread, called with a cancelled result if it is
+    //! dropped because the context is destroyed
+    struct PostedContinuation
+    {
+        PostedContinuation(const Continuation & c, const AsyncResult<T> & r) :
+            continuation(c), result(r), called(false)
+        {}
+        ~PostedContinuation()
+        {
+            if (!called)
+                continuation(lostContext());
+        }
+        void run()
+        {
+            called = true;
+            continuation(result);
+        }
+        Continuation continuation;
+        AsyncResult<T> result;
+        bool called;
+    };
+
+    static AsyncResult<T> lostContext()
+    {
+        AsyncResult<T> lost;
+        lost.cancel();
+        return lost;
+    }
+
+    void deliver(const Continuation & continuation) const
+    {
+        AsyncResult<T> self(*this);
+        if (!_state->hasContext)
+        {
+            continuation(self);
+            return;
+        }
+        // Executor affinity : run on the context thread
+        QObject * ctx = _state->context.data();
+        if (!ctx)
+        {
+            continuation(lostContext());
+            return;
+        }
+        QSharedPointer<PostedContinuation> posted(new PostedContinuation(continuation, self));
+        QTimer::singleShot(0, ctx, [posted]() { posted->run(); });
+    }
+
+    QSharedPointer<State> _state;
+};
+
+//******************************************************************************************
+
+#ifdef DGV_HAS_COROUTINES
+
+template<typename T>
+struct AsyncAwaiter
+{
+    AsyncResult<T> result;
+
+    bool await_ready() const
+    { return result.isFinished(); }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        result.then([handle](const AsyncResult<T> &) { handle.resume(); });
+    }
+
+    AsyncResult<T> await_resume() const
+    { return result; }
+};
+
+template<typename T>
+AsyncAwaiter<T> operator co_await(AsyncResult<T> result)
+{
+    AsyncAwaiter<T> awaiter = { result };
+    return awaiter;
+}
+
+#endif
+
+//******************************************************************************************
+
+}
+
+#endif // ASYNC_H
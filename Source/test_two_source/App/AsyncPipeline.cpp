@@ -0,0 +1,283 @@
+
+// Qt
+#include <QRunnable>
+
+// Project
+#include "AsyncPipeline.h"
+#include "BasicPairsDetector.h"
+#include "FeatureCache.h"
+#include "Core/WorkerIsolation.h"
+
+namespace DGV
+{
+
+//******************************************************************************************
+
+class DetectCardsTask : public QRunnable
+{
+public:
+    DetectCardsTask(AsyncPipeline * owner, const cv::Mat & frame, const AsyncResult<FrameResult> & result, const CancellationToken & token) :
+        _owner(owner), _frame(frame), _result(result), _token(token)
+    {}
+
+    void run()
+    {
+        if (_token.isCancelled())
+        {
+            _result.cancel();
+            return;
+        }
+        ImageCommon::pinWorkerThread();
+        Pipeline * pipeline = _owner->acquirePipeline();
+        FrameResult frameResult;
+        bool ok = pipeline->processFrame(_frame, &frameResult);
+        _owner->releasePipeline(pipeline);
+        if (!ok || _token.isCancelled())
+        {
+            _result.cancel();
+            return;
+        }
+        _result.finish(frameResult);
+    }
+
+private:
+    AsyncPipeline * _owner;
+    cv::Mat _frame;
+    AsyncResult<FrameResult> _result;
+    CancellationToken _token;
+};
+
+//******************************************************************************************
+/*!
+ * \brief The PairMatcher class holds the pairs detector and the features of the last matched
+ * frame. Features are computed again only if the frame changes (see FrameResult::frameId)
+ */
+class PairMatcher
+{
+public:
+    PairMatcher() :
+        detector(0.29, 10, false),
+        cache(detector.getExtractor())
+    {}
+
+    void setFrame(const FrameResult & f)
+    {
+        if (f.frameId >= 0 && f.frameId == frame.frameId)
+            return;
+        frame = f;
+        cache.setCards(frame.cards, &frame.objects);
+    }
+
+    BasicPairsDetector detector;
+    FeatureCache cache;
+    FrameResult frame;
+};
+
+//******************************************************************************************
+
+class MatchTask : public QRunnable
+{
+public:
+    MatchTask(AsyncPipeline * owner, const FrameResult & frame, int card1, int card2, const AsyncResult<PairResult> & result, const CancellationToken & token) :
+        _owner(owner), _frame(frame), _card1(card1), _card2(card2), _result(result), _token(token)
+    {}
+
+    void run()
+    {
+        const ObjectTable & objects = _frame.objects;
+        if (_token.isCancelled() ||
+                _card1 < 0 || _card2 < 0 || _card1 >= objects.cardCount() || _card2 >= objects.cardCount())
+        {
+            _result.cancel();
+            return;
+        }
+        ImageCommon::pinWorkerThread();
+
+        PairMatcher * matcher = _owner->acquireMatcher();
+        matcher->setFrame(_frame);
+        BasicPairsDetector & pairsDetector = matcher->detector;
+        FeatureCache & featureCache = matcher->cache;
+
+        PairResult pair;
+        pair.card1 = _card1;
+        pair.card2 = _card2;
+        bool cancelled = false;
+        for (int i=objects.cardOffsets[_card1]; !pair.found && i<objects.cardOffsets[_card1+1]; i++)
+        {
+            if (_token.isCancelled())
+            {
+                cancelled = true;
+                break;
+            }
+            if (!pairsDetector.setupRefObject(featureCache, i))
+                continue;
+            for (int j=objects.cardOffsets[_card2]; j<objects.cardOffsets[_card2+1]; j++)
+            {
+                if (pairsDetector.matchWithRefObject(featureCache, j))
+                {
+                    pair.object1 = i;
+                    pair.object2 = j;
+                    pair.found = true;
+                    break;
+                }
+            }
+        }
+        _owner->releaseMatcher(matcher);
+        if (cancelled)
+        {
+            _result.cancel();
+            return;
+        }
+        _result.finish(pair);
+    }
+
+private:
+    AsyncPipeline * _owner;
+    FrameResult _frame;
+    int _card1;
+    int _card2;
+    AsyncResult<PairResult> _result;
+    CancellationToken _token;
+};
+
+//******************************************************************************************
+/*!
+ * \brief AsyncPipeline::AsyncPipeline
+ * \param pool thread pool running the tasks, QThreadPool::globalInstance() if null. Not owned
+ */
+AsyncPipeline::AsyncPipeline(QThreadPool *pool) :
+    _cardSizeMinRatio(0.15),
+    _cardSizeMaxRatio(1.0),
+    _frameSizeLimit(700),
+    _pool(pool ? pool : QThreadPool::globalInstance()),
+    _workerIsolation(false),
+    _poolMaxThreads(-1),
+    _poolExpiryTimeout(-1)
+{
+}
+
+//******************************************************************************************
+/*!
+ * \brief AsyncPipeline::~AsyncPipeline waits for the tasks of the thread pool and disables the
+ * worker isolation mode if it was enabled by this pipeline
+ */
+AsyncPipeline::~AsyncPipeline()
+{
+    _pool->waitForDone();
+    if (_workerIsolation)
+        setWorkerIsolation(false);
+    qDeleteAll(_pipelines);
+    qDeleteAll(_matchers);
+}
+
+//******************************************************************************************
+/*!
+ * \brief AsyncPipeline::setWorkerIsolation enables the worker isolation mode (see
+ * ImageCommon::setWorkerIsolation) : one pool thread per core, pinned to its core, and no
+ * OpenCV inner parallelism. Threads are kept alive to keep their core.
+ * The mode is global to the process and should be set before tasks are started. The thread count
+ * and expiry timeout of the pool are restored when the mode is disabled.
+ */
+void AsyncPipeline::setWorkerIsolation(bool enabled)
+{
+    ImageCommon::setWorkerIsolation(enabled);
+    if (enabled == _workerIsolation)
+        return;
+    _workerIsolation = enabled;
+    if (enabled)
+    {
+        _poolMaxThreads = _pool->maxThreadCount();
+        _poolExpiryTimeout = _pool->expiryTimeout();
+        _pool->setMaxThreadCount(qMax(ImageCommon::workerCoreCount(), 1));
+        _pool->setExpiryTimeout(-1);
+    }
+    else
+    {
+        _pool->setMaxThreadCount(_poolMaxThreads);
+        _pool->setExpiryTimeout(_poolExpiryTimeout);
+    }
+}
+
+//******************************************************************************************
+
+Pipeline * AsyncPipeline::acquirePipeline()
+{
+    QMutexLocker locker(&_mutex);
+    if (_freePipelines.isEmpty())
+    {
+        Pipeline * pipeline = new Pipeline(_cardSizeMinRatio, _cardSizeMaxRatio, _frameSizeLimit);
+        _pipelines << pipeline;
+        return pipeline;
+    }
+    return _freePipelines.takeLast();
+}
+
+//******************************************************************************************
+
+void AsyncPipeline::releasePipeline(Pipeline *pipeline)
+{
+    QMutexLocker locker(&_mutex);
+    _freePipelines << pipeline;
+}
+
+//******************************************************************************************
+/*!
+ * \brief AsyncPipeline::acquireMatcher returns a free matcher, preferably the last released one
+ * as it holds the features of the most recent frame
+ */
+PairMatcher * AsyncPipeline::acquireMatcher()
+{
+    QMutexLocker locker(&_mutex);
+    if (_freeMatchers.isEmpty())
+    {
+        PairMatcher * matcher = new PairMatcher();
+        _matchers << matcher;
+        return matcher;
+    }
+    return _freeMatchers.takeLast();
+}
+
+//******************************************************************************************
+
+void AsyncPipeline::releaseMatcher(PairMatcher *matcher)
+{
+    QMutexLocker locker(&_mutex);
+    _freeMatchers << matcher;
+}
+
+//******************************************************************************************
+/*!
+ * \brief AsyncPipeline::detectCardsAsync finds cards and their objects on the frame
+ * \param frame input image of type CV_8UC1, CV_8UC3 (BGR) or CV_8UC4 (BGRA). The data is shared,
+ * not copied, and should not be modified until the result is finished
+ * \param context (optional) executor context of the result
+ * \param token (optional) cancellation token
+ * \return result handle. The result is cancelled if the frame is not supported
+ */
+AsyncResult<FrameResult> AsyncPipeline::detectCardsAsync(const cv::Mat &frame, QObject *context, const CancellationToken &token)
+{
+    AsyncResult<FrameResult> result(context);
+    _pool->start(new DetectCardsTask(this, frame, result, token));
+    return result;
+}
+
+//******************************************************************************************
+/*!
+ * \brief AsyncPipeline::matchAsync finds the common object of two cards of a frame
+ * \param frame result of detectCardsAsync
+ * \param card1 first card index
+ * \param card2 second card index
+ * \param context (optional) executor context of the result
+ * \param token (optional) cancellation token, checked between the objects of the first card
+ * \return result handle, PairResult::found is false if no common object is found
+ */
+AsyncResult<PairResult> AsyncPipeline::matchAsync(const FrameResult &frame, int card1, int card2, QObject *context, const CancellationToken &token)
+{
+    AsyncResult<PairResult> result(context);
+    _pool->start(new MatchTask(this, frame, card1, card2, result, token));
+    return result;
+}
+
+//******************************************************************************************
+
+}
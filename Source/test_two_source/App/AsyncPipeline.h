@@ -0,0 +1,102 @@
+#ifndef ASYNCPIPELINE_H
+#define ASYNCPIPELINE_H
+
+// Qt
+#include <QObject>
+#include <QThreadPool>
+#include <QMutex>
+#include <QList>
+
+// Opencv
+#include <opencv2/core.hpp>
+
+// Project
+#include "Core/Global.h"
+#include "Async.h"
+#include "Pipeline.h"
+#include "AppExport.h"
+
+namespace DGV
+{
+
+class PairMatcher;
+
+//******************************************************************************************
+
+struct PairResult
+{
+    PairResult() :
+        card1(-1), card2(-1), object1(-1), object2(-1), found(false)
+    {}
+
+    int card1;
+    int card2;
+    //! Matched objects, index in the object table of the frame
+    int object1;
+    int object2;
+    bool found;
+};
+
+//******************************************************************************************
+/*!
+ * \brief The AsyncPipeline class runs the pipeline operations as tasks of a thread pool and
+ * returns AsyncResult handles instead of blocking the caller.
+ *
+ * Waiting operations do not hold threads : a frame in flight is a queued task or a shared
+ * result state. Pipelines are not thread safe, so each running task borrows a pipeline from
+ * an internal free list (at most one pipeline per pool thread is created). Match tasks borrow
+ * a pairs detector and a feature cache the same way : the features and the trained indices of
+ * a frame are reused by the next pairs of the same frame.
+ *
+ * Results are delivered on the thread of the given context object (executor affinity), or on
+ * the worker thread if no context is given.
+ *
+ * In worker isolation mode (see setWorkerIsolation), pool threads are pinned to the cores and
+ * each task runs its OpenCV calls sequentially : the pool is the only source of concurrency.
+ */
+class DGV_APP_EXPORT AsyncPipeline
+{
+    PROPERTY_ACCESSORS(double, cardSizeMinRatio, getCardSizeMinRatio, setCardSizeMinRatio)
+    PROPERTY_ACCESSORS(double, cardSizeMaxRatio, getCardSizeMaxRatio, setCardSizeMaxRatio)
+    PROPERTY_ACCESSORS(int, frameSizeLimit, getFrameSizeLimit, setFrameSizeLimit)
+public:
+    AsyncPipeline(QThreadPool * pool=0);
+    ~AsyncPipeline();
+
+    AsyncResult<FrameResult> detectCardsAsync(const cv::Mat & frame, QObject * context=0,
+                                              const CancellationToken & token=CancellationToken());
+    AsyncResult<PairResult> matchAsync(const FrameResult & frame, int card1, int card2, QObject * context=0,
+                                       const CancellationToken & token=CancellationToken());
+
+    QThreadPool * threadPool() const
+    { return _pool; }
+
+    void setWorkerIsolation(bool enabled);
+
+protected:
+    friend class DetectCardsTask;
+    friend class MatchTask;
+
+    Pipeline * acquirePipeline();
+    void releasePipeline(Pipeline * pipeline);
+    PairMatcher * acquireMatcher();
+    void releaseMatcher(PairMatcher * matcher);
+
+    QThreadPool * _pool;
+    QMutex _mutex;
+    QList<Pipeline*> _freePipelines;
+    QList<Pipeline*> _pipelines;
+    QList<PairMatcher*> _freeMatchers;
+    QList<PairMatcher*> _matchers;
+    bool _workerIsolation;
+    //! Thread pool settings replaced in worker isolation mode, restored when it is disabled
+    int _poolMaxThreads;
+    int _poolExpiryTimeout;
+
+};
+
+//******************************************************************************************
+
+}
+
+#endif // ASYNCPIPELINE_H
@@ -3,8 +3,10 @@
 
 // Project
 #include "BasicPairsDetector.h"
+#include "FeatureCache.h"
 #include "Core/Global.h"
 #include "Core/ImageCommon.h"
+#include "Core/ImageProcessing.h"
 
 namespace DGV
 {
@@ -12,8 +14,12 @@ namespace DGV
 //******************************************************************************************
 
 BasicPairsDetector::BasicPairsDetector(float goodDistance, int goodMatchesMinLimit, bool verbose) :
+    _indexCacheLimit(64 * 1024 * 1024),
     _goodDistance(goodDistance),
     _goodMatchesMinLimit(goodMatchesMinLimit),
+    _indicesBytes(0),
+    _indicesGeneration(0),
+    _trainedIndexCount(0),
     PairsDetector(verbose)
 {
 #if 1
@@ -27,6 +33,16 @@ BasicPairsDetector::BasicPairsDetector(float goodDistance, int goodMatchesMinLim
 
 }
 
+//******************************************************************************************
+/*!
+ * \brief BasicPairsDetector::supportRadius returns the border within which the KAZE (M-SURF)
+ * descriptors are not computed at the finest scale : 12 * sqrt(2) scale units, scale 1.6 rounded to 2
+ */
+int BasicPairsDetector::supportRadius() const
+{
+    return 35;
+}
+
 //******************************************************************************************
 /*!
  * \brief BasicPairsDetector::setupRefObject setups the reference object
@@ -35,7 +51,91 @@ BasicPairsDetector::BasicPairsDetector(float goodDistance, int goodMatchesMinLim
  */
 bool BasicPairsDetector::setupRefObject(const cv::Mat &image, const cv::Mat & mask)
 {
+    _refImage = image;
     cv::Mat descriptors = computeDescriptors(image, mask, _refKeyPoints);
+    return setupRefDescriptors(descriptors);
+}
+
+//******************************************************************************************
+/*!
+ * \brief BasicPairsDetector::setupRefObject setups the reference object from its view :
+ * keypoints, descriptors and Hu moments are computed on the object region only
+ */
+bool BasicPairsDetector::setupRefObject(const ObjectView &object)
+{
+    return setupRefObject(object.image, object.mask);
+}
+
+//******************************************************************************************
+/*!
+ * \brief BasicPairsDetector::setupRefObject setups the reference object with its cached features.
+ * Features are computed by the cache if this is their first use.
+ *
+ * Trained indices are kept by object for the cards of the cache, so a reference object compared
+ * with the objects of several cards is indexed once. Indices of the least recently used objects
+ * are released above the memory limit (see setIndexCacheLimit).
+ */
+bool BasicPairsDetector::setupRefObject(FeatureCache &cache, int object)
+{
+    const ObjectFeatures & features = cache.objectFeatures(object);
+    _refImage = cache.card(object);
+    _refKeyPoints = features.keypoints;
+    _refMatcher.release();
+    if (features.descriptors.empty()) {
+        SD_TRACE("BasicPairsDetector::setupRefObject : descriptors matrix is empty");
+        return false;
+    }
+
+    // Indices are valid for the cards of the cache
+    if (cache.generation() != _indicesGeneration)
+    {
+        clearIndexCache();
+        _indicesGeneration = cache.generation();
+    }
+
+    if (_indices.contains(object))
+    {
+        _indicesLru.removeOne(object);
+        _indicesLru << object;
+        _refMatcher = _indices[object].matcher;
+        return true;
+    }
+
+    IndexEntry e;
+    e.matcher = _matcher->clone(true);
+    e.matcher->add(features.descriptors);
+    e.matcher->train();
+    // Descriptors are copied by the index, the trees are of the same order
+    e.bytes = 2 * (qint64) features.descriptors.total() * features.descriptors.elemSize();
+    _trainedIndexCount++;
+
+    _indices.insert(object, e);
+    _indicesLru << object;
+    _indicesBytes += e.bytes;
+    while (_indicesBytes > _indexCacheLimit && _indicesLru.size() > 1)
+    {
+        _indicesBytes -= _indices.take(_indicesLru.takeFirst()).bytes;
+    }
+
+    _refMatcher = e.matcher;
+    return true;
+}
+
+//******************************************************************************************
+
+void BasicPairsDetector::clearIndexCache()
+{
+    _indices.clear();
+    _indicesLru.clear();
+    _indicesBytes = 0;
+    _refMatcher.release();
+}
+
+//******************************************************************************************
+
+bool BasicPairsDetector::setupRefDescriptors(const cv::Mat &descriptors)
+{
+    _refMatcher.release();
     if (descriptors.empty()) {
         SD_TRACE("BasicPairsDetector::setupRefObject : descriptors matrix is empty");
         return false;
@@ -44,6 +144,7 @@ bool BasicPairsDetector::setupRefObject(const cv::Mat &image, const cv::Mat & ma
     _matcher->clear();
     _matcher->add(descriptors);
     _matcher->train();
+    _refMatcher = _matcher;
 
     return true;
 }
@@ -54,14 +155,39 @@ bool BasicPairsDetector::matchWithRefObject(const cv::Mat &image, const cv::Mat
 {
     std::vector<cv::KeyPoint> keypoints;
     cv::Mat descriptors = computeDescriptors(image, mask, keypoints);
+    return matchDescriptors(descriptors);
+}
+
+//******************************************************************************************
+
+bool BasicPairsDetector::matchWithRefObject(const ObjectView &object)
+{
+    return matchWithRefObject(object.image, object.mask);
+}
+
+//******************************************************************************************
+
+bool BasicPairsDetector::matchWithRefObject(FeatureCache &cache, int object)
+{
+    return matchDescriptors(cache.objectFeatures(object).descriptors);
+}
+
+//******************************************************************************************
+
+bool BasicPairsDetector::matchDescriptors(const cv::Mat &descriptors)
+{
     if (descriptors.empty()) {
         SD_TRACE("BasicPairsDetector::matchWithRefObject : descriptors matrix is empty");
         return false;
     }
 
+    if (_refMatcher.empty()) {
+        SD_TRACE("BasicPairsDetector::matchWithRefObject : reference object is not setup");
+        return false;
+    }
 
     std::vector<cv::DMatch> matchedKeypoints;
-    _matcher->match(descriptors, matchedKeypoints);
+    _refMatcher->match(descriptors, matchedKeypoints);
 
     if (_verbose) SD_TRACE1("Matched keypoints count : %1", matchedKeypoints.size());
     SD_TRACE1("Matched keypoints count : %1", matchedKeypoints.size());
@@ -86,9 +212,8 @@ bool BasicPairsDetector::matchWithRefObject(const cv::Mat &image, const cv::Mat
 
     if (_verbose) {
         // DISPLAY
-        cv::Mat out, refImageCopy, imageCopy;
+        cv::Mat out, refImageCopy;
         _refImage.copyTo(refImageCopy);
-        image.copyTo(imageCopy);
         std::vector<std::vector<cv::DMatch> > vectorOfMatchedKeypoints;
         vectorOfMatchedKeypoints.push_back(goodMatches);
 //        cv::drawMatches(refImageCopy, _refKeyPoints, imageCopy, keypoints, vectorOfMatchedKeypoints, out);
@@ -110,11 +235,13 @@ bool BasicPairsDetector::matchTwoObjects(const cv::Mat &object1, const cv::Mat &
 cv::Mat BasicPairsDetector::computeDescriptors(const cv::Mat &image, const cv::Mat &mask, std::vector<cv::KeyPoint> & keypoints)
 {
     cv::Mat descriptors;
-    _extractor->detectAndCompute(image,
-                                mask,
-                                keypoints,
-                                descriptors);
+    _extractor->detect(image, keypoints, mask);
 
+    // Bounded description and matching work on textured objects : the strongest keypoints are
+    // kept before the description
+    ImageProcessing::capKeypoints(keypoints);
+    if (!keypoints.empty())
+        _extractor->compute(image, keypoints, descriptors);
 
     if (descriptors.empty())
     {
@@ -1,20 +1,27 @@
 #ifndef BASICPAIRSDETECTOR_H
 #define BASICPAIRSDETECTOR_H
 
+// Qt
+#include <QHash>
+#include <QList>
 
 // Opencv
 #include <opencv2/features2d.hpp>
 
 // Project
 #include "PairsDetector.h"
+#include "Core/Global.h"
+#include "AppExport.h"
 
 namespace DGV
 {
 
 //******************************************************************************************
 
-class BasicPairsDetector : public PairsDetector
+class DGV_APP_EXPORT BasicPairsDetector : public PairsDetector
 {
+    //! Memory limit in bytes of the trained reference indices kept between comparisons
+    PROPERTY_ACCESSORS(qint64, indexCacheLimit, getIndexCacheLimit, setIndexCacheLimit)
 public:
     BasicPairsDetector(float goodDistance = 0.29, int goodMatchesMinLimit = 10, bool verbose=false);
     virtual ~BasicPairsDetector() {}
@@ -26,9 +33,34 @@ public:
     // Compare two objects:
     virtual bool matchTwoObjects(const cv::Mat & object1, const cv::Mat & object2, const cv::Mat &mask1 = cv::Mat(), const cv::Mat &mask2 = cv::Mat());
 
+    // Compare object views:
+    virtual bool setupRefObject(const ObjectView & object);
+    virtual bool matchWithRefObject(const ObjectView & object);
+
+    // Compare objects of a feature cache:
+    virtual bool setupRefObject(FeatureCache & cache, int object);
+    virtual bool matchWithRefObject(FeatureCache & cache, int object);
+
+    const cv::Ptr<cv::Feature2D> & getExtractor() const
+    { return _extractor; }
+
+    virtual int supportRadius() const;
+
+    //! Number of reference indices trained since the construction
+    int trainedIndexCount() const
+    { return _trainedIndexCount; }
+    //! Number of reference indices kept and their memory size in bytes
+    int indexCacheCount() const
+    { return _indices.size(); }
+    qint64 indexCacheBytes() const
+    { return _indicesBytes; }
+    void clearIndexCache();
+
 protected:
 
     cv::Mat computeDescriptors(const cv::Mat & image, const cv::Mat &mask, std::vector<cv::KeyPoint> &keypoints);
+    bool setupRefDescriptors(const cv::Mat & descriptors);
+    bool matchDescriptors(const cv::Mat & descriptors);
 
     cv::Ptr<cv::Feature2D> _extractor;
     cv::Ptr<cv::DescriptorMatcher> _matcher;
@@ -38,6 +70,22 @@ protected:
 
     cv::Mat _refImage;
     std::vector<cv::KeyPoint> _refKeyPoints;
+    //! Matcher trained with the reference descriptors
+    cv::Ptr<cv::DescriptorMatcher> _refMatcher;
+
+    //! Trained indices of the feature cache objects
+    struct IndexEntry
+    {
+        cv::Ptr<cv::DescriptorMatcher> matcher;
+        qint64 bytes;
+    };
+    QHash<int, IndexEntry> _indices;
+    //! Objects of the indices, least recently used first
+    QList<int> _indicesLru;
+    qint64 _indicesBytes;
+    //! Feature cache generation of the indices
+    int _indicesGeneration;
+    int _trainedIndexCount;
 
 };
 
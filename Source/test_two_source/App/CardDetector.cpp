@@ -1,4 +1,7 @@
 
+// Std
+#include <algorithm>
+
 // Qt
 #include <qmath.h>
 
@@ -13,6 +16,12 @@
 namespace DGV
 {
 
+//! Canny thresholds of the object extraction
+static const double CANNY_LOW = 20.0;
+static const double CANNY_HIGH = 150.0;
+
+//******************************************************************************************
+
 struct Compare : public std::binary_function<std::vector<cv::Point>, std::vector<cv::Point>, bool>
 {
     enum Type {Less, Greater};
@@ -42,7 +51,10 @@ protected:
 CardDetector::CardDetector(double minSizeRatio, double maxSizeRatio, bool verbose) :
     _minSizeRatio(minSizeRatio),
     _maxSizeRatio(maxSizeRatio),
-    _verbose(verbose)
+    _verbose(verbose),
+    _targetSymbolSize(32),
+    _probeSize(128),
+    _batchObserver(0)
 {
 }
 
@@ -133,13 +145,27 @@ QVector<cv::Mat> CardDetector::detectCards(const cv::Mat &src)
     if (_verbose) SD_TRACE(QString("Selected contours count : %1").arg(out.size()));
     if (_verbose) ImageCommon::displayContours(contours, procImage);
 
+    return extractCards(src, QVector<std::vector<cv::Point> >::fromStdVector(out));
+}
 
-    QVector<cv::Mat> cards(out.size());
+//******************************************************************************************
+/*!
+ * \brief CardDetector::extractCards crops and masks the cards given by their contours
+ * \param src source image
+ * \param cardContours card contours in source image coordinates
+ * \param cardRects (optional) output crop rectangle of each card in source image coordinates
+ * \return card images
+ */
+QVector<cv::Mat> CardDetector::extractCards(const cv::Mat &src, const QVector<std::vector<cv::Point> > &cardContours, QVector<cv::Rect> *cardRects)
+{
+    QVector<cv::Mat> cards(cardContours.size());
+    if (cardRects)
+        cardRects->resize(cardContours.size());
 
     double marginFactor = 0.02;
-    for (size_t i=0; i<out.size(); i++)
+    for (int i=0; i<cardContours.size(); i++)
     {
-        cv::Rect brect = cv::boundingRect(out[i]);
+        cv::Rect brect = cv::boundingRect(cardContours[i]);
 
         brect.x += brect.width * marginFactor;
         brect.y += brect.height * marginFactor;
@@ -159,6 +185,8 @@ QVector<cv::Mat> CardDetector::detectCards(const cv::Mat &src)
         int cut = 1;
         cv::Rect r(cut,cut,brect.width-2*cut, brect.height-2*cut);
         t(r).copyTo(cards[i]);
+        if (cardRects)
+            (*cardRects)[i] = cv::Rect(brect.x + cut, brect.y + cut, r.width, r.height);
         if (_verbose) ImageCommon::displayMat(cards[i], true, QString("Card %1").arg(i));
     }
 
@@ -191,6 +219,314 @@ QVector<cv::Mat> CardDetector::uniformSize(const QVector<cv::Mat> &cards, int si
     return out;
 }
 
+//******************************************************************************************
+/*!
+ * \brief CardDetector::snapWorkingSize rounds up the size to the closest working size.
+ * Working sizes are multiples of 16 (full SIMD registers on rows) and products of 2, 3 and 5
+ * (fast DFT sizes)
+ * \param size wanted card size
+ * \param maxSize (optional) largest size, e.g. the native card size. If the rounded up size is
+ * larger, the size is rounded down instead. 0 : no limit
+ * \return working size, the smallest working size if maxSize is below all the working sizes
+ */
+int CardDetector::snapWorkingSize(int size, int maxSize)
+{
+    static const int sizes[] = {64, 80, 96, 128, 160, 192, 240, 256, 320, 384, 480, 512, 640};
+    static const int count = sizeof(sizes) / sizeof(sizes[0]);
+    int i = 0;
+    while (i < count-1 && size > sizes[i])
+        i++;
+    while (i > 0 && maxSize > 0 && sizes[i] > maxSize)
+        i--;
+    return sizes[i];
+}
+
+//******************************************************************************************
+/*!
+ * \brief CardDetector::estimateWorkingSize computes the card size such that the small symbols
+ * of the card are about targetSymbolSize pixels large.
+ * Symbols are measured on a copy of the card resized to probeSize. The first quartile of the
+ * symbol sizes is used : small symbols limit the resolution, the largest one would not.
+ * \param card card image
+ * \param probeCard (optional) output card resized to probeSize
+ * \param probeContours (optional) output objects found on the probe card
+ * \return working size of the card, snapped with snapWorkingSize
+ */
+int CardDetector::estimateWorkingSize(const cv::Mat &card, cv::Mat * probeCard, QVector<std::vector<cv::Point> > * probeContours)
+{
+    ExtractionBuffers buffers;
+    int size = estimateWorkingSize(card, buffers);
+    if (probeCard)
+        cv::swap(*probeCard, buffers.probe);
+    if (probeContours)
+        probeContours->swap(buffers.probeContours);
+    return size;
+}
+
+//******************************************************************************************
+
+int CardDetector::estimateWorkingSize(const cv::Mat &card, ExtractionBuffers &buffers)
+{
+    // Used when there are not enough symbols to measure (size of the old pipeline)
+    const int defaultSize = 256;
+    const int minSymbolCount = 3;
+
+    cv::resize(card, buffers.probe, cv::Size(_probeSize, _probeSize), 0, 0, cv::INTER_AREA);
+    QVector<std::vector<cv::Point> > & c = buffers.probeContours;
+    extractObjects(buffers.probe, &c, 0, buffers, false);
+
+    int nativeSize = qMax(card.rows, card.cols);
+    if (c.size() < minSymbolCount)
+    {
+        if (_verbose) SD_TRACE1("Not enough symbols to estimate the working size : %1", c.size());
+        return snapWorkingSize(defaultSize, nativeSize);
+    }
+
+    std::vector<int> symbolSizes(c.size());
+    for (int i=0; i<c.size(); i++)
+    {
+        cv::Rect brect = cv::boundingRect(c[i]);
+        symbolSizes[i] = qMax(brect.width, brect.height);
+    }
+    std::vector<int>::iterator q1 = symbolSizes.begin() + symbolSizes.size()/4;
+    std::nth_element(symbolSizes.begin(), q1, symbolSizes.end());
+
+    // Upsampling does not add information
+    int size = qRound(_probeSize * _targetSymbolSize * 1.0 / qMax(*q1, 1));
+    size = snapWorkingSize(size, nativeSize);
+    if (_verbose) SD_TRACE2("Small symbol size on probe : %1, working size : %2", *q1, size);
+    return size;
+}
+
+//******************************************************************************************
+
+void ObjectTable::clear()
+{
+    objects.resize(0);
+    points.clear();
+    cardOffsets.resize(0);
+}
+
+//******************************************************************************************
+
+std::vector<cv::Point> ObjectTable::contour(int object) const
+{
+    const Object & o = objects[object];
+    return std::vector<cv::Point>(points.begin() + o.contourOffset,
+                                  points.begin() + o.contourOffset + o.contourLength);
+}
+
+//******************************************************************************************
+/*!
+ * \brief The CardBatchInvoker class processes the cards of a batch in parallel stripes.
+ * Stripe s handles cards s, s + nstripes, ... with the scratch buffers of index s.
+ * Shared vectors are accessed through their data pointers, taken on the calling thread : a non const
+ * QVector::operator[] from the workers could detach the vector while other workers use it.
+ */
+class CardBatchInvoker : public cv::ParallelLoopBody
+{
+public:
+    CardBatchInvoker(CardDetector * detector, const QVector<cv::Mat> & cards, QVector<cv::Mat> * resizedCards, int nstripes,
+                     const FrameEdges * frameEdges, const QVector<cv::Rect> * cardRects) :
+        _detector(detector), _cards(cards), _resizedCards(resizedCards ? resizedCards->data() : 0), _nstripes(nstripes),
+        _frameEdges(frameEdges), _cardRects(cardRects),
+        _buffers(detector->_buffers.data()), _cardObjects(detector->_cardObjects.data())
+    {}
+
+    void operator()(const cv::Range& range) const
+    {
+        for (int s = range.start; s < range.end; s++)
+        {
+            ExtractionBuffers & buffers = _buffers[s];
+            for (int i = s; i < _cards.size(); i += _nstripes)
+            {
+                processCard(i, buffers);
+                if (_detector->_batchObserver)
+                    _detector->_batchObserver->cardProcessed(i, _cardObjects[i].size());
+            }
+        }
+    }
+
+protected:
+    void processCard(int i, ExtractionBuffers & buffers) const
+    {
+        QVector<std::vector<cv::Point> > & objects = _cardObjects[i];
+        if (!_resizedCards)
+        {
+            _detector->extractObjects(_cards[i], &objects, 0, buffers, false);
+            return;
+        }
+
+        cv::Mat & card = _resizedCards[i];
+        int size = _detector->estimateWorkingSize(_cards[i], buffers);
+        if (size == _detector->_probeSize)
+        {
+            // Probe is already at working size
+            buffers.probe.copyTo(card);
+            objects.swap(buffers.probeContours);
+            return;
+        }
+        int nativeSize = qMax(_cards[i].rows, _cards[i].cols);
+        if (_frameEdges && size >= nativeSize)
+        {
+            // Upsampling does not add information : the card stays at the frame resolution
+            // and its edges are cropped from the frame edges
+            card = _cards[i];
+            _detector->cardEdges(*_frameEdges, (*_cardRects)[i], buffers);
+            _detector->extractObjectsFromEdges(card, &objects, 0, buffers, false);
+            _detector->_frameEdgeCards.ref();
+            return;
+        }
+        cv::resize(_cards[i], card, cv::Size(size, size), 0, 0, size < nativeSize ? cv::INTER_AREA : cv::INTER_LINEAR);
+        _detector->extractObjects(card, &objects, 0, buffers, false);
+    }
+
+private:
+    CardDetector * _detector;
+    const QVector<cv::Mat> & _cards;
+    cv::Mat * _resizedCards;
+    int _nstripes;
+    const FrameEdges * _frameEdges;
+    const QVector<cv::Rect> * _cardRects;
+    ExtractionBuffers * _buffers;
+    QVector<std::vector<cv::Point> > * _cardObjects;
+};
+
+//******************************************************************************************
+/*!
+ * \brief CardDetector::runBatch processes all cards in parallel and gathers the objects in the table
+ * \param cards card images
+ * \param resizedCards if not null, cards are resized to their working size first (see adaptiveSize)
+ * \param objects (optional) output objects in coordinates of the processed cards
+ * \param frameEdges (optional) edges of the frame of the cards, used with resizedCards (see adaptiveSize)
+ * \param cardRects card crops in frame coordinates, required with frameEdges
+ */
+void CardDetector::runBatch(const QVector<cv::Mat> &cards, QVector<cv::Mat> *resizedCards, ObjectTable *objects,
+                            const FrameEdges *frameEdges, const QVector<cv::Rect> *cardRects)
+{
+    if (frameEdges && (frameEdges->empty() || !cardRects || cardRects->size() != cards.size()))
+    {
+        SD_TRACE("CardDetector::runBatch : frame edges need the card rects, they are not used");
+        frameEdges = 0;
+    }
+    _frameEdgeCards.store(0);
+
+    // Intermediate images are displayed in verbose mode : stay on the calling thread
+    int nstripes = _verbose ? 1 : qMax(1, qMin(cards.size(), cv::getNumThreads()));
+    if (_buffers.size() < nstripes)
+        _buffers.resize(nstripes);
+    _cardObjects.resize(cards.size());
+    if (resizedCards)
+        resizedCards->resize(cards.size());
+
+    cv::parallel_for_(cv::Range(0, nstripes), CardBatchInvoker(this, cards, resizedCards, nstripes, frameEdges, cardRects), nstripes);
+
+    if (!objects)
+        return;
+
+    // Gather objects in the table
+    objects->clear();
+    objects->cardOffsets.resize(cards.size() + 1);
+    for (int i=0; i<cards.size(); i++)
+    {
+        objects->cardOffsets[i] = objects->objects.size();
+        const QVector<std::vector<cv::Point> > & cardObjects = _cardObjects[i];
+        for (int j=0; j<cardObjects.size(); j++)
+        {
+            const std::vector<cv::Point> & contour = cardObjects[j];
+            ObjectTable::Object o;
+            o.cardId = i;
+            o.contourOffset = (int) objects->points.size();
+            o.contourLength = (int) contour.size();
+            o.bbox = cv::boundingRect(contour);
+            o.label = -1;
+            objects->points.insert(objects->points.end(), contour.begin(), contour.end());
+            objects->objects << o;
+        }
+        if (_verbose) ImageCommon::displayContours(cardObjects.toStdVector(), resizedCards ? (*resizedCards)[i] : cards[i], false, true);
+    }
+    objects->cardOffsets[cards.size()] = objects->objects.size();
+}
+
+//******************************************************************************************
+/*!
+ * \brief CardDetector::adaptiveSize resizes each card to its own working size (see estimateWorkingSize),
+ * such that the following processing scales with the symbol sizes and not with the camera resolution.
+ * Cards are processed in parallel.
+ * \param cards card images
+ * \param objects (optional) output objects of all cards in working size coordinates
+ * \param frameEdges (optional) edges of the frame the cards are cropped from, see computeFrameEdges.
+ * Cards whose working size is not smaller than their size are kept at the frame resolution and
+ * their objects are extracted on the cropped frame edges. Other cards are resized and their edges
+ * are detected again
+ * \param cardRects card crops in frame coordinates (see extractCards), required with frameEdges
+ * \return resized cards
+ */
+QVector<cv::Mat> CardDetector::adaptiveSize(const QVector<cv::Mat> &cards, ObjectTable * objects,
+                                            const FrameEdges * frameEdges, const QVector<cv::Rect> * cardRects)
+{
+    QVector<cv::Mat> out;
+    runBatch(cards, &out, objects, frameEdges, cardRects);
+    return out;
+}
+
+//******************************************************************************************
+/*!
+ * \brief CardDetector::computeFrameEdges computes the edge representation of a frame once for all
+ * its cards : median filter and Sobel derivatives as in the Canny detector
+ * \param gray 8 bits single channel frame, the one the cards are cropped from
+ * \param edges output, buffers are reused
+ */
+void CardDetector::computeFrameEdges(const cv::Mat &gray, FrameEdges *edges)
+{
+    if (!edges)
+    {
+        SD_TRACE("CardDetector::computeFrameEdges : edges is null");
+        return;
+    }
+    cv::medianBlur(gray, edges->median, 5);
+    cv::Sobel(edges->median, edges->dx, CV_16S, 1, 0, 3, 1, 0, cv::BORDER_REPLICATE);
+    cv::Sobel(edges->median, edges->dy, CV_16S, 0, 1, 3, 1, 0, cv::BORDER_REPLICATE);
+}
+
+//******************************************************************************************
+/*!
+ * \brief CardDetector::cardEdges computes the edges of a card on the frame edges. Edges outside
+ * the card circle are removed, as the card image is masked by extractCards
+ * \param frameEdges edges of the frame
+ * \param cardRect card crop in frame coordinates
+ * \param buffers output edges in buffers.edges
+ */
+void CardDetector::cardEdges(const FrameEdges &frameEdges, const cv::Rect &cardRect, ExtractionBuffers &buffers)
+{
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 2)
+    cv::Canny(frameEdges.dx(cardRect), frameEdges.dy(cardRect), buffers.edges, CANNY_LOW, CANNY_HIGH);
+#else
+    // No Canny on derivatives : only the median filter is shared
+    cv::Canny(frameEdges.median(cardRect), buffers.edges, CANNY_LOW, CANNY_HIGH);
+#endif
+    cv::Mat mask = ImageProcessing::getCircleKernel2D(cardRect.size(), 255, CV_8U);
+    cv::bitwise_and(buffers.edges, mask, buffers.edges);
+}
+
+//******************************************************************************************
+/*!
+ * \brief CardDetector::extractObjects extracts the objects of all cards of a frame in parallel.
+ * Scratch buffers are kept by the detector and reused between calls : a detector should not be
+ * used by several threads at the same time.
+ * \param cards card images
+ * \param objects output table of objects
+ */
+void CardDetector::extractObjects(const QVector<cv::Mat> &cards, ObjectTable *objects)
+{
+    if (!objects)
+    {
+        SD_TRACE("CardDetector::extractObjects : objects is null");
+        return;
+    }
+    runBatch(cards, 0, objects);
+}
+
 //******************************************************************************************
 /*!
  * \brief CardDetector::extractObjects Extracts objects from the card
@@ -204,36 +540,68 @@ void CardDetector::extractObjects(const cv::Mat &card, QVector<std::vector<cv::P
         SD_TRACE("CardDetector::extractObjects : ObjectContours is null");
         return;
     }
+    ExtractionBuffers buffers;
+    extractObjects(card, objectContours, objectMasks, buffers, _verbose);
+}
 
-    cv::Size uniSize = card.size();
-    cv::Mat procImage;
-    card.copyTo(procImage);
-    if (procImage.channels() > 1)
+//******************************************************************************************
+
+void CardDetector::extractObjects(const cv::Mat &card, QVector<std::vector<cv::Point> > * objectContours, QVector<cv::Mat> * objectMasks, ExtractionBuffers & buffers, bool verbose)
+{
+    cv::Mat gray = card;
+    if (card.channels() > 1)
     {
-        cv::cvtColor(procImage, procImage, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(card, buffers.gray, cv::COLOR_BGR2GRAY);
+        gray = buffers.gray;
     }
 
     // Median filter
-    cv::medianBlur(procImage, procImage, 5);
-    if (_verbose) ImageCommon::displayMat(procImage, true, "Median");
+    cv::medianBlur(gray, buffers.median, 5);
+    if (verbose) ImageCommon::displayMat(buffers.median, true, "Median");
 
 //    // Enhance contours :
 //    ImageProcessing::enhance(procImage, procImage);
 //    if (_verbose) ImageCommon::displayMat(procImage, true, "Enhance");
 
     // Canny
-    cv::Canny(procImage, procImage, 20, 150);
-    if (_verbose) ImageCommon::displayMat(procImage, true, "Canny");
+    cv::Canny(buffers.median, buffers.edges, CANNY_LOW, CANNY_HIGH);
+    if (verbose) ImageCommon::displayMat(buffers.edges, true, "Canny");
+
+    extractObjectsFromEdges(card, objectContours, objectMasks, buffers, verbose);
+}
+
+//******************************************************************************************
+/*!
+ * \brief CardDetector::extractObjectsFromEdges selects the objects of the card on its edges
+ * \param card card image
+ * \param buffers edges of the card in buffers.edges
+ */
+void CardDetector::extractObjectsFromEdges(const cv::Mat &card, QVector<std::vector<cv::Point> > * objectContours, QVector<cv::Mat> * objectMasks, ExtractionBuffers & buffers, bool verbose)
+{
+    cv::Size uniSize = card.size();
+
+    // Noisy or textured card : no objects rather than an unbounded contour search
+    objectContours->clear();
+    if (objectMasks) objectMasks->clear();
+    if (!ImageProcessing::checkEdgeDensity(buffers.edges))
+    {
+        if (verbose) SD_TRACE("CardDetector::extractObjects : edge density is above the limit");
+        return;
+    }
 
     // Morpho
-    cv::Mat k1 = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3,3));
-    cv::morphologyEx(procImage, procImage, cv::MORPH_CLOSE, k1, cv::Point(1, 1), 2);
-    if (_verbose) ImageCommon::displayMat(procImage, true, "Morpho");
+    static const cv::Mat k1 = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3,3));
+    cv::morphologyEx(buffers.edges, buffers.closed, cv::MORPH_CLOSE, k1, cv::Point(1, 1), 2);
+    if (verbose) ImageCommon::displayMat(buffers.closed, true, "Morpho");
 
     // Find contours
-    std::vector< std::vector<cv::Point> > contours;
-    cv::findContours(procImage, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
-    objectContours->clear();
+    std::vector< std::vector<cv::Point> > & contours = buffers.contours;
+    cv::findContours(buffers.closed, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+    if (!ImageProcessing::checkContours(contours))
+    {
+        if (verbose) SD_TRACE1("CardDetector::extractObjects : %1 contours are above the limits", contours.size());
+        return;
+    }
     objectContours->resize(contours.size());
 
 
@@ -241,14 +609,14 @@ void CardDetector::extractObjects(const cv::Mat &card, QVector<std::vector<cv::P
     int minArea = 16;
     //    int minArea = 0.25 * M_PI * objMinSize*objMinSize;
     int roiRadius = 0.45 * uniSize.width;
-    if (_verbose) SD_TRACE(QString("Roi radius : %1").arg(roiRadius));
+    if (verbose) SD_TRACE(QString("Roi radius : %1").arg(roiRadius));
     //    int maxLength = 0.95*uniSize.width * M_PI;
-    if (_verbose) SD_TRACE(QString("Contours count : %1").arg(contours.size()));
+    if (verbose) SD_TRACE(QString("Contours count : %1").arg(contours.size()));
 
     int count=0;
     for (size_t i=0;i<contours.size();i++)
     {
-        std::vector<cv::Point> contour = contours[i];
+        std::vector<cv::Point> & contour = contours[i];
         //        double p = cv::arcLength(contour, true);
         //        if (p < maxLength)
         //        {
@@ -280,8 +648,8 @@ void CardDetector::extractObjects(const cv::Mat &card, QVector<std::vector<cv::P
     // order by size (descending)
     std::sort(objectContours->begin(), objectContours->end(), Compare(Compare::Greater));
 
-    if (_verbose) SD_TRACE(QString("Selected contours count : %1").arg(count));
-    if (_verbose) ImageCommon::displayContours(objectContours->toStdVector(), card, false, true);
+    if (verbose) SD_TRACE(QString("Selected contours count : %1").arg(count));
+    if (verbose) ImageCommon::displayContours(objectContours->toStdVector(), card, false, true);
 
     // Draw filled contours as segmented image:
     if (objectMasks) {
@@ -290,7 +658,7 @@ void CardDetector::extractObjects(const cv::Mat &card, QVector<std::vector<cv::P
         std::vector<std::vector<cv::Point> > out = objectContours->toStdVector();
         for(int idx=0; idx < count; idx++)
         {
-            (*objectMasks)[idx] = cv::Mat(procImage.rows, procImage.cols, CV_8U, cv::Scalar::all(0));
+            (*objectMasks)[idx] = cv::Mat(uniSize.height, uniSize.width, CV_8U, cv::Scalar::all(0));
             cv::Scalar color( 255 );
             cv::drawContours( (*objectMasks)[idx], out, idx, color, CV_FILLED);
         }
@@ -6,34 +6,144 @@
 
 // Qt
 #include <QVector>
+#include <QAtomicInt>
 
 // Opencv
 #include <opencv2/core.hpp>
 
 // Project
 #include "Core/Global.h"
+#include "AppExport.h"
 
 namespace DGV
 {
 
 //******************************************************************************************
+/*!
+ * \brief The ObjectTable struct holds the objects of all cards of a frame in flat arrays.
+ * Objects are grouped by card, in card order. Containers keep their capacity between frames.
+ */
+struct DGV_APP_EXPORT ObjectTable
+{
+    struct Object
+    {
+        int cardId;
+        //! First point of the contour in points
+        int contourOffset;
+        int contourLength;
+        //! Bounding rect in card coordinates
+        cv::Rect bbox;
+        //! Symbol label, -1 if unknown
+        int label;
+    };
+
+    QVector<Object> objects;
+    std::vector<cv::Point> points;
+    //! First object of each card. Size is card count + 1, last value is the object count
+    QVector<int> cardOffsets;
+
+    void clear();
+    int cardCount() const
+    { return qMax(cardOffsets.size() - 1, 0); }
+    int objectCount(int card) const
+    { return cardOffsets[card+1] - cardOffsets[card]; }
+    std::vector<cv::Point> contour(int object) const;
+};
+
+//******************************************************************************************
+/*!
+ * \brief The ExtractionBuffers struct holds the scratch images of the object extraction.
+ * One instance is used by one thread at a time.
+ */
+struct ExtractionBuffers
+{
+    cv::Mat gray;
+    cv::Mat median;
+    cv::Mat edges;
+    cv::Mat closed;
+    cv::Mat probe;
+    std::vector< std::vector<cv::Point> > contours;
+    QVector<std::vector<cv::Point> > probeContours;
+};
+
+//******************************************************************************************
+/*!
+ * \brief The FrameEdges struct holds the edge representation of a frame, shared by its cards.
+ * Gradients are kept rather than an edge map : symbol edges of a card are computed on its crop
+ * with the thresholds of the object extraction, without filtering and derivating the card again.
+ */
+struct FrameEdges
+{
+    //! Median filtered frame
+    cv::Mat median;
+    //! Sobel derivatives of the median frame, CV_16S
+    cv::Mat dx;
+    cv::Mat dy;
 
-class CardDetector
+    bool empty() const
+    { return median.empty(); }
+};
+
+//******************************************************************************************
+/*!
+ * \brief The CardBatchObserver class is notified when a card of a batch is processed.
+ * Notifications come from the worker threads.
+ */
+class CardBatchObserver
+{
+public:
+    virtual ~CardBatchObserver() {}
+    virtual void cardProcessed(int card, int objectCount) = 0;
+};
+
+//******************************************************************************************
+
+class DGV_APP_EXPORT CardDetector
 {
     PROPERTY_ACCESSORS(double, minSizeRatio, getMinSizeRatio, setMinSizeRatio)
     PROPERTY_ACCESSORS(double, maxSizeRatio, getMaxSizeRatio, setMaxSizeRatio)
     PROPERTY_ACCESSORS(bool, verbose, isVerbose, setVerbose)
+    //! Number of pixels wanted along the small symbols of a card, see adaptiveSize
+    PROPERTY_ACCESSORS(int, targetSymbolSize, getTargetSymbolSize, setTargetSymbolSize)
+    //! Size of the card used to measure its symbols, see adaptiveSize
+    PROPERTY_ACCESSORS(int, probeSize, getProbeSize, setProbeSize)
+    //! Optional observer of the batch processing, not owned
+    PTR_PROPERTY_ACCESSORS(CardBatchObserver, batchObserver, getBatchObserver, setBatchObserver)
 public:
     CardDetector(double minSizeRatio, double maxSizeRatio, bool verbose=false);
 
     QVector<cv::Mat> detectCards(const cv::Mat & src);
+    QVector<cv::Mat> extractCards(const cv::Mat & src, const QVector<std::vector<cv::Point> > & cardContours, QVector<cv::Rect> * cardRects=0);
     cv::Mat uniformSize(const cv::Mat & card, int sizeX, int sizeY=0);
     QVector<cv::Mat> uniformSize(const QVector<cv::Mat> & cards, int sizeX, int sizeY=0);
+    int estimateWorkingSize(const cv::Mat & card, cv::Mat * probeCard=0, QVector<std::vector<cv::Point> > * probeContours=0);
+    QVector<cv::Mat> adaptiveSize(const QVector<cv::Mat> & cards, ObjectTable * objects=0,
+                                  const FrameEdges * frameEdges=0, const QVector<cv::Rect> * cardRects=0);
+    void computeFrameEdges(const cv::Mat & gray, FrameEdges * edges);
+    static int snapWorkingSize(int size, int maxSize=0);
+    int frameEdgeCardCount() const
+    { return _frameEdgeCards.load(); }
     void extractObjects(const cv::Mat & card, QVector<std::vector<cv::Point> > * objectContours, QVector<cv::Mat> *objectMasks=0);
+    void extractObjects(const QVector<cv::Mat> & cards, ObjectTable * objects);
     cv::Mat getObject(const cv::Mat & card, const std::vector<cv::Point> & contour);
     cv::Mat getObjectMask(const cv::Mat & card, const std::vector<cv::Point> & contour);
 
 protected:
+    friend class CardBatchInvoker;
+
+    int estimateWorkingSize(const cv::Mat & card, ExtractionBuffers & buffers);
+    void extractObjects(const cv::Mat & card, QVector<std::vector<cv::Point> > * objectContours, QVector<cv::Mat> *objectMasks, ExtractionBuffers & buffers, bool verbose);
+    void extractObjectsFromEdges(const cv::Mat & card, QVector<std::vector<cv::Point> > * objectContours, QVector<cv::Mat> *objectMasks, ExtractionBuffers & buffers, bool verbose);
+    void cardEdges(const FrameEdges & frameEdges, const cv::Rect & cardRect, ExtractionBuffers & buffers);
+    void runBatch(const QVector<cv::Mat> & cards, QVector<cv::Mat> * resizedCards, ObjectTable * objects,
+                  const FrameEdges * frameEdges=0, const QVector<cv::Rect> * cardRects=0);
+
+    //! Scratch buffers of each parallel stripe, reused between cards and frames
+    QVector<ExtractionBuffers> _buffers;
+    //! Objects of each card before they are gathered in the object table
+    QVector<QVector<std::vector<cv::Point> > > _cardObjects;
+    //! Number of cards of the last batch whose edges were taken from the frame edges
+    QAtomicInt _frameEdgeCards;
 
 };
 
@@ -0,0 +1,349 @@
+
+// Std
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+// Qt
+#include <QFile>
+#include <QTextStream>
+#include <QRegExp>
+#include <QStringList>
+
+// Project
+#include "DeckModel.h"
+#include "CardDetector.h"
+
+namespace DGV
+{
+
+//******************************************************************************************
+
+static bool isPrime(int n)
+{
+    if (n < 2)
+        return false;
+    for (int d=2; d*d<=n; d++)
+    {
+        if (n % d == 0)
+            return false;
+    }
+    return true;
+}
+
+//******************************************************************************************
+
+DeckModel::DeckModel() :
+    _symbolCount(0)
+{
+}
+
+//******************************************************************************************
+/*!
+ * \brief DeckModel::DeckModel builds the model of a deck
+ * \param cardSymbols symbols of each card. The model is not valid if two cards do not share
+ * exactly one symbol
+ */
+DeckModel::DeckModel(const QVector<QVector<int> > &cardSymbols) :
+    _symbolCount(0)
+{
+    build(cardSymbols);
+}
+
+//******************************************************************************************
+/*!
+ * \brief DeckModel::load loads the card -> symbols table of a deck catalog : one card per line,
+ * symbol labels separated by spaces or commas. Empty lines and lines starting with '#' are skipped
+ * \return false if the file can not be read or if the table is not a valid deck
+ */
+bool DeckModel::load(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        SD_TRACE1("DeckModel::load : failed to open '%1'", path);
+        return false;
+    }
+
+    QVector<QVector<int> > cardSymbols;
+    QTextStream stream(&file);
+    while (!stream.atEnd())
+    {
+        QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        QVector<int> symbols;
+        foreach (QString field, line.split(QRegExp("[\\s,]+"), QString::SkipEmptyParts))
+        {
+            bool ok = false;
+            int symbol = field.toInt(&ok);
+            if (!ok || symbol < 0)
+            {
+                SD_TRACE2("DeckModel::load : bad symbol '%1' in '%2'", field, path);
+                return false;
+            }
+            symbols << symbol;
+        }
+        cardSymbols << symbols;
+    }
+    build(cardSymbols);
+    return isValid();
+}
+
+//******************************************************************************************
+/*!
+ * \brief DeckModel::projectivePlane returns the cards of the projective plane of the given prime order.
+ * Symbols : affine points (x, y) -> x*n + y, points at infinity of slope m -> n*n + m,
+ * vertical point at infinity -> n*n + n.
+ * Cards : lines y = m*x + b, vertical lines x = c, line at infinity.
+ * \param order prime order of the plane
+ * \return symbols of each card, empty if the order is not prime
+ */
+QVector<QVector<int> > DeckModel::projectivePlane(int order)
+{
+    QVector<QVector<int> > cardSymbols;
+    if (!isPrime(order))
+    {
+        SD_TRACE1("DeckModel::projectivePlane : order should be a prime number, got %1", order);
+        return cardSymbols;
+    }
+
+    int n = order;
+    cardSymbols.reserve(n * n + n + 1);
+
+    // Lines y = m*x + b
+    for (int m=0; m<n; m++)
+    {
+        for (int b=0; b<n; b++)
+        {
+            QVector<int> card;
+            for (int x=0; x<n; x++)
+                card << x*n + (m*x + b) % n;
+            card << n*n + m;
+            cardSymbols << card;
+        }
+    }
+    // Vertical lines x = c
+    for (int c=0; c<n; c++)
+    {
+        QVector<int> card;
+        for (int y=0; y<n; y++)
+            card << c*n + y;
+        card << n*n + n;
+        cardSymbols << card;
+    }
+    // Line at infinity
+    QVector<int> card;
+    for (int m=0; m<=n; m++)
+        card << n*n + m;
+    cardSymbols << card;
+    return cardSymbols;
+}
+
+//******************************************************************************************
+/*!
+ * \brief DeckModel::build checks the deck and computes the lookup tables
+ */
+void DeckModel::build(const QVector<QVector<int> > &cardSymbols)
+{
+    _symbolCount = 0;
+    _cardSymbols.clear();
+    _cardOfSymbols.clear();
+    _commonSymbol.clear();
+    if (cardSymbols.size() < 2)
+    {
+        SD_TRACE1("DeckModel : a deck should have at least two cards, got %1", cardSymbols.size());
+        return;
+    }
+
+    QVector<QVector<int> > cards = cardSymbols;
+    int symbolCount = 0;
+    for (int c=0; c<cards.size(); c++)
+    {
+        std::sort(cards[c].begin(), cards[c].end());
+        if (cards[c].isEmpty() || cards[c].first() < 0 ||
+                std::adjacent_find(cards[c].begin(), cards[c].end()) != cards[c].end())
+        {
+            SD_TRACE1("DeckModel : card %1 should have distinct non negative symbols", c);
+            return;
+        }
+        symbolCount = qMax(symbolCount, cards[c].last() + 1);
+    }
+
+    // Any two cards share exactly one symbol
+    int cardCount = cards.size();
+    QVector<int> commonSymbol(cardCount * cardCount, -1);
+    for (int i=0; i<cardCount; i++)
+    {
+        for (int j=i+1; j<cardCount; j++)
+        {
+            std::vector<int> common;
+            std::set_intersection(cards[i].begin(), cards[i].end(), cards[j].begin(), cards[j].end(),
+                                  std::back_inserter(common));
+            if (common.size() != 1)
+            {
+                SD_TRACE3("DeckModel : cards %1 and %2 share %3 symbols instead of one", i, j, (int) common.size());
+                return;
+            }
+            commonSymbol[i * cardCount + j] = commonSymbol[j * cardCount + i] = common[0];
+        }
+    }
+
+    // Any two symbols are on at most one card : follows from the above for cards of 2 symbols or more
+    QVector<int> cardOfSymbols(symbolCount * symbolCount, -1);
+    for (int c=0; c<cardCount; c++)
+    {
+        const QVector<int> & symbols = cards[c];
+        for (int i=0; i<symbols.size(); i++)
+        {
+            for (int j=0; j<symbols.size(); j++)
+            {
+                if (i != j)
+                    cardOfSymbols[symbols[i] * symbolCount + symbols[j]] = c;
+            }
+        }
+    }
+
+    _symbolCount = symbolCount;
+    _cardSymbols = cards;
+    _cardOfSymbols = cardOfSymbols;
+    _commonSymbol = commonSymbol;
+}
+
+//******************************************************************************************
+
+bool DeckModel::hasSymbol(int card, int symbol) const
+{
+    const QVector<int> & symbols = _cardSymbols[card];
+    return std::binary_search(symbols.begin(), symbols.end(), symbol);
+}
+
+//******************************************************************************************
+/*!
+ * \brief DeckModel::cardFromSymbols returns the unique card with both symbols
+ * \return card index or -1 if the symbols are equal or out of range
+ */
+int DeckModel::cardFromSymbols(int symbol1, int symbol2) const
+{
+    int count = _symbolCount;
+    if (!isValid() || symbol1 < 0 || symbol2 < 0 || symbol1 >= count || symbol2 >= count)
+        return -1;
+    return _cardOfSymbols[symbol1 * count + symbol2];
+}
+
+//******************************************************************************************
+/*!
+ * \brief DeckModel::commonSymbol returns the symbol shared by two cards
+ * \return symbol or -1 if the cards are equal or out of range
+ */
+int DeckModel::commonSymbol(int card1, int card2) const
+{
+    int count = cardCount();
+    if (!isValid() || card1 < 0 || card2 < 0 || card1 >= count || card2 >= count)
+        return -1;
+    return _commonSymbol[card1 * count + card2];
+}
+
+//******************************************************************************************
+/*!
+ * \brief DeckModel::resolveCard identifies a card from the labels of its objects.
+ * The two first distinct known labels define the card, other known labels should agree.
+ * \param labels symbol label of each object of the card, -1 for unknown objects
+ * \return card index, or -1 if less than two symbols are known or if the labels are inconsistent
+ */
+int DeckModel::resolveCard(const QVector<int> &labels) const
+{
+    int first = -1;
+    int card = -1;
+    foreach (int label, labels)
+    {
+        if (label < 0)
+            continue;
+        if (first < 0)
+        {
+            first = label;
+            continue;
+        }
+        if (card < 0)
+        {
+            if (label == first)
+                continue;
+            card = cardFromSymbols(first, label);
+            if (card < 0)
+                return -1;
+            continue;
+        }
+        if (!hasSymbol(card, label))
+            return -1;
+    }
+    return card;
+}
+
+//******************************************************************************************
+/*!
+ * \brief DeckModel::resolveCards identifies each card of the table from the labels of its objects
+ * \param objects object table with labels, -1 for unknown objects
+ * \param cards output card index of each card of the table, -1 if not resolved
+ */
+void DeckModel::resolveCards(const ObjectTable &objects, QVector<int> *cards) const
+{
+    if (!cards)
+    {
+        SD_TRACE("DeckModel::resolveCards : cards is null");
+        return;
+    }
+
+    cards->resize(objects.cardCount());
+    QVector<int> labels;
+    for (int i=0; i<objects.cardCount(); i++)
+    {
+        labels.resize(0);
+        for (int j=objects.cardOffsets[i]; j<objects.cardOffsets[i+1]; j++)
+            labels << objects.objects[j].label;
+        (*cards)[i] = resolveCard(labels);
+    }
+}
+
+//******************************************************************************************
+/*!
+ * \brief DeckModel::commonObjects gives the common objects of two identified cards without
+ * matching : the objects labelled with the symbol the deck gives for the two cards
+ * \param objects object table with labels
+ * \param cards card index of each card of the table, see resolveCards
+ * \param card1 first card of the table
+ * \param card2 second card of the table
+ * \param object1 output object of the first card, index in the object table
+ * \param object2 output object of the second card, index in the object table
+ * \return false if a card is not identified or if the common symbol is not labelled on both
+ * cards : the objects should be compared
+ */
+bool DeckModel::commonObjects(const ObjectTable &objects, const QVector<int> &cards, int card1, int card2,
+                              int *object1, int *object2) const
+{
+    if (card1 < 0 || card2 < 0 || card1 >= cards.size() || card2 >= cards.size() ||
+            card1 >= objects.cardCount() || card2 >= objects.cardCount())
+        return false;
+    int symbol = commonSymbol(cards[card1], cards[card2]);
+    if (symbol < 0)
+        return false;
+
+    int found[2] = {-1, -1};
+    int tableCards[2] = {card1, card2};
+    for (int k=0; k<2; k++)
+    {
+        for (int i=objects.cardOffsets[tableCards[k]]; found[k] < 0 && i<objects.cardOffsets[tableCards[k]+1]; i++)
+        {
+            if (objects.objects[i].label == symbol)
+                found[k] = i;
+        }
+    }
+    if (found[0] < 0 || found[1] < 0)
+        return false;
+    if (object1) *object1 = found[0];
+    if (object2) *object2 = found[1];
+    return true;
+}
+
+//******************************************************************************************
+
+}
@@ -0,0 +1,76 @@
+#ifndef DECKMODEL_H
+#define DECKMODEL_H
+
+// Qt
+#include <QVector>
+#include <QString>
+
+// Project
+#include "Core/Global.h"
+#include "AppExport.h"
+
+namespace DGV
+{
+
+struct ObjectTable;
+
+//******************************************************************************************
+/*!
+ * \brief The DeckModel class describes a deck by its card -> symbols table : any two cards share
+ * exactly one symbol. The standard deck is a finite projective plane of order 7 (57 symbols,
+ * 8 symbols per card) of which the commercial deck prints 55 cards : the table of the printed
+ * deck is loaded from its catalog (see load), so that the symbols are those of the catalog.
+ *
+ * Symbols are labels from 0 to symbolCount()-1, as in ObjectTable::Object::label (see
+ * SymbolCatalog::labelObjects). A card is identified by any two of its symbols, then its other
+ * symbols and the symbol shared with any other identified card are read from the model without
+ * matching.
+ */
+class DGV_APP_EXPORT DeckModel
+{
+public:
+    DeckModel();
+    DeckModel(const QVector<QVector<int> > & cardSymbols);
+
+    bool load(const QString & path);
+
+    static QVector<QVector<int> > projectivePlane(int order);
+
+    bool isValid() const
+    { return !_cardSymbols.isEmpty(); }
+    int symbolCount() const
+    { return _symbolCount; }
+    int cardCount() const
+    { return _cardSymbols.size(); }
+
+    const QVector<int> & cardSymbols(int card) const
+    { return _cardSymbols[card]; }
+    bool hasSymbol(int card, int symbol) const;
+
+    int cardFromSymbols(int symbol1, int symbol2) const;
+    int commonSymbol(int card1, int card2) const;
+
+    int resolveCard(const QVector<int> & labels) const;
+    void resolveCards(const ObjectTable & objects, QVector<int> * cards) const;
+    bool commonObjects(const ObjectTable & objects, const QVector<int> & cards, int card1, int card2,
+                       int * object1, int * object2) const;
+
+protected:
+
+    void build(const QVector<QVector<int> > & cardSymbols);
+
+    int _symbolCount;
+    //! Symbols of each card, sorted
+    QVector<QVector<int> > _cardSymbols;
+    //! Card of each pair of symbols, symbolCount() x symbolCount(), -1 on the diagonal
+    QVector<int> _cardOfSymbols;
+    //! Common symbol of each pair of cards, cardCount() x cardCount(), -1 on the diagonal
+    QVector<int> _commonSymbol;
+
+};
+
+//******************************************************************************************
+
+}
+
+#endif // DECKMODEL_H
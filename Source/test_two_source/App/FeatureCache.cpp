@@ -0,0 +1,198 @@
+
+// Opencv
+#include <opencv2/imgproc.hpp>
+
+// Project
+#include "FeatureCache.h"
+#include "BasicPairsDetector.h"
+#include "Core/Global.h"
+#include "Core/ImageProcessing.h"
+
+namespace DGV
+{
+
+//******************************************************************************************
+
+static QAtomicInt GENERATIONS(0);
+
+//******************************************************************************************
+
+FeatureCache::FeatureCache(const cv::Ptr<cv::Feature2D> &extractor, bool huMoments) :
+    _extractor(extractor),
+    _huMoments(huMoments),
+    _objects(0),
+    _generation(GENERATIONS.fetchAndAddOrdered(1) + 1)
+{
+}
+
+//******************************************************************************************
+
+FeatureCache::~FeatureCache()
+{
+    qDeleteAll(_cardEntries);
+    qDeleteAll(_objectEntries);
+}
+
+//******************************************************************************************
+/*!
+ * \brief FeatureCache::setCards resets the cache for new cards. Should not be called while
+ * features are requested from other threads.
+ * \param cards card images
+ * \param objects objects of the cards. The table is not copied and should outlive the cache use
+ */
+void FeatureCache::setCards(const QVector<cv::Mat> &cards, const ObjectTable *objects)
+{
+    _cards = cards;
+    _objects = objects;
+    _generation = GENERATIONS.fetchAndAddOrdered(1) + 1;
+    _computedCards.store(0);
+    _computedObjects.store(0);
+
+    // Entries are reused, computed data is released
+    int objectCount = objects ? objects->objects.size() : 0;
+    while (_cardEntries.size() < cards.size())
+        _cardEntries << new CardEntry();
+    while (_objectEntries.size() < objectCount)
+        _objectEntries << new ObjectEntry();
+    for (int i=0; i<cards.size(); i++)
+    {
+        CardEntry * e = _cardEntries[i];
+        e->ready.store(0);
+        e->keypoints.clear();
+        e->descriptors.release();
+        e->objectOffsets.clear();
+    }
+    for (int i=0; i<objectCount; i++)
+    {
+        ObjectEntry * e = _objectEntries[i];
+        e->ready.store(0);
+        e->features.keypoints.clear();
+        e->features.descriptors.release();
+    }
+}
+
+//******************************************************************************************
+
+const cv::Mat & FeatureCache::card(int object) const
+{
+    return _cards[_objects->objects[object].cardId];
+}
+
+//******************************************************************************************
+/*!
+ * \brief FeatureCache::objectMask computes the object mask (values 0 and 1) in card coordinates
+ */
+cv::Mat FeatureCache::objectMask(int object) const
+{
+    const cv::Mat & c = card(object);
+    cv::Mat mask(c.rows, c.cols, CV_8U, cv::Scalar::all(0));
+    std::vector<std::vector<cv::Point> > contours(1, _objects->contour(object));
+    cv::drawContours(mask, contours, 0, cv::Scalar(1), CV_FILLED);
+    return mask;
+}
+
+//******************************************************************************************
+/*!
+ * \brief FeatureCache::objectView returns the object region of the card and the object mask in
+ * this region, see makeObjectView
+ */
+ObjectView FeatureCache::objectView(int object, int margin) const
+{
+    return makeObjectView(card(object), _objects->contour(object), margin);
+}
+
+//******************************************************************************************
+
+const FeatureCache::CardEntry & FeatureCache::cardFeatures(int card)
+{
+    CardEntry * e = _cardEntries[card];
+    if (e->ready.loadAcquire())
+        return *e;
+
+    QMutexLocker locker(&e->mutex);
+    if (!e->ready.load())
+    {
+        std::vector<cv::KeyPoint> cardKeypoints;
+        _extractor->detect(_cards[card], cardKeypoints);
+
+        // Keypoints of each object, capped before the description : the description work is
+        // bounded on textured objects
+        int first = _objects->cardOffsets[card];
+        int last = _objects->cardOffsets[card+1];
+        e->objectOffsets.assign(1, 0);
+        for (int i=first; i<last; i++)
+        {
+            // Keypoints are detected on the whole card : the view only selects them, without margin
+            ObjectView view = objectView(i, 0);
+            cv::Rect region(view.offset, view.mask.size());
+
+            // Select keypoints as cv::KeyPointsFilter::runByPixelsMask, the mask is null outside the region
+            std::vector<cv::KeyPoint> keypoints;
+            for (size_t k=0; k<cardKeypoints.size(); k++)
+            {
+                const cv::KeyPoint & kp = cardKeypoints[k];
+                cv::Point p(cvRound(kp.pt.x), cvRound(kp.pt.y));
+                if (region.contains(p) && view.mask.at<uchar>(p - view.offset) != 0)
+                    keypoints.push_back(kp);
+            }
+            ImageProcessing::capKeypoints(keypoints);
+            e->keypoints.insert(e->keypoints.end(), keypoints.begin(), keypoints.end());
+            e->objectOffsets.push_back((int) e->keypoints.size());
+        }
+        if (!e->keypoints.empty())
+            _extractor->compute(_cards[card], e->keypoints, e->descriptors);
+        if (e->descriptors.rows != (int) e->keypoints.size())
+        {
+            SD_TRACE1("FeatureCache : keypoints of the card %1 are not all described", card);
+            e->keypoints.clear();
+            e->descriptors.release();
+            e->objectOffsets.assign(last - first + 1, 0);
+        }
+        _computedCards.ref();
+        e->ready.storeRelease(1);
+    }
+    return *e;
+}
+
+//******************************************************************************************
+/*!
+ * \brief FeatureCache::objectFeatures returns keypoints and descriptors of the object,
+ * computed on the first request
+ * \param object index of the object in the object table
+ * \return object features. Descriptors are empty if no keypoints are found on the object
+ */
+const ObjectFeatures & FeatureCache::objectFeatures(int object)
+{
+    ObjectEntry * e = _objectEntries[object];
+    if (e->ready.loadAcquire())
+        return e->features;
+
+    QMutexLocker locker(&e->mutex);
+    if (!e->ready.load())
+    {
+        int card = _objects->objects[object].cardId;
+        const CardEntry & c = cardFeatures(card);
+        int i = object - _objects->cardOffsets[card];
+        int start = c.objectOffsets[i];
+        int end = c.objectOffsets[i+1];
+
+        ObjectFeatures & f = e->features;
+        if (end > start)
+        {
+            f.keypoints.assign(c.keypoints.begin() + start, c.keypoints.begin() + end);
+            c.descriptors.rowRange(start, end).copyTo(f.descriptors);
+            if (_huMoments)
+            {
+                ObjectView view = objectView(object, 0);
+                prependHuMoments(view.image.mul(view.mask), f.descriptors);
+            }
+        }
+        _computedObjects.ref();
+        e->ready.storeRelease(1);
+    }
+    return e->features;
+}
+
+//******************************************************************************************
+
+}
@@ -0,0 +1,109 @@
+#ifndef FEATURECACHE_H
+#define FEATURECACHE_H
+
+// Std
+#include <vector>
+
+// Qt
+#include <QVector>
+#include <QMutex>
+#include <QAtomicInt>
+
+// Opencv
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+
+// Project
+#include "CardDetector.h"
+#include "PairsDetector.h"
+#include "AppExport.h"
+
+namespace DGV
+{
+
+//******************************************************************************************
+
+struct ObjectFeatures
+{
+    std::vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors;
+};
+
+//******************************************************************************************
+/*!
+ * \brief The FeatureCache class computes keypoints and descriptors of the card objects on demand.
+ *
+ * Nothing is computed when the cards are set. The first time features of an object are requested,
+ * keypoints of its card are detected on the whole card (one scale space per card), the keypoints
+ * of each object of the card are selected with the object mask and capped to the strongest ones
+ * (see ImageProcessing::capKeypoints), then only the kept keypoints are described. This gives the
+ * same keypoints and descriptors as a detection with the object mask, as the mask is applied
+ * after the detection.
+ * Object masks and Hu moments are computed on the object region (see ObjectView), not on the card.
+ * Card and object features are memoized. Concurrent requests are safe : the first one computes,
+ * the others wait for it.
+ */
+class DGV_APP_EXPORT FeatureCache
+{
+public:
+    FeatureCache(const cv::Ptr<cv::Feature2D> & extractor, bool huMoments=true);
+    ~FeatureCache();
+
+    void setCards(const QVector<cv::Mat> & cards, const ObjectTable * objects);
+
+    const ObjectFeatures & objectFeatures(int object);
+
+    const cv::Mat & card(int object) const;
+    cv::Mat objectMask(int object) const;
+    ObjectView objectView(int object, int margin) const;
+
+    int computedCardCount() const
+    { return _computedCards.load(); }
+    int computedObjectCount() const
+    { return _computedObjects.load(); }
+    //! Identifier of the cards set by setCards, unique among all caches
+    int generation() const
+    { return _generation; }
+
+protected:
+
+    struct CardEntry
+    {
+        QAtomicInt ready;
+        QMutex mutex;
+        //! Kept keypoints of the card objects and their descriptors
+        std::vector<cv::KeyPoint> keypoints;
+        cv::Mat descriptors;
+        //! Rows of the i-th object of the card : objectOffsets[i] to objectOffsets[i+1]
+        std::vector<int> objectOffsets;
+    };
+
+    struct ObjectEntry
+    {
+        QAtomicInt ready;
+        QMutex mutex;
+        ObjectFeatures features;
+    };
+
+    const CardEntry & cardFeatures(int card);
+
+    cv::Ptr<cv::Feature2D> _extractor;
+    bool _huMoments;
+
+    QVector<cv::Mat> _cards;
+    const ObjectTable * _objects;
+
+    QVector<CardEntry*> _cardEntries;
+    QVector<ObjectEntry*> _objectEntries;
+
+    QAtomicInt _computedCards;
+    QAtomicInt _computedObjects;
+    int _generation;
+
+};
+
+//******************************************************************************************
+
+}
+
+#endif // FEATURECACHE_H
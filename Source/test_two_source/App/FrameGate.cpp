@@ -0,0 +1,91 @@
+
+// Qt
+#include <qmath.h>
+
+// Opencv
+#include <opencv2/imgproc.hpp>
+
+// Project
+#include "FrameGate.h"
+
+namespace DGV
+{
+
+//******************************************************************************************
+
+FrameGate::FrameGate(bool verbose) :
+    _workingSize(160),
+    _minSharpness(20.0),
+    _minMeanIntensity(30.0),
+    _maxMeanIntensity(225.0),
+    _maxClippedRatio(0.25),
+    _maxMotion(8.0),
+    _maxDeferredFrames(15),
+    _verbose(verbose),
+    _deferredCount(0)
+{
+}
+
+//******************************************************************************************
+
+void FrameGate::reset()
+{
+    _previous.release();
+    _deferredCount = 0;
+}
+
+//******************************************************************************************
+/*!
+ * \brief FrameGate::admit decides whether the frame should be processed
+ * \param grayFrame input frame of type CV_8U
+ * \param quality (optional) output frame quality measures
+ * \return decision
+ */
+FrameGate::Decision FrameGate::admit(const cv::Mat &grayFrame, ImageProcessing::FrameQuality *quality)
+{
+    ImageProcessing::FrameQuality q;
+
+    // Decimate : INTER_AREA averages out the sensor noise that would bias the Laplacian variance
+    int dim = qMax(grayFrame.rows, grayFrame.cols);
+    if (_workingSize > 0 && dim > _workingSize)
+    {
+        double f = _workingSize * 1.0 / dim;
+        cv::resize(grayFrame, _decimated, cv::Size(), f, f, cv::INTER_AREA);
+    }
+    else
+    {
+        grayFrame.copyTo(_decimated);
+    }
+
+    ImageProcessing::computeFrameQuality(_decimated, _previous, &q);
+    cv::swap(_decimated, _previous);
+    if (quality)
+        *quality = q;
+
+    if (_verbose) SD_TRACE4("Frame quality : sharpness=%1, mean=%2, clipped=%3, motion=%4",
+                            q.sharpness, q.meanIntensity, q.darkRatio + q.brightRatio, q.motion);
+
+    if (q.meanIntensity < _minMeanIntensity || q.meanIntensity > _maxMeanIntensity ||
+            q.darkRatio + q.brightRatio > _maxClippedRatio)
+    {
+        return SKIP_EXPOSURE;
+    }
+
+    if (q.sharpness < _minSharpness)
+    {
+        return SKIP_BLUR;
+    }
+
+    if (q.motion > _maxMotion && _deferredCount < _maxDeferredFrames)
+    {
+        _deferredCount++;
+        return DEFER_MOTION;
+    }
+
+    _deferredCount = 0;
+    return ACCEPT;
+}
+
+//******************************************************************************************
+
+}
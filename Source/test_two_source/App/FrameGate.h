@@ -0,0 +1,61 @@
+#ifndef FRAMEGATE_H
+#define FRAMEGATE_H
+
+// Opencv
+#include <opencv2/core.hpp>
+
+// Project
+#include "Core/Global.h"
+#include "Core/ImageProcessing.h"
+#include "AppExport.h"
+
+namespace DGV
+{
+
+//******************************************************************************************
+/*!
+ * \brief The FrameGate class decides on a decimated copy of the frame whether the frame
+ * is worth the full processing.
+ *
+ * - Blurred frames (low variance of the Laplacian) and badly exposed frames are skipped.
+ * - Frames taken while the scene moves (players grab cards, hands over the table) are deferred :
+ * the caller should wait for a stable frame. After maxDeferredFrames consecutive deferred frames
+ * the frame is accepted anyway.
+ */
+class DGV_APP_EXPORT FrameGate
+{
+    PROPERTY_ACCESSORS(int, workingSize, getWorkingSize, setWorkingSize)
+    PROPERTY_ACCESSORS(double, minSharpness, getMinSharpness, setMinSharpness)
+    PROPERTY_ACCESSORS(double, minMeanIntensity, getMinMeanIntensity, setMinMeanIntensity)
+    PROPERTY_ACCESSORS(double, maxMeanIntensity, getMaxMeanIntensity, setMaxMeanIntensity)
+    PROPERTY_ACCESSORS(double, maxClippedRatio, getMaxClippedRatio, setMaxClippedRatio)
+    PROPERTY_ACCESSORS(double, maxMotion, getMaxMotion, setMaxMotion)
+    PROPERTY_ACCESSORS(int, maxDeferredFrames, getMaxDeferredFrames, setMaxDeferredFrames)
+    PROPERTY_ACCESSORS(bool, verbose, isVerbose, setVerbose)
+public:
+
+    enum Decision {
+        ACCEPT=0,
+        SKIP_BLUR=1,
+        SKIP_EXPOSURE=2,
+        DEFER_MOTION=3
+    };
+
+    FrameGate(bool verbose=false);
+
+    Decision admit(const cv::Mat & grayFrame, ImageProcessing::FrameQuality * quality=0);
+    void reset();
+
+protected:
+
+    cv::Mat _decimated;
+    cv::Mat _previous;
+    int _deferredCount;
+
+};
+
+//******************************************************************************************
+
+}
+
+#endif // FRAMEGATE_H
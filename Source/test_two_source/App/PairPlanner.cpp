@@ -0,0 +1,205 @@
+
+// Project
+#include "PairPlanner.h"
+#include "CardDetector.h"
+
+namespace DGV
+{
+
+//******************************************************************************************
+
+PairPlanner::PairPlanner() :
+    _objects(0),
+    _cardCount(0),
+    _next1(0),
+    _next2(1),
+    _matchedCount(0),
+    _inferredCount(0)
+{
+}
+
+//******************************************************************************************
+/*!
+ * \brief PairPlanner::reset starts the planning of the pairs of a frame
+ * \param objects objects of the cards. The table is not copied and should outlive the planning
+ */
+void PairPlanner::reset(const ObjectTable &objects)
+{
+    _objects = &objects;
+    _cardCount = objects.cardCount();
+    _states.fill(UNKNOWN, _cardCount * _cardCount);
+    _object1.fill(-1, _cardCount * _cardCount);
+    _object2.fill(-1, _cardCount * _cardCount);
+
+    int objectCount = objects.objects.size();
+    _parents.resize(objectCount);
+    _clusterCards.resize(objectCount);
+    for (int i=0; i<objectCount; i++)
+    {
+        _parents[i] = i;
+        _clusterCards[i].clear();
+        _clusterCards[i] << objects.objects[i].cardId;
+    }
+
+    _next1 = 0;
+    _next2 = 1;
+    _matchedCount = 0;
+    _inferredCount = 0;
+}
+
+//******************************************************************************************
+
+int PairPlanner::pairIndex(int card1, int card2) const
+{
+    return card1 < card2 ? card1 * _cardCount + card2 : card2 * _cardCount + card1;
+}
+
+//******************************************************************************************
+
+int PairPlanner::root(int object) const
+{
+    int r = object;
+    while (_parents[r] != r)
+        r = _parents[r];
+    // Path compression
+    while (_parents[object] != r)
+    {
+        int p = _parents[object];
+        _parents[object] = r;
+        object = p;
+    }
+    return r;
+}
+
+//******************************************************************************************
+/*!
+ * \brief PairPlanner::infer looks for a symbol cluster with objects of both cards
+ * \return true if the common objects of the cards are given by a cluster
+ */
+bool PairPlanner::infer(int card1, int card2, int *object1, int *object2) const
+{
+    const QVector<int> & offsets = _objects->cardOffsets;
+    for (int i=offsets[card1]; i<offsets[card1+1]; i++)
+    {
+        int r = root(i);
+        if (!_clusterCards[r].contains(card2))
+            continue;
+        for (int j=offsets[card2]; j<offsets[card2+1]; j++)
+        {
+            if (root(j) == r)
+            {
+                *object1 = i;
+                *object2 = j;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//******************************************************************************************
+/*!
+ * \brief PairPlanner::nextPair gives the next pair to compare. Pairs resolved by inference on
+ * the way are skipped and recorded.
+ * \param card1 first card, smaller than card2
+ * \param card2 second card
+ * \return false if all the pairs are resolved or compared
+ */
+bool PairPlanner::nextPair(int *card1, int *card2)
+{
+    for (; _next1 < _cardCount; _next1++, _next2 = _next1 + 1)
+    {
+        for (; _next2 < _cardCount; _next2++)
+        {
+            int index = pairIndex(_next1, _next2);
+            if (_states[index] != UNKNOWN)
+                continue;
+
+            int object1, object2;
+            if (infer(_next1, _next2, &object1, &object2))
+            {
+                _states[index] = INFERRED;
+                _object1[index] = object1;
+                _object2[index] = object2;
+                _inferredCount++;
+                continue;
+            }
+
+            *card1 = _next1;
+            *card2 = _next2;
+            _next2++;
+            return true;
+        }
+    }
+    return false;
+}
+
+//******************************************************************************************
+/*!
+ * \brief PairPlanner::setResult records the comparison of two cards
+ * \param card1 first card
+ * \param card2 second card
+ * \param object1 common object of the first card (object table index), -1 if not found
+ * \param object2 common object of the second card (object table index), -1 if not found
+ */
+void PairPlanner::setResult(int card1, int card2, int object1, int object2)
+{
+    if (card1 == card2 || card1 < 0 || card2 < 0 || card1 >= _cardCount || card2 >= _cardCount)
+    {
+        SD_TRACE2("PairPlanner::setResult : invalid pair %1, %2", card1, card2);
+        return;
+    }
+
+    int index = pairIndex(card1, card2);
+    if (object1 < 0 || object2 < 0)
+    {
+        _states[index] = NOT_FOUND;
+        return;
+    }
+    if (card1 > card2)
+        qSwap(object1, object2);
+    _states[index] = MATCHED;
+    _object1[index] = object1;
+    _object2[index] = object2;
+    _matchedCount++;
+
+    // Merge the symbol clusters, unless a card would have two objects in the cluster
+    int r1 = root(object1);
+    int r2 = root(object2);
+    if (r1 == r2)
+        return;
+    if (_clusterCards[r1].intersects(_clusterCards[r2]))
+    {
+        SD_TRACE2("PairPlanner::setResult : match of cards %1 and %2 is not consistent with the previous matches", card1, card2);
+        return;
+    }
+    _parents[r2] = r1;
+    _clusterCards[r1].unite(_clusterCards[r2]);
+    _clusterCards[r2].clear();
+}
+
+//******************************************************************************************
+
+PairPlanner::PairState PairPlanner::state(int card1, int card2) const
+{
+    return (PairState) _states[pairIndex(card1, card2)];
+}
+
+//******************************************************************************************
+/*!
+ * \brief PairPlanner::commonObjects gives the common objects of two cards, matched or inferred
+ * \return false if the common objects are not known
+ */
+bool PairPlanner::commonObjects(int card1, int card2, int *object1, int *object2) const
+{
+    int index = pairIndex(card1, card2);
+    if (_states[index] != MATCHED && _states[index] != INFERRED)
+        return false;
+    *object1 = card1 < card2 ? _object1[index] : _object2[index];
+    *object2 = card1 < card2 ? _object2[index] : _object1[index];
+    return true;
+}
+
+//******************************************************************************************
+
+}
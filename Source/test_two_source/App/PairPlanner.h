@@ -0,0 +1,93 @@
+#ifndef PAIRPLANNER_H
+#define PAIRPLANNER_H
+
+// Qt
+#include <QVector>
+#include <QSet>
+
+// Project
+#include "Core/Global.h"
+#include "AppExport.h"
+
+namespace DGV
+{
+
+struct ObjectTable;
+
+//******************************************************************************************
+/*!
+ * \brief The PairPlanner class schedules the comparisons of the card pairs of a frame and infers
+ * the pairs that need no comparison.
+ *
+ * Any two cards share exactly one symbol. Matched objects are gathered in symbol clusters : if
+ * card A shares its object a with B and the same object a with C, then B and C share this symbol,
+ * given by their objects of the cluster. Such pairs are resolved without matching.
+ *
+ * Pairs are given in star order (all pairs of the first card, then of the second, ...) : the
+ * pairs of a card create one cluster per symbol of this card, so most of the next pairs are
+ * inferred. A cluster never holds two objects of the same card : a match that would give such a
+ * cluster is kept for its pair but not used for the inference.
+ *
+ * Usage :
+ *  planner.reset(objects);
+ *  while (planner.nextPair(&card1, &card2))
+ *  {
+ *      ... compare the cards ...
+ *      planner.setResult(card1, card2, object1, object2);
+ *  }
+ */
+class DGV_APP_EXPORT PairPlanner
+{
+public:
+    enum PairState {
+        UNKNOWN=0,      ///< not compared yet
+        MATCHED=1,      ///< common objects found by matching (or given by the deck model)
+        INFERRED=2,     ///< common objects given by a symbol cluster
+        NOT_FOUND=3     ///< compared, no common objects found
+    };
+
+    PairPlanner();
+
+    void reset(const ObjectTable & objects);
+
+    bool nextPair(int * card1, int * card2);
+    void setResult(int card1, int card2, int object1, int object2);
+
+    PairState state(int card1, int card2) const;
+    bool commonObjects(int card1, int card2, int * object1, int * object2) const;
+
+    int cardCount() const
+    { return _cardCount; }
+    int matchedCount() const
+    { return _matchedCount; }
+    int inferredCount() const
+    { return _inferredCount; }
+
+protected:
+
+    int pairIndex(int card1, int card2) const;
+    int root(int object) const;
+    bool infer(int card1, int card2, int * object1, int * object2) const;
+
+    const ObjectTable * _objects;
+    int _cardCount;
+    //! Pair states and common objects (object table indices), cardCount() x cardCount()
+    QVector<int> _states;
+    QVector<int> _object1;
+    QVector<int> _object2;
+    //! Symbol clusters : parent of each object (union-find) and cards of each cluster root
+    mutable QVector<int> _parents;
+    QVector<QSet<int> > _clusterCards;
+    //! Star order position
+    int _next1;
+    int _next2;
+    int _matchedCount;
+    int _inferredCount;
+
+};
+
+//******************************************************************************************
+
+}
+
+#endif // PAIRPLANNER_H
@@ -1,6 +1,12 @@
+// Std
+#include <climits>
+
+// Opencv
+#include <opencv2/imgproc.hpp>
 
 // Project
 #include "PairsDetector.h"
+#include "FeatureCache.h"
 
 namespace DGV
 {
@@ -13,6 +19,61 @@ PairsDetector::PairsDetector(bool verbose) :
 
 }
 
+//******************************************************************************************
+/*!
+ * \brief makeObjectView creates the view of an object of a card
+ * \param card card image
+ * \param contour object contour in card coordinates
+ * \param margin pixels added around the bounding rect of the contour (clipped to the card), e.g.
+ * the descriptor support radius (see PairsDetector::supportRadius)
+ */
+ObjectView makeObjectView(const cv::Mat &card, const std::vector<cv::Point> &contour, int margin)
+{
+    ObjectView view;
+    cv::Rect r = cv::boundingRect(contour);
+    r = cv::Rect(r.x - margin, r.y - margin, r.width + 2*margin, r.height + 2*margin) & cv::Rect(cv::Point(), card.size());
+    view.image = card(r);
+    view.offset = r.tl();
+    view.mask = cv::Mat(r.height, r.width, CV_8U, cv::Scalar::all(0));
+    std::vector<std::vector<cv::Point> > contours(1, contour);
+    cv::drawContours(view.mask, contours, 0, cv::Scalar(1), CV_FILLED, 8, cv::noArray(), INT_MAX, -view.offset);
+    return view;
+}
+
+//******************************************************************************************
+/*!
+ * \brief PairsDetector::setupRefObject setups the reference object from its view.
+ * Default implementation uses the region image and the object mask
+ */
+bool PairsDetector::setupRefObject(const ObjectView &object)
+{
+    return setupRefObject(object.image, object.mask);
+}
+
+//******************************************************************************************
+
+bool PairsDetector::matchWithRefObject(const ObjectView &object)
+{
+    return matchWithRefObject(object.image, object.mask);
+}
+
+//******************************************************************************************
+/*!
+ * \brief PairsDetector::setupRefObject setups the reference object from the cache.
+ * Default implementation uses the object view extended by the descriptor support radius
+ */
+bool PairsDetector::setupRefObject(FeatureCache &cache, int object)
+{
+    return setupRefObject(cache.objectView(object, supportRadius()));
+}
+
+//******************************************************************************************
+
+bool PairsDetector::matchWithRefObject(FeatureCache &cache, int object)
+{
+    return matchWithRefObject(cache.objectView(object, supportRadius()));
+}
+
 //******************************************************************************************
 
 }
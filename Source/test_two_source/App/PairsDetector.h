@@ -1,16 +1,38 @@
 #ifndef PAIRSDETECTOR_H
 #define PAIRSDETECTOR_H
 
+// Std
+#include <vector>
+
 // Opencv
 #include <opencv2/core.hpp>
 
+// Project
+#include "AppExport.h"
 
 namespace DGV
 {
 
+class FeatureCache;
+
 //******************************************************************************************
+/*!
+ * \brief The ObjectView struct is an object of a card restricted to its bounding rect : the card
+ * sub-matrix (no copy) and the object mask in this region. Work done on a view does not depend
+ * on the card size.
+ */
+struct ObjectView
+{
+    cv::Mat image;      ///< card region of the object
+    cv::Mat mask;       ///< object mask (values 0 and 1) of the region size
+    cv::Point offset;   ///< region position in the card
+};
+
+ObjectView makeObjectView(const cv::Mat & card, const std::vector<cv::Point> & contour, int margin);
 
-class PairsDetector
+//******************************************************************************************
+
+class DGV_APP_EXPORT PairsDetector
 {
 public:
     PairsDetector(bool verbose=false);
@@ -22,7 +44,18 @@ public:
     // Compare two objects:
     virtual bool matchTwoObjects(const cv::Mat & object1, const cv::Mat & object2, const cv::Mat &mask1 = cv::Mat(), const cv::Mat &mask2 = cv::Mat()) = 0;
 
-    //
+    // Compare object views (card regions of the objects):
+    virtual bool setupRefObject(const ObjectView & object);
+    virtual bool matchWithRefObject(const ObjectView & object);
+
+    // Compare objects of a feature cache, features are computed on the first request:
+    virtual bool setupRefObject(FeatureCache & cache, int object);
+    virtual bool matchWithRefObject(FeatureCache & cache, int object);
+
+    //! Radius in pixels of the image support of the descriptors around a keypoint : object views
+    //! are extended by this margin, so that the keypoints near the object border are kept
+    virtual int supportRadius() const
+    { return 0; }
 
 protected:
 
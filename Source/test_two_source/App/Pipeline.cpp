@@ -0,0 +1,300 @@
+
+// Qt
+#include <qmath.h>
+
+// Opencv
+#include <opencv2/imgproc.hpp>
+
+// Project
+#include "Pipeline.h"
+#include "Core/ImageProcessing.h"
+
+namespace DGV
+{
+
+//******************************************************************************************
+
+static QAtomicInt NEXT_FRAME_ID(0);
+
+//******************************************************************************************
+
+void FrameResult::clear()
+{
+    frameId = -1;
+    scale = 1.0;
+    admission = FrameGate::ACCEPT;
+    cardContours.clear();
+    cardRects.clear();
+    cards.clear();
+    objects.clear();
+}
+
+//******************************************************************************************
+
+cv::Point FrameResult::toFrame(const cv::Point &p) const
+{
+    return cv::Point(qRound(p.x / scale), qRound(p.y / scale));
+}
+
+//******************************************************************************************
+
+cv::Point FrameResult::cardToFrame(int card, const cv::Point &p) const
+{
+    const cv::Rect & r = cardRects[card];
+    const cv::Mat & c = cards[card];
+    double fx = r.width * 1.0 / c.cols;
+    double fy = r.height * 1.0 / c.rows;
+    return cv::Point(qRound((r.x + p.x * fx) / scale), qRound((r.y + p.y * fy) / scale));
+}
+
+//******************************************************************************************
+
+Pipeline::Pipeline(double cardSizeMinRatio, double cardSizeMaxRatio, int frameSizeLimit, bool verbose) :
+    _cardSizeMinRatio(cardSizeMinRatio),
+    _cardSizeMaxRatio(cardSizeMaxRatio),
+    _frameSizeLimit(frameSizeLimit),
+    _verbose(verbose),
+    _reuseFrameEdges(false),
+    _frameGate(0),
+    _resultSink(0),
+    _sessionRecorder(0),
+    _recordStream(0),
+    _cardDetector(cardSizeMinRatio, cardSizeMaxRatio, verbose),
+    _frameIndex(-1),
+    _cardCount(0)
+{
+    _cardDetector.setBatchObserver(this);
+    _firstAnswer.store(-1);
+}
+
+//******************************************************************************************
+/*!
+ * \brief Pipeline::processFrame detects cards on the frame and extracts objects of each card.
+ * Each card is processed at its own working resolution (see CardDetector::adaptiveSize)
+ * \param frame input image of type CV_8UC1, CV_8UC3 (BGR) or CV_8UC4 (BGRA)
+ * \param result output, containers are reused
+ * \return false if the frame is not supported
+ *
+ * If a frame gate is set, the frame is first checked by the gate and cards are searched only
+ * if the frame is accepted (see FrameResult::admission)
+ */
+bool Pipeline::processFrame(const cv::Mat &frame, FrameResult *result)
+{
+    if (!result)
+    {
+        SD_TRACE("Pipeline::processFrame : result is null");
+        return false;
+    }
+    result->clear();
+
+    if (frame.empty() || frame.depth() != CV_8U)
+    {
+        SD_TRACE("Pipeline::processFrame : frame should be a non empty 8 bits matrix");
+        return false;
+    }
+
+    // To gray scale. Input data is never written
+    cv::Mat gray;
+    if (frame.channels() == 3)
+    {
+        cv::cvtColor(frame, _gray, cv::COLOR_BGR2GRAY);
+        gray = _gray;
+    }
+    else if (frame.channels() == 4)
+    {
+        cv::cvtColor(frame, _gray, cv::COLOR_BGRA2GRAY);
+        gray = _gray;
+    }
+    else if (frame.channels() == 1)
+    {
+        gray = frame;
+    }
+    else
+    {
+        SD_TRACE("Pipeline::processFrame : frame should have 1, 3 or 4 channels");
+        return false;
+    }
+
+    _frameIndex++;
+    result->frameId = NEXT_FRAME_ID.fetchAndAddOrdered(1);
+    _cardCount = 0;
+    _firstAnswer.store(-1);
+    // Recorded at arrival, the copy or the encoding is not part of the stage times
+    if (_sessionRecorder)
+        _sessionRecorder->recordSessionFrame(_recordStream, _frameIndex, frame);
+    _frameTimer.start();
+
+    // ---- FRAME ADMISSION
+    if (_frameGate)
+    {
+        result->admission = _frameGate->admit(gray, &result->quality);
+        if (result->admission != FrameGate::ACCEPT)
+        {
+            if (_verbose) SD_TRACE1("Frame is not admitted : %1", result->admission);
+            return true;
+        }
+    }
+    if (hasEventConsumer())
+    {
+        PipelineEvent event;
+        event.type = PipelineEvent::FRAME_ACCEPTED;
+        postEvent(event);
+    }
+
+    // Resize
+    cv::Mat procImage = gray;
+    int dim = qMax(gray.rows, gray.cols);
+    if (_frameSizeLimit > 0 && dim > _frameSizeLimit)
+    {
+        result->scale = _frameSizeLimit * 1.0 / dim;
+        cv::resize(gray, _procImage, cv::Size(), result->scale, result->scale);
+        procImage = _procImage;
+    }
+
+    // ---- FIND CARDS
+    ImageProcessing::detectObjects(procImage, &result->cardContours,
+                                   _cardSizeMinRatio, _cardSizeMaxRatio,
+                                   cv::Mat(),
+                                   ImageProcessing::ELLIPSE_LIKE, 2.0,
+                                   _verbose);
+    if (result->cardContours.isEmpty())
+        return true;
+
+    result->cards = _cardDetector.extractCards(procImage, result->cardContours, &result->cardRects);
+    _cardCount = result->cards.size();
+    for (int i=0; hasEventConsumer() && i<result->cards.size(); i++)
+    {
+        const cv::Rect & r = result->cardRects[i];
+        PipelineEvent event;
+        event.type = PipelineEvent::CARD_DETECTED;
+        event.card = i;
+        event.rect = cv::Rect(result->toFrame(r.tl()), result->toFrame(r.br()));
+        postEvent(event);
+    }
+
+    // ---- ADAPT CARD RESOLUTIONS AND EXTRACT OBJECTS
+    if (_reuseFrameEdges)
+    {
+        // One edge computation for the cards kept at the frame resolution
+        _cardDetector.computeFrameEdges(procImage, &_frameEdges);
+        result->cards = _cardDetector.adaptiveSize(result->cards, &result->objects, &_frameEdges, &result->cardRects);
+        if (_verbose) SD_TRACE2("Edges of %1 cards on %2 are cropped from the frame", _cardDetector.frameEdgeCardCount(), result->cards.size());
+    }
+    else
+    {
+        result->cards = _cardDetector.adaptiveSize(result->cards, &result->objects);
+    }
+    return true;
+}
+
+//******************************************************************************************
+/*!
+ * \brief Pipeline::cardProcessed is called from the worker threads when the objects of a card are extracted
+ */
+void Pipeline::cardProcessed(int card, int objectCount)
+{
+    if (!hasEventConsumer())
+        return;
+    PipelineEvent event;
+    event.type = PipelineEvent::CARD_OBJECTS_READY;
+    event.card = card;
+    event.count = objectCount;
+    postEvent(event);
+}
+
+//******************************************************************************************
+/*!
+ * \brief Pipeline::postPairResolved posts the answer for two cards of the current frame.
+ * Can be called from any thread.
+ * \param card1 first card index
+ * \param card2 second card index
+ * \param object1 (optional) matched object of the first card, index in the object table
+ * \param object2 (optional) matched object of the second card, index in the object table
+ * \param symbol (optional) common symbol
+ */
+void Pipeline::postPairResolved(int card1, int card2, int object1, int object2, int symbol)
+{
+    PipelineEvent event;
+    event.type = PipelineEvent::PAIR_RESOLVED;
+    event.card = card1;
+    event.otherCard = card2;
+    event.object = object1;
+    event.otherObject = object2;
+    event.symbol = symbol;
+    postEvent(event);
+
+    // Keep the first answer time
+    _firstAnswer.testAndSetOrdered(-1, qRound(event.elapsed * 1000.0));
+}
+
+//******************************************************************************************
+/*!
+ * \brief Pipeline::endFrame posts the end of the current frame with the time to the first answer
+ */
+void Pipeline::endFrame()
+{
+    PipelineEvent event;
+    event.type = PipelineEvent::FRAME_DONE;
+    event.count = _cardCount;
+    int firstAnswer = _firstAnswer.load();
+    event.firstAnswer = firstAnswer < 0 ? -1.0 : firstAnswer * 0.001;
+    postEvent(event);
+    if (_verbose) SD_TRACE2("Frame done in %1 ms, first answer in %2 ms", event.elapsed, event.firstAnswer);
+}
+
+//******************************************************************************************
+
+void Pipeline::postEvent(PipelineEvent &event)
+{
+    event.frame = _frameIndex;
+    event.elapsed = _frameTimer.nsecsElapsed() * 1e-6;
+    if (_sessionRecorder)
+    {
+        _sessionRecorder->recordStage(_recordStream, event.frame, stageName(event.type), event.elapsed);
+        if (event.type == PipelineEvent::FRAME_DONE && event.firstAnswer >= 0.0)
+            _sessionRecorder->recordStage(_recordStream, event.frame, "first answer", event.firstAnswer);
+    }
+    if (!_resultSink)
+        return;
+    if (!_events.push(event))
+        _droppedEvents.ref();
+}
+
+//******************************************************************************************
+/*!
+ * \brief Pipeline::stageName returns the stage name of an event type in the session logs
+ */
+const char * Pipeline::stageName(int type)
+{
+    switch (type)
+    {
+    case PipelineEvent::FRAME_ACCEPTED: return "frame accepted";
+    case PipelineEvent::CARD_DETECTED: return "card detected";
+    case PipelineEvent::CARD_OBJECTS_READY: return "card objects";
+    case PipelineEvent::PAIR_RESOLVED: return "pair resolved";
+    case PipelineEvent::FRAME_DONE: return "frame done";
+    default: return "unknown";
+    }
+}
+
+//******************************************************************************************
+/*!
+ * \brief Pipeline::dispatchEvents delivers the queued events to the result sink on the calling thread
+ * \return number of delivered events
+ */
+int Pipeline::dispatchEvents()
+{
+    PipelineEvent event;
+    int count = 0;
+    while (_events.pop(&event))
+    {
+        if (_resultSink)
+            _resultSink->onEvent(event);
+        count++;
+    }
+    return count;
+}
+
+//******************************************************************************************
+
+}
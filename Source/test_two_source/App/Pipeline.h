@@ -0,0 +1,133 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Std
+#include <vector>
+
+// Qt
+#include <QVector>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+
+// Opencv
+#include <opencv2/core.hpp>
+
+// Project
+#include "Core/Global.h"
+#include "Core/LockFreeQueue.h"
+#include "Core/SessionLog.h"
+#include "CardDetector.h"
+#include "FrameGate.h"
+#include "ResultSink.h"
+#include "AppExport.h"
+
+namespace DGV
+{
+
+//******************************************************************************************
+/*!
+ * \brief The FrameResult struct holds cards and objects found on a frame.
+ * Containers are reused from one frame to another.
+ */
+struct DGV_APP_EXPORT FrameResult
+{
+    FrameResult() : frameId(-1), admission(FrameGate::ACCEPT), scale(1.0) {}
+
+    void clear();
+
+    //! Identifier of the processed frame, unique among all the pipelines, -1 if not processed
+    int frameId;
+
+    //! Frame gate decision and measures. Cards are not searched if the frame is not accepted
+    FrameGate::Decision admission;
+    ImageProcessing::FrameQuality quality;
+    //! Processing image size / frame size
+    double scale;
+    //! Card contours in processing image coordinates
+    QVector<std::vector<cv::Point> > cardContours;
+    //! Card crops in processing image coordinates
+    QVector<cv::Rect> cardRects;
+    //! Cards at their working resolution
+    QVector<cv::Mat> cards;
+    //! Objects of all cards in card coordinates
+    ObjectTable objects;
+
+    cv::Point toFrame(const cv::Point & p) const;
+    cv::Point cardToFrame(int card, const cv::Point & p) const;
+};
+
+//******************************************************************************************
+
+/*!
+ * \brief The Pipeline class finds cards and their objects on frames.
+ *
+ * If a result sink is set, partial results are posted as events while the frame is processed
+ * (see PipelineEvent). Events are posted from the worker threads into a lock-free queue and
+ * delivered to the sink by dispatchEvents, called from the thread owning the sink. Pairs are
+ * resolved outside of the pipeline : the caller posts them with postPairResolved and closes the
+ * frame with endFrame.
+ */
+class DGV_APP_EXPORT Pipeline : protected CardBatchObserver
+{
+    PROPERTY_ACCESSORS(double, cardSizeMinRatio, getCardSizeMinRatio, setCardSizeMinRatio)
+    PROPERTY_ACCESSORS(double, cardSizeMaxRatio, getCardSizeMaxRatio, setCardSizeMaxRatio)
+    PROPERTY_ACCESSORS(int, frameSizeLimit, getFrameSizeLimit, setFrameSizeLimit)
+    PROPERTY_ACCESSORS(bool, verbose, isVerbose, setVerbose)
+    //! Symbol edges are cropped from frame edges for cards kept at the frame resolution, see CardDetector::adaptiveSize
+    PROPERTY_ACCESSORS(bool, reuseFrameEdges, isReuseFrameEdges, setReuseFrameEdges)
+    //! Optional frame admission gate, not owned
+    PTR_PROPERTY_ACCESSORS(FrameGate, frameGate, getFrameGate, setFrameGate)
+    //! Optional receiver of the partial results, not owned
+    PTR_PROPERTY_ACCESSORS(ResultSink, resultSink, getResultSink, setResultSink)
+    //! Optional session recorder of the frames and of the stage times (events), not owned
+    PTR_PROPERTY_ACCESSORS(ImageCommon::SessionRecorder, sessionRecorder, getSessionRecorder, setSessionRecorder)
+    //! Stream id of the recorded frames
+    PROPERTY_ACCESSORS(int, recordStream, getRecordStream, setRecordStream)
+public:
+    Pipeline(double cardSizeMinRatio=0.15, double cardSizeMaxRatio=1.0, int frameSizeLimit=700, bool verbose=false);
+
+    bool processFrame(const cv::Mat & frame, FrameResult * result);
+
+    void postPairResolved(int card1, int card2, int object1=-1, int object2=-1, int symbol=-1);
+    void endFrame();
+    int dispatchEvents();
+
+    int getDroppedEventCount() const
+    { return _droppedEvents.load(); }
+
+    CardDetector & cardDetector()
+    { return _cardDetector; }
+
+    static const char * stageName(int type);
+
+protected:
+
+    virtual void cardProcessed(int card, int objectCount);
+    void postEvent(PipelineEvent & event);
+    //! Events are built when a result sink or a session recorder consumes them
+    bool hasEventConsumer() const
+    { return _resultSink || _sessionRecorder; }
+
+    CardDetector _cardDetector;
+
+    // Events
+    LockFreeQueue<PipelineEvent> _events;
+    QElapsedTimer _frameTimer;
+    int _frameIndex;
+    int _cardCount;
+    //! Time to the first pair answer of the current frame in microseconds, -1 if none
+    QAtomicInt _firstAnswer;
+    QAtomicInt _droppedEvents;
+
+    // Buffers reused between frames
+    cv::Mat _gray;
+    cv::Mat _procImage;
+    FrameEdges _frameEdges;
+
+};
+
+//******************************************************************************************
+
+}
+
+#endif // PIPELINE_H
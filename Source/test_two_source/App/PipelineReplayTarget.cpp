@@ -0,0 +1,66 @@
+
+// Project
+#include "PipelineReplayTarget.h"
+
+namespace DGV
+{
+
+//******************************************************************************************
+
+PipelineReplayTarget::PipelineReplayTarget(double cardSizeMinRatio, double cardSizeMaxRatio, int frameSizeLimit) :
+    _cardSizeMinRatio(cardSizeMinRatio),
+    _cardSizeMaxRatio(cardSizeMaxRatio),
+    _frameSizeLimit(frameSizeLimit)
+{
+}
+
+//******************************************************************************************
+
+PipelineReplayTarget::~PipelineReplayTarget()
+{
+    qDeleteAll(_streams);
+}
+
+//******************************************************************************************
+/*!
+ * \brief PipelineReplayTarget::stream returns the pipeline of a replayed stream, created on its first frame
+ */
+PipelineReplayTarget::Stream * PipelineReplayTarget::stream(int id)
+{
+    QMutexLocker locker(&_mutex);
+    Stream * s = _streams.value(id, 0);
+    if (!s)
+    {
+        s = new Stream(_cardSizeMinRatio, _cardSizeMaxRatio, _frameSizeLimit);
+        _streams.insert(id, s);
+    }
+    return s;
+}
+
+//******************************************************************************************
+/*!
+ * \brief PipelineReplayTarget::processFrame runs the pipeline of the stream on the frame.
+ * Events are dispatched on the stream thread once the frame is done
+ */
+void PipelineReplayTarget::processFrame(int stream, int frame, const cv::Mat &image, QVector<ImageCommon::StageTiming> *stages)
+{
+    Q_UNUSED(frame);
+    Stream * s = this->stream(stream);
+    s->stages = stages;
+    s->pipeline.processFrame(image, &s->result);
+    s->pipeline.endFrame();
+    s->pipeline.dispatchEvents();
+    s->stages = 0;
+}
+
+//******************************************************************************************
+
+void PipelineReplayTarget::Stream::onEvent(const PipelineEvent &event)
+{
+    if (stages)
+        *stages << ImageCommon::StageTiming(Pipeline::stageName(event.type), event.elapsed);
+}
+
+//******************************************************************************************
+
+}
@@ -0,0 +1,60 @@
+#ifndef PIPELINEREPLAYTARGET_H
+#define PIPELINEREPLAYTARGET_H
+
+// Qt
+#include <QHash>
+#include <QMutex>
+
+// Project
+#include "Pipeline.h"
+#include "Core/SessionLog.h"
+
+namespace DGV
+{
+
+//******************************************************************************************
+/*!
+ * \brief The PipelineReplayTarget class processes the frames of a replayed session with a
+ * pipeline per stream. Stage times are the pipeline events, named as in the recorded session
+ * (see Pipeline::setSessionRecorder). Pairs are not resolved : pair stages are not replayed.
+ */
+class PipelineReplayTarget : public ImageCommon::ReplayTarget
+{
+public:
+    PipelineReplayTarget(double cardSizeMinRatio=0.15, double cardSizeMaxRatio=1.0, int frameSizeLimit=700);
+    virtual ~PipelineReplayTarget();
+
+    virtual void processFrame(int stream, int frame, const cv::Mat & image, QVector<ImageCommon::StageTiming> * stages);
+
+protected:
+
+    struct Stream : public ResultSink
+    {
+        Stream(double cardSizeMinRatio, double cardSizeMaxRatio, int frameSizeLimit) :
+            pipeline(cardSizeMinRatio, cardSizeMaxRatio, frameSizeLimit),
+            stages(0)
+        {
+            pipeline.setResultSink(this);
+        }
+        virtual void onEvent(const PipelineEvent & event);
+
+        Pipeline pipeline;
+        FrameResult result;
+        QVector<ImageCommon::StageTiming> * stages;
+    };
+
+    Stream * stream(int id);
+
+    double _cardSizeMinRatio;
+    double _cardSizeMaxRatio;
+    int _frameSizeLimit;
+
+    QMutex _mutex;
+    QHash<int, Stream*> _streams;
+};
+
+//******************************************************************************************
+
+}
+
+#endif // PIPELINEREPLAYTARGET_H
@@ -0,0 +1,67 @@
+#ifndef RESULTSINK_H
+#define RESULTSINK_H
+
+// Opencv
+#include <opencv2/core.hpp>
+
+namespace DGV
+{
+
+//******************************************************************************************
+/*!
+ * \brief The PipelineEvent struct describes a partial result of a frame, as soon as it is known.
+ * Times are in milliseconds since the start of the frame processing.
+ */
+struct PipelineEvent
+{
+    enum Type {
+        FRAME_ACCEPTED=0,
+        CARD_DETECTED=1,
+        CARD_OBJECTS_READY=2,
+        PAIR_RESOLVED=3,
+        FRAME_DONE=4
+    };
+
+    PipelineEvent() :
+        type(FRAME_ACCEPTED), frame(-1), elapsed(0.0),
+        card(-1), otherCard(-1), object(-1), otherObject(-1), symbol(-1),
+        count(0), firstAnswer(-1.0)
+    {}
+
+    Type type;
+    int frame;
+    double elapsed;
+    //! CARD_* : card index, PAIR_RESOLVED : first card
+    int card;
+    //! PAIR_RESOLVED : second card
+    int otherCard;
+    //! PAIR_RESOLVED : matched objects (index in ObjectTable), -1 if unknown
+    int object;
+    int otherObject;
+    //! PAIR_RESOLVED : common symbol, -1 if unknown
+    int symbol;
+    //! CARD_OBJECTS_READY : object count of the card, FRAME_DONE : card count
+    int count;
+    //! CARD_DETECTED : card rectangle in frame coordinates
+    cv::Rect rect;
+    //! FRAME_DONE : time to the first pair answer, -1 if no pair was resolved
+    double firstAnswer;
+};
+
+//******************************************************************************************
+/*!
+ * \brief The ResultSink class receives the pipeline events. Events are queued by the worker
+ * threads and delivered by Pipeline::dispatchEvents on the thread calling it (e.g. UI thread).
+ */
+class ResultSink
+{
+public:
+    virtual ~ResultSink() {}
+    virtual void onEvent(const PipelineEvent & event) = 0;
+};
+
+//******************************************************************************************
+
+}
+
+#endif // RESULTSINK_H
@@ -0,0 +1,190 @@
+
+// Qt
+#include <QDir>
+#include <QFile>
+
+// Opencv
+#include <opencv2/imgcodecs.hpp>
+
+// Project
+#include "SymbolCatalog.h"
+#include "PairsDetector.h"
+
+namespace DGV
+{
+
+//******************************************************************************************
+/*!
+ * \brief SymbolCatalog::SymbolCatalog
+ * \param extractor feature extractor of the frame objects, see FeatureCache
+ */
+SymbolCatalog::SymbolCatalog(const cv::Ptr<cv::Feature2D> &extractor) :
+    _symbolCache(extractor)
+{
+}
+
+//******************************************************************************************
+/*!
+ * \brief SymbolCatalog::load loads the deck table and the symbol images of a catalog directory
+ * \return false if the deck table is not valid
+ */
+bool SymbolCatalog::load(const QString &path)
+{
+    DeckModel deck;
+    if (!deck.load(QDir(path).filePath("deck.txt")))
+        return false;
+    setDeck(deck);
+
+    QVector<cv::Mat> images(deck.symbolCount());
+    int count = 0;
+    for (int s=0; s<images.size(); s++)
+    {
+        QString file = QDir(path).filePath(QString("%1.png").arg(s));
+        if (!QFile::exists(file))
+            continue;
+        images[s] = cv::imread(file.toStdString(), cv::IMREAD_GRAYSCALE);
+        if (!images[s].empty())
+            count++;
+    }
+    if (count < images.size())
+        SD_TRACE2("SymbolCatalog::load : %1 symbol images out of %2", count, images.size());
+    setSymbols(images);
+    return true;
+}
+
+//******************************************************************************************
+
+void SymbolCatalog::setDeck(const DeckModel &deck)
+{
+    _deck = deck;
+}
+
+//******************************************************************************************
+/*!
+ * \brief SymbolCatalog::setSymbols sets the reference images of the symbols. The whole image is
+ * the symbol object, features are computed on the first classification
+ * \param images 8 bits single channel image of each symbol label, empty if the symbol has no image
+ */
+void SymbolCatalog::setSymbols(const QVector<cv::Mat> &images)
+{
+    _symbols = images;
+    _symbolObjects.clear();
+    _symbolObjects.cardOffsets.resize(images.size() + 1);
+    _symbolObject.fill(-1, images.size());
+    for (int s=0; s<images.size(); s++)
+    {
+        _symbolObjects.cardOffsets[s] = _symbolObjects.objects.size();
+        if (images[s].empty())
+            continue;
+        cv::Rect r(0, 0, images[s].cols, images[s].rows);
+        ObjectTable::Object o;
+        o.cardId = s;
+        o.contourOffset = (int) _symbolObjects.points.size();
+        o.contourLength = 4;
+        o.bbox = r;
+        o.label = s;
+        _symbolObjects.points.push_back(r.tl());
+        _symbolObjects.points.push_back(cv::Point(r.br().x - 1, r.y));
+        _symbolObjects.points.push_back(r.br() - cv::Point(1, 1));
+        _symbolObjects.points.push_back(cv::Point(r.x, r.br().y - 1));
+        _symbolObject[s] = _symbolObjects.objects.size();
+        _symbolObjects.objects << o;
+    }
+    _symbolObjects.cardOffsets[images.size()] = _symbolObjects.objects.size();
+    _symbolCache.setCards(_symbols, &_symbolObjects);
+}
+
+//******************************************************************************************
+/*!
+ * \brief SymbolCatalog::classify finds the symbol of an object among candidate symbols
+ * \param detector matching method, its reference object is replaced
+ * \param cache features of the frame objects
+ * \param object object index in the object table of the cache
+ * \param symbols candidate symbols, compared in this order
+ * \return first matched symbol or -1
+ */
+int SymbolCatalog::classify(PairsDetector &detector, FeatureCache &cache, int object, const QVector<int> &symbols)
+{
+    if (!detector.setupRefObject(cache, object))
+        return -1;
+    foreach (int s, symbols)
+    {
+        if (s >= 0 && s < _symbolObject.size() && _symbolObject[s] >= 0 &&
+                detector.matchWithRefObject(_symbolCache, _symbolObject[s]))
+            return s;
+    }
+    return -1;
+}
+
+//******************************************************************************************
+/*!
+ * \brief SymbolCatalog::labelObjects sets the symbol labels of the objects. Objects of a card are
+ * compared with all the symbols until two distinct labels identify the card, then with the
+ * remaining symbols of the card only. Labels of a card that is not identified are reset
+ * \param detector matching method, its reference object is replaced
+ * \param cache features of the frame objects
+ * \param objects object table of the cache, labels are written
+ * \return number of labelled objects
+ */
+int SymbolCatalog::labelObjects(PairsDetector &detector, FeatureCache &cache, ObjectTable *objects)
+{
+    if (!objects)
+    {
+        SD_TRACE("SymbolCatalog::labelObjects : objects is null");
+        return 0;
+    }
+    if (!isValid())
+        return 0;
+
+    QVector<int> allSymbols(_deck.symbolCount());
+    for (int s=0; s<allSymbols.size(); s++)
+        allSymbols[s] = s;
+
+    int count = 0;
+    for (int c=0; c<objects->cardCount(); c++)
+    {
+        int first = -1;
+        int card = -1;
+        QVector<int> candidates = allSymbols;
+        int labelled = 0;
+        for (int i=objects->cardOffsets[c]; i<objects->cardOffsets[c+1]; i++)
+        {
+            int label = classify(detector, cache, i, candidates);
+            objects->objects[i].label = label;
+            if (label < 0)
+                continue;
+            labelled++;
+            candidates.removeOne(label);
+            if (first < 0)
+            {
+                first = label;
+            }
+            else if (card < 0)
+            {
+                card = _deck.cardFromSymbols(first, label);
+                if (card < 0)
+                    break;
+                // Other objects are symbols of the card
+                candidates.clear();
+                foreach (int s, _deck.cardSymbols(card))
+                {
+                    if (s != first && s != label)
+                        candidates << s;
+                }
+            }
+        }
+        // Labels are kept only if they identify a card
+        if (card < 0)
+        {
+            for (int i=objects->cardOffsets[c]; i<objects->cardOffsets[c+1]; i++)
+                objects->objects[i].label = -1;
+            continue;
+        }
+        count += labelled;
+    }
+    return count;
+}
+
+//******************************************************************************************
+
+}
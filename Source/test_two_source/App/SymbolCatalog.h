@@ -0,0 +1,74 @@
+#ifndef SYMBOLCATALOG_H
+#define SYMBOLCATALOG_H
+
+// Qt
+#include <QVector>
+#include <QString>
+
+// Opencv
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+
+// Project
+#include "Core/Global.h"
+#include "CardDetector.h"
+#include "DeckModel.h"
+#include "FeatureCache.h"
+#include "AppExport.h"
+
+namespace DGV
+{
+
+class PairsDetector;
+
+//******************************************************************************************
+/*!
+ * \brief The SymbolCatalog class labels the card objects with the symbols of a deck catalog :
+ * the card -> symbols table of the printed deck (see DeckModel) and one reference image per symbol.
+ *
+ * Objects are classified by matching them with the symbol images. Two distinct labels identify
+ * the card, then its other objects are only compared with the symbols of this card. Labels are
+ * read by DeckModel::resolveCards and DeckModel::commonObjects.
+ *
+ * Catalog directory :
+ *  deck.txt        card -> symbols table, see DeckModel::load
+ *  <symbol>.png    image of each symbol, e.g. 0.png ... 56.png. Missing symbols are never labelled
+ */
+class DGV_APP_EXPORT SymbolCatalog
+{
+public:
+    SymbolCatalog(const cv::Ptr<cv::Feature2D> & extractor);
+
+    bool load(const QString & path);
+    void setDeck(const DeckModel & deck);
+    void setSymbols(const QVector<cv::Mat> & images);
+
+    bool isValid() const
+    { return _deck.isValid(); }
+    const DeckModel & deck() const
+    { return _deck; }
+
+    int classify(PairsDetector & detector, FeatureCache & cache, int object, const QVector<int> & symbols);
+    int labelObjects(PairsDetector & detector, FeatureCache & cache, ObjectTable * objects);
+
+private:
+    SymbolCatalog(const SymbolCatalog &);
+    SymbolCatalog & operator=(const SymbolCatalog &);
+
+protected:
+
+    DeckModel _deck;
+    //! Symbol images as cards of one object each, empty for the missing symbols
+    QVector<cv::Mat> _symbols;
+    ObjectTable _symbolObjects;
+    FeatureCache _symbolCache;
+    //! Object of each symbol in the symbol cache, -1 if the symbol has no image
+    QVector<int> _symbolObject;
+
+};
+
+//******************************************************************************************
+
+}
+
+#endif // SYMBOLCATALOG_H
@@ -17,14 +17,38 @@
 // Project
 #include "CardDetector.h"
 #include "BasicPairsDetector.h"
+#include "FeatureCache.h"
+#include "DeckModel.h"
+#include "SymbolCatalog.h"
+#include "PairPlanner.h"
+#include "PipelineReplayTarget.h"
 #include "Core/Global.h"
 #include "Core/ImageCommon.h"
 #include "Core/ImageProcessing.h"
+#include "Core/Profiler.h"
+#include "Core/ImagePrefetcher.h"
+#include "Core/TiledImage.h"
+#include "Core/SessionLog.h"
 
 
 
 bool VERBOSE = true;
 
+// Profile one frame out of PROFILE_EVERY_NTH_FRAME frames (0 to disable)
+int PROFILE_EVERY_NTH_FRAME = 5;
+// Read the hardware counters of the zones on the profiled frames (Linux perf events). Counters
+// are per thread : the work of a zone done on other threads (OpenCV parallel loops) is not counted
+bool PROFILE_COUNTERS = true;
+
+// TIFF images larger than TILED_IMAGE_MIN_AREA pixels (table scans) are processed tile by tile
+qint64 TILED_IMAGE_MIN_AREA = 8000 * 8000;
+// Card sizes in pixels on the table scans
+int TILED_CARD_MIN_SIZE = 300;
+int TILED_CARD_MAX_SIZE = 3000;
+
+// Deck catalog (card -> symbols table and symbol images, see SymbolCatalog) in the image data path
+QString CATALOG_DIR = "Catalog";
+
 /*!
  * OK - Find circles and mask their content = Find cards
  * OK - Rectify circles and its content = Rectify card geometry
@@ -39,12 +63,37 @@ void help()
     SD_TRACE("Usage : DGVApp image_data_path");
     SD_TRACE("  where image_data_path is a path with *.jpg, *.png, *.tif images");
     SD_TRACE("Example : DGVApp C:/Temp/");
+    SD_TRACE("Usage : DGVApp --replay session_log [copies] [speed]");
+    SD_TRACE("  replays a recorded session (see Pipeline::setSessionRecorder) with its timing on");
+    SD_TRACE("  copies concurrent replays of each stream, speed times faster, and compares the stage latencies");
+}
+
+//******************************************************************************************
+
+int replay(const QString & log, int copies, double speed)
+{
+    ImageCommon::SessionReplayer replayer;
+    if (!replayer.open(log))
+        return 1;
+    SD_TRACE3("Replay %1 frames of %2 streams, %3 copies", replayer.frameCount(), replayer.streamCount(), copies);
+
+    DGV::PipelineReplayTarget target;
+    ImageCommon::SessionReplayer::Report report = replayer.replay(&target, copies, speed);
+    report.trace();
+    return 0;
 }
 
 
 int main(int argc, char** argv)
 {
 
+    if (argc >= 3 && QString(argv[1]) == "--replay")
+    {
+        int copies = argc > 3 ? QString(argv[3]).toInt() : 1;
+        double speed = argc > 4 ? QString(argv[4]).toDouble() : 1.0;
+        return replay(QString(argv[2]), copies, speed);
+    }
+
     if (argc != 2)
     {
         help();
@@ -79,12 +128,75 @@ int main(int argc, char** argv)
     double cardSizeMaxRatio = 1.0;
     DGV::CardDetector cardDetector(cardSizeMinRatio, cardSizeMaxRatio, VERBOSE);
 
-    // Loop on files :
+    Profiler::MachinePeak peak;
+    if (PROFILE_EVERY_NTH_FRAME > 0)
+    {
+        peak = Profiler::machinePeak(QDir::temp().filePath("dgv_machine_peak.txt"));
+        if (PROFILE_COUNTERS)
+        {
+            // Zones are active on the sampled frames only, counters are read by the active zones
+            if (Profiler::countersAvailable())
+                Profiler::setCountersEnabled(true);
+            else
+                SD_TRACE("Hardware counters are not available (check /proc/sys/kernel/perf_event_paranoid)");
+        }
+    }
+    int frameIndex = 0;
+
+    // Files are read ahead while the previous ones are processed. Large TIFF scans are not
+    // loaded : cards are detected on tiles read on demand
+    QStringList filePaths;
     foreach (QString file, filesToOpen)
     {
+        QString filePath = path + "/" + file;
+        ImageCommon::TiffTiledImage scan;
+        if (!ImageCommon::TiffTiledImage::isTiff(filePath) || !scan.open(filePath) ||
+                (qint64) scan.size().width * scan.size().height < TILED_IMAGE_MIN_AREA)
+        {
+            filePaths << filePath;
+            continue;
+        }
+
+        SD_TRACE3("Open scan '%1' : %2x%3", file, scan.size().width, scan.size().height);
+        QVector<std::vector<cv::Point> > cardContours;
+        ImageProcessing::detectObjectsTiled(scan, &cardContours,
+                                            TILED_CARD_MIN_SIZE, TILED_CARD_MAX_SIZE,
+                                            ImageProcessing::ELLIPSE_LIKE, 2.0);
+        SD_TRACE1("Cards found on the scan : %1", cardContours.size());
+
+        // Only the card regions are read, then cards are processed as the cards of a frame
+        QVector<cv::Mat> scanCards;
+        for (int i=0; i<cardContours.size(); i++)
+        {
+            cv::Rect r = cv::boundingRect(cardContours[i]);
+            SD_TRACE4("Card at %1, %2 (%3x%4)", r.x, r.y, r.width, r.height);
+            cv::Mat crop;
+            if (!scan.readRegion(r, &crop))
+                continue;
+            QVector<std::vector<cv::Point> > contour(1, cardContours[i]);
+            for (size_t k=0; k<contour[0].size(); k++)
+                contour[0][k] -= r.tl();
+            scanCards << cardDetector.extractCards(crop, contour);
+        }
+        DGV::ObjectTable scanObjects;
+        QVector<cv::Mat> uniCards = cardDetector.adaptiveSize(scanCards, &scanObjects);
+        for (int i=0; i<scanObjects.cardCount(); i++)
+        {
+            SD_TRACE3("Card %1 of the scan : %2 objects at %3 pixels", i, scanObjects.objectCount(i), uniCards[i].cols);
+            ImageCommon::displayMat(uniCards[i], true, "Scan card");
+        }
+    }
+    ImageCommon::ImagePrefetcher prefetcher(filePaths, 8);
+
+    // Loop on files :
+    QString file;
+    cv::Mat inImage;
+    while (prefetcher.next(&file, &inImage))
+    {
+        Profiler::setEnabled(PROFILE_EVERY_NTH_FRAME > 0 && frameIndex % PROFILE_EVERY_NTH_FRAME == 0);
+        frameIndex++;
+
         SD_TRACE1("Open file '%1'", file);
-        QString f = path + "/" + file;
-        cv::Mat inImage = cv::imread(f.toStdString(), cv::IMREAD_GRAYSCALE);
 
          ImageCommon::displayMat(inImage, true, "Input image");
 
@@ -116,6 +228,7 @@ int main(int argc, char** argv)
         // -------------------------------------------------------------------
         // -------------------------------------------------------------------
 
+        if (PROFILE_EVERY_NTH_FRAME > 0) Profiler::report(peak);
         return 0;
 
         QVector<cv::Mat> cards = cardDetector.detectCards(procImage);
@@ -125,91 +238,120 @@ int main(int argc, char** argv)
             return 0;
         }
 
-        // ---- UNIFY SIZE OF THE CARDS
-        int uniDim = qMax(procImage.rows, procImage.cols)*(cardSizeMinRatio + cardSizeMaxRatio)/2.0;
+        // ---- ADAPT CARD RESOLUTIONS TO THEIR SYMBOL SIZES AND EXTRACT OBJECTS OF ALL CARDS
+        DGV::ObjectTable objects;
+        QVector<cv::Mat> uniCards = cardDetector.adaptiveSize(cards, &objects);
 
+        // ---- MATCH SHAPES BETWEEN TWO CARD
 
-        SD_TRACE(QString("Uniform size : %1, %2").arg(uniDim).arg(uniDim));
-        QVector<cv::Mat> uniCards = cardDetector.uniformSize(cards, uniDim);
+        DGV::BasicPairsDetector * pairsDetector = new DGV::BasicPairsDetector(0.29, 10, false);
 
-        // ---- EXTRACT OBJECTS AND MATCH SHAPES BETWEEN TWO CARD
+        // Features are computed only for the objects reached by the comparisons below
+        DGV::FeatureCache featureCache(pairsDetector->getExtractor());
+        featureCache.setCards(uniCards, &objects);
 
-        DGV::PairsDetector * pairsDetector = new DGV::BasicPairsDetector(0.29, 10, false);
-
-        // VERBOSE = true;
-        while (!uniCards.isEmpty())
+        // Objects are labelled with the catalog symbols : cards with two labelled objects are
+        // identified by the deck model
+        DGV::SymbolCatalog catalog(pairsDetector->getExtractor());
+        QVector<int> cardIds;
+        if (catalog.load(QDir(path).filePath(CATALOG_DIR)))
         {
+            int labelled = catalog.labelObjects(*pairsDetector, featureCache, &objects);
+            SD_TRACE2("Objects labelled with the catalog symbols : %1 out of %2", labelled, objects.objects.size());
+        }
+        catalog.deck().resolveCards(objects, &cardIds);
 
-            // TAKE ONE CARD
-            cv::Mat cardOne = uniCards.takeFirst();
-            if (uniCards.isEmpty()) break;
-
-            QVector<std::vector<cv::Point> > oContours1;
-            cardDetector.extractObjects(cardOne, &oContours1);
-            ImageCommon::displayContours(oContours1.toStdVector(), cardOne, false, true, "Card 1");
+        // Pairs implied by the previous matches (symbol clusters) are not compared
+        DGV::PairPlanner planner;
+        planner.reset(objects);
 
-            // TAKE ANOTHER CARD
-            foreach (cv::Mat cardTwo, uniCards)
+        // VERBOSE = true;
+        int c1, c2;
+        while (planner.nextPair(&c1, &c2))
+        {
+            int offset1 = objects.cardOffsets[c1];
+            int offset2 = objects.cardOffsets[c2];
+
+            // BOTH CARDS ARE IDENTIFIED AND THE COMMON SYMBOL IS LABELLED -> NO MATCHING
+            // Otherwise fall back to descriptor matching
+            int matchIndices[2] = {-1, -1};
+            int object1, object2;
+            bool labelled = catalog.deck().commonObjects(objects, cardIds, c1, c2, &object1, &object2);
+            if (labelled)
             {
+                matchIndices[0] = object1 - offset1;
+                matchIndices[1] = object2 - offset2;
+                SD_TRACE3("Cards %1 and %2 share the symbol %3", cardIds[c1], cardIds[c2], objects.objects[object1].label);
+            }
 
-                QVector<std::vector<cv::Point> > oContours2;
-                cardDetector.extractObjects(cardTwo, &oContours2);
-                ImageCommon::displayContours(oContours2.toStdVector(), cardTwo, false, true, "Card 2");
-
-
-                // LOOP ON THE OBJECTS FROM THE CARD ONE:
-                StartTimer("Compare two cards");
-                int matchIndices[2] = {-1, -1};
-                for (int i=0;i<oContours1.size();i++)
+            // LOOP ON THE OBJECTS FROM THE CARD ONE:
+            StartTimer("Compare two cards");
+            for (int i=0;!labelled && i<objects.objectCount(c1);i++)
+            {
+                if (!pairsDetector->setupRefObject(featureCache, offset1 + i))
                 {
-                    cv::Mat objectOneMask = cardDetector.getObjectMask(cardOne, oContours1[i]);
-                    if (!pairsDetector->setupRefObject(cardOne, objectOneMask))
-                    {
-                        SD_TRACE1("Failed to setup reference object %1", i);
-                        continue;
-                    }
+                    SD_TRACE1("Failed to setup reference object %1", i);
+                    continue;
+                }
 
-                    bool matchFound=false;
+                bool matchFound=false;
 
-                    // LOOP ON THE OBJECTS OF THE CARD TWO
-                    for (int j=0;j<oContours2.size();j++)
-                    {
+                // LOOP ON THE OBJECTS OF THE CARD TWO
+                for (int j=0;j<objects.objectCount(c2);j++)
+                {
 
-                        cv::Mat objectTwoMask = cardDetector.getObjectMask(cardTwo, oContours2[j]);
-                        matchFound = pairsDetector->matchWithRefObject(cardTwo, objectTwoMask);
+                    matchFound = pairsDetector->matchWithRefObject(featureCache, offset2 + j);
 
 
-                        // IF MATCH IS FOUND -> NO NEED TO COMPARE THESE CARDS
-                        if (matchFound)
-                        {
-                            matchIndices[0] = i;
-                            matchIndices[1] = j;
-                            break;
-                        }
-                    }
-                    // Stop compare other objects if match is found
+                    // IF MATCH IS FOUND -> NO NEED TO COMPARE THESE CARDS
                     if (matchFound)
                     {
+                        matchIndices[0] = i;
+                        matchIndices[1] = j;
                         break;
                     }
                 }
-                StopTimer();
+                // Stop compare other objects if match is found
+                if (matchFound)
+                {
+                    break;
+                }
+            }
+            StopTimer();
+
+            if (matchIndices[0] >= 0 && matchIndices[1] >= 0)
+                planner.setResult(c1, c2, offset1 + matchIndices[0], offset2 + matchIndices[1]);
+            else
+                planner.setResult(c1, c2, -1, -1);
+        }
 
-                if (matchIndices[0] >= 0 && matchIndices[1] >= 0)
+        // Matched and inferred pairs
+        for (c1=0; c1<planner.cardCount(); c1++)
+        {
+            for (c2=c1+1; c2<planner.cardCount(); c2++)
+            {
+                int object1, object2;
+                if (planner.commonObjects(c1, c2, &object1, &object2))
                 {
-                    SD_TRACE2("Match found between object %1 on the 1st card and object %2 on the second card", matchIndices[0], matchIndices[1]);
-                    cv::Mat objectOneMask = cardDetector.getObjectMask(cardOne, oContours1[matchIndices[0]]);
-                    cv::Mat objectTwoMask = cardDetector.getObjectMask(cardTwo, oContours2[matchIndices[1]]);
-                    ImageCommon::displayMat(cardOne.mul(objectOneMask), false, "Matched object 1", false);
-                    ImageCommon::displayMat(cardTwo.mul(objectTwoMask), false, "Matched object 2", true);
+                    SD_TRACE4("Match found between object %1 on the card %2 and object %3 on the card %4",
+                              object1 - objects.cardOffsets[c1], c1, object2 - objects.cardOffsets[c2], c2);
+                    if (planner.state(c1, c2) == DGV::PairPlanner::INFERRED) SD_TRACE("  (inferred)");
+                    // Displayed without margin
+                    DGV::ObjectView objectOne = featureCache.objectView(object1, 0);
+                    DGV::ObjectView objectTwo = featureCache.objectView(object2, 0);
+                    ImageCommon::displayMat(objectOne.image.mul(objectOne.mask), false, "Matched object 1", false);
+                    ImageCommon::displayMat(objectTwo.image.mul(objectTwo.mask), false, "Matched object 2", true);
                 } else {
-                    SD_TRACE("No matches found");
+                    SD_TRACE2("No matches found between the cards %1 and %2", c1, c2);
                 }
             }
         }
+        SD_TRACE2("Pairs matched : %1, inferred : %2", planner.matchedCount(), planner.inferredCount());
 
+        SD_TRACE2("Features computed for %1 objects out of %2", featureCache.computedObjectCount(), objects.objects.size());
         delete pairsDetector;
 
+        if (PROFILE_EVERY_NTH_FRAME > 0) Profiler::report(peak);
         return 0;
     }
 
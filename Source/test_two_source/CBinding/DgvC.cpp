@@ -0,0 +1,225 @@
+
+// Std
+#include <vector>
+#include <string.h>
+
+// Opencv
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+// Project
+#include "Core/Global.h"
+#include "Pipeline.h"
+#include "DgvC.h"
+
+//******************************************************************************
+
+struct dgv_context
+{
+    dgv_context(const dgv_params & params) :
+        pipeline(params.card_size_min_ratio, params.card_size_max_ratio, params.frame_size_limit, false)
+    {}
+
+    DGV::Pipeline pipeline;
+    DGV::FrameResult frame;
+
+    // Flat result of the last frame. Vectors keep their capacity between frames
+    std::vector<dgv_card> cards;
+    std::vector<dgv_object> objects;
+    std::vector<dgv_point> points;
+};
+
+//******************************************************************************
+
+namespace
+{
+
+dgv_rect toRect(const cv::Rect & r)
+{
+    dgv_rect out;
+    out.x = r.x;
+    out.y = r.y;
+    out.width = r.width;
+    out.height = r.height;
+    return out;
+}
+
+//******************************************************************************
+
+void flatten(dgv_context * context)
+{
+    const DGV::FrameResult & frame = context->frame;
+    context->cards.clear();
+    context->objects.clear();
+    context->points.clear();
+
+    std::vector<cv::Point> framePoints;
+    for (int i=0; i<frame.cardContours.size(); i++)
+    {
+        dgv_card card;
+        card.contour_offset = (int) context->points.size();
+        const std::vector<cv::Point> & contour = frame.cardContours[i];
+        framePoints.resize(contour.size());
+        for (size_t k=0; k<contour.size(); k++)
+        {
+            framePoints[k] = frame.toFrame(contour[k]);
+            dgv_point p = { framePoints[k].x, framePoints[k].y };
+            context->points.push_back(p);
+        }
+        card.contour_length = (int) contour.size();
+        card.bbox = toRect(cv::boundingRect(framePoints));
+        card.object_offset = (int) context->objects.size();
+        card.object_count = i < frame.objects.cardCount() ? frame.objects.objectCount(i) : 0;
+
+        for (int j=0; j<card.object_count; j++)
+        {
+            const DGV::ObjectTable::Object & o = frame.objects.objects[frame.objects.cardOffsets[i] + j];
+            dgv_object object;
+            object.card_id = i;
+            object.contour_offset = (int) context->points.size();
+            framePoints.resize(o.contourLength);
+            for (int k=0; k<o.contourLength; k++)
+            {
+                framePoints[k] = frame.cardToFrame(i, frame.objects.points[o.contourOffset + k]);
+                dgv_point p = { framePoints[k].x, framePoints[k].y };
+                context->points.push_back(p);
+            }
+            object.contour_length = o.contourLength;
+            object.bbox = toRect(cv::boundingRect(framePoints));
+            context->objects.push_back(object);
+        }
+        context->cards.push_back(card);
+    }
+}
+
+}
+
+//******************************************************************************
+
+int dgv_api_version(void)
+{
+    return DGV_C_API_VERSION;
+}
+
+//******************************************************************************
+
+const char * dgv_status_string(dgv_status status)
+{
+    switch (status)
+    {
+    case DGV_OK: return "ok";
+    case DGV_ERROR_INVALID_ARGUMENT: return "invalid argument";
+    case DGV_ERROR_INSUFFICIENT_CAPACITY: return "insufficient capacity";
+    case DGV_ERROR_INTERNAL: return "internal error";
+    }
+    return "unknown status";
+}
+
+//******************************************************************************
+
+void dgv_params_default(dgv_params *params)
+{
+    if (!params)
+        return;
+    params->card_size_min_ratio = 0.15;
+    params->card_size_max_ratio = 1.0;
+    params->frame_size_limit = 700;
+}
+
+//******************************************************************************
+
+dgv_context * dgv_context_create(const dgv_params *params)
+{
+    dgv_params p;
+    dgv_params_default(&p);
+    if (params)
+        p = *params;
+
+    try
+    {
+        return new dgv_context(p);
+    }
+    catch (...)
+    {
+        return 0;
+    }
+}
+
+//******************************************************************************
+
+void dgv_context_destroy(dgv_context *context)
+{
+    delete context;
+}
+
+//******************************************************************************
+
+dgv_status dgv_process_frame(dgv_context *context, const dgv_image *image, dgv_frame_result *result)
+{
+    if (!context || !image || !result || !image->data ||
+            image->width <= 0 || image->height <= 0 ||
+            (image->channels != 1 && image->channels != 3 && image->channels != 4) ||
+            image->stride < image->width * image->channels)
+    {
+        return DGV_ERROR_INVALID_ARGUMENT;
+    }
+
+    try
+    {
+        // Wrap caller data without copy. The pipeline never writes into the input
+        cv::Mat frame(image->height, image->width, CV_8UC(image->channels),
+                      const_cast<unsigned char*>(image->data), image->stride);
+
+        if (!context->pipeline.processFrame(frame, &context->frame))
+            return DGV_ERROR_INTERNAL;
+        flatten(context);
+    }
+    catch (const cv::Exception & e)
+    {
+        SD_TRACE1("dgv_process_frame : %1", QString::fromStdString(e.what()));
+        return DGV_ERROR_INTERNAL;
+    }
+    catch (...)
+    {
+        return DGV_ERROR_INTERNAL;
+    }
+
+    return dgv_fetch_result(context, result);
+}
+
+//******************************************************************************
+
+dgv_status dgv_fetch_result(dgv_context *context, dgv_frame_result *result)
+{
+    if (!context || !result)
+        return DGV_ERROR_INVALID_ARGUMENT;
+
+    result->cards_count = (int) context->cards.size();
+    result->objects_count = (int) context->objects.size();
+    result->points_count = (int) context->points.size();
+
+    if (result->cards_count > result->cards_capacity ||
+            result->objects_count > result->objects_capacity ||
+            result->points_count > result->points_capacity)
+    {
+        return DGV_ERROR_INSUFFICIENT_CAPACITY;
+    }
+
+    if ((result->cards_count > 0 && !result->cards) ||
+            (result->objects_count > 0 && !result->objects) ||
+            (result->points_count > 0 && !result->points))
+    {
+        return DGV_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (result->cards_count > 0)
+        memcpy(result->cards, &context->cards[0], result->cards_count * sizeof(dgv_card));
+    if (result->objects_count > 0)
+        memcpy(result->objects, &context->objects[0], result->objects_count * sizeof(dgv_object));
+    if (result->points_count > 0)
+        memcpy(result->points, &context->points[0], result->points_count * sizeof(dgv_point));
+
+    return DGV_OK;
+}
+
+//******************************************************************************
@@ -0,0 +1,128 @@
+#ifndef DGVC_H
+#define DGVC_H
+
+/*
+ * Plain C interface of Dobble Game Vision.
+ *
+ * The interface does not expose Qt, OpenCV or C++ types. Images are given as raw pointers with
+ * a row stride and results are written into arrays owned by the caller. When an array is too
+ * small, dgv_process_frame returns DGV_ERROR_INSUFFICIENT_CAPACITY and sets the *_count fields
+ * to the required sizes. The caller can then grow the arrays and fetch the same result with
+ * dgv_fetch_result, without processing the frame again. Arrays can be reused from frame to frame,
+ * so in steady state no memory is allocated on the caller side.
+ *
+ * Contexts are not thread safe : use one context per thread.
+ *
+ * Example :
+ *
+ *  dgv_context * ctx = dgv_context_create(NULL);
+ *  dgv_frame_result res = {0};
+ *  dgv_status status = dgv_process_frame(ctx, &image, &res);
+ *  if (status == DGV_ERROR_INSUFFICIENT_CAPACITY) {
+ *      grow(&res); // cards_capacity >= cards_count, etc
+ *      status = dgv_fetch_result(ctx, &res);
+ *  }
+ *  dgv_context_destroy(ctx);
+ */
+
+#include "Export.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* ************************************************************************** */
+
+#define DGV_C_API_VERSION 1
+
+typedef enum dgv_status
+{
+    DGV_OK = 0,
+    DGV_ERROR_INVALID_ARGUMENT = 1,
+    DGV_ERROR_INSUFFICIENT_CAPACITY = 2,
+    DGV_ERROR_INTERNAL = 3
+} dgv_status;
+
+typedef struct dgv_context dgv_context;
+
+typedef struct dgv_params
+{
+    double card_size_min_ratio;  /* minimal card size as a fraction of the frame size */
+    double card_size_max_ratio;  /* maximal card size as a fraction of the frame size */
+    int frame_size_limit;        /* frames are downscaled to this max dimension, 0 to disable */
+} dgv_params;
+
+typedef struct dgv_image
+{
+    const unsigned char * data;
+    int width;
+    int height;
+    int stride;                  /* bytes per row */
+    int channels;                /* 1 (gray), 3 (BGR) or 4 (BGRA) */
+} dgv_image;
+
+typedef struct dgv_point
+{
+    int x;
+    int y;
+} dgv_point;
+
+typedef struct dgv_rect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+} dgv_rect;
+
+/* All coordinates are given in the input frame coordinates */
+
+typedef struct dgv_card
+{
+    dgv_rect bbox;
+    int contour_offset;          /* first point of the card contour in points array */
+    int contour_length;
+    int object_offset;           /* first object of the card in objects array */
+    int object_count;
+} dgv_card;
+
+typedef struct dgv_object
+{
+    int card_id;                 /* index in cards array */
+    dgv_rect bbox;
+    int contour_offset;          /* first point of the object contour in points array */
+    int contour_length;
+} dgv_object;
+
+typedef struct dgv_frame_result
+{
+    dgv_card * cards;
+    int cards_capacity;
+    int cards_count;
+
+    dgv_object * objects;
+    int objects_capacity;
+    int objects_count;
+
+    dgv_point * points;
+    int points_capacity;
+    int points_count;
+} dgv_frame_result;
+
+int DGV_C_EXPORT dgv_api_version(void);
+const char * DGV_C_EXPORT dgv_status_string(dgv_status status);
+
+void DGV_C_EXPORT dgv_params_default(dgv_params * params);
+
+/* params can be NULL to use default parameters. Returns NULL on failure */
+dgv_context * DGV_C_EXPORT dgv_context_create(const dgv_params * params);
+void DGV_C_EXPORT dgv_context_destroy(dgv_context * context);
+
+dgv_status DGV_C_EXPORT dgv_process_frame(dgv_context * context, const dgv_image * image, dgv_frame_result * result);
+dgv_status DGV_C_EXPORT dgv_fetch_result(dgv_context * context, dgv_frame_result * result);
+
+/* ************************************************************************** */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DGVC_H */
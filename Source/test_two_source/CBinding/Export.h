@@ -0,0 +1,16 @@
+#ifndef DGVC_EXPORT_H
+#define DGVC_EXPORT_H
+
+/* ************************************************************************** */
+/* DLL Export definitions */
+/* ************************************************************************** */
+#if (defined WIN32 || defined _WIN32 || defined WINCE) && defined C_API_EXPORT
+#  define DGV_C_EXPORT __declspec(dllexport)
+#elif (defined WIN32 || defined _WIN32 || defined WINCE)
+#  define DGV_C_EXPORT __declspec(dllimport)
+#else
+#  define DGV_C_EXPORT
+#endif
+
+
+#endif /* DGVC_EXPORT_H */
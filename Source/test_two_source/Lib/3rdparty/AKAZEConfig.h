@@ -16,6 +16,12 @@ namespace cv
 /// AKAZE configuration options structure
 struct AKAZEOptions {
 
+    /// Scheme of the nonlinear diffusion steps
+    enum DiffusionScheme {
+        DIFFUSION_FED = 0,          ///< Explicit Fast Explicit Diffusion cycles
+        DIFFUSION_AOS = 1           ///< Semi-implicit additive operator splitting steps
+    };
+
     AKAZEOptions()
         : omax(4)
         , nsublevels(4)
@@ -25,6 +31,8 @@ struct AKAZEOptions {
         , derivative_factor(1.5f)
         , sderivatives(1.0)
         , diffusivity(KAZE::DIFF_PM_G2)
+        , diffusion_scheme(DIFFUSION_FED)
+        , aos_max_step(4.0f)
 
         , dthreshold(0.001f)
         , min_dthreshold(0.00001f)
@@ -48,6 +56,8 @@ struct AKAZEOptions {
     float derivative_factor;        ///< Factor for the multiscale derivatives
     float sderivatives;             ///< Smoothing factor for the derivatives
     int diffusivity;   ///< Diffusivity type
+    int diffusion_scheme;           ///< Diffusion scheme (DiffusionScheme)
+    float aos_max_step;             ///< Maximum time step of the AOS scheme
 
     float dthreshold;               ///< Detector response threshold to accept point
     float min_dthreshold;           ///< Minimum detector threshold to accept a point
@@ -13,6 +13,7 @@
 #include "utils.h"
 
 #include <iostream>
+#include <map>
 
 
 /* IEEE754 constants and macros */
@@ -66,7 +67,16 @@ void AKAZEFeatures::Allocate_Memory_Evolution(void) {
   float rfactor = 0.0f;
   int level_height = 0, level_width = 0;
 
-  // Allocate the dimension of the matrices for the evolution
+  // Only the upright M-LDB subset descriptor with the intensity channel does not read Lx, Ly.
+  // The full descriptors (descriptor_size == 0) always read the three channels
+  keep_derivatives_ = !(options_.descriptor == AKAZE::DESCRIPTOR_MLDB_UPRIGHT && options_.descriptor_channels < 2 &&
+                        options_.descriptor_size > 0);
+
+  // Derivative kernels are computed once per derivative size
+  std::map<int, std::pair<Mat, Mat> > kernels;
+
+  // Allocate the dimension of the matrices for the evolution. The derivative and detector
+  // planes are allocated when they are computed
   for (int i = 0, power = 1; i <= options_.omax - 1; i++, power *= 2) {
     rfactor = 1.0f / power;
     level_height = (int)(options_.img_height*rfactor);
@@ -80,19 +90,20 @@ void AKAZEFeatures::Allocate_Memory_Evolution(void) {
 
     for (int j = 0; j < options_.nsublevels; j++) {
       TEvolution step;
-      step.Lx = Mat::zeros(level_height, level_width, CV_32F);
-      step.Ly = Mat::zeros(level_height, level_width, CV_32F);
-      step.Lxx = Mat::zeros(level_height, level_width, CV_32F);
-      step.Lxy = Mat::zeros(level_height, level_width, CV_32F);
-      step.Lyy = Mat::zeros(level_height, level_width, CV_32F);
       step.Lt = Mat::zeros(level_height, level_width, CV_32F);
-      step.Ldet = Mat::zeros(level_height, level_width, CV_32F);
       step.Lsmooth = Mat::zeros(level_height, level_width, CV_32F);
       step.esigma = options_.soffset*pow(2.f, (float)(j) / (float)(options_.nsublevels) + i);
       step.sigma_size = fRound(step.esigma);
       step.etime = 0.5f*(step.esigma*step.esigma);
       step.octave = i;
       step.sublevel = j;
+      step.derivative_size = fRound(step.esigma * options_.derivative_factor / power);
+      if (kernels.find(step.derivative_size) == kernels.end()) {
+        compute_derivative_kernels(kernels[step.derivative_size].first, kernels[step.derivative_size].second,
+                                   1, 0, step.derivative_size);
+      }
+      step.Kderiv = kernels[step.derivative_size].first;
+      step.Ksmooth = kernels[step.derivative_size].second;
       evolution_.push_back(step);
     }
   }
@@ -103,7 +114,14 @@ void AKAZEFeatures::Allocate_Memory_Evolution(void) {
     vector<float> tau;
     float ttime = 0.0f;
     ttime = evolution_[i].etime - evolution_[i - 1].etime;
-    naux = fed_tau_by_process_time(ttime, 1, 0.25f, reordering_, tau);
+    if (options_.diffusion_scheme == AKAZEOptions::DIFFUSION_AOS) {
+      // Semi-implicit steps are stable for any step size: equal steps bounded for accuracy
+      naux = std::max(1, (int)ceil(ttime / options_.aos_max_step));
+      tau.assign(naux, ttime / naux);
+    }
+    else {
+      naux = fed_tau_by_process_time(ttime, 1, 0.25f, reordering_, tau);
+    }
     nsteps_.push_back(naux);
     tsteps_.push_back(tau);
     ncycles_++;
@@ -125,9 +143,10 @@ int AKAZEFeatures::Create_Nonlinear_Scale_Space(const Mat& img)
   gaussian_2D_convolution(evolution_[0].Lt, evolution_[0].Lt, 0, 0, options_.soffset);
   evolution_[0].Lt.copyTo(evolution_[0].Lsmooth);
 
-  // Allocate memory for the flow and step images
+  // Allocate memory for the flow, step and gradient images
   Mat Lflow = Mat::zeros(evolution_[0].Lt.rows, evolution_[0].Lt.cols, CV_32F);
   Mat Lstep = Mat::zeros(evolution_[0].Lt.rows, evolution_[0].Lt.cols, CV_32F);
+  Mat Lx, Ly;
 
   // First compute the kcontrast factor
   options_.kcontrast = compute_k_percentile(img, options_.kcontrast_percentile, 1.0f, options_.kcontrast_nbins, 0, 0);
@@ -150,31 +169,46 @@ int AKAZEFeatures::Create_Nonlinear_Scale_Space(const Mat& img)
     gaussian_2D_convolution(evolution_[i].Lt, evolution_[i].Lsmooth, 0, 0, 1.0f);
 
     // Compute the Gaussian derivatives Lx and Ly
-    image_derivatives_scharr(evolution_[i].Lsmooth, evolution_[i].Lx, 1, 0);
-    image_derivatives_scharr(evolution_[i].Lsmooth, evolution_[i].Ly, 0, 1);
+    image_derivatives_scharr(evolution_[i].Lsmooth, Lx, 1, 0);
+    image_derivatives_scharr(evolution_[i].Lsmooth, Ly, 0, 1);
+
+    // With a derivative size of 1, the multiscale derivatives of Lsmooth are the normalized
+    // Scharr derivatives (1/32 of the Scharr kernel) : keep them
+    evolution_[i].conductivity_derivatives = evolution_[i].derivative_size == 1;
+    if (evolution_[i].conductivity_derivatives) {
+      Lx.convertTo(evolution_[i].Lx, CV_32F, 1.0 / 32.0);
+      Ly.convertTo(evolution_[i].Ly, CV_32F, 1.0 / 32.0);
+    }
 
     // Compute the conductivity equation
     switch (options_.diffusivity) {
       case KAZE::DIFF_PM_G1:
-        pm_g1(evolution_[i].Lx, evolution_[i].Ly, Lflow, options_.kcontrast);
+        pm_g1(Lx, Ly, Lflow, options_.kcontrast);
       break;
       case KAZE::DIFF_PM_G2:
-        pm_g2(evolution_[i].Lx, evolution_[i].Ly, Lflow, options_.kcontrast);
+        pm_g2(Lx, Ly, Lflow, options_.kcontrast);
       break;
       case KAZE::DIFF_WEICKERT:
-        weickert_diffusivity(evolution_[i].Lx, evolution_[i].Ly, Lflow, options_.kcontrast);
+        weickert_diffusivity(Lx, Ly, Lflow, options_.kcontrast);
       break;
       case KAZE::DIFF_CHARBONNIER:
-        charbonnier_diffusivity(evolution_[i].Lx, evolution_[i].Ly, Lflow, options_.kcontrast);
+        charbonnier_diffusivity(Lx, Ly, Lflow, options_.kcontrast);
       break;
       default:
         CV_Error(options_.diffusivity, "Diffusivity is not supported");
       break;
     }
 
-    // Perform FED n inner steps
-    for (int j = 0; j < nsteps_[i - 1]; j++) {
-      nld_step_scalar(evolution_[i].Lt, Lflow, Lstep, tsteps_[i - 1][j]);
+    // Perform n inner steps (FED cycle or AOS steps)
+    if (options_.diffusion_scheme == AKAZEOptions::DIFFUSION_AOS) {
+      for (int j = 0; j < nsteps_[i - 1]; j++) {
+        nld_step_aos(evolution_[i].Lt, Lflow, tsteps_[i - 1][j]);
+      }
+    }
+    else {
+      for (int j = 0; j < nsteps_[i - 1]; j++) {
+        nld_step_scalar(evolution_[i].Lt, Lflow, Lstep, tsteps_[i - 1][j]);
+      }
     }
   }
 
@@ -190,98 +224,122 @@ void AKAZEFeatures::Feature_Detection(std::vector<KeyPoint>& kpts)
 {
   kpts.clear();
   Compute_Determinant_Hessian_Response();
-  Find_Scale_Space_Extrema(kpts);
-  Do_Subpixel_Refinement(kpts);
+  Find_Scale_Space_Extrema(points_);
+  Do_Subpixel_Refinement(points_);
+  points_.toKeyPoints(kpts);
 }
 
 /* ************************************************************************* */
+/**
+ * @brief Computes the multiscale derivatives and the detector response of the levels.
+ * Second order derivatives are only needed by the detector response : they are computed into
+ * buffers of the invoker and the determinant is computed in the same pass.
+ */
 class MultiscaleDerivativesAKAZEInvoker : public ParallelLoopBody
 {
 public:
-    explicit MultiscaleDerivativesAKAZEInvoker(std::vector<TEvolution>& ev, const AKAZEOptions& opt)
+    explicit MultiscaleDerivativesAKAZEInvoker(std::vector<TEvolution>& ev, bool keep_derivatives)
     : evolution_(&ev)
-    , options_(opt)
+    , keep_derivatives_(keep_derivatives)
   {
   }
 
   void operator()(const Range& range) const
   {
     std::vector<TEvolution>& evolution = *evolution_;
+    Mat Lx, Ly, Lxx, Lxy, Lyy;
 
     for (int i = range.start; i < range.end; i++)
     {
-        float ratio = (float)fastpow(2, evolution[i].octave);
-      int sigma_size_ = fRound(evolution[i].esigma * options_.derivative_factor / ratio);
-
-      compute_scharr_derivatives(evolution[i].Lsmooth, evolution[i].Lx, 1, 0, sigma_size_);
-      compute_scharr_derivatives(evolution[i].Lsmooth, evolution[i].Ly, 0, 1, sigma_size_);
-      compute_scharr_derivatives(evolution[i].Lx, evolution[i].Lxx, 1, 0, sigma_size_);
-      compute_scharr_derivatives(evolution[i].Ly, evolution[i].Lyy, 0, 1, sigma_size_);
-      compute_scharr_derivatives(evolution[i].Lx, evolution[i].Lxy, 0, 1, sigma_size_);
-
-      evolution[i].Lx = evolution[i].Lx*((sigma_size_));
-      evolution[i].Ly = evolution[i].Ly*((sigma_size_));
-      evolution[i].Lxx = evolution[i].Lxx*((sigma_size_)*(sigma_size_));
-      evolution[i].Lxy = evolution[i].Lxy*((sigma_size_)*(sigma_size_));
-      evolution[i].Lyy = evolution[i].Lyy*((sigma_size_)*(sigma_size_));
+      TEvolution& e = evolution[i];
+      int sigma_size_ = e.derivative_size;
+
+      // First order derivatives, in the level planes if the descriptor reads them
+      if (e.conductivity_derivatives) {
+        Lx = e.Lx;
+        Ly = e.Ly;
+      }
+      else {
+        Mat& dx = keep_derivatives_ ? e.Lx : Lx;
+        Mat& dy = keep_derivatives_ ? e.Ly : Ly;
+        sepFilter2D(e.Lsmooth, dx, CV_32F, e.Kderiv, e.Ksmooth);
+        sepFilter2D(e.Lsmooth, dy, CV_32F, e.Ksmooth, e.Kderiv);
+        Lx = dx;
+        Ly = dy;
+      }
+      sepFilter2D(Lx, Lxx, CV_32F, e.Kderiv, e.Ksmooth);
+      sepFilter2D(Ly, Lyy, CV_32F, e.Ksmooth, e.Kderiv);
+      sepFilter2D(Lx, Lxy, CV_32F, e.Ksmooth, e.Kderiv);
+
+      // Detector response
+      float s2 = (float)(sigma_size_*sigma_size_);
+      e.Ldet.create(e.Lt.rows, e.Lt.cols, CV_32F);
+      for (int ix = 0; ix < e.Ldet.rows; ix++)
+      {
+        const float* lxx = Lxx.ptr<float>(ix);
+        const float* lxy = Lxy.ptr<float>(ix);
+        const float* lyy = Lyy.ptr<float>(ix);
+        float* det = e.Ldet.ptr<float>(ix);
+        for (int jx = 0; jx < e.Ldet.cols; jx++)
+        {
+          float a = lxx[jx]*s2, b = lxy[jx]*s2, c = lyy[jx]*s2;
+          det[jx] = a*c - b*b;
+        }
+      }
+
+      if (keep_derivatives_) {
+        e.Lx = e.Lx*((sigma_size_));
+        e.Ly = e.Ly*((sigma_size_));
+      }
+      else {
+        e.Lx.release();
+        e.Ly.release();
+      }
     }
   }
 
 private:
   std::vector<TEvolution>*  evolution_;
-  AKAZEOptions              options_;
+  bool                      keep_derivatives_;
 };
 
 /* ************************************************************************* */
 /**
  * @brief This method computes the multiscale derivatives for the nonlinear scale space
+ * and the feature detector response
  */
 void AKAZEFeatures::Compute_Multiscale_Derivatives(void)
 {
   parallel_for_(Range(0, (int)evolution_.size()),
-                                        MultiscaleDerivativesAKAZEInvoker(evolution_, options_));
+                                        MultiscaleDerivativesAKAZEInvoker(evolution_, keep_derivatives_));
 }
 
 /* ************************************************************************* */
 /**
  * @brief This method computes the feature detector response for the nonlinear scale space
- * @note We use the Hessian determinant as the feature detector response
+ * @note We use the Hessian determinant as the feature detector response, computed with the
+ * multiscale derivatives
  */
 void AKAZEFeatures::Compute_Determinant_Hessian_Response(void) {
-
-  // Firstly compute the multiscale derivatives
   Compute_Multiscale_Derivatives();
-
-  for (size_t i = 0; i < evolution_.size(); i++)
-  {
-    for (int ix = 0; ix < evolution_[i].Ldet.rows; ix++)
-    {
-      for (int jx = 0; jx < evolution_[i].Ldet.cols; jx++)
-      {
-        float lxx = *(evolution_[i].Lxx.ptr<float>(ix)+jx);
-        float lxy = *(evolution_[i].Lxy.ptr<float>(ix)+jx);
-        float lyy = *(evolution_[i].Lyy.ptr<float>(ix)+jx);
-        *(evolution_[i].Ldet.ptr<float>(ix)+jx) = (lxx*lyy - lxy*lxy);
-      }
-    }
-  }
 }
 
 /* ************************************************************************* */
 /**
  * @brief This method finds extrema in the nonlinear scale space
- * @param kpts Vector of detected keypoints
+ * @param kpts Detected keypoints (positions in image coordinates)
  */
-void AKAZEFeatures::Find_Scale_Space_Extrema(std::vector<KeyPoint>& kpts)
+void AKAZEFeatures::Find_Scale_Space_Extrema(KeyPointBuffer& kpts)
 {
 
   float value = 0.0;
-  float dist = 0.0, ratio = 0.0, smax = 0.0;
-  int npoints = 0, id_repeated = 0;
+  float dist = 0.0, ratio = 0.0, smax = 0.0, size = 0.0;
+  int id_repeated = 0;
   int sigma_size_ = 0, left_x = 0, right_x = 0, up_y = 0, down_y = 0;
   bool is_extremum = false, is_repeated = false, is_out = false;
-  KeyPoint point;
-  vector<KeyPoint> kpts_aux;
+  KeyPointBuffer& aux = candidates_;
+  aux.clear();
+  kpts.clear();
 
   // Set maximum size
   if (options_.descriptor == AKAZE::DESCRIPTOR_MLDB_UPRIGHT || options_.descriptor == AKAZE::DESCRIPTOR_MLDB) {
@@ -292,6 +350,12 @@ void AKAZEFeatures::Find_Scale_Space_Extrema(std::vector<KeyPoint>& kpts)
   }
 
   for (size_t i = 0; i < evolution_.size(); i++) {
+    const int level = (int)i;
+    const int octave = evolution_[i].octave;
+    size = evolution_[i].esigma*options_.derivative_factor;
+    ratio = (float)fastpow(2, octave);
+    sigma_size_ = fRound(size / ratio);
+
     float* prev = evolution_[i].Ldet.ptr<float>(0);
     float* curr = evolution_[i].Ldet.ptr<float>(1);
     for (int ix = 1; ix < evolution_[i].Ldet.rows - 1; ix++) {
@@ -301,7 +365,7 @@ void AKAZEFeatures::Find_Scale_Space_Extrema(std::vector<KeyPoint>& kpts)
         is_extremum = false;
         is_repeated = false;
         is_out = false;
-        value = *(evolution_[i].Ldet.ptr<float>(ix)+jx);
+        value = curr[jx];
 
         // Filter the points with the detector threshold
         if (value > options_.dthreshold && value >= options_.min_dthreshold &&
@@ -315,25 +379,20 @@ void AKAZEFeatures::Find_Scale_Space_Extrema(std::vector<KeyPoint>& kpts)
             value > next[jx+1]) {
 
           is_extremum = true;
-          point.response = fabs(value);
-          point.size = evolution_[i].esigma*options_.derivative_factor;
-          point.octave = (int)evolution_[i].octave;
-          point.class_id = (int)i;
-          ratio = (float)fastpow(2, point.octave);
-          sigma_size_ = fRound(point.size / ratio);
-          point.pt.x = static_cast<float>(jx);
-          point.pt.y = static_cast<float>(ix);
+          float response = fabs(value);
+          float px = jx*ratio;
+          float py = ix*ratio;
 
           // Compare response with the same and lower scale
-          for (size_t ik = 0; ik < kpts_aux.size(); ik++) {
+          const size_t n = aux.count();
+          for (size_t ik = 0; ik < n; ik++) {
 
-            if ((point.class_id - 1) == kpts_aux[ik].class_id ||
-                point.class_id == kpts_aux[ik].class_id) {
-              float distx = point.pt.x*ratio - kpts_aux[ik].pt.x;
-              float disty = point.pt.y*ratio - kpts_aux[ik].pt.y;
+            if ((level - 1) == aux.level[ik] || level == aux.level[ik]) {
+              float distx = px - aux.x[ik];
+              float disty = py - aux.y[ik];
               dist = distx * distx + disty * disty;
-              if (dist <= point.size * point.size) {
-                if (point.response > kpts_aux[ik].response) {
+              if (dist <= size * size) {
+                if (response > aux.response[ik]) {
                   id_repeated = (int)ik;
                   is_repeated = true;
                 }
@@ -349,10 +408,10 @@ void AKAZEFeatures::Find_Scale_Space_Extrema(std::vector<KeyPoint>& kpts)
           if (is_extremum == true) {
 
             // Check that the point is under the image limits for the descriptor computation
-            left_x = fRound(point.pt.x - smax*sigma_size_) - 1;
-            right_x = fRound(point.pt.x + smax*sigma_size_) + 1;
-            up_y = fRound(point.pt.y - smax*sigma_size_) - 1;
-            down_y = fRound(point.pt.y + smax*sigma_size_) + 1;
+            left_x = fRound(jx - smax*sigma_size_) - 1;
+            right_x = fRound(jx + smax*sigma_size_) + 1;
+            up_y = fRound(ix - smax*sigma_size_) - 1;
+            down_y = fRound(ix + smax*sigma_size_) + 1;
 
             if (left_x < 0 || right_x >= evolution_[i].Ldet.cols ||
                 up_y < 0 || down_y >= evolution_[i].Ldet.rows) {
@@ -361,15 +420,10 @@ void AKAZEFeatures::Find_Scale_Space_Extrema(std::vector<KeyPoint>& kpts)
 
             if (is_out == false) {
               if (is_repeated == false) {
-                point.pt.x *= ratio;
-                point.pt.y *= ratio;
-                kpts_aux.push_back(point);
-                npoints++;
+                aux.push(px, py, size, response, octave, level);
               }
               else {
-                point.pt.x *= ratio;
-                point.pt.y *= ratio;
-                kpts_aux[id_repeated] = point;
+                aux.set(id_repeated, px, py, size, response, octave, level);
               }
             } // if is_out
           } //if is_extremum
@@ -381,19 +435,19 @@ void AKAZEFeatures::Find_Scale_Space_Extrema(std::vector<KeyPoint>& kpts)
   } // for i
 
   // Now filter points with the upper scale level
-  for (size_t i = 0; i < kpts_aux.size(); i++) {
+  kpts.reserve(aux.count());
+  for (size_t i = 0; i < aux.count(); i++) {
 
     is_repeated = false;
-    const KeyPoint& pt = kpts_aux[i];
-    for (size_t j = i + 1; j < kpts_aux.size(); j++) {
+    for (size_t j = i + 1; j < aux.count(); j++) {
 
       // Compare response with the upper scale
-      if ((pt.class_id + 1) == kpts_aux[j].class_id) {
-        float distx = pt.pt.x - kpts_aux[j].pt.x;
-        float disty = pt.pt.y - kpts_aux[j].pt.y;
+      if ((aux.level[i] + 1) == aux.level[j]) {
+        float distx = aux.x[i] - aux.x[j];
+        float disty = aux.y[i] - aux.y[j];
         dist = distx * distx + disty * disty;
-        if (dist <= pt.size * pt.size) {
-          if (pt.response < kpts_aux[j].response) {
+        if (dist <= aux.size[i] * aux.size[i]) {
+          if (aux.response[i] < aux.response[j]) {
             is_repeated = true;
             break;
           }
@@ -402,75 +456,125 @@ void AKAZEFeatures::Find_Scale_Space_Extrema(std::vector<KeyPoint>& kpts)
     }
 
     if (is_repeated == false)
-      kpts.push_back(pt);
+      kpts.push(aux.x[i], aux.y[i], aux.size[i], aux.response[i], aux.octave[i], aux.level[i]);
   }
 }
 
 /* ************************************************************************* */
 /**
  * @brief This method performs subpixel refinement of the detected keypoints
- * @param kpts Vector of detected keypoints
+ * @param kpts Detected keypoints, unstable keypoints are removed
+ * @note The refinement is done in three passes over the keypoints : the derivatives of the
+ * detector response are gathered, the 2x2 systems are solved for all the keypoints in a
+ * branchless loop (vectorized by the compiler), and the stable keypoints are kept in order
  */
-void AKAZEFeatures::Do_Subpixel_Refinement(std::vector<KeyPoint>& kpts)
+void AKAZEFeatures::Do_Subpixel_Refinement(KeyPointBuffer& kpts)
 {
-  float Dx = 0.0, Dy = 0.0, ratio = 0.0;
-  float Dxx = 0.0, Dyy = 0.0, Dxy = 0.0;
-  int x = 0, y = 0;
-  Matx22f A(0, 0, 0, 0);
-  Vec2f b(0, 0);
-  Vec2f dst(0, 0);
-
-  for (size_t i = 0; i < kpts.size(); i++) {
-    ratio = (float)fastpow(2, kpts[i].octave);
-    x = fRound(kpts[i].pt.x / ratio);
-    y = fRound(kpts[i].pt.y / ratio);
-
-    // Compute the gradient
-    Dx = (0.5f)*(*(evolution_[kpts[i].class_id].Ldet.ptr<float>(y)+x + 1)
-        - *(evolution_[kpts[i].class_id].Ldet.ptr<float>(y)+x - 1));
-    Dy = (0.5f)*(*(evolution_[kpts[i].class_id].Ldet.ptr<float>(y + 1) + x)
-        - *(evolution_[kpts[i].class_id].Ldet.ptr<float>(y - 1) + x));
-
-    // Compute the Hessian
-    Dxx = (*(evolution_[kpts[i].class_id].Ldet.ptr<float>(y)+x + 1)
-        + *(evolution_[kpts[i].class_id].Ldet.ptr<float>(y)+x - 1)
-        - 2.0f*(*(evolution_[kpts[i].class_id].Ldet.ptr<float>(y)+x)));
-
-    Dyy = (*(evolution_[kpts[i].class_id].Ldet.ptr<float>(y + 1) + x)
-        + *(evolution_[kpts[i].class_id].Ldet.ptr<float>(y - 1) + x)
-        - 2.0f*(*(evolution_[kpts[i].class_id].Ldet.ptr<float>(y)+x)));
-
-    Dxy = (0.25f)*(*(evolution_[kpts[i].class_id].Ldet.ptr<float>(y + 1) + x + 1)
-        + (*(evolution_[kpts[i].class_id].Ldet.ptr<float>(y - 1) + x - 1)))
-        - (0.25f)*(*(evolution_[kpts[i].class_id].Ldet.ptr<float>(y - 1) + x + 1)
-        + (*(evolution_[kpts[i].class_id].Ldet.ptr<float>(y + 1) + x - 1)));
-
-    // Solve the linear system
-    A(0, 0) = Dxx;
-    A(1, 1) = Dyy;
-    A(0, 1) = A(1, 0) = Dxy;
-    b(0) = -Dx;
-    b(1) = -Dy;
-
-    solve(A, b, dst, DECOMP_LU);
-
-    if (fabs(dst(0)) <= 1.0f && fabs(dst(1)) <= 1.0f) {
-        kpts[i].pt.x = x + dst(0);
-      kpts[i].pt.y = y + dst(1);
-      int power = fastpow(2, evolution_[kpts[i].class_id].octave);
-      kpts[i].pt.x *= power;
-      kpts[i].pt.y *= power;
-      kpts[i].angle = 0.0;
+  const size_t n = kpts.count();
+  if (n == 0)
+    return;
+
+  refinement_.resize(7 * n);
+  float* Dx = &refinement_[0];
+  float* Dy = Dx + n;
+  float* Dxx = Dy + n;
+  float* Dyy = Dxx + n;
+  float* Dxy = Dyy + n;
+  float* X = Dxy + n;
+  float* Y = X + n;
+
+  // Gradient and Hessian of the detector response at the keypoints
+  for (size_t i = 0; i < n; i++) {
+    float ratio = (float)fastpow(2, kpts.octave[i]);
+    int x = fRound(kpts.x[i] / ratio);
+    int y = fRound(kpts.y[i] / ratio);
+    const Mat& Ldet = evolution_[kpts.level[i]].Ldet;
+    const float* r0 = Ldet.ptr<float>(y - 1) + x;
+    const float* r1 = Ldet.ptr<float>(y) + x;
+    const float* r2 = Ldet.ptr<float>(y + 1) + x;
+
+    Dx[i] = (0.5f)*(r1[1] - r1[-1]);
+    Dy[i] = (0.5f)*(r2[0] - r0[0]);
+    Dxx[i] = r1[1] + r1[-1] - 2.0f*r1[0];
+    Dyy[i] = r2[0] + r0[0] - 2.0f*r1[0];
+    Dxy[i] = (0.25f)*(r2[1] + r0[-1]) - (0.25f)*(r0[1] + r2[-1]);
+    X[i] = (float)x;
+    Y[i] = (float)y;
+  }
+
+  // Solve the linear systems A * d = -D. A singular system gives a null offset (as cv::solve)
+  for (size_t i = 0; i < n; i++) {
+    float det = Dxx[i]*Dyy[i] - Dxy[i]*Dxy[i];
+    float inv = det != 0.0f ? 1.0f / det : 0.0f;
+    float ox = (Dy[i]*Dxy[i] - Dx[i]*Dyy[i])*inv;
+    float oy = (Dx[i]*Dxy[i] - Dy[i]*Dxx[i])*inv;
+    Dx[i] = ox;
+    Dy[i] = oy;
+  }
+
+  // Keep the stable points
+  size_t k = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (fabs(Dx[i]) <= 1.0f && fabs(Dy[i]) <= 1.0f) {
+      float power = (float)fastpow(2, evolution_[kpts.level[i]].octave);
+      kpts.copy(k, i);
+      kpts.x[k] = (X[i] + Dx[i]) * power;
+      kpts.y[k] = (Y[i] + Dy[i]) * power;
 
       // In OpenCV the size of a keypoint its the diameter
-      kpts[i].size *= 2.0f;
-    }
-    // Delete the point since its not stable
-    else {
-      kpts.erase(kpts.begin() + i);
-      i--;
+      kpts.size[k] *= 2.0f;
+      k++;
     }
   }
+  kpts.resize(k);
+}
+
+/* ************************************************************************* */
+// KeyPointBuffer
+
+void KeyPointBuffer::clear()
+{
+  resize(0);
+}
+
+void KeyPointBuffer::reserve(size_t n)
+{
+  x.reserve(n); y.reserve(n); size.reserve(n);
+  response.reserve(n); octave.reserve(n); level.reserve(n);
+}
+
+void KeyPointBuffer::resize(size_t n)
+{
+  x.resize(n); y.resize(n); size.resize(n);
+  response.resize(n); octave.resize(n); level.resize(n);
+}
+
+void KeyPointBuffer::push(float px, float py, float psize, float presponse, int poctave, int plevel)
+{
+  x.push_back(px); y.push_back(py); size.push_back(psize);
+  response.push_back(presponse); octave.push_back(poctave); level.push_back(plevel);
+}
+
+void KeyPointBuffer::set(size_t i, float px, float py, float psize, float presponse, int poctave, int plevel)
+{
+  x[i] = px; y[i] = py; size[i] = psize;
+  response[i] = presponse; octave[i] = poctave; level[i] = plevel;
+}
+
+void KeyPointBuffer::copy(size_t dst, size_t src)
+{
+  set(dst, x[src], y[src], size[src], response[src], octave[src], level[src]);
+}
+
+/**
+ * @brief Converts the buffer to OpenCV keypoints (angle 0, class_id is the evolution level)
+ */
+void KeyPointBuffer::toKeyPoints(std::vector<KeyPoint>& kpts) const
+{
+  kpts.resize(count());
+  for (size_t i = 0; i < count(); i++) {
+    kpts[i] = KeyPoint(x[i], y[i], size[i], 0.0f, response[i], octave[i], level[i]);
+  }
 }
 
 /* ************************************************************************* */
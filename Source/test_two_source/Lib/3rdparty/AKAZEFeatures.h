@@ -17,6 +17,27 @@
 namespace cv
 {
 
+/* ************************************************************************* */
+/// Keypoint candidates of the detection as a structure of arrays.
+/// Buffers are reused from one detection to another
+struct KeyPointBuffer
+{
+  std::vector<float> x, y;      ///< Position in image coordinates
+  std::vector<float> size;      ///< Scale
+  std::vector<float> response;  ///< Detector response
+  std::vector<int> octave;      ///< Octave of the level
+  std::vector<int> level;       ///< Evolution level (KeyPoint::class_id)
+
+  size_t count() const { return x.size(); }
+  void clear();
+  void reserve(size_t n);
+  void push(float px, float py, float psize, float presponse, int poctave, int plevel);
+  void set(size_t i, float px, float py, float psize, float presponse, int poctave, int plevel);
+  void copy(size_t dst, size_t src);
+  void resize(size_t n);
+  void toKeyPoints(std::vector<cv::KeyPoint>& kpts) const;
+};
+
 /* ************************************************************************* */
 // AKAZE Class Declaration
 class AKAZEFeatures {
@@ -25,6 +46,7 @@ private:
 
   AKAZEOptions options_;                ///< Configuration options for AKAZE
   std::vector<TEvolution> evolution_;        ///< Vector of nonlinear diffusion evolution
+  bool keep_derivatives_;        ///< Multiscale first derivatives are read by the descriptor
 
   /// FED parameters
   int ncycles_;                  ///< Number of cycles
@@ -37,6 +59,11 @@ private:
   cv::Mat descriptorBits_;
   cv::Mat bitMask_;
 
+  /// Detection buffers
+  KeyPointBuffer candidates_;   ///< Extrema of the levels
+  KeyPointBuffer points_;       ///< Detected keypoints
+  std::vector<float> refinement_; ///< Subpixel refinement : derivatives and offsets of the keypoints
+
 public:
 
   /// Constructor with input arguments
@@ -51,8 +78,8 @@ public:
   void Feature_Detection(std::vector<cv::KeyPoint>& kpts);
   void Compute_Determinant_Hessian_Response(void);
   void Compute_Multiscale_Derivatives(void);
-  void Find_Scale_Space_Extrema(std::vector<cv::KeyPoint>& kpts);
-  void Do_Subpixel_Refinement(std::vector<cv::KeyPoint>& kpts);
+  void Find_Scale_Space_Extrema(KeyPointBuffer& kpts);
+  void Do_Subpixel_Refinement(KeyPointBuffer& kpts);
 
   /// Feature description methods
   void Compute_Descriptors(std::vector<cv::KeyPoint>& kpts, cv::Mat& desc);
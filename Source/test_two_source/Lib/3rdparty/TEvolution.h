@@ -21,18 +21,22 @@ struct TEvolution
     octave = 0;
     sublevel = 0;
     sigma_size = 0;
+    derivative_size = 0;
+    conductivity_derivatives = false;
   }
 
-  Mat Lx, Ly;           ///< First order spatial derivatives
-  Mat Lxx, Lxy, Lyy;    ///< Second order spatial derivatives
+  Mat Lx, Ly;           ///< First order spatial derivatives. Allocated only if read by the descriptor
   Mat Lt;               ///< Evolution image
   Mat Lsmooth;          ///< Smoothed image
-  Mat Ldet;             ///< Detector response
+  Mat Ldet;             ///< Detector response. Allocated by the detection
+  Mat Kderiv, Ksmooth;  ///< Derivative kernels of the multiscale derivatives, shared by the levels of the same size
   float etime;              ///< Evolution time
   float esigma;             ///< Evolution sigma. For linear diffusion t = sigma^2 / 2
   int octave;               ///< Image octave
   int sublevel;             ///< Image sublevel in each octave
   int sigma_size;           ///< Integer esigma. For computing the feature detector responses
+  int derivative_size;      ///< Scale of the multiscale derivatives
+  bool conductivity_derivatives; ///< Lx, Ly are already the multiscale derivatives (computed for the conductivity)
 };
 
 }
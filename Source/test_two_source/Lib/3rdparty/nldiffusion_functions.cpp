@@ -25,6 +25,7 @@
 //#include "../precomp.hpp"
 #include "nldiffusion_functions.h"
 #include <iostream>
+#include <algorithm>
 
 // Namespaces
 
@@ -465,6 +466,144 @@ void nld_step_scalar(cv::Mat& Ld, const cv::Mat& c, cv::Mat& Lstep, float stepsi
     Ld += Lstep;
 }
 
+/* ************************************************************************* */
+/**
+* @brief Solves the tridiagonal systems of the semi-implicit diffusion along the columns
+* @note Thomas algorithm. A block of adjacent columns is solved at once, rows are processed
+* in order and the inner loops run over the contiguous columns of the block (vectorized)
+*/
+class Nld_Aos_Columns_Invoker : public cv::ParallelLoopBody
+{
+public:
+    Nld_Aos_Columns_Invoker(const cv::Mat& Ld, const cv::Mat& c, cv::Mat& U, cv::Mat& Cp, float _stepsize, int _block)
+        : _Ld(&Ld)
+        , _c(&c)
+        , _U(&U)
+        , _Cp(&Cp)
+        , stepsize(_stepsize)
+        , block(_block)
+    {
+    }
+
+    void operator()(const cv::Range& range) const
+    {
+        const cv::Mat& Ld = *_Ld;
+        const cv::Mat& c = *_c;
+        cv::Mat& U = *_U;
+        cv::Mat& Cp = *_Cp;
+        const int rows = Ld.rows;
+        // Two directions : each one is solved with twice the time step
+        const float t = 2.0f*stepsize;
+
+        for (int b = range.start; b < range.end; b++)
+        {
+            const int j0 = b*block;
+            const int j1 = std::min(j0 + block, Ld.cols);
+
+            // Forward sweep : Cp is the modified upper diagonal, U the modified right-hand side
+            // Row i : -t*gm*u[i-1] + (1 + t*(gm + gp))*u[i] - t*gp*u[i+1] = Ld[i]
+            // with gm, gp the mean conductivities with the previous and next rows (0 outside)
+            // The first row has no previous row : Cp and U are not initialized and never read there
+            {
+                const float* c_curr = c.ptr<float>(0);
+                const float* c_next = c.ptr<float>(std::min(1, rows - 1));
+                const float* ld = Ld.ptr<float>(0);
+                float* cp = Cp.ptr<float>(0);
+                float* u = U.ptr<float>(0);
+                const float fp = rows > 1 ? 0.5f*t : 0.0f;
+
+                for (int j = j0; j < j1; j++)
+                {
+                    float cc = -fp*(c_curr[j] + c_next[j]);
+                    float m = 1.0f/(1.0f - cc);
+                    cp[j] = cc*m;
+                    u[j] = ld[j]*m;
+                }
+            }
+
+            for (int i = 1; i < rows; i++)
+            {
+                const float* c_prev = c.ptr<float>(i - 1);
+                const float* c_curr = c.ptr<float>(i);
+                const float* c_next = c.ptr<float>(std::min(i + 1, rows - 1));
+                const float* ld = Ld.ptr<float>(i);
+                const float* cp_prev = Cp.ptr<float>(i - 1);
+                const float* u_prev = U.ptr<float>(i - 1);
+                float* cp = Cp.ptr<float>(i);
+                float* u = U.ptr<float>(i);
+                const float fm = 0.5f*t;
+                const float fp = i < rows - 1 ? 0.5f*t : 0.0f;
+
+                for (int j = j0; j < j1; j++)
+                {
+                    float a = -fm*(c_prev[j] + c_curr[j]);
+                    float cc = -fp*(c_curr[j] + c_next[j]);
+                    float m = 1.0f/(1.0f - a - cc - a*cp_prev[j]);
+                    cp[j] = cc*m;
+                    u[j] = (ld[j] - a*u_prev[j])*m;
+                }
+            }
+
+            // Backward substitution
+            for (int i = rows - 2; i >= 0; i--)
+            {
+                const float* cp = Cp.ptr<float>(i);
+                const float* u_next = U.ptr<float>(i + 1);
+                float* u = U.ptr<float>(i);
+                for (int j = j0; j < j1; j++)
+                    u[j] -= cp[j]*u_next[j];
+            }
+        }
+    }
+
+private:
+    const cv::Mat * _Ld;
+    const cv::Mat * _c;
+    cv::Mat * _U;
+    cv::Mat * _Cp;
+    float stepsize;
+    int block;
+};
+
+/* ************************************************************************* */
+/**
+* @brief Semi-implicit diffusion along the columns, parallel over blocks of columns
+*/
+static void nld_aos_columns(const cv::Mat& Ld, const cv::Mat& c, cv::Mat& U, cv::Mat& Cp, float stepsize) {
+
+    const int block = 64;
+    U.create(Ld.size(), CV_32F);
+    Cp.create(Ld.size(), CV_32F);
+    int nblocks = (Ld.cols + block - 1) / block;
+    cv::parallel_for_(cv::Range(0, nblocks), Nld_Aos_Columns_Invoker(Ld, c, U, Cp, stepsize, block), (double)Ld.total()/(1 << 16));
+}
+
+/* ************************************************************************* */
+/**
+* @brief This function performs a semi-implicit non-linear diffusion step (additive operator splitting)
+* @param Ld Image in the evolution, updated
+* @param c Conductivity image
+* @param stepsize The step size in time units
+* @note Ld = 1/2 * ((I - 2*stepsize*Ax)^-1 + (I - 2*stepsize*Ay)^-1) Ld, where Ax and Ay are the
+* diffusion operators along x and y with the same discretization as nld_step_scalar.
+* The scheme is stable for any step size, so a level of the scale space needs a few large steps
+* instead of many small explicit steps. Its accuracy decreases with the step size.
+* The rows are solved as the columns of the transposed images.
+*/
+void nld_step_aos(cv::Mat& Ld, const cv::Mat& c, float stepsize) {
+
+    cv::Mat Uy, Ux, Cp, LdT, cT, UxT;
+
+    nld_aos_columns(Ld, c, Uy, Cp, stepsize);
+
+    cv::transpose(Ld, LdT);
+    cv::transpose(c, cT);
+    nld_aos_columns(LdT, cT, UxT, Cp, stepsize);
+    cv::transpose(UxT, Ux);
+
+    cv::addWeighted(Ux, 0.5, Uy, 0.5, 0.0, Ld);
+}
+
 /* ************************************************************************* */
 /**
 * @brief This function downsamples the input image using OpenCV resize
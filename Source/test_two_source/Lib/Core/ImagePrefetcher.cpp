@@ -0,0 +1,680 @@
+
+// Std
+#include <string.h>
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Qt
+#include <QDir>
+#include <QFile>
+
+// Posix
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// Linux
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HAS_IO_URING
+#endif
+#endif
+#endif
+
+// Project
+#include "Global.h"
+#include "ImagePrefetcher.h"
+
+namespace ImageCommon
+{
+
+//******************************************************************************************
+
+class ImagePrefetcher::Reader
+{
+public:
+    Reader(const std::vector<std::string> & files, int window) :
+        _files(files), _window(window)
+    {}
+    virtual ~Reader() {}
+
+    virtual Backend backend() const = 0;
+    //! Waits for the file and moves its content into buffer. Files are taken in order
+    virtual bool take(int index, std::vector<uchar> * buffer) = 0;
+
+protected:
+    std::vector<std::string> _files;
+    int _window;
+};
+
+//******************************************************************************************
+
+namespace
+{
+
+/*!
+ * \brief readFile reads the whole file with pread (fread on Windows)
+ */
+bool readFile(const std::string & file, std::vector<uchar> * buffer)
+{
+    buffer->clear();
+#ifndef _WIN32
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    buffer->resize(st.st_size);
+    size_t done = 0;
+    while (done < buffer->size())
+    {
+        ssize_t res = pread(fd, &(*buffer)[done], buffer->size() - done, done);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            break;
+        done += res;
+    }
+    close(fd);
+    buffer->resize(done);
+    return done > 0;
+#else
+    FILE * f = fopen(file.c_str(), "rb");
+    if (!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buffer->resize(size > 0 ? size : 0);
+    size_t done = buffer->empty() ? 0 : fread(&(*buffer)[0], 1, buffer->size(), f);
+    fclose(f);
+    buffer->resize(done);
+    return done > 0;
+#endif
+}
+
+//******************************************************************************************
+/*!
+ * \brief The ThreadReader class reads files with a few threads. File i is read only once
+ * file i - window is taken, so the window bounds the memory in use.
+ */
+class ThreadReader : public ImagePrefetcher::Reader
+{
+public:
+    ThreadReader(const std::vector<std::string> & files, int window) :
+        Reader(files, window),
+        _slots(window),
+        _nextToRead(0),
+        _taken(0),
+        _stop(false)
+    {
+        int count = qMin(qMax(1, window), 4);
+        for (int i=0; i<count; i++)
+            _threads.push_back(std::thread(&ThreadReader::work, this));
+    }
+
+    ~ThreadReader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _condition.notify_all();
+        for (size_t i=0; i<_threads.size(); i++)
+            _threads[i].join();
+    }
+
+    ImagePrefetcher::Backend backend() const
+    { return ImagePrefetcher::READ_THREADS; }
+
+    bool take(int index, std::vector<uchar> * buffer)
+    {
+        Slot & slot = _slots[index % _window];
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!(slot.ready && slot.index == index))
+            _condition.wait(lock);
+        buffer->swap(slot.data);
+        bool ok = slot.ok;
+        slot.ready = false;
+        _taken = index + 1;
+        lock.unlock();
+        _condition.notify_all();
+        return ok;
+    }
+
+protected:
+
+    struct Slot
+    {
+        Slot() : index(-1), ready(false), ok(false) {}
+        int index;
+        bool ready;
+        bool ok;
+        std::vector<uchar> data;
+    };
+
+    void work()
+    {
+        std::vector<uchar> data;
+        for (;;)
+        {
+            int index;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (!_stop && !(_nextToRead < (int) _files.size() && _nextToRead < _taken + _window))
+                    _condition.wait(lock);
+                if (_stop)
+                    return;
+                index = _nextToRead++;
+            }
+
+            bool ok = readFile(_files[index], &data);
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                Slot & slot = _slots[index % _window];
+                slot.data.swap(data);
+                slot.index = index;
+                slot.ok = ok;
+                slot.ready = true;
+            }
+            _condition.notify_all();
+        }
+    }
+
+    std::vector<Slot> _slots;
+    int _nextToRead;
+    int _taken;
+    bool _stop;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::vector<std::thread> _threads;
+};
+
+//******************************************************************************************
+
+#ifdef HAS_IO_URING
+
+/*!
+ * \brief The UringReader class submits the reads with io_uring from the calling thread.
+ * Files are opened synchronously (cheap), reads go through the submission ring. Slot k holds
+ * files k, k + window, ...
+ *
+ * The kernel writes in the slot buffers until the completion of their reads : a slot is pending
+ * from the queuing of its read to its completion, and is neither reused nor freed while pending.
+ * If the ring fails, the remaining reads are done with pread in new buffers, the buffers of the
+ * reads still in the kernel are kept until the end (or leaked when their completion can not be
+ * awaited).
+ */
+class UringReader : public ImagePrefetcher::Reader
+{
+public:
+    UringReader(const std::vector<std::string> & files, int window) :
+        Reader(files, window),
+        _ring(-1),
+        _sqPtr(0), _cqPtr(0), _sqes(0),
+        _sqSize(0), _cqSize(0), _sqesSize(0),
+        _slots(window),
+        _nextToSubmit(0),
+        _taken(0),
+        _inFlight(0),
+        _broken(false)
+    {}
+
+    ~UringReader()
+    {
+        // Wait for the reads in flight before freeing their buffers and the rings
+        while (_inFlight > 0 && !_broken)
+            reap(true);
+        if (_inFlight > 0)
+        {
+            // Completions can not be awaited : leak the buffers the kernel may still write in
+            for (size_t i=0; i<_slots.size(); i++)
+            {
+                if (_slots[i].pending)
+                    orphan(_slots[i]);
+            }
+            _orphans.clear();
+        }
+        for (size_t i=0; i<_orphans.size(); i++)
+            delete _orphans[i];
+
+        for (size_t i=0; i<_slots.size(); i++)
+        {
+            if (_slots[i].fd >= 0)
+                close(_slots[i].fd);
+        }
+        if (_sqes) munmap(_sqes, _sqesSize);
+        if (_cqPtr && _cqPtr != _sqPtr) munmap(_cqPtr, _cqSize);
+        if (_sqPtr) munmap(_sqPtr, _sqSize);
+        if (_ring >= 0) close(_ring);
+    }
+
+    ImagePrefetcher::Backend backend() const
+    { return ImagePrefetcher::IO_URING; }
+
+    //! Creates the rings, returns false if io_uring is not available
+    bool init()
+    {
+        unsigned entries = 1;
+        while (entries < (unsigned) _window)
+            entries <<= 1;
+
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        _ring = (int) syscall(__NR_io_uring_setup, entries, &p);
+        if (_ring < 0)
+            return false;
+
+        _sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        _cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        bool singleMmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap)
+            _sqSize = _cqSize = qMax(_sqSize, _cqSize);
+
+        void * sq = mmap(0, _sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQ_RING);
+        if (sq == MAP_FAILED)
+            return false;
+        _sqPtr = (char*) sq;
+        if (singleMmap)
+        {
+            _cqPtr = _sqPtr;
+        }
+        else
+        {
+            void * cq = mmap(0, _cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_CQ_RING);
+            if (cq == MAP_FAILED)
+                return false;
+            _cqPtr = (char*) cq;
+        }
+        _sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+        void * sqes = mmap(0, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            return false;
+        _sqes = (struct io_uring_sqe*) sqes;
+
+        _sqHead = (unsigned*) (_sqPtr + p.sq_off.head);
+        _sqTail = (unsigned*) (_sqPtr + p.sq_off.tail);
+        _sqMask = (unsigned*) (_sqPtr + p.sq_off.ring_mask);
+        _sqArray = (unsigned*) (_sqPtr + p.sq_off.array);
+        _cqHead = (unsigned*) (_cqPtr + p.cq_off.head);
+        _cqTail = (unsigned*) (_cqPtr + p.cq_off.tail);
+        _cqMask = (unsigned*) (_cqPtr + p.cq_off.ring_mask);
+        _cqes = (struct io_uring_cqe*) (_cqPtr + p.cq_off.cqes);
+
+        fill();
+        return true;
+    }
+
+    bool take(int index, std::vector<uchar> * buffer)
+    {
+        Slot & slot = _slots[index % _window];
+        while (slot.pending && !_broken)
+            reap(true);
+        if (!slot.finished)
+        {
+            // Ring failure : finish the read synchronously, in a new buffer if the kernel may
+            // still write in the current one
+            if (slot.pending)
+                orphan(slot);
+            readRemaining(slot);
+        }
+        buffer->swap(slot.data);
+        buffer->resize(slot.done);
+        bool ok = slot.ok;
+        slot.reset();
+        _taken = index + 1;
+        fill();
+        return ok;
+    }
+
+protected:
+
+    struct Slot
+    {
+        Slot() : fd(-1), pending(false), finished(true), ok(false), done(0) {}
+        void reset()
+        {
+            if (fd >= 0) close(fd);
+            fd = -1;
+            finished = true;
+            ok = false;
+            done = 0;
+        }
+        int fd;
+        //! A read of the slot is queued or in the kernel
+        bool pending;
+        bool finished;
+        bool ok;
+        size_t done;
+        std::vector<uchar> data;
+        struct iovec iov;
+    };
+
+    //! Opens the next files of the window and submits their reads
+    void fill()
+    {
+        unsigned submitted = 0;
+        while (_nextToSubmit < (int) _files.size() && _nextToSubmit < _taken + _window)
+        {
+            Slot & slot = _slots[_nextToSubmit % _window];
+            if (slot.pending)
+                break;
+            _nextToSubmit++;
+            slot.finished = false;
+            slot.ok = false;
+            slot.done = 0;
+            slot.data.clear();
+            slot.fd = open(_files[_nextToSubmit - 1].c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (slot.fd < 0 || fstat(slot.fd, &st) != 0 || st.st_size == 0)
+            {
+                slot.finished = true;
+                continue;
+            }
+            slot.data.resize(st.st_size);
+            // Read by take with the ring broken
+            if (_broken)
+                continue;
+            queueRead(slot, _nextToSubmit - 1);
+            submitted++;
+        }
+        if (submitted > 0)
+            enter(0);
+    }
+
+    void queueRead(Slot & slot, int index)
+    {
+        unsigned tail = *_sqTail;
+        unsigned i = tail & *_sqMask;
+        struct io_uring_sqe * sqe = &_sqes[i];
+        memset(sqe, 0, sizeof(*sqe));
+        slot.iov.iov_base = &slot.data[slot.done];
+        slot.iov.iov_len = slot.data.size() - slot.done;
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = slot.fd;
+        sqe->addr = (unsigned long) &slot.iov;
+        sqe->len = 1;
+        sqe->off = slot.done;
+        sqe->user_data = (unsigned) index;
+        _sqArray[i] = i;
+        __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+        slot.pending = true;
+        _inFlight++;
+    }
+
+    //! Submits the queued reads and waits for minComplete completions. On failure, the ring is
+    //! marked broken and the reads which did not reach the kernel are no longer pending
+    bool enter(unsigned minComplete)
+    {
+        for (;;)
+        {
+            unsigned toSubmit = *_sqTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+            int res = (int) syscall(__NR_io_uring_enter, _ring, toSubmit, minComplete,
+                                    minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, 0, 0);
+            if (res >= 0)
+                return true;
+            if (errno != EINTR)
+                break;
+        }
+
+        int error = errno;
+        SD_TRACE1("ImagePrefetcher : io_uring failure (errno %1), read the remaining files with pread", error);
+        _broken = true;
+        unsigned head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+        for (; head != *_sqTail; head++)
+        {
+            struct io_uring_sqe * sqe = &_sqes[_sqArray[head & *_sqMask]];
+            _slots[(int) sqe->user_data % _window].pending = false;
+            _inFlight--;
+        }
+        return false;
+    }
+
+    //! Processes the completions, waits for at least one if wait is true
+    bool reap(bool wait)
+    {
+        unsigned head = *_cqHead;
+        if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE))
+        {
+            if (!wait || !enter(1))
+                return false;
+        }
+
+        unsigned resubmitted = 0;
+        head = *_cqHead;
+        while (head != __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe * cqe = &_cqes[head & *_cqMask];
+            int index = (int) cqe->user_data;
+            int res = cqe->res;
+            head++;
+            __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+
+            Slot & slot = _slots[index % _window];
+            slot.pending = false;
+            _inFlight--;
+            if (res == -EINTR || res == -EAGAIN)
+            {
+                queueRead(slot, index);
+                resubmitted++;
+                continue;
+            }
+            if (res <= 0)
+            {
+                // Error or end of file
+                slot.ok = slot.done > 0 && res == 0;
+                slot.finished = true;
+                continue;
+            }
+            slot.done += res;
+            if (slot.done < slot.data.size())
+            {
+                // Short read
+                queueRead(slot, index);
+                resubmitted++;
+                continue;
+            }
+            slot.ok = true;
+            slot.finished = true;
+        }
+        if (resubmitted > 0)
+            enter(0);
+        return true;
+    }
+
+    //! Gives a new buffer to the slot and keeps the current one, in which a read is in flight
+    void orphan(Slot & slot)
+    {
+        std::vector<uchar> * data = new std::vector<uchar>(slot.data.size());
+        data->swap(slot.data);
+        _orphans.push_back(data);
+        slot.pending = false;
+        slot.done = 0;
+    }
+
+    void readRemaining(Slot & slot)
+    {
+        while (slot.done < slot.data.size())
+        {
+            ssize_t res = pread(slot.fd, &slot.data[slot.done], slot.data.size() - slot.done, slot.done);
+            if (res < 0 && errno == EINTR)
+                continue;
+            if (res <= 0)
+                break;
+            slot.done += res;
+        }
+        slot.ok = slot.done > 0;
+        slot.finished = true;
+    }
+
+    int _ring;
+    char * _sqPtr;
+    char * _cqPtr;
+    struct io_uring_sqe * _sqes;
+    size_t _sqSize;
+    size_t _cqSize;
+    size_t _sqesSize;
+
+    unsigned * _sqHead;
+    unsigned * _sqTail;
+    unsigned * _sqMask;
+    unsigned * _sqArray;
+    unsigned * _cqHead;
+    unsigned * _cqTail;
+    unsigned * _cqMask;
+    struct io_uring_cqe * _cqes;
+
+    std::vector<Slot> _slots;
+    int _nextToSubmit;
+    int _taken;
+    //! Reads queued or in the kernel
+    int _inFlight;
+    //! The ring failed, remaining reads are done with pread
+    bool _broken;
+    //! Buffers of the reads left in the kernel by a ring failure
+    std::vector<std::vector<uchar>*> _orphans;
+};
+
+#endif
+
+}
+
+//******************************************************************************************
+/*!
+ * \brief ImagePrefetcher::ImagePrefetcher starts reading the first files
+ * \param files file paths
+ * \param window number of files read ahead
+ * \param backend reading backend. If io_uring is requested but not available, reading threads are used
+ */
+ImagePrefetcher::ImagePrefetcher(const QStringList &files, int window, Backend backend) :
+    _files(files),
+    _current(0),
+    _reader(0),
+    _jpegDecoding(JPEG_PARALLEL_RESTART)
+{
+    window = qMax(1, window);
+    std::vector<std::string> paths;
+    foreach (QString f, files)
+        paths.push_back(QFile::encodeName(f).toStdString());
+
+#ifdef HAS_IO_URING
+    if (backend != READ_THREADS)
+    {
+        UringReader * reader = new UringReader(paths, window);
+        if (reader->init())
+        {
+            _reader = reader;
+            return;
+        }
+        delete reader;
+        if (backend == IO_URING)
+            SD_TRACE("ImagePrefetcher : io_uring is not available, use reading threads");
+    }
+#else
+    if (backend == IO_URING)
+        SD_TRACE("ImagePrefetcher : io_uring is not supported on this platform, use reading threads");
+#endif
+    _reader = new ThreadReader(paths, window);
+}
+
+//******************************************************************************************
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+    delete _reader;
+}
+
+//******************************************************************************************
+
+ImagePrefetcher::Backend ImagePrefetcher::backend() const
+{
+    return _reader->backend();
+}
+
+//******************************************************************************************
+/*!
+ * \brief ImagePrefetcher::next gives the next file of the list
+ * \param file output file path
+ * \param buffer output file content
+ * \param ok (optional) false if the file could not be read
+ * \return false if all files are given
+ */
+bool ImagePrefetcher::next(QString *file, std::vector<uchar> *buffer, bool *ok)
+{
+    if (_current >= _files.size())
+        return false;
+    if (!buffer)
+    {
+        SD_TRACE("ImagePrefetcher::next : buffer is null");
+        return false;
+    }
+    bool res = _reader->take(_current, buffer);
+    if (file)
+        *file = _files[_current];
+    if (ok)
+        *ok = res;
+    _current++;
+    return true;
+}
+
+//******************************************************************************************
+/*!
+ * \brief ImagePrefetcher::next gives the next file of the list decoded with cv::imdecode
+ * \param file output file path
+ * \param image output image, empty if the file could not be read or decoded
+ * \param flags cv::imdecode flags. With cv::IMREAD_GRAYSCALE, the image is decoded with decodeJpegGray
+ * \return false if all files are given
+ */
+bool ImagePrefetcher::next(QString *file, cv::Mat *image, int flags)
+{
+    bool ok = false;
+    if (!next(file, &_buffer, &ok))
+        return false;
+    if (!image)
+    {
+        SD_TRACE("ImagePrefetcher::next : image is null");
+        return false;
+    }
+    if (!ok || _buffer.empty())
+        *image = cv::Mat();
+    else if (flags == cv::IMREAD_GRAYSCALE)
+        *image = decodeJpegGray(&_buffer[0], _buffer.size(), _jpegDecoding);
+    else
+        *image = cv::imdecode(cv::Mat(1, (int) _buffer.size(), CV_8U, &_buffer[0]), flags);
+    return true;
+}
+
+//******************************************************************************************
+/*!
+ * \brief ImagePrefetcher::enumerate lists the files of a directory
+ * \param path directory
+ * \param filters name filters
+ * \return absolute file paths sorted by name
+ */
+QStringList ImagePrefetcher::enumerate(const QString &path, const QStringList &filters)
+{
+    QDir d(path);
+    QStringList out;
+    foreach (QString f, d.entryList(filters, QDir::Files, QDir::Name))
+        out << d.absoluteFilePath(f);
+    return out;
+}
+
+//******************************************************************************************
+
+}
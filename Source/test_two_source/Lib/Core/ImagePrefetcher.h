@@ -0,0 +1,90 @@
+#ifndef IMAGEPREFETCHER_H
+#define IMAGEPREFETCHER_H
+
+// Std
+#include <vector>
+
+// Qt
+#include <QString>
+#include <QStringList>
+
+// Opencv
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+// Project
+#include "LibExport.h"
+#include "JpegDecoder.h"
+
+namespace ImageCommon
+{
+
+//******************************************************************************************
+/*!
+ * \brief The ImagePrefetcher class reads a list of files ahead of their use.
+ *
+ * A window of file reads is kept in flight, so that decoding and processing of a file overlap
+ * with the reads of the following files. Files are delivered in the order of the list as encoded
+ * buffers, or decoded with cv::imdecode. Grayscale JPEG images with restart markers are decoded
+ * in parallel (see decodeJpegGray and setJpegDecoding).
+ *
+ * Backends :
+ * - IO_URING : Linux io_uring, all reads are submitted by the calling thread without extra threads
+ * - READ_THREADS : reading threads with pread (fallback when io_uring is not available)
+ * AUTO selects io_uring if the kernel supports it.
+ *
+ * Usage :
+ *  ImagePrefetcher prefetcher(ImagePrefetcher::enumerate(path), 8);
+ *  QString file;
+ *  cv::Mat image;
+ *  while (prefetcher.next(&file, &image))
+ *  {
+ *      if (image.empty()) continue; // read or decode error
+ *      ...
+ *  }
+ */
+class DGV_DLL_EXPORT ImagePrefetcher
+{
+public:
+
+    enum Backend {
+        AUTO=0,
+        IO_URING=1,
+        READ_THREADS=2
+    };
+
+    ImagePrefetcher(const QStringList & files, int window=8, Backend backend=AUTO);
+    ~ImagePrefetcher();
+
+    Backend backend() const;
+    int fileCount() const
+    { return _files.size(); }
+
+    bool next(QString * file, std::vector<uchar> * buffer, bool * ok=0);
+    bool next(QString * file, cv::Mat * image, int flags=cv::IMREAD_GRAYSCALE);
+
+    void setJpegDecoding(JpegDecoding mode)
+    { _jpegDecoding = mode; }
+    JpegDecoding getJpegDecoding() const
+    { return _jpegDecoding; }
+
+    static QStringList enumerate(const QString & path, const QStringList & filters=QStringList() << "*.jpg" << "*.png" << "*.tif");
+
+    class Reader;
+
+private:
+    ImagePrefetcher(const ImagePrefetcher &);
+    ImagePrefetcher & operator=(const ImagePrefetcher &);
+
+    QStringList _files;
+    int _current;
+    Reader * _reader;
+    std::vector<uchar> _buffer;
+    JpegDecoding _jpegDecoding;
+};
+
+//******************************************************************************************
+
+}
+
+#endif // IMAGEPREFETCHER_H
@@ -1,9 +1,13 @@
 
 // Std
 #include <math.h>
+#include <string.h>
+#include <algorithm>
 
 // Qt
 #include <qmath.h>
+#include <QAtomicInt>
+#include <QAtomicInteger>
 
 // Opencv
 #include <opencv2/imgproc.hpp>
@@ -17,7 +21,10 @@
 #include "Global.h"
 #include "ImageCommon.h"
 #include "ImageProcessing.h"
+#include "Profiler.h"
+#include "TiledImage.h"
 #include "3rdparty/AKAZEFeatures.h"
+#include "3rdparty/fed.h"
 
 
 
@@ -66,6 +73,10 @@ void freqFilter(const cv::Mat &input, cv::Mat &output, const cv::Mat &freqMask,
         return;
     }
 
+    // Rough model : 2 complex transforms of 5*N*log2(N) flops and ~10 passes over the complex image
+    double npixels = input.total();
+    PROFILE_ZONE("freqFilter", 10.0 * 8.0 * npixels, 2.0 * 5.0 * npixels * log(npixels) / log(2.0));
+
     cv::Mat img2F;
     input.convertTo(img2F, CV_32F);
     cv::dft(img2F, img2F, cv::DFT_COMPLEX_OUTPUT | cv::DFT_SCALE);
@@ -326,14 +337,58 @@ void enhance(const cv::Mat &input, cv::Mat &output, double strength, bool laplac
 }
 
 
+#if defined HAS_3RDPARTY && defined TIME_PROFILER_ON
+//******************************************************************************************
+/*!
+ * \brief diffusionCost estimates the float memory traffic and operations of the nonlinear scale
+ * space of the first octave (see cv::AKAZEFeatures::Create_Nonlinear_Scale_Space), for the
+ * profiler roofline. Per pixel :
+ *  contrast factor and first level : Gaussian, Scharr derivatives, gradient histogram
+ *  each level : copy, Gaussian (5 taps), Scharr derivatives, conductivity
+ *  each FED step : explicit step and update
+ *  each AOS step : 2 tridiagonal solves, 3 transposes and the average
+ */
+static void diffusionCost(const cv::AKAZEOptions & options, double * bytes, double * flops)
+{
+    const double initBytes = 80.0, initFlops = 70.0;
+    const double levelBytes = 68.0, levelFlops = 36.0;
+    const double fedBytes = 24.0, fedFlops = 17.0;
+    const double aosBytes = 92.0, aosFlops = 33.0;
+
+    int steps = 0;
+    for (int j=1; j<options.nsublevels; j++)
+    {
+        float s0 = options.soffset * std::pow(2.0f, (float) (j - 1) / options.nsublevels);
+        float s1 = options.soffset * std::pow(2.0f, (float) j / options.nsublevels);
+        float ttime = 0.5f * (s1 * s1 - s0 * s0);
+        if (options.diffusion_scheme == cv::AKAZEOptions::DIFFUSION_AOS)
+        {
+            steps += std::max(1, (int) std::ceil(ttime / options.aos_max_step));
+        }
+        else
+        {
+            std::vector<float> tau;
+            steps += fed_tau_by_process_time(ttime, 1, 0.25f, true, tau);
+        }
+    }
+    bool aos = options.diffusion_scheme == cv::AKAZEOptions::DIFFUSION_AOS;
+    double pixels = (double) options.img_width * options.img_height;
+    int levels = options.nsublevels - 1;
+    *bytes = pixels * (initBytes + levels * levelBytes + steps * (aos ? aosBytes : fedBytes));
+    *flops = pixels * (initFlops + levels * levelFlops + steps * (aos ? aosFlops : fedFlops));
+}
+#endif
+
 #ifdef HAS_3RDPARTY
 //******************************************************************************************
 /*!
  * \brief nonlinearDiffusionFiltering
  * \param input
  * \param output
+ * \param scheme diffusion steps : explicit FED cycles or semi-implicit AOS steps. AOS takes a few
+ * large steps per level, it is faster on large images and less accurate than FED
  */
-void nonlinearDiffusionFiltering(const cv::Mat &input, cv::Mat &output)
+void nonlinearDiffusionFiltering(const cv::Mat &input, cv::Mat &output, DiffusionScheme scheme)
 {
     cv::Mat img32F;
     if ( input.depth() == CV_32F )
@@ -345,12 +400,20 @@ void nonlinearDiffusionFiltering(const cv::Mat &input, cv::Mat &output)
 
     CV_Assert( ! img32F.empty() );
 
-
     cv::AKAZEOptions options;
     options.img_width = img32F.cols;
     options.img_height = img32F.rows;
     options.omax = 1;
     options.nsublevels = 12;
+    options.diffusion_scheme = scheme == DIFFUSION_AOS ?
+                cv::AKAZEOptions::DIFFUSION_AOS : cv::AKAZEOptions::DIFFUSION_FED;
+
+#ifdef TIME_PROFILER_ON
+    double bytes = 0.0, flops = 0.0;
+    if (Profiler::isEnabled())
+        diffusionCost(options, &bytes, &flops);
+    PROFILE_ZONE("nonlinearDiffusionFiltering", bytes, flops);
+#endif
 
     cv::AKAZEFeatures ndf(options);
     ndf.Create_Nonlinear_Scale_Space(img32F);
@@ -427,19 +490,457 @@ void edgeStrength(const cv::Mat &input, cv::Mat &output, int ksize)
 
 }
 
+//******************************************************************************************
+/*!
+ * \brief guidedFilter Edge-preserving smoothing, self-guided filter of He et al.
+ * \param input single band image of any depth
+ * \param output filtered image of input depth
+ * \param radius radius of the box filters
+ * \param eps regularization on values normalized to [0, 1] for integer depths. Variations of
+ * variance larger than eps are preserved, smaller ones are smoothed
+ *
+ * Algorithm, with mean() a box filter of the given radius :
+ *  a = var(I) / (var(I) + eps), b = mean(I) - a * mean(I)
+ *  out = mean(a) * I + mean(b)
+ * The cost per pixel does not depend on the radius (box filters).
+ */
+void guidedFilter(const cv::Mat &input, cv::Mat &output, int radius, double eps)
+{
+    double scale = input.depth() == CV_8U ? 1.0 / 255.0 : input.depth() == CV_16U ? 1.0 / 65535.0 : 1.0;
+    cv::Mat I, meanI, meanII, a, b;
+    input.convertTo(I, CV_32F, scale);
+
+    cv::Size ksize(2*radius + 1, 2*radius + 1);
+    cv::boxFilter(I, meanI, CV_32F, ksize);
+    cv::boxFilter(I.mul(I), meanII, CV_32F, ksize);
+
+    // var = mean(I^2) - mean(I)^2
+    cv::Mat var = meanII - meanI.mul(meanI);
+    cv::divide(var, var + eps, a);
+    b = meanI - a.mul(meanI);
+
+    cv::boxFilter(a, a, CV_32F, ksize);
+    cv::boxFilter(b, b, CV_32F, ksize);
+
+    I = a.mul(I) + b;
+    I.convertTo(output, input.depth(), 1.0 / scale);
+}
 
 //******************************************************************************************
 /*!
- * \brief detectObjects Method to detect objects on the image
- * \param image input image of type CV_8U (8 bits single channel)
- * \param objectContours output contours
- * \param minSizeRatio Minimal size ratio of detected objects, as a factor of the mean of the image dimensions
- * \param maxSizeRatio Maximal size ratio of detected objects, as a factor of the mean of the image dimensions
- * \param mask Binary mask matrix ({0,1}) indicates where to search the objects. Object should entirely be in the mask zone, otherwise it is rejected
- * \param type Object type to detect. Possible values : ANY (any type of objects), ELLIPSE_LIKE (ellipse like objects: length/area ~ (a+b)/(a*b) and length ~ pi*(a+b) )
- * \param param A parameter to define ellipse like tolerance for {ELLIPSE_LIKE, NOT_ELLIPSE_LIKE } type. See ImageCommon::isEllipseLike2
- * \param verbose Option to display intermediate processing result
+ * \brief blurGridAxis Separable [1 2 1] / 4 blur of the bilateral grid along one axis
+ * \param stride index step along the axis
+ * \param length number of cells along the axis
+ */
+static void blurGridAxis(const std::vector<cv::Vec2f> & grid, std::vector<cv::Vec2f> & out, int stride, int length)
+{
+    for (size_t i=0; i<grid.size(); i++)
+    {
+        int p = (int) (i / stride) % length;
+        cv::Vec2f v = grid[i] * 2.0f;
+        if (p > 0) v += grid[i - stride];
+        if (p < length - 1) v += grid[i + stride];
+        out[i] = v * 0.25f;
+    }
+}
+
+//******************************************************************************************
+/*!
+ * \brief bilateralGridFilter Edge-preserving smoothing, bilateral grid of Paris and Durand
+ * \param input single band image of 8U or 32F depth
+ * \param output filtered image of input depth
+ * \param sigmaSpace spatial sampling of the grid in pixels
+ * \param sigmaColor range sampling of the grid in input values
  *
+ * Algorithm :
+ *  1) Splat : pixel values and weights are accumulated in a 3D grid (x/sigmaSpace, y/sigmaSpace, value/sigmaColor)
+ *  2) Blur : the grid is blurred along the 3 axes
+ *  3) Slice : output is the normalized grid value at (x, y, value), trilinear interpolation
+ * The cost per pixel does not depend on sigmaSpace, the grid is sigmaSpace^2 * sigmaColor times smaller than the image.
+ */
+void bilateralGridFilter(const cv::Mat &input, cv::Mat &output, double sigmaSpace, double sigmaColor)
+{
+    if (input.channels() != 1 || (input.depth() != CV_8U && input.depth() != CV_32F))
+    {
+        SD_TRACE("bilateralGridFilter : Input image should a 8U or 32F single channel matrix");
+        return;
+    }
+    if (sigmaSpace <= 0.0 || sigmaColor <= 0.0)
+    {
+        SD_TRACE("bilateralGridFilter : Grid sampling should be positive");
+        return;
+    }
+
+    cv::Mat src;
+    input.convertTo(src, CV_32F);
+    double minVal, maxVal;
+    cv::minMaxLoc(src, &minVal, &maxVal);
+
+    // Grid with a padding of one cell, zero weight outside the image
+    const int pad = 1;
+    int gw = (int) ((src.cols - 1) / sigmaSpace) + 1 + 2*pad;
+    int gh = (int) ((src.rows - 1) / sigmaSpace) + 1 + 2*pad;
+    int gd = (int) ((maxVal - minVal) / sigmaColor) + 1 + 2*pad;
+    std::vector<cv::Vec2f> grid(gw * gh * gd, cv::Vec2f(0.0f, 0.0f));
+    std::vector<cv::Vec2f> tmp(grid.size());
+
+    // Splat
+    for (int y=0; y<src.rows; y++)
+    {
+        const float * row = src.ptr<float>(y);
+        int gy = cvRound(y / sigmaSpace) + pad;
+        for (int x=0; x<src.cols; x++)
+        {
+            int gx = cvRound(x / sigmaSpace) + pad;
+            int gz = cvRound((row[x] - minVal) / sigmaColor) + pad;
+            grid[(gz * gh + gy) * gw + gx] += cv::Vec2f(row[x], 1.0f);
+        }
+    }
+
+    // Blur
+    blurGridAxis(grid, tmp, 1, gw);
+    blurGridAxis(tmp, grid, gw, gh);
+    blurGridAxis(grid, tmp, gw * gh, gd);
+    grid.swap(tmp);
+
+    // Slice
+    cv::Mat dst(src.size(), CV_32F);
+    for (int y=0; y<src.rows; y++)
+    {
+        const float * row = src.ptr<float>(y);
+        float * out = dst.ptr<float>(y);
+        float fy = (float) (y / sigmaSpace) + pad;
+        int y0 = (int) fy;
+        float wy = fy - y0;
+        for (int x=0; x<src.cols; x++)
+        {
+            float fx = (float) (x / sigmaSpace) + pad;
+            float fz = (float) ((row[x] - minVal) / sigmaColor) + pad;
+            int x0 = (int) fx;
+            int z0 = (int) fz;
+            float wx = fx - x0;
+            float wz = fz - z0;
+
+            cv::Vec2f v(0.0f, 0.0f);
+            for (int k=0; k<8; k++)
+            {
+                int dx = k & 1, dy = (k >> 1) & 1, dz = k >> 2;
+                float w = (dx ? wx : 1.0f - wx) * (dy ? wy : 1.0f - wy) * (dz ? wz : 1.0f - wz);
+                v += grid[((z0 + dz) * gh + y0 + dy) * gw + x0 + dx] * w;
+            }
+            out[x] = v[1] > 0.0f ? v[0] / v[1] : row[x];
+        }
+    }
+
+    dst.convertTo(output, input.depth());
+}
+
+//******************************************************************************************
+
+static QAtomicInt PRE_FILTER(PREFILTER_MEDIAN);
+
+//******************************************************************************************
+/*!
+ * \brief setDetectionPreFilter sets the edge-preserving pre-filter of detectObjects. The pre-filter
+ * is global and can be changed while detections run in other threads.
+ */
+void setDetectionPreFilter(PreFilter filter)
+{
+    PRE_FILTER.store(filter);
+}
+
+//******************************************************************************************
+
+PreFilter getDetectionPreFilter()
+{
+    return (PreFilter) PRE_FILTER.load();
+}
+
+//******************************************************************************************
+/*!
+ * \brief preFilter applies a pre-filter of the detection with its detection parameters
+ * \param input 8 bits single channel image
+ * \param output filtered image, 8 bits. Can be the input
+ * \param filter pre-filter to apply
+ */
+void preFilter(const cv::Mat &input, cv::Mat &output, PreFilter filter)
+{
+    switch (filter)
+    {
+    case PREFILTER_GUIDED:
+        guidedFilter(input, output, 4, 0.01);
+        break;
+    case PREFILTER_BILATERAL_GRID:
+        bilateralGridFilter(input, output, 15.0, 50.0);
+        break;
+    case PREFILTER_DIFFUSION:
+#ifdef HAS_3RDPARTY
+    {
+        cv::Mat t;
+        nonlinearDiffusionFiltering(input, t);
+        t.convertTo(output, CV_8U, 255.0);
+        break;
+    }
+#else
+        SD_TRACE("preFilter : nonlinear diffusion is not available, median blur is used");
+#endif
+    case PREFILTER_MEDIAN:
+    default:
+        cv::medianBlur(input, output, 5);
+        break;
+    }
+}
+
+
+//******************************************************************************************
+
+// Limits are read by every check : atomics rather than a lock. The edge density is stored as its bits
+static qint64 toBits(double value)
+{
+    qint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static double fromBits(qint64 bits)
+{
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static QAtomicInteger<qint64> MAX_EDGE_DENSITY(toBits(DetectionLimits().maxEdgeDensity));
+static QAtomicInt MAX_CONTOURS(DetectionLimits().maxContours);
+static QAtomicInt MAX_POINTS(DetectionLimits().maxPoints);
+static QAtomicInt MAX_KEYPOINTS(DetectionLimits().maxKeypoints);
+static QAtomicInt EDGE_MAPS(0);
+static QAtomicInt EDGE_DENSITY_BAILOUTS(0);
+static QAtomicInt CONTOURS_BAILOUTS(0);
+static QAtomicInt POINTS_BAILOUTS(0);
+static QAtomicInt CAPPED_KEYPOINTS(0);
+
+//******************************************************************************************
+/*!
+ * \brief setDetectionLimits sets the work limits of the detections. Limits are global and can be
+ * changed while detections run in other threads, each limit is updated atomically.
+ */
+void setDetectionLimits(const DetectionLimits &limits)
+{
+    MAX_EDGE_DENSITY.store(toBits(limits.maxEdgeDensity));
+    MAX_CONTOURS.store(limits.maxContours);
+    MAX_POINTS.store(limits.maxPoints);
+    MAX_KEYPOINTS.store(limits.maxKeypoints);
+}
+
+//******************************************************************************************
+
+DetectionLimits getDetectionLimits()
+{
+    return DetectionLimits(fromBits(MAX_EDGE_DENSITY.load()), MAX_CONTOURS.load(), MAX_POINTS.load(), MAX_KEYPOINTS.load());
+}
+
+//******************************************************************************************
+/*!
+ * \brief getDetectionCounters returns the number of bail-outs since the last reset
+ */
+DetectionCounters getDetectionCounters()
+{
+    DetectionCounters counters;
+    counters.edgeMaps = EDGE_MAPS.load();
+    counters.edgeDensityBailouts = EDGE_DENSITY_BAILOUTS.load();
+    counters.contoursBailouts = CONTOURS_BAILOUTS.load();
+    counters.pointsBailouts = POINTS_BAILOUTS.load();
+    counters.cappedKeypoints = CAPPED_KEYPOINTS.load();
+    return counters;
+}
+
+//******************************************************************************************
+
+void resetDetectionCounters()
+{
+    EDGE_MAPS.store(0);
+    EDGE_DENSITY_BAILOUTS.store(0);
+    CONTOURS_BAILOUTS.store(0);
+    POINTS_BAILOUTS.store(0);
+    CAPPED_KEYPOINTS.store(0);
+}
+
+//******************************************************************************************
+/*!
+ * \brief checkEdgeDensity checks the edge map (e.g. Canny output) against the maximal edge density.
+ * It should be called before searching the contours : their count and length grow with the edges.
+ * \return false if the edge map is too dense and should not be processed
+ */
+bool checkEdgeDensity(const cv::Mat &edges)
+{
+    EDGE_MAPS.ref();
+    double maxEdgeDensity = fromBits(MAX_EDGE_DENSITY.load());
+    if (maxEdgeDensity <= 0.0 || edges.empty())
+        return true;
+    if (cv::countNonZero(edges) <= maxEdgeDensity * edges.total())
+        return true;
+    EDGE_DENSITY_BAILOUTS.ref();
+    return false;
+}
+
+//******************************************************************************************
+/*!
+ * \brief checkContours checks the contours against the maximal contours and points counts.
+ * It should be called before the selection of the contours (bounding rects, shape tests, sort).
+ * \return false if the contours should not be processed
+ */
+bool checkContours(const std::vector<std::vector<cv::Point> > &contours)
+{
+    int maxContours = MAX_CONTOURS.load();
+    if (maxContours > 0 && (int) contours.size() > maxContours)
+    {
+        CONTOURS_BAILOUTS.ref();
+        return false;
+    }
+    int maxPoints = MAX_POINTS.load();
+    if (maxPoints > 0)
+    {
+        size_t points = 0;
+        for (size_t i=0; i<contours.size(); i++)
+        {
+            points += contours[i].size();
+            if (points > (size_t) maxPoints)
+            {
+                POINTS_BAILOUTS.ref();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//******************************************************************************************
+/*!
+ * \brief The ResponseGreater struct orders keypoint indices by decreasing response
+ */
+struct ResponseGreater
+{
+    ResponseGreater(const std::vector<cv::KeyPoint> & keypoints) :
+        _keypoints(keypoints)
+    {}
+    bool operator() (int i, int j) const
+    {
+        return _keypoints[i].response > _keypoints[j].response;
+    }
+protected:
+    const std::vector<cv::KeyPoint> & _keypoints;
+};
+
+//******************************************************************************************
+/*!
+ * \brief capKeypoints keeps the maxKeypoints strongest keypoints of an object. Should be called
+ * between the detection and the description, so that only the kept keypoints are described
+ * \param keypoints keypoints of the object. Kept keypoints are in their initial order
+ * \param descriptors (optional) descriptors of the keypoints, one row per keypoint. Rows of the
+ * removed keypoints are removed
+ * \return true if keypoints were removed
+ */
+bool capKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat *descriptors)
+{
+    int maxKeypoints = MAX_KEYPOINTS.load();
+    if (maxKeypoints <= 0 || (int) keypoints.size() <= maxKeypoints)
+        return false;
+
+    std::vector<int> indices(keypoints.size());
+    for (size_t i=0; i<indices.size(); i++)
+        indices[i] = (int) i;
+    std::nth_element(indices.begin(), indices.begin() + maxKeypoints, indices.end(), ResponseGreater(keypoints));
+    indices.resize(maxKeypoints);
+    std::sort(indices.begin(), indices.end());
+
+    bool hasDescriptors = descriptors && descriptors->rows == (int) keypoints.size();
+    std::vector<cv::KeyPoint> kept(maxKeypoints);
+    cv::Mat keptDescriptors;
+    if (hasDescriptors)
+        keptDescriptors.create(maxKeypoints, descriptors->cols, descriptors->type());
+    for (int i=0; i<maxKeypoints; i++)
+    {
+        kept[i] = keypoints[indices[i]];
+        if (hasDescriptors)
+            descriptors->row(indices[i]).copyTo(keptDescriptors.row(i));
+    }
+    keypoints.swap(kept);
+    if (hasDescriptors)
+        *descriptors = keptDescriptors;
+
+    CAPPED_KEYPOINTS.ref();
+    return true;
+}
+
+//******************************************************************************************
+
+#define USE_RESIZE
+
+// Margin of the filters (median, Canny, morphology) around the mask regions
+#define MASK_ROI_HALO 16
+// Above this count, mask components are processed in a single region
+#define MASK_ROI_MAX_COUNT 16
+
+//******************************************************************************************
+/*!
+ * \brief maskRegions computes the regions of the image to process for a mask : bounding rects
+ * of the mask components with a halo. Overlapping regions are merged.
+ * \return regions, empty if the mask is null
+ */
+static QVector<cv::Rect> maskRegions(const cv::Mat & mask, int halo)
+{
+    QVector<cv::Rect> regions;
+    cv::Rect bounds(cv::Point(), mask.size());
+    cv::Mat labels, stats, centroids;
+    int count = cv::connectedComponentsWithStats(mask != 0, labels, stats, centroids, 8, CV_32S);
+    cv::Rect all;
+    for (int i=1; i<count; i++)
+    {
+        cv::Rect r(stats.at<int>(i, cv::CC_STAT_LEFT), stats.at<int>(i, cv::CC_STAT_TOP),
+                   stats.at<int>(i, cv::CC_STAT_WIDTH), stats.at<int>(i, cv::CC_STAT_HEIGHT));
+        r = cv::Rect(r.x - halo, r.y - halo, r.width + 2*halo, r.height + 2*halo) & bounds;
+        all = regions.isEmpty() ? r : (all | r);
+        regions << r;
+    }
+    if (regions.size() > MASK_ROI_MAX_COUNT)
+        return QVector<cv::Rect>() << all;
+
+    // Merge overlapping regions
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (int i=0; i<regions.size() && !merged; i++)
+        {
+            for (int j=i+1; j<regions.size() && !merged; j++)
+            {
+                if ((regions[i] & regions[j]).area() > 0)
+                {
+                    regions[i] |= regions[j];
+                    regions.remove(j);
+                    merged = true;
+                }
+            }
+        }
+    }
+
+    // Crops covering most of the union are not worth the multiple passes
+    int area = 0;
+    foreach (cv::Rect r, regions)
+        area += r.area();
+    if (regions.size() > 1 && area > 0.75 * all.area())
+        return QVector<cv::Rect>() << all;
+    return regions;
+}
+
+//******************************************************************************************
+/*!
+ * \brief detectObjectsInRegion runs the detection chain of detectObjects on a region of the image
+ * \param image region of the image
+ * \param mask region of the mask or empty matrix
+ * \param size whole image size, size ratios are relative to the whole image
+ * \param offset region position in the image, added to the output contours
+ * \param objectContours selected contours are appended
  *
  * Idea :
  *
@@ -455,30 +956,15 @@ void edgeStrength(const cv::Mat &input, cv::Mat &output, int ksize)
  *      - Apply selection criteria
  *
  */
-
-#define USE_RESIZE
-
-void detectObjects(const cv::Mat &image, Contours *objectContours,
-                   double minSizeRatio, double maxSizeRatio, const cv::Mat &mask,
-                   DetectedObjectType type, double param,
-                   bool verbose)
+static void detectObjectsInRegion(const cv::Mat &image, const cv::Mat &mask, const cv::Size & size, const cv::Point & offset,
+                                  double minSizeRatio, double maxSizeRatio,
+                                  DetectedObjectType type, double param,
+                                  bool verbose, Contours *objectContours)
 {
-    if (image.type() != CV_8U) {
-        SD_TRACE("detectObjects : Input image should a 8 bits single channel matrix");
-        return;
-    }
-
-    if (!objectContours)
-    {
-        SD_TRACE("detectObjects : ObjectContours is null");
-        return;
-    }
-
-    cv::Size size = image.size();
     cv::Mat procImage;
     image.copyTo(procImage);
 
-    int imageDim = (image.cols + image.rows)/2;
+    int imageDim = (size.width + size.height)/2;
     if (verbose) SD_TRACE1("Detected object min size : %1", imageDim*minSizeRatio);
     if (verbose) SD_TRACE1("Detected object max size : %1", imageDim*maxSizeRatio);
 
@@ -510,10 +996,10 @@ void detectObjects(const cv::Mat &image, Contours *objectContours,
 
 #if 1
 
-    // Median blur
-    int medianBlurSize = 5;
-    cv::medianBlur(procImage, procImage, medianBlurSize);
-    if (verbose) ImageCommon::displayMat(procImage, true, QString("Median blur, ksize=%1").arg(medianBlurSize));
+    // Edge-preserving pre-filter, median blur by default
+    PreFilter filter = getDetectionPreFilter();
+    preFilter(procImage, procImage, filter);
+    if (verbose) ImageCommon::displayMat(procImage, true, QString("Pre-filter : %1").arg(filter));
 
     if (objectMinSize > 0)
     {
@@ -569,15 +1055,6 @@ void detectObjects(const cv::Mat &image, Contours *objectContours,
 #endif
 
 
-#if 0
-    cv::Mat m;
-    int d=15;
-    double sigmaSpace=15.0;
-    double sigmaColor=50.0;
-    cv::bilateralFilter(procImage, m, d, sigmaColor, sigmaSpace);
-    procImage = m;
-    if (verbose) ImageCommon::displayMat(procImage, true, QString("Bilateral : %1").arg(sigmaSpace));
-#endif
 
 
 
@@ -688,6 +1165,13 @@ void detectObjects(const cv::Mat &image, Contours *objectContours,
 
     if (verbose) ImageCommon::displayMat(procImage, true, QString("Canny : %1, %2").arg(t1).arg(t2));
 
+    // Too many edges : the frame is noise or texture, contours would be numerous and long
+    if (!checkEdgeDensity(procImage))
+    {
+        if (verbose) SD_TRACE("detectObjects : edge density is above the limit, region is skipped");
+        return;
+    }
+
 
 
     //    cv::Mat in3, in3c[] = {procImage, procImage, procImage};
@@ -744,9 +1228,14 @@ void detectObjects(const cv::Mat &image, Contours *objectContours,
     // Find contours
     std::vector< std::vector<cv::Point> > contours;
     std::vector< cv::Vec4i > hierarchy;
-    cv::findContours(procImage, contours, hierarchy, cv::RETR_CCOMP, cv::CHAIN_APPROX_NONE);
-    objectContours->clear();
-    objectContours->resize(contours.size());
+    cv::findContours(procImage, contours, hierarchy, cv::RETR_CCOMP, cv::CHAIN_APPROX_NONE, offset);
+    if (!checkContours(contours))
+    {
+        if (verbose) SD_TRACE1("detectObjects : %1 contours are above the limits, region is skipped", contours.size());
+        return;
+    }
+    int count = objectContours->size();
+    objectContours->resize(count + (int) contours.size());
 
 
     // ***** Select contours *****
@@ -761,7 +1250,6 @@ void detectObjects(const cv::Mat &image, Contours *objectContours,
     //    int maxLength = 0.95*size.width * M_PI;
     if (verbose) SD_TRACE(QString("Contours count : %1").arg(contours.size()));
 
-    int count=0;
     for (size_t i=0;i<contours.size();i++)
     {
         std::vector<cv::Point> contour = contours[i];
@@ -798,6 +1286,8 @@ void detectObjects(const cv::Mat &image, Contours *objectContours,
             {
                 std::vector< std::vector<cv::Point> > tstContours;
                 tstContours.push_back(contour);
+                for (size_t k=0; k<contour.size(); k++)
+                    tstContours[0][k] -= offset;
                 ImageCommon::displayContours(tstContours, image, false, true);
             }
 
@@ -819,14 +1309,219 @@ void detectObjects(const cv::Mat &image, Contours *objectContours,
         }
     }
     objectContours->resize(count);
+}
+
+//******************************************************************************************
+/*!
+ * \brief detectObjects Method to detect objects on the image
+ * \param image input image of type CV_8U (8 bits single channel)
+ * \param objectContours output contours
+ * \param minSizeRatio Minimal size ratio of detected objects, as a factor of the mean of the image dimensions
+ * \param maxSizeRatio Maximal size ratio of detected objects, as a factor of the mean of the image dimensions
+ * \param mask Binary mask matrix ({0,1}) of type CV_8U indicates where to search the objects. Object should entirely be in the mask zone, otherwise it is rejected.
+ * Only the regions of the mask components (with a halo for the filters) are processed.
+ * \param type Object type to detect. Possible values : ANY (any type of objects), ELLIPSE_LIKE (ellipse like objects: length/area ~ (a+b)/(a*b) and length ~ pi*(a+b) )
+ * \param param A parameter to define ellipse like tolerance for {ELLIPSE_LIKE, NOT_ELLIPSE_LIKE } type. See ImageCommon::isEllipseLike2
+ * \param verbose Option to display intermediate processing result
+ *
+ * See detectObjectsInRegion for the detection chain.
+ */
+void detectObjects(const cv::Mat &image, Contours *objectContours,
+                   double minSizeRatio, double maxSizeRatio, const cv::Mat &mask,
+                   DetectedObjectType type, double param,
+                   bool verbose)
+{
+    if (image.type() != CV_8U) {
+        SD_TRACE("detectObjects : Input image should a 8 bits single channel matrix");
+        return;
+    }
+
+    if (!objectContours)
+    {
+        SD_TRACE("detectObjects : ObjectContours is null");
+        return;
+    }
+
+    if (!mask.empty() && (mask.type() != CV_8U || mask.size() != image.size()))
+    {
+        SD_TRACE("detectObjects : Mask should be a 8 bits single channel matrix of the image size");
+        return;
+    }
+
+    // 8 bits filters and contours : no float work to place on the roofline
+    PROFILE_TIME_ZONE("detectObjects");
+
+    objectContours->clear();
+    if (mask.empty())
+    {
+        detectObjectsInRegion(image, mask, image.size(), cv::Point(),
+                              minSizeRatio, maxSizeRatio, type, param, verbose, objectContours);
+    }
+    else
+    {
+        // The chain runs only on the mask regions
+        QVector<cv::Rect> regions = maskRegions(mask, MASK_ROI_HALO);
+        if (verbose) SD_TRACE1("Mask regions count : %1", regions.size());
+        foreach (cv::Rect r, regions)
+        {
+            detectObjectsInRegion(image(r), mask(r), image.size(), r.tl(),
+                                  minSizeRatio, maxSizeRatio, type, param, verbose, objectContours);
+        }
+    }
 
     // order by size (descending)
     std::sort(objectContours->begin(), objectContours->end(), Compare(Compare::Less));
 
-    if (verbose) SD_TRACE(QString("Selected contours count : %1").arg(count));
+    if (verbose) SD_TRACE(QString("Selected contours count : %1").arg(objectContours->size()));
     if (verbose) ImageCommon::displayContours(objectContours->toStdVector(), image, false, true);
+}
+
+//******************************************************************************************
+/*!
+ * \brief The TiledDetectionInvoker class detects objects on tiles read with their halo.
+ * Only the objects with the bounding rect center inside the tile core are kept, so each object
+ * is given by a single tile.
+ */
+class TiledDetectionInvoker : public cv::ParallelLoopBody
+{
+public:
+    TiledDetectionInvoker(const ImageCommon::TiledImage & image, const QVector<cv::Rect> & tiles, int halo,
+                          int minSize, int maxSize, DetectedObjectType type, double param,
+                          QVector<Contours> & tileContours, bool verbose) :
+        _image(image),
+        _tiles(tiles),
+        _halo(halo),
+        _minSize(minSize),
+        _maxSize(maxSize),
+        _type(type),
+        _param(param),
+        _tileContours(tileContours),
+        _verbose(verbose)
+    {}
+
+    virtual void operator()(const cv::Range & range) const
+    {
+        cv::Rect bounds(cv::Point(), _image.size());
+        cv::Mat tile;
+        Contours contours;
+        for (int i=range.start; i<range.end; i++)
+        {
+            const cv::Rect & core = _tiles[i];
+            cv::Rect region(core.x - _halo, core.y - _halo, core.width + 2*_halo, core.height + 2*_halo);
+            region &= bounds;
+            if (!_image.readRegion(region, &tile))
+            {
+                SD_TRACE4("detectObjectsTiled : failed to read the region %1, %2, %3, %4", region.x, region.y, region.width, region.height);
+                continue;
+            }
+
+            // Size ratios such that the area limits of detectObjects are minSize^2 and maxSize^2
+            double dim = qSqrt(1.0 * tile.cols * tile.rows);
+            detectObjects(tile, &contours, _minSize / dim, _maxSize / dim, cv::Mat(), _type, _param, _verbose);
+
+            Contours & out = _tileContours[i];
+            for (int j=0; j<contours.size(); j++)
+            {
+                std::vector<cv::Point> & contour = contours[j];
+                cv::Rect brect = cv::boundingRect(contour);
+                cv::Point center(region.x + brect.x + brect.width/2, region.y + brect.y + brect.height/2);
+                if (!core.contains(center))
+                    continue;
+                // Objects cut by the halo border are larger than the maximum size
+                if ((brect.x <= 0 && region.x > 0) ||
+                        (brect.y <= 0 && region.y > 0) ||
+                        (brect.br().x >= region.width && region.br().x < bounds.width) ||
+                        (brect.br().y >= region.height && region.br().y < bounds.height))
+                    continue;
+                for (size_t k=0; k<contour.size(); k++)
+                    contour[k] += region.tl();
+                out.push_back(contour);
+            }
+        }
+    }
+
+protected:
+    const ImageCommon::TiledImage & _image;
+    const QVector<cv::Rect> & _tiles;
+    int _halo;
+    int _minSize;
+    int _maxSize;
+    DetectedObjectType _type;
+    double _param;
+    QVector<Contours> & _tileContours;
+    bool _verbose;
+};
+
+//******************************************************************************************
+/*!
+ * \brief detectObjectsTiled detects objects on a large image tile by tile, without loading the whole image
+ * \param image tiled image, e.g. ImageCommon::TiffTiledImage
+ * \param objectContours output contours in image coordinates, ordered by size (descending)
+ * \param minSize minimal size of detected objects in pixels
+ * \param maxSize maximal size of detected objects in pixels
+ * \param type object type to detect, see detectObjects
+ * \param param ellipse like tolerance, see detectObjects
+ * \param tileSize approximative size of the processed tiles, rounded to the native tile size
+ * \param verbose option to display intermediate processing results (tiles are processed sequentially)
+ *
+ * Object sizes bound the bounding rect areas, not the extents : an elongated or rotated object of
+ * size maxSize reaches further than maxSize/2 from its center. Each tile is read with a halo of
+ * maxSize pixels (plus filter margins), so that any object with its center in the tile and a
+ * bounding rect of aspect ratio up to 4 is entirely visible. Tiles are read and processed in parallel:
+ * the reads of some workers overlap the processing of the others, and the memory used is bounded
+ * by the number of workers times the tile size.
+ *
+ * Filtering and normalization of detectObjects are computed per tile : results can differ from
+ * detectObjects applied on the whole image.
+ */
+void detectObjectsTiled(const ImageCommon::TiledImage &image, Contours *objectContours,
+                        int minSize, int maxSize,
+                        DetectedObjectType type, double param,
+                        int tileSize, bool verbose)
+{
+    if (!objectContours)
+    {
+        SD_TRACE("detectObjectsTiled : ObjectContours is null");
+        return;
+    }
+    objectContours->clear();
 
+    cv::Size size = image.size();
+    if (size.area() == 0 || minSize < 0 || maxSize <= minSize)
+    {
+        SD_TRACE("detectObjectsTiled : image is empty or object sizes are not valid");
+        return;
+    }
+
+    PROFILE_TIME_ZONE("detectObjectsTiled");
 
+    // Tiles are aligned on the native tiles to decode each native tile once per tile
+    cv::Size native = image.tileSize();
+    native.width = qBound(1, native.width, size.width);
+    native.height = qBound(1, native.height, size.height);
+    int tw = qMax(1, (tileSize + native.width/2) / native.width) * native.width;
+    int th = qMax(1, (tileSize + native.height/2) / native.height) * native.height;
+    // Largest half-extent of the objects, median blur and morphology margins
+    int halo = maxSize + 8;
+
+    QVector<cv::Rect> tiles;
+    for (int y=0; y<size.height; y+=th)
+    {
+        for (int x=0; x<size.width; x+=tw)
+            tiles << (cv::Rect(x, y, tw, th) & cv::Rect(cv::Point(), size));
+    }
+    if (verbose) SD_TRACE4("Tiled detection : %1 tiles of %2x%3, halo %4", tiles.size(), tw, th, halo);
+
+    QVector<Contours> tileContours(tiles.size());
+    TiledDetectionInvoker invoker(image, tiles, halo, minSize, maxSize, type, param, tileContours, verbose);
+    cv::parallel_for_(cv::Range(0, tiles.size()), invoker, verbose ? 1 : tiles.size());
+
+    foreach (const Contours & contours, tileContours)
+        *objectContours << contours;
+
+    // order by size (descending)
+    std::sort(objectContours->begin(), objectContours->end(), Compare(Compare::Less));
+    if (verbose) SD_TRACE1("Tiled detection : %1 objects", objectContours->size());
 }
 
 //******************************************************************************************
@@ -880,6 +1575,82 @@ void detectObjects2(const cv::Mat &image, Contours *objectContours, double minSi
 }
 
 
+//******************************************************************************************
+/*!
+ * \brief computeFrameQuality computes in a single pass the sharpness, the exposure statistics and
+ * the motion energy of a (decimated) frame
+ * \param image input image of type CV_8U (8 bits single channel)
+ * \param previous previous frame of the same size and type, or empty matrix
+ * \param quality output
+ *
+ * Sharpness is the variance of the 4-neighbours Laplacian, motion is the mean absolute difference
+ * with the previous frame. Statistics are computed on the image without its 1 pixel border.
+ */
+void computeFrameQuality(const cv::Mat &image, const cv::Mat &previous, FrameQuality *quality)
+{
+    if (!quality)
+    {
+        SD_TRACE("computeFrameQuality : quality is null");
+        return;
+    }
+
+    quality->sharpness = 0.0;
+    quality->meanIntensity = 0.0;
+    quality->darkRatio = 0.0;
+    quality->brightRatio = 0.0;
+    quality->motion = -1.0;
+
+    if (image.type() != CV_8U || image.rows < 3 || image.cols < 3) {
+        SD_TRACE("computeFrameQuality : Input image should a 8 bits single channel matrix larger than 3x3");
+        return;
+    }
+
+    bool hasPrevious = !previous.empty();
+    if (hasPrevious && (previous.size() != image.size() || previous.type() != image.type()))
+    {
+        SD_TRACE("computeFrameQuality : previous frame should have the same size and type as the image");
+        hasPrevious = false;
+    }
+
+    // Integer accumulators per row, double accumulators per image
+    double sumLap = 0.0, sumLap2 = 0.0, sumI = 0.0, sumDiff = 0.0;
+    qint64 dark = 0, bright = 0;
+    for (int i=1; i<image.rows-1; i++)
+    {
+        const uchar * prev = image.ptr<uchar>(i-1);
+        const uchar * curr = image.ptr<uchar>(i);
+        const uchar * next = image.ptr<uchar>(i+1);
+        const uchar * last = hasPrevious ? previous.ptr<uchar>(i) : 0;
+
+        qint64 rowLap = 0, rowLap2 = 0, rowI = 0, rowDiff = 0;
+        for (int j=1; j<image.cols-1; j++)
+        {
+            int v = curr[j];
+            int lap = prev[j] + next[j] + curr[j-1] + curr[j+1] - 4*v;
+            rowLap += lap;
+            rowLap2 += lap*lap;
+            rowI += v;
+            dark += v <= 5;
+            bright += v >= 250;
+            if (last)
+                rowDiff += qAbs(v - (int) last[j]);
+        }
+        sumLap += rowLap;
+        sumLap2 += rowLap2;
+        sumI += rowI;
+        sumDiff += rowDiff;
+    }
+
+    double n = (image.rows - 2.0) * (image.cols - 2.0);
+    double meanLap = sumLap / n;
+    quality->sharpness = sumLap2 / n - meanLap * meanLap;
+    quality->meanIntensity = sumI / n;
+    quality->darkRatio = dark / n;
+    quality->brightRatio = bright / n;
+    if (hasPrevious)
+        quality->motion = sumDiff / n;
+}
+
 //******************************************************************************************
 
 }
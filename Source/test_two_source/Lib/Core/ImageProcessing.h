@@ -10,6 +10,11 @@
 // Project
 #include "LibExport.h"
 
+namespace ImageCommon
+{
+class TiledImage;
+}
+
 namespace ImageProcessing
 {
 
@@ -40,11 +45,22 @@ inline cv::Mat DGV_DLL_EXPORT getCircleKernel2D(int width, int height, double va
 void DGV_DLL_EXPORT simplify(const cv::Mat & src, cv::Mat & dst, double f);
 
 #ifdef HAS_3RDPARTY
-void DGV_DLL_EXPORT nonlinearDiffusionFiltering(const cv::Mat & input, cv::Mat & output);
+//! Scheme of the nonlinear diffusion steps, see cv::AKAZEOptions::DiffusionScheme
+enum DiffusionScheme
+{
+    DIFFUSION_FED = 0,
+    DIFFUSION_AOS = 1
+};
+
+void DGV_DLL_EXPORT nonlinearDiffusionFiltering(const cv::Mat & input, cv::Mat & output, DiffusionScheme scheme=DIFFUSION_FED);
 #endif
 
 void DGV_DLL_EXPORT edgeStrength(const cv::Mat & input, cv::Mat & output, int ksize=3);
 
+void DGV_DLL_EXPORT guidedFilter(const cv::Mat & input, cv::Mat & output, int radius=4, double eps=0.01);
+
+void DGV_DLL_EXPORT bilateralGridFilter(const cv::Mat & input, cv::Mat & output, double sigmaSpace=15.0, double sigmaColor=50.0);
+
 
 // Detection methods
 //******************************************************************************************
@@ -74,6 +90,85 @@ void DGV_DLL_EXPORT detectObjects2(const cv::Mat & image,
                                   const cv::Mat & mask=cv::Mat(), DetectedObjectType type=ANY, double param=0.0,
                                   bool verbose=false);
 
+void DGV_DLL_EXPORT detectObjectsTiled(const ImageCommon::TiledImage & image,
+                                       Contours * objectContours,
+                                       int minSize, int maxSize,
+                                       DetectedObjectType type=ANY, double param=0.0,
+                                       int tileSize=2048, bool verbose=false);
+
+//! Edge-preserving pre-filter of the detection, applied before the frequency filter
+enum PreFilter {
+    PREFILTER_MEDIAN=0,         ///< median blur, 5x5
+    PREFILTER_GUIDED=1,         ///< guided filter, constant time
+    PREFILTER_BILATERAL_GRID=2, ///< bilateral grid, constant time
+    PREFILTER_DIFFUSION=3       ///< nonlinear diffusion (FED), median blur without 3rdparty
+};
+
+void DGV_DLL_EXPORT setDetectionPreFilter(PreFilter filter);
+PreFilter DGV_DLL_EXPORT getDetectionPreFilter();
+void DGV_DLL_EXPORT preFilter(const cv::Mat & input, cv::Mat & output, PreFilter filter);
+
+
+// Work limits of the detection methods
+//******************************************************************************************
+
+/*!
+ * \brief The DetectionLimits struct bounds the work done on a frame by the object detections
+ * (detectObjects, detectObjectsTiled and the card object extraction of the application).
+ *
+ * Noisy or highly textured frames give a Canny output with a lot of edges, tens of thousands of
+ * contours and millions of points. Such frames are rejected as early as possible : no object is
+ * detected on them. A null value disables a limit.
+ */
+struct DetectionLimits
+{
+    DetectionLimits(double maxEdgeDensity=0.35, int maxContours=20000, int maxPoints=2000000, int maxKeypoints=1000) :
+        maxEdgeDensity(maxEdgeDensity),
+        maxContours(maxContours),
+        maxPoints(maxPoints),
+        maxKeypoints(maxKeypoints)
+    {}
+    double maxEdgeDensity;  ///< maximal fraction of edge pixels of the Canny output
+    int maxContours;        ///< maximal number of contours found on the edges
+    int maxPoints;          ///< maximal number of points of all the contours
+    int maxKeypoints;       ///< maximal number of keypoints per object, the strongest are kept
+};
+
+struct DetectionCounters
+{
+    int edgeMaps;               ///< number of checked edge maps
+    int edgeDensityBailouts;    ///< edge maps rejected by maxEdgeDensity
+    int contoursBailouts;       ///< contour sets rejected by maxContours
+    int pointsBailouts;         ///< contour sets rejected by maxPoints
+    int cappedKeypoints;        ///< keypoint sets reduced to maxKeypoints
+};
+
+void DGV_DLL_EXPORT setDetectionLimits(const DetectionLimits & limits);
+DetectionLimits DGV_DLL_EXPORT getDetectionLimits();
+
+DetectionCounters DGV_DLL_EXPORT getDetectionCounters();
+void DGV_DLL_EXPORT resetDetectionCounters();
+
+bool DGV_DLL_EXPORT checkEdgeDensity(const cv::Mat & edges);
+bool DGV_DLL_EXPORT checkContours(const std::vector< std::vector<cv::Point> > & contours);
+bool DGV_DLL_EXPORT capKeypoints(std::vector<cv::KeyPoint> & keypoints, cv::Mat * descriptors=0);
+
+
+
+// Frame quality methods
+//******************************************************************************************
+
+struct FrameQuality
+{
+    double sharpness;       ///< variance of the Laplacian
+    double meanIntensity;   ///< mean pixel value
+    double darkRatio;       ///< fraction of pixels below or equal to 5
+    double brightRatio;     ///< fraction of pixels above or equal to 250
+    double motion;          ///< mean absolute difference with the previous frame, -1 if no previous frame
+};
+
+void DGV_DLL_EXPORT computeFrameQuality(const cv::Mat & image, const cv::Mat & previous, FrameQuality * quality);
+
 
 //******************************************************************************************
 
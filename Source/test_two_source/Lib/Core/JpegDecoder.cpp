@@ -0,0 +1,760 @@
+
+// Std
+#include <string.h>
+#include <atomic>
+
+// Opencv
+#include <opencv2/imgcodecs.hpp>
+
+// Project
+#include "Global.h"
+#include "JpegDecoder.h"
+
+namespace ImageCommon
+{
+
+//******************************************************************************************
+
+namespace
+{
+
+const int ZIGZAG[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63
+};
+
+const int FAST_BITS = 9;
+
+//******************************************************************************************
+
+struct HuffmanTable
+{
+    HuffmanTable() : defined(false) {}
+
+    bool build(const uchar * counts, const uchar * symbols, int total)
+    {
+        memset(fast, 0, sizeof(fast));
+        memcpy(values, symbols, total);
+        int code = 0;
+        int k = 0;
+        for (int len=1; len<=16; len++)
+        {
+            int n = counts[len-1];
+            valptr[len] = k;
+            mincode[len] = code;
+            for (int i=0; i<n; i++, k++, code++)
+            {
+                if (len <= FAST_BITS)
+                {
+                    // All the lookups starting with this code
+                    int first = code << (FAST_BITS - len);
+                    int count = 1 << (FAST_BITS - len);
+                    for (int j=0; j<count; j++)
+                        fast[first + j] = (unsigned short) ((len << 8) | values[k]);
+                }
+            }
+            maxcode[len] = n > 0 ? code - 1 : -1;
+            if (code > (1 << len))
+                return false;
+            code <<= 1;
+        }
+        defined = true;
+        return true;
+    }
+
+    bool defined;
+    //! len << 8 | symbol for codes up to FAST_BITS bits, 0 for longer codes
+    unsigned short fast[1 << FAST_BITS];
+    int maxcode[17];
+    int mincode[17];
+    int valptr[17];
+    uchar values[256];
+};
+
+//******************************************************************************************
+/*!
+ * \brief The BitReader struct reads the entropy coded data of a restart interval.
+ * Stuffed bytes (0xFF 0x00) are removed, zeros are read past the end.
+ */
+struct BitReader
+{
+    BitReader(const uchar * begin, const uchar * end) :
+        p(begin), e(end), buffer(0), count(0)
+    {}
+
+    void fill()
+    {
+        while (count <= 24)
+        {
+            unsigned int b = 0;
+            if (p < e)
+            {
+                b = *p++;
+                if (b == 0xFF && p < e && *p == 0x00)
+                    p++;
+            }
+            buffer |= b << (24 - count);
+            count += 8;
+        }
+    }
+
+    int peek(int n)
+    {
+        fill();
+        return (int) (buffer >> (32 - n));
+    }
+
+    void skip(int n)
+    {
+        buffer <<= n;
+        count -= n;
+    }
+
+    int get(int n)
+    {
+        int v = peek(n);
+        skip(n);
+        return v;
+    }
+
+    const uchar * p;
+    const uchar * e;
+    unsigned int buffer;
+    int count;
+};
+
+//******************************************************************************************
+
+inline int decodeSymbol(BitReader & br, const HuffmanTable & t)
+{
+    int e = t.fast[br.peek(FAST_BITS)];
+    if (e)
+    {
+        br.skip(e >> 8);
+        return e & 0xFF;
+    }
+    int bits = br.peek(16);
+    for (int len=FAST_BITS+1; len<=16; len++)
+    {
+        int code = bits >> (16 - len);
+        if (code <= t.maxcode[len])
+        {
+            br.skip(len);
+            return t.values[t.valptr[len] + code - t.mincode[len]];
+        }
+    }
+    return -1;
+}
+
+//******************************************************************************************
+
+inline int extend(int v, int s)
+{
+    return v < (1 << (s - 1)) ? v - (1 << s) + 1 : v;
+}
+
+//******************************************************************************************
+
+struct Component
+{
+    int id;
+    int h;
+    int v;
+    int tq;
+    int td;
+    int ta;
+};
+
+struct JpegInfo
+{
+    JpegInfo() : width(0), height(0), restartInterval(0), adobeTransform(-1), orientation(1) {}
+
+    int width;
+    int height;
+    int restartInterval;
+    int adobeTransform;
+    //! EXIF orientation, 1 if not present
+    int orientation;
+    std::vector<Component> components;
+    //! Components of the scan, indices in components
+    std::vector<int> scan;
+    unsigned short quant[4][64];
+    HuffmanTable dc[4];
+    HuffmanTable ac[4];
+    //! Restart intervals of the scan data, [begin, end) offsets
+    std::vector<std::pair<size_t, size_t> > segments;
+};
+
+//******************************************************************************************
+
+inline int read16(const uchar * p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+inline int readExif(const uchar * p, int n, bool littleEndian)
+{
+    unsigned int v = 0;
+    for (int i=0; i<n; i++)
+        v |= (unsigned int) p[i] << (8 * (littleEndian ? i : n - 1 - i));
+    return (int) v;
+}
+
+/*!
+ * \brief readExifOrientation reads the orientation tag of the first IFD of an APP1 Exif segment
+ * \return orientation, 1 if not found
+ */
+int readExifOrientation(const uchar * seg, int length)
+{
+    if (length < 14 || memcmp(seg, "Exif\0\0", 6) != 0)
+        return 1;
+    const uchar * tiff = seg + 6;
+    int size = length - 6;
+    bool le = tiff[0] == 'I' && tiff[1] == 'I';
+    if (!le && !(tiff[0] == 'M' && tiff[1] == 'M'))
+        return 1;
+    int ifd = readExif(tiff + 4, 4, le);
+    if (ifd < 8 || ifd + 2 > size)
+        return 1;
+    int count = readExif(tiff + ifd, 2, le);
+    for (int i=0; i<count && ifd + 2 + 12*(i+1) <= size; i++)
+    {
+        const uchar * entry = tiff + ifd + 2 + 12*i;
+        if (readExif(entry, 2, le) == 0x0112)
+            return readExif(entry + 8, 2, le);
+    }
+    return 1;
+}
+
+/*!
+ * \brief parseJpeg reads the headers up to the first scan and splits the scan at the restart markers
+ * \return false if the image is not supported by the parallel decoder
+ */
+bool parseJpeg(const uchar * data, size_t size, JpegInfo * info)
+{
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        return false;
+
+    size_t pos = 2;
+    bool frame = false;
+    while (pos + 4 <= size)
+    {
+        if (data[pos] != 0xFF)
+            return false;
+        int marker = data[pos+1];
+        if (marker == 0xFF)
+        {
+            pos++;
+            continue;
+        }
+        pos += 2;
+        if (marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7) || marker == 0x01)
+            continue;
+        if (marker == 0xD9)
+            return false;
+
+        int length = read16(data + pos);
+        if (length < 2 || pos + length > size)
+            return false;
+        const uchar * seg = data + pos + 2;
+        int segLength = length - 2;
+
+        if (marker == 0xC0 || marker == 0xC1)
+        {
+            // Baseline or extended sequential, Huffman
+            if (segLength < 6 || seg[0] != 8)
+                return false;
+            info->height = read16(seg + 1);
+            info->width = read16(seg + 3);
+            int n = seg[5];
+            if ((n != 1 && n != 3) || segLength < 6 + 3*n || info->width <= 0 || info->height <= 0)
+                return false;
+            for (int i=0; i<n; i++)
+            {
+                Component c;
+                c.id = seg[6 + 3*i];
+                c.h = seg[7 + 3*i] >> 4;
+                c.v = seg[7 + 3*i] & 15;
+                c.tq = seg[8 + 3*i];
+                c.td = c.ta = 0;
+                if (c.h < 1 || c.h > 4 || c.v < 1 || c.v > 4 || c.tq > 3)
+                    return false;
+                info->components.push_back(c);
+            }
+            frame = true;
+        }
+        else if ((marker >= 0xC2 && marker <= 0xCF) && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+        {
+            // Progressive, lossless, hierarchical or arithmetic coding
+            return false;
+        }
+        else if (marker == 0xC4)
+        {
+            int k = 0;
+            while (k + 17 <= segLength)
+            {
+                int tc = seg[k] >> 4;
+                int th = seg[k] & 15;
+                if (tc > 1 || th > 3)
+                    return false;
+                const uchar * counts = seg + k + 1;
+                int total = 0;
+                for (int i=0; i<16; i++)
+                    total += counts[i];
+                if (total > 256 || k + 17 + total > segLength)
+                    return false;
+                HuffmanTable & t = tc == 0 ? info->dc[th] : info->ac[th];
+                if (!t.build(counts, seg + k + 17, total))
+                    return false;
+                k += 17 + total;
+            }
+        }
+        else if (marker == 0xDB)
+        {
+            int k = 0;
+            while (k < segLength)
+            {
+                int pq = seg[k] >> 4;
+                int tq = seg[k] & 15;
+                if (tq > 3 || k + 1 + 64 * (pq + 1) > segLength)
+                    return false;
+                for (int i=0; i<64; i++)
+                    info->quant[tq][i] = pq ? read16(seg + k + 1 + 2*i) : seg[k + 1 + i];
+                k += 1 + 64 * (pq + 1);
+            }
+        }
+        else if (marker == 0xDD)
+        {
+            if (segLength < 2)
+                return false;
+            info->restartInterval = read16(seg);
+        }
+        else if (marker == 0xE1)
+        {
+            info->orientation = readExifOrientation(seg, segLength);
+        }
+        else if (marker == 0xEE)
+        {
+            if (segLength >= 12 && memcmp(seg, "Adobe", 5) == 0)
+                info->adobeTransform = seg[11];
+        }
+        else if (marker == 0xDA)
+        {
+            if (!frame || segLength < 1)
+                return false;
+            int n = seg[0];
+            // Single interleaved scan with all components
+            if (n != (int) info->components.size() || segLength < 4 + 2*n)
+                return false;
+            for (int i=0; i<n; i++)
+            {
+                int id = seg[1 + 2*i];
+                int index = -1;
+                for (size_t j=0; j<info->components.size(); j++)
+                {
+                    if (info->components[j].id == id)
+                        index = (int) j;
+                }
+                if (index < 0)
+                    return false;
+                Component & c = info->components[index];
+                c.td = seg[2 + 2*i] >> 4;
+                c.ta = seg[2 + 2*i] & 15;
+                if (c.td > 3 || c.ta > 3 || !info->dc[c.td].defined || !info->ac[c.ta].defined)
+                    return false;
+                info->scan.push_back(index);
+            }
+            if (seg[1 + 2*n] != 0 || seg[2 + 2*n] != 63 || seg[3 + 2*n] != 0)
+                return false;
+
+            // Split the entropy coded data at the restart markers
+            pos += length;
+            size_t start = pos;
+            while (pos + 1 < size)
+            {
+                if (data[pos] != 0xFF)
+                {
+                    pos++;
+                    continue;
+                }
+                int next = data[pos+1];
+                if (next == 0x00)
+                {
+                    pos += 2;
+                }
+                else if (next == 0xFF)
+                {
+                    pos++;
+                }
+                else if (next >= 0xD0 && next <= 0xD7)
+                {
+                    info->segments.push_back(std::make_pair(start, pos));
+                    pos += 2;
+                    start = pos;
+                }
+                else
+                {
+                    break;
+                }
+            }
+            info->segments.push_back(std::make_pair(start, qMin(pos, size)));
+            return true;
+        }
+        pos += length;
+    }
+    return false;
+}
+
+//******************************************************************************************
+/*!
+ * \brief The Idct class computes the inverse DCT of a 8x8 block with the integer ISLOW transform
+ * of libjpeg (jidctint.c, default DCT method of cv::imdecode) : same fixed point constants,
+ * roundings and range limiting, so that the output is identical to the one of libjpeg.
+ */
+class Idct
+{
+public:
+    Idct()
+    {
+        // Range limiting of libjpeg : value & RANGE_MASK, then [0, 127] -> 128 + v,
+        // [128, 511] -> 255, [512, 895] -> 0, [896, 1023] -> v - 896
+        for (int v=0; v<RANGE_SIZE; v++)
+        {
+            int p = v < RANGE_SIZE / 2 ? v + 128 : v - RANGE_SIZE + 128;
+            _range[v] = (uchar) (p < 0 ? 0 : (p > 255 ? 255 : p));
+        }
+    }
+
+    void apply(const int * coef, uchar * out, int step, int width, int height) const
+    {
+        qint64 ws[64];
+
+        // Columns : results scaled up by 2^PASS1_BITS
+        for (int c=0; c<8; c++)
+        {
+            const int * in = coef + c;
+            qint64 * w = ws + c;
+            if (!in[8] && !in[16] && !in[24] && !in[32] && !in[40] && !in[48] && !in[56])
+            {
+                qint64 dc = (qint64) in[0] << PASS1_BITS;
+                for (int k=0; k<8; k++)
+                    w[8*k] = dc;
+                continue;
+            }
+            qint64 t[8];
+            transform(in[0], in[8], in[16], in[24], in[32], in[40], in[48], in[56], t);
+            for (int k=0; k<8; k++)
+                w[8*k] = descale(t[k], CONST_BITS - PASS1_BITS);
+        }
+
+        // Rows : results scaled down by 8 * 2^PASS1_BITS
+        uchar block[64];
+        for (int r=0; r<8; r++)
+        {
+            const qint64 * w = ws + 8*r;
+            uchar * o = block + 8*r;
+            if (!w[1] && !w[2] && !w[3] && !w[4] && !w[5] && !w[6] && !w[7])
+            {
+                uchar p = _range[descale(w[0], PASS1_BITS + 3) & RANGE_MASK];
+                memset(o, p, 8);
+                continue;
+            }
+            qint64 t[8];
+            transform(w[0], w[1], w[2], w[3], w[4], w[5], w[6], w[7], t);
+            for (int k=0; k<8; k++)
+                o[k] = _range[descale(t[k], CONST_BITS + PASS1_BITS + 3) & RANGE_MASK];
+        }
+
+        for (int y=0; y<height; y++)
+            memcpy(out + y*step, block + 8*y, width);
+    }
+
+private:
+
+    enum {
+        CONST_BITS = 13,
+        PASS1_BITS = 2,
+        RANGE_SIZE = 1024,
+        RANGE_MASK = RANGE_SIZE - 1
+    };
+
+    //! FIX(x) = x * 2^CONST_BITS rounded, values of jidctint.c
+    enum {
+        FIX_0_298631336 = 2446,
+        FIX_0_390180644 = 3196,
+        FIX_0_541196100 = 4433,
+        FIX_0_765366865 = 6270,
+        FIX_0_899976223 = 7373,
+        FIX_1_175875602 = 9633,
+        FIX_1_501321110 = 12299,
+        FIX_1_847759065 = 15137,
+        FIX_1_961570560 = 16069,
+        FIX_2_053119869 = 16819,
+        FIX_2_562915447 = 20995,
+        FIX_3_072711026 = 25172
+    };
+
+    static qint64 descale(qint64 x, int n)
+    { return (x + ((qint64) 1 << (n - 1))) >> n; }
+
+    //! 1D inverse DCT of 8 values, outputs scaled up by 2^CONST_BITS
+    static void transform(qint64 i0, qint64 i1, qint64 i2, qint64 i3, qint64 i4, qint64 i5, qint64 i6, qint64 i7, qint64 * o)
+    {
+        // Even part
+        qint64 z1 = (i2 + i6) * FIX_0_541196100;
+        qint64 tmp2 = z1 - i6 * FIX_1_847759065;
+        qint64 tmp3 = z1 + i2 * FIX_0_765366865;
+        qint64 tmp0 = (i0 + i4) << CONST_BITS;
+        qint64 tmp1 = (i0 - i4) << CONST_BITS;
+        qint64 tmp10 = tmp0 + tmp3;
+        qint64 tmp13 = tmp0 - tmp3;
+        qint64 tmp11 = tmp1 + tmp2;
+        qint64 tmp12 = tmp1 - tmp2;
+
+        // Odd part
+        tmp0 = i7;
+        tmp1 = i5;
+        tmp2 = i3;
+        tmp3 = i1;
+        z1 = tmp0 + tmp3;
+        qint64 z2 = tmp1 + tmp2;
+        qint64 z3 = tmp0 + tmp2;
+        qint64 z4 = tmp1 + tmp3;
+        qint64 z5 = (z3 + z4) * FIX_1_175875602;
+        tmp0 *= FIX_0_298631336;
+        tmp1 *= FIX_2_053119869;
+        tmp2 *= FIX_3_072711026;
+        tmp3 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 = z3 * -FIX_1_961570560 + z5;
+        z4 = z4 * -FIX_0_390180644 + z5;
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        o[0] = tmp10 + tmp3;
+        o[7] = tmp10 - tmp3;
+        o[1] = tmp11 + tmp2;
+        o[6] = tmp11 - tmp2;
+        o[2] = tmp12 + tmp1;
+        o[5] = tmp12 - tmp1;
+        o[3] = tmp13 + tmp0;
+        o[4] = tmp13 - tmp0;
+    }
+
+    uchar _range[RANGE_SIZE];
+};
+
+//******************************************************************************************
+/*!
+ * \brief The RestartIntervalInvoker class decodes restart intervals. Each interval starts with
+ * null DC predictions on byte boundary, so intervals are independent.
+ */
+class RestartIntervalInvoker : public cv::ParallelLoopBody
+{
+public:
+    RestartIntervalInvoker(const uchar * data, const JpegInfo & info, cv::Mat & out, std::atomic<bool> * error) :
+        _data(data), _info(info), _out(out), _error(error)
+    {
+        const Component & y = info.components[0];
+        _interleaved = info.scan.size() > 1;
+        if (_interleaved)
+        {
+            int hmax = 1, vmax = 1;
+            for (size_t i=0; i<info.components.size(); i++)
+            {
+                hmax = qMax(hmax, info.components[i].h);
+                vmax = qMax(vmax, info.components[i].v);
+            }
+            _mcusX = (info.width + 8*hmax - 1) / (8*hmax);
+            _mcusY = (info.height + 8*vmax - 1) / (8*vmax);
+        }
+        else
+        {
+            // Single component scan : one block per MCU
+            _mcusX = (info.width + 7) / 8;
+            _mcusY = (info.height + 7) / 8;
+        }
+        _lumaH = _interleaved ? y.h : 1;
+        _lumaV = _interleaved ? y.v : 1;
+    }
+
+    int mcuCount() const
+    { return _mcusX * _mcusY; }
+
+    void operator()(const cv::Range& range) const
+    {
+        int coef[64];
+        int ri = _info.restartInterval;
+        int total = mcuCount();
+        for (int s = range.start; s < range.end && !_error->load(); s++)
+        {
+            BitReader br(_data + _info.segments[s].first, _data + _info.segments[s].second);
+            int pred[3] = {0, 0, 0};
+            int last = qMin((s + 1) * ri, total);
+            for (int m = s * ri; m < last; m++)
+            {
+                int mx = m % _mcusX;
+                int my = m / _mcusX;
+                for (size_t k=0; k<_info.scan.size(); k++)
+                {
+                    int ci = _info.scan[k];
+                    const Component & c = _info.components[ci];
+                    int nh = _interleaved ? c.h : 1;
+                    int nv = _interleaved ? c.v : 1;
+                    bool luma = ci == 0;
+                    for (int by=0; by<nv; by++)
+                    {
+                        for (int bx=0; bx<nh; bx++)
+                        {
+                            if (!decodeBlock(br, c, &pred[ci], luma ? coef : 0))
+                            {
+                                _error->store(true);
+                                return;
+                            }
+                            if (!luma)
+                                continue;
+                            int px = (mx * _lumaH + bx) * 8;
+                            int py = (my * _lumaV + by) * 8;
+                            if (px >= _out.cols || py >= _out.rows)
+                                continue;
+                            _idct.apply(coef, _out.ptr<uchar>(py) + px, (int) _out.step,
+                                        qMin(8, _out.cols - px), qMin(8, _out.rows - py));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+private:
+
+    bool decodeBlock(BitReader & br, const Component & c, int * pred, int * coef) const
+    {
+        const HuffmanTable & dc = _info.dc[c.td];
+        const HuffmanTable & ac = _info.ac[c.ta];
+        const unsigned short * q = _info.quant[c.tq];
+
+        int s = decodeSymbol(br, dc);
+        if (s < 0 || s > 11)
+            return false;
+        *pred += s ? extend(br.get(s), s) : 0;
+        if (coef)
+        {
+            // Coefficients are 16 bits in libjpeg
+            memset(coef, 0, 64 * sizeof(int));
+            coef[0] = (short) *pred * q[0];
+        }
+
+        for (int k=1; k<64; )
+        {
+            int rs = decodeSymbol(br, ac);
+            if (rs < 0)
+                return false;
+            int r = rs >> 4;
+            s = rs & 15;
+            if (s == 0)
+            {
+                if (r != 15)
+                    break;
+                k += 16;
+                continue;
+            }
+            k += r;
+            if (k > 63)
+                return false;
+            int v = extend(br.get(s), s);
+            if (coef)
+                coef[ZIGZAG[k]] = v * q[k];
+            k++;
+        }
+        return true;
+    }
+
+    const uchar * _data;
+    const JpegInfo & _info;
+    cv::Mat & _out;
+    std::atomic<bool> * _error;
+    Idct _idct;
+    bool _interleaved;
+    int _mcusX;
+    int _mcusY;
+    int _lumaH;
+    int _lumaV;
+};
+
+//******************************************************************************************
+
+cv::Mat decodeStandard(const uchar * data, size_t size)
+{
+    cv::Mat buffer(1, (int) size, CV_8U, (void*) data);
+    return cv::imdecode(buffer, cv::IMREAD_GRAYSCALE);
+}
+
+}
+
+//******************************************************************************************
+/*!
+ * \brief decodeJpegGray decodes the luminance of a JPEG image
+ * \param data encoded image (any format supported by cv::imdecode)
+ * \param size data size in bytes
+ * \param mode JPEG_PARALLEL_RESTART to decode the restart intervals in parallel when possible
+ * \param parallel (optional) output, true if the parallel decoder was used
+ * \return image of type CV_8UC1, empty if the data cannot be decoded
+ */
+cv::Mat decodeJpegGray(const uchar *data, size_t size, JpegDecoding mode, bool * parallel)
+{
+    if (parallel)
+        *parallel = false;
+    if (!data || size == 0)
+    {
+        SD_TRACE("decodeJpegGray : data is empty");
+        return cv::Mat();
+    }
+    if (mode == JPEG_STANDARD)
+        return decodeStandard(data, size);
+
+    JpegInfo info;
+    if (!parseJpeg(data, size, &info) || info.restartInterval == 0 || info.orientation != 1)
+        return decodeStandard(data, size);
+
+    // Luminance should be the first component, at full resolution
+    if (info.components.size() == 3)
+    {
+        const Component & y = info.components[0];
+        bool rgb = info.adobeTransform == 0 ||
+                (info.components[0].id == 'R' && info.components[1].id == 'G' && info.components[2].id == 'B');
+        if (rgb || y.h < info.components[1].h || y.h < info.components[2].h ||
+                y.v < info.components[1].v || y.v < info.components[2].v)
+            return decodeStandard(data, size);
+    }
+
+    cv::Mat out(info.height, info.width, CV_8U);
+    std::atomic<bool> error(false);
+    RestartIntervalInvoker invoker(data, info, out, &error);
+    int expected = (invoker.mcuCount() + info.restartInterval - 1) / info.restartInterval;
+    if ((int) info.segments.size() < expected || expected < 2)
+        return decodeStandard(data, size);
+
+    cv::parallel_for_(cv::Range(0, expected), invoker);
+    if (error.load())
+    {
+        SD_TRACE("decodeJpegGray : corrupted restart interval, use the standard decoder");
+        return decodeStandard(data, size);
+    }
+    if (parallel)
+        *parallel = true;
+    return out;
+}
+
+//******************************************************************************************
+
+}
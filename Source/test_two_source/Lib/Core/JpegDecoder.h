@@ -0,0 +1,43 @@
+#ifndef JPEGDECODER_H
+#define JPEGDECODER_H
+
+// Std
+#include <vector>
+
+// Opencv
+#include <opencv2/core.hpp>
+
+// Project
+#include "LibExport.h"
+
+namespace ImageCommon
+{
+
+//******************************************************************************************
+/*!
+ * Parallel grayscale decoding of baseline JPEG images with restart markers.
+ *
+ * Restart markers reset the entropy decoder state (DC predictions, bit alignment), so the
+ * restart intervals of the scan can be entropy decoded independently. Intervals are decoded in
+ * parallel and the luminance blocks are written directly into the output matrix. Chrominance
+ * blocks are entropy decoded (to advance in the bit stream) but not transformed. The inverse DCT
+ * is the integer ISLOW transform of libjpeg, the output is identical to cv::imdecode.
+ *
+ * Supported : baseline/extended sequential Huffman, 8 bits, one scan with 1 component or
+ * 3 components (YCbCr) with full resolution luminance. Other images (progressive, no restart
+ * markers, CMYK, Adobe RGB, EXIF orientation other than 1, ...) are decoded with cv::imdecode
+ * and cv::IMREAD_GRAYSCALE, so that the result does not depend on the decoder.
+ */
+
+enum JpegDecoding {
+    JPEG_STANDARD=0,        ///< always cv::imdecode
+    JPEG_PARALLEL_RESTART=1 ///< parallel decoding if the image has restart markers
+};
+
+cv::Mat DGV_DLL_EXPORT decodeJpegGray(const uchar * data, size_t size, JpegDecoding mode=JPEG_PARALLEL_RESTART, bool * parallel=0);
+
+//******************************************************************************************
+
+}
+
+#endif // JPEGDECODER_H
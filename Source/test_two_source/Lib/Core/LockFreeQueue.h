@@ -0,0 +1,126 @@
+#ifndef LOCKFREEQUEUE_H
+#define LOCKFREEQUEUE_H
+
+// Qt
+#include <QtGlobal>
+#include <QAtomicInteger>
+
+//******************************************************************************************
+/*!
+ * \brief The LockFreeQueue class is a bounded multi-producer multi-consumer queue
+ * (D. Vyukov's algorithm). Each cell holds a sequence number telling whether the cell is ready
+ * to be written or read for a given position, so producers and consumers only compete with
+ * a compare-and-swap on the positions and never block.
+ *
+ * push fails when the queue is full and pop fails when the queue is empty. T should be
+ * default constructible and copyable.
+ */
+template<typename T>
+class LockFreeQueue
+{
+public:
+    explicit LockFreeQueue(int capacity=1024)
+    {
+        // Round up to a power of 2 to index the cells with a mask
+        quint32 size = 2;
+        while (size < (quint32) capacity)
+            size <<= 1;
+        _mask = size - 1;
+        _cells = new Cell[size];
+        for (quint32 i=0; i<size; i++)
+            _cells[i].sequence.store(i);
+        _enqueuePos.store(0);
+        _dequeuePos.store(0);
+    }
+
+    ~LockFreeQueue()
+    {
+        delete [] _cells;
+    }
+
+    int capacity() const
+    { return (int) _mask + 1; }
+
+    bool push(const T & value)
+    {
+        Cell * cell;
+        quint32 pos = _enqueuePos.load();
+        for (;;)
+        {
+            cell = &_cells[pos & _mask];
+            quint32 seq = cell->sequence.loadAcquire();
+            qint32 diff = (qint32) (seq - pos);
+            if (diff == 0)
+            {
+                if (_enqueuePos.testAndSetRelaxed(pos, pos + 1))
+                    break;
+                pos = _enqueuePos.load();
+            }
+            else if (diff < 0)
+            {
+                // Full
+                return false;
+            }
+            else
+            {
+                pos = _enqueuePos.load();
+            }
+        }
+        cell->value = value;
+        cell->sequence.storeRelease(pos + 1);
+        return true;
+    }
+
+    bool pop(T * value)
+    {
+        Cell * cell;
+        quint32 pos = _dequeuePos.load();
+        for (;;)
+        {
+            cell = &_cells[pos & _mask];
+            quint32 seq = cell->sequence.loadAcquire();
+            qint32 diff = (qint32) (seq - (pos + 1));
+            if (diff == 0)
+            {
+                if (_dequeuePos.testAndSetRelaxed(pos, pos + 1))
+                    break;
+                pos = _dequeuePos.load();
+            }
+            else if (diff < 0)
+            {
+                // Empty
+                return false;
+            }
+            else
+            {
+                pos = _dequeuePos.load();
+            }
+        }
+        *value = cell->value;
+        cell->sequence.storeRelease(pos + _mask + 1);
+        return true;
+    }
+
+private:
+    Q_DISABLE_COPY(LockFreeQueue)
+
+    struct Cell
+    {
+        QAtomicInteger<quint32> sequence;
+        T value;
+    };
+
+    Cell * _cells;
+    quint32 _mask;
+
+    // Positions on separate cache lines : producers and consumers do not share them
+    char _pad0[64];
+    QAtomicInteger<quint32> _enqueuePos;
+    char _pad1[64];
+    QAtomicInteger<quint32> _dequeuePos;
+    char _pad2[64];
+};
+
+//******************************************************************************************
+
+#endif // LOCKFREEQUEUE_H
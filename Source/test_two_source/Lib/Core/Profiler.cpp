@@ -0,0 +1,471 @@
+
+// Std
+#include <string.h>
+#include <vector>
+
+// Qt
+#include <QFile>
+#include <QTextStream>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
+
+// Opencv
+#include <opencv2/core.hpp>
+
+// Linux
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Project
+#include "Global.h"
+#include "Profiler.h"
+
+namespace Profiler
+{
+
+//******************************************************************************************
+
+QAtomicInt ENABLED(0);
+QAtomicInt COUNTERS_ENABLED(0);
+QMutex ZONES_MUTEX;
+QMap<QString, ZoneStats> ZONES;
+
+//! Calls of a zone running at the same time, see ZoneStats::wallMsec
+struct ZoneActivity
+{
+    ZoneActivity() : running(0), since(0) {}
+    int running;
+    qint64 since;
+};
+QMap<QString, ZoneActivity> ACTIVITIES;
+
+//******************************************************************************************
+
+static QElapsedTimer startedClock()
+{
+    QElapsedTimer clock;
+    clock.start();
+    return clock;
+}
+
+//******************************************************************************************
+/*!
+ * \brief clockNsecs returns the time in nanoseconds of a clock shared by all the threads
+ */
+static qint64 clockNsecs()
+{
+    static const QElapsedTimer clock = startedClock();
+    return clock.nsecsElapsed();
+}
+
+//******************************************************************************************
+
+void setEnabled(bool enabled)
+{
+    ENABLED.store(enabled ? 1 : 0);
+}
+
+//******************************************************************************************
+
+bool isEnabled()
+{
+    return ENABLED.load() != 0;
+}
+
+//******************************************************************************************
+
+void setCountersEnabled(bool enabled)
+{
+    COUNTERS_ENABLED.store(enabled ? 1 : 0);
+}
+
+//******************************************************************************************
+
+#ifdef __linux__
+/*!
+ * \brief openCounter opens a hardware counter of the calling thread
+ * \param config one of PERF_COUNT_HW_* values
+ * \param groupFd file descriptor of the group leader or -1 to create a new group
+ * \return file descriptor or -1 if counter is not available (no PMU, perf_event_paranoid, etc)
+ */
+int openCounter(quint64 config, int groupFd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = groupFd < 0 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+const quint64 COUNTER_CONFIGS[COUNTERS_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+#endif
+
+//******************************************************************************************
+
+bool countersAvailable()
+{
+#ifdef __linux__
+    int fd = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (fd < 0)
+        return false;
+    close(fd);
+    return true;
+#else
+    return false;
+#endif
+}
+
+//******************************************************************************************
+
+void reset()
+{
+    QMutexLocker locker(&ZONES_MUTEX);
+    ZONES.clear();
+    // Running zones are counted from now
+    for (QMap<QString, ZoneActivity>::iterator it = ACTIVITIES.begin(); it != ACTIVITIES.end(); ++it)
+        it->since = it->running > 0 ? clockNsecs() : 0;
+}
+
+//******************************************************************************************
+
+QList<ZoneStats> zoneStats()
+{
+    QMutexLocker locker(&ZONES_MUTEX);
+    return ZONES.values();
+}
+
+//******************************************************************************************
+
+Zone::Zone(const char *name, double bytes, double flops) :
+    _name(name),
+    _bytes(bytes),
+    _flops(flops),
+    _active(ENABLED.load() != 0)
+{
+    for (int i=0; i<COUNTERS_COUNT; i++)
+        _fds[i] = -1;
+
+    if (!_active)
+        return;
+
+    qint64 now = clockNsecs();
+    {
+        QMutexLocker locker(&ZONES_MUTEX);
+        ZoneActivity & activity = ACTIVITIES[QString(_name)];
+        if (activity.running++ == 0)
+            activity.since = now;
+    }
+
+#ifdef __linux__
+    if (COUNTERS_ENABLED.load() != 0)
+    {
+        _fds[0] = openCounter(COUNTER_CONFIGS[0], -1);
+        if (_fds[0] >= 0)
+        {
+            for (int i=1; i<COUNTERS_COUNT; i++)
+                _fds[i] = openCounter(COUNTER_CONFIGS[i], _fds[0]);
+            ioctl(_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+#endif
+
+    _timer.start();
+}
+
+//******************************************************************************************
+
+Zone::~Zone()
+{
+    if (!_active)
+        return;
+
+    double msec = _timer.nsecsElapsed() * 1e-6;
+    qint64 now = clockNsecs();
+
+    double counters[COUNTERS_COUNT];
+    for (int i=0; i<COUNTERS_COUNT; i++)
+        counters[i] = -1.0;
+
+#ifdef __linux__
+    if (_fds[0] >= 0)
+    {
+        ioctl(_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        // Group read format : { nr, values[nr] } in the order the counters were added
+        quint64 values[1 + COUNTERS_COUNT];
+        if (read(_fds[0], values, sizeof(values)) > 0)
+        {
+            int index = 0;
+            for (int i=0; i<COUNTERS_COUNT && index < (int) values[0]; i++)
+            {
+                if (_fds[i] < 0)
+                    continue;
+                counters[i] = (double) values[1 + index];
+                index++;
+            }
+        }
+        for (int i=COUNTERS_COUNT-1; i>=0; i--)
+        {
+            if (_fds[i] >= 0)
+                close(_fds[i]);
+        }
+    }
+#endif
+
+    QMutexLocker locker(&ZONES_MUTEX);
+    QString name(_name);
+    // Wall time is counted once for concurrent calls : when the last running call ends
+    double wallMsec = 0.0;
+    ZoneActivity & activity = ACTIVITIES[name];
+    if (--activity.running == 0)
+        wallMsec = (now - activity.since) * 1e-6;
+
+    QMap<QString, ZoneStats>::iterator it = ZONES.find(name);
+    if (it == ZONES.end())
+    {
+        ZoneStats stats;
+        stats.name = name;
+        stats.calls = 0;
+        stats.msec = 0.0;
+        stats.wallMsec = 0.0;
+        stats.bytes = 0.0;
+        stats.flops = 0.0;
+        for (int i=0; i<COUNTERS_COUNT; i++)
+            stats.counters[i] = counters[i];
+        it = ZONES.insert(name, stats);
+    }
+    else
+    {
+        for (int i=0; i<COUNTERS_COUNT; i++)
+        {
+            if (it->counters[i] >= 0.0 && counters[i] >= 0.0)
+                it->counters[i] += counters[i];
+            else
+                it->counters[i] = -1.0;
+        }
+    }
+    it->calls++;
+    it->msec += msec;
+    it->wallMsec += wallMsec;
+    it->bytes += _bytes;
+    it->flops += _flops;
+}
+
+//******************************************************************************************
+
+class TriadInvoker : public cv::ParallelLoopBody
+{
+public:
+    TriadInvoker(float * a, const float * b, const float * c, size_t size, int nstripes) :
+        _a(a), _b(b), _c(c), _size(size), _nstripes(nstripes)
+    {}
+
+    void operator()(const cv::Range& range) const
+    {
+        for (int s = range.start; s < range.end; s++)
+        {
+            size_t start = _size * s / _nstripes;
+            size_t end = _size * (s + 1) / _nstripes;
+            for (size_t i = start; i < end; i++)
+                _a[i] = _b[i] + 3.0f * _c[i];
+        }
+    }
+
+private:
+    float * _a;
+    const float * _b;
+    const float * _c;
+    size_t _size;
+    int _nstripes;
+};
+
+//******************************************************************************************
+
+class FmaInvoker : public cv::ParallelLoopBody
+{
+public:
+    FmaInvoker(int iterations, float * output) :
+        _iterations(iterations), _output(output)
+    {}
+
+    void operator()(const cv::Range& range) const
+    {
+        for (int s = range.start; s < range.end; s++)
+        {
+            // Independent accumulators to hide the FMA latency and let the compiler vectorize
+            float acc[32];
+            for (int k=0; k<32; k++)
+                acc[k] = 1.0f + k * 1e-3f;
+            for (int i=0; i<_iterations; i++)
+            {
+                for (int k=0; k<32; k++)
+                    acc[k] = acc[k] * 0.999999f + 1e-7f;
+            }
+            float sum = 0.0f;
+            for (int k=0; k<32; k++)
+                sum += acc[k];
+            _output[s] = sum;
+        }
+    }
+
+private:
+    int _iterations;
+    float * _output;
+};
+
+//******************************************************************************************
+/*!
+ * \brief measureMachinePeak measures the practical peak of the machine with all OpenCV threads
+ * \param sizeMB size of each array used by the bandwidth (triad) test. Should be larger than LLC.
+ * \return bandwidth in GB/s and compute throughput in GFLOP/s
+ */
+MachinePeak measureMachinePeak(int sizeMB)
+{
+    MachinePeak peak;
+    int nstripes = qMax(1, cv::getNumThreads());
+
+    // Bandwidth : a = b + s*c, 3 arrays -> 12 bytes per element
+    size_t size = (size_t) sizeMB * 1024 * 1024 / sizeof(float);
+    std::vector<float> a(size, 0.0f), b(size, 1.0f), c(size, 2.0f);
+    double bestMsec = -1.0;
+    for (int r=0; r<5; r++)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        cv::parallel_for_(cv::Range(0, nstripes), TriadInvoker(&a[0], &b[0], &c[0], size, nstripes));
+        double msec = timer.nsecsElapsed() * 1e-6;
+        if (bestMsec < 0.0 || msec < bestMsec)
+            bestMsec = msec;
+    }
+    peak.bandwidth = 3.0 * size * sizeof(float) / (bestMsec * 1e6);
+
+    // Compute : 2 flops per accumulator update
+    int iterations = 1 << 20;
+    std::vector<float> output(nstripes);
+    bestMsec = -1.0;
+    for (int r=0; r<3; r++)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        cv::parallel_for_(cv::Range(0, nstripes), FmaInvoker(iterations, &output[0]));
+        double msec = timer.nsecsElapsed() * 1e-6;
+        if (bestMsec < 0.0 || msec < bestMsec)
+            bestMsec = msec;
+    }
+    peak.gflops = 2.0 * 32.0 * iterations * nstripes / (bestMsec * 1e6);
+    peak.threads = nstripes;
+
+    SD_TRACE2("Machine peak : %1 GB/s, %2 GFLOP/s", peak.bandwidth, peak.gflops);
+    return peak;
+}
+
+//******************************************************************************************
+/*!
+ * \brief machinePeak returns the machine peak, measured once (see measureMachinePeak)
+ * \param cacheFile (optional) text file keeping the peak between runs. The peak is measured
+ * again if the file is missing or if it was measured with another number of threads
+ */
+MachinePeak machinePeak(const QString & cacheFile)
+{
+    static QMutex mutex;
+    static MachinePeak cached;
+    QMutexLocker locker(&mutex);
+
+    int threads = qMax(1, cv::getNumThreads());
+    if (cached.threads == threads)
+        return cached;
+
+    if (!cacheFile.isEmpty())
+    {
+        QFile file(cacheFile);
+        if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            QTextStream in(&file);
+            MachinePeak peak;
+            in >> peak.bandwidth >> peak.gflops >> peak.threads;
+            if (in.status() == QTextStream::Ok && peak.threads == threads &&
+                    peak.bandwidth > 0.0 && peak.gflops > 0.0)
+            {
+                cached = peak;
+                return cached;
+            }
+        }
+    }
+
+    cached = measureMachinePeak();
+    if (!cacheFile.isEmpty())
+    {
+        QFile file(cacheFile);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate))
+        {
+            QTextStream out(&file);
+            out << cached.bandwidth << " " << cached.gflops << " " << cached.threads << "\n";
+        }
+        else
+        {
+            SD_TRACE1("machinePeak : can not write the cache file '%1'", cacheFile);
+        }
+    }
+    return cached;
+}
+
+//******************************************************************************************
+/*!
+ * \brief report prints zone statistics. If the peak is given, the achieved bandwidth and throughput
+ * are compared to the roofline : attainable = min(peak flops, arithmetic intensity * peak bandwidth).
+ * Achieved values are the work of all the calls over the wall time of the zone (see ZoneStats)
+ */
+void report(const MachinePeak & peak)
+{
+    QList<ZoneStats> stats = zoneStats();
+    SD_TRACE("Profiler report :");
+    foreach (ZoneStats s, stats)
+    {
+        double msecPerCall = s.msec / s.calls;
+        SD_TRACE4("  %1 : calls=%2, total=%3 msec, per call=%4 msec", s.name, s.calls, s.msec, msecPerCall);
+
+        if ((s.bytes > 0.0 || s.flops > 0.0) && s.wallMsec > 0.0)
+        {
+            double gbs = s.bytes / (s.wallMsec * 1e6);
+            double gflops = s.flops / (s.wallMsec * 1e6);
+            SD_TRACE2("    achieved : %1 GB/s, %2 GFLOP/s", gbs, gflops);
+
+            if (peak.bandwidth > 0.0 && peak.gflops > 0.0 && s.bytes > 0.0)
+            {
+                double intensity = s.flops / s.bytes;
+                double attainable = qMin(peak.gflops, intensity * peak.bandwidth);
+                QString bound = intensity * peak.bandwidth < peak.gflops ? "memory-bound" : "compute-bound";
+                SD_TRACE4("    intensity : %1 flop/byte, %2, %3% of peak bandwidth, %4% of roofline",
+                          intensity, bound, 100.0 * gbs / peak.bandwidth, 100.0 * gflops / attainable);
+            }
+        }
+
+        if (s.counters[CYCLES] > 0.0)
+        {
+            double ipc = s.counters[INSTRUCTIONS] > 0.0 ? s.counters[INSTRUCTIONS] / s.counters[CYCLES] : -1.0;
+            SD_TRACE4("    counters per call : cycles=%1, IPC=%2, LLC misses=%3, branch misses=%4",
+                      s.counters[CYCLES] / s.calls, ipc,
+                      s.counters[LLC_MISSES] / s.calls, s.counters[BRANCH_MISSES] / s.calls);
+        }
+    }
+}
+
+//******************************************************************************************
+
+}
@@ -0,0 +1,109 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Qt
+#include <QString>
+#include <QList>
+#include <QElapsedTimer>
+
+// Project
+#include "Global.h"
+#include "LibExport.h"
+
+namespace Profiler
+{
+
+//******************************************************************************************
+/*!
+ * Profiler zones measure the wall time of a code block and, on Linux, optionally read the
+ * hardware counters of the calling thread (perf_event_open). A zone can be annotated with
+ * the number of bytes moved and floating point operations done by the kernel, so that the
+ * report gives the achieved GB/s and GFLOP/s next to the measured machine peak (roofline).
+ * Zones without estimates (PROFILE_TIME_ZONE) are timed only and are not placed on the roofline.
+ *
+ * Concurrent calls of a zone (several workers) are aggregated : the achieved throughput is the work
+ * of all the calls over the time during which at least one call runs, comparable with the peak
+ * of all the threads. Hardware counters are those of the calling thread only.
+ *
+ * Zones are disabled by default and cost a single flag test in this case.
+ *
+ * Usage :
+ *  {
+ *      PROFILE_ZONE("freqFilter", bytes, flops);
+ *      ... kernel ...
+ *  }
+ */
+
+enum Counter {
+    CYCLES=0,
+    INSTRUCTIONS=1,
+    LLC_MISSES=2,
+    BRANCH_MISSES=3,
+    COUNTERS_COUNT=4
+};
+
+struct ZoneStats
+{
+    QString name;
+    int calls;
+    double msec;        ///< sum of the call times
+    double wallMsec;    ///< time during which at least one call runs
+    double bytes;
+    double flops;
+    double counters[COUNTERS_COUNT]; ///< -1 if the counter is not available
+};
+
+struct MachinePeak
+{
+    MachinePeak() : bandwidth(0.0), gflops(0.0), threads(0) {}
+    double bandwidth; ///< GB/s
+    double gflops;    ///< GFLOP/s
+    int threads;      ///< number of threads of the measure
+};
+
+void DGV_DLL_EXPORT setEnabled(bool enabled);
+bool DGV_DLL_EXPORT isEnabled();
+
+void DGV_DLL_EXPORT setCountersEnabled(bool enabled);
+bool DGV_DLL_EXPORT countersAvailable();
+
+void DGV_DLL_EXPORT reset();
+QList<ZoneStats> DGV_DLL_EXPORT zoneStats();
+
+MachinePeak DGV_DLL_EXPORT measureMachinePeak(int sizeMB=64);
+MachinePeak DGV_DLL_EXPORT machinePeak(const QString & cacheFile=QString());
+void DGV_DLL_EXPORT report(const MachinePeak & peak=MachinePeak());
+
+//******************************************************************************************
+
+class DGV_DLL_EXPORT Zone
+{
+public:
+    Zone(const char * name, double bytes=0.0, double flops=0.0);
+    ~Zone();
+
+private:
+    Zone(const Zone &);
+    Zone & operator=(const Zone &);
+
+    const char * _name;
+    double _bytes;
+    double _flops;
+    bool _active;
+    QElapsedTimer _timer;
+    int _fds[COUNTERS_COUNT];
+};
+
+//******************************************************************************************
+
+}
+
+#ifdef TIME_PROFILER_ON
+#   define PROFILE_ZONE(name, bytes, flops) Profiler::Zone profilerZone(name, bytes, flops);
+#   define PROFILE_TIME_ZONE(name) Profiler::Zone profilerZone(name);
+#else
+#   define PROFILE_ZONE(name, bytes, flops)
+#   define PROFILE_TIME_ZONE(name)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,589 @@
+
+// Std
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+// Qt
+#include <QHash>
+
+// Opencv
+#include <opencv2/imgcodecs.hpp>
+
+// Project
+#include "Global.h"
+#include "SessionLog.h"
+
+namespace ImageCommon
+{
+
+//******************************************************************************************
+
+// Log layout : file header, then records aligned on 8 bytes. A null record size ends the log.
+
+static const char LOG_MAGIC[4] = {'D', 'G', 'V', 'S'};
+static const quint32 LOG_VERSION = 1;
+
+enum RecordType {
+    RECORD_RAW_FRAME=1,
+    RECORD_ENCODED_FRAME=2,
+    RECORD_STAGE=3
+};
+
+struct FileHeader
+{
+    char magic[4];
+    quint32 version;
+};
+
+struct RecordHeader
+{
+    //! Size of the record with its header, written last
+    quint32 size;
+    quint16 type;
+    quint16 stream;
+    qint32 frame;
+    qint32 reserved;
+    qint64 timestamp;
+};
+
+struct RawFrameHeader
+{
+    qint32 rows;
+    qint32 cols;
+    qint32 type;
+    qint32 reserved;
+};
+
+struct StageRecord
+{
+    char name[16];
+    double ms;
+};
+
+static qint64 alignedSize(qint64 size)
+{
+    return (size + 7) & ~((qint64) 7);
+}
+
+struct CompareTimestamps
+{
+    template <typename Entry>
+    bool operator() (const Entry & e1, const Entry & e2) const
+    { return e1.timestamp < e2.timestamp; }
+};
+
+//******************************************************************************************
+/*!
+ * \brief commitRecord writes the record header. The size is written after the record content is
+ * visible, so that a reader of an unclosed log never sees a partial record
+ */
+static void commitRecord(uchar * record, quint32 size, RecordType type, int stream, int frame, qint64 timestamp)
+{
+    RecordHeader * h = (RecordHeader *) record;
+    h->type = (quint16) type;
+    h->stream = (quint16) stream;
+    h->frame = frame;
+    h->reserved = 0;
+    h->timestamp = timestamp;
+    std::atomic_thread_fence(std::memory_order_release);
+    h->size = size;
+}
+
+//******************************************************************************************
+
+SessionRecorder::SessionRecorder() :
+    _data(0),
+    _capacity(0),
+    _offset(0),
+    _dropped(0),
+    _frameFormat(FRAME_JPEG),
+    _frameSampling(1)
+{
+}
+
+//******************************************************************************************
+
+SessionRecorder::~SessionRecorder()
+{
+    close();
+}
+
+//******************************************************************************************
+/*!
+ * \brief SessionRecorder::open creates the log file and maps it
+ * \param path log file, overwritten
+ * \param capacity maximal size of the log in bytes
+ * \return false if the file can not be created or mapped
+ */
+bool SessionRecorder::open(const QString &path, qint64 capacity)
+{
+    close();
+    if (capacity <= (qint64) sizeof(FileHeader))
+    {
+        SD_TRACE("SessionRecorder::open : capacity is too small");
+        return false;
+    }
+
+    _file.setFileName(path);
+    if (!_file.open(QIODevice::ReadWrite | QIODevice::Truncate) || !_file.resize(capacity))
+    {
+        SD_TRACE1("SessionRecorder::open : failed to create the log '%1'", path);
+        _file.close();
+        return false;
+    }
+    _data = _file.map(0, capacity);
+    if (!_data)
+    {
+        SD_TRACE1("SessionRecorder::open : failed to map the log '%1'", path);
+        _file.close();
+        return false;
+    }
+
+    FileHeader * h = (FileHeader *) _data;
+    memcpy(h->magic, LOG_MAGIC, sizeof(LOG_MAGIC));
+    h->version = LOG_VERSION;
+
+    _capacity = capacity;
+    _offset.store(sizeof(FileHeader));
+    _dropped.store(0);
+    _timer.start();
+    return true;
+}
+
+//******************************************************************************************
+/*!
+ * \brief SessionRecorder::close unmaps the log and truncates it to the recorded size.
+ * Records should not be appended during the close
+ */
+void SessionRecorder::close()
+{
+    if (!_data)
+        return;
+    qint64 used = sizeof(FileHeader) + size();
+    _file.unmap(_data);
+    _data = 0;
+    _file.resize(used);
+    _file.close();
+}
+
+//******************************************************************************************
+
+qint64 SessionRecorder::timestamp() const
+{
+    return _timer.isValid() ? _timer.nsecsElapsed() : 0;
+}
+
+//******************************************************************************************
+
+qint64 SessionRecorder::size() const
+{
+    return qMin(_offset.load(), _capacity) - (qint64) sizeof(FileHeader);
+}
+
+//******************************************************************************************
+
+uchar * SessionRecorder::reserve(qint64 size)
+{
+    if (!_data)
+        return 0;
+    qint64 offset = _offset.fetch_add(size);
+    if (offset + size > _capacity)
+    {
+        if (_dropped++ == 0)
+        {
+            SD_TRACE2("SessionRecorder : the log '%1' is full (%2 bytes), the following records are dropped",
+                      _file.fileName(), _capacity);
+        }
+        return 0;
+    }
+    return _data + offset;
+}
+
+//******************************************************************************************
+/*!
+ * \brief SessionRecorder::recordFrame appends a decoded frame
+ * \param stream stream (camera, table) of the frame
+ * \param frame frame index in the stream
+ * \param image frame
+ * \param timestamp arrival time in nanoseconds since the open (see timestamp), -1 for now
+ * \return false if the recorder is not open or the log is full
+ */
+bool SessionRecorder::recordFrame(int stream, int frame, const cv::Mat &image, qint64 timestamp)
+{
+    if (timestamp < 0)
+        timestamp = this->timestamp();
+    qint64 rowSize = (qint64) image.cols * image.elemSize();
+    qint64 size = alignedSize(sizeof(RecordHeader) + sizeof(RawFrameHeader) + rowSize * image.rows);
+    uchar * record = reserve(size);
+    if (!record)
+        return false;
+
+    RawFrameHeader * f = (RawFrameHeader *) (record + sizeof(RecordHeader));
+    f->rows = image.rows;
+    f->cols = image.cols;
+    f->type = image.type();
+    f->reserved = 0;
+    uchar * dst = record + sizeof(RecordHeader) + sizeof(RawFrameHeader);
+    for (int y=0; y<image.rows; y++)
+        memcpy(dst + y * rowSize, image.ptr(y), rowSize);
+
+    commitRecord(record, (quint32) size, RECORD_RAW_FRAME, stream, frame, timestamp);
+    return true;
+}
+
+//******************************************************************************************
+/*!
+ * \brief SessionRecorder::recordEncodedFrame appends a frame as received (JPEG, PNG, ...)
+ * \param data encoded buffer, decoded with cv::imdecode by the replayer
+ * \param size buffer size in bytes
+ * \see recordFrame
+ */
+bool SessionRecorder::recordEncodedFrame(int stream, int frame, const uchar *data, size_t size, qint64 timestamp)
+{
+    if (timestamp < 0)
+        timestamp = this->timestamp();
+    qint64 recordSize = alignedSize(sizeof(RecordHeader) + sizeof(qint64) + size);
+    uchar * record = reserve(recordSize);
+    if (!record)
+        return false;
+
+    qint64 dataSize = (qint64) size;
+    memcpy(record + sizeof(RecordHeader), &dataSize, sizeof(qint64));
+    memcpy(record + sizeof(RecordHeader) + sizeof(qint64), data, size);
+
+    commitRecord(record, (quint32) recordSize, RECORD_ENCODED_FRAME, stream, frame, timestamp);
+    return true;
+}
+
+//******************************************************************************************
+/*!
+ * \brief SessionRecorder::recordStage appends the processing time of a stage of a frame
+ * \param stage stage name, truncated to 15 characters
+ * \param ms stage latency in milliseconds
+ */
+bool SessionRecorder::recordStage(int stream, int frame, const char *stage, double ms)
+{
+    qint64 size = alignedSize(sizeof(RecordHeader) + sizeof(StageRecord));
+    uchar * record = reserve(size);
+    if (!record)
+        return false;
+
+    StageRecord * s = (StageRecord *) (record + sizeof(RecordHeader));
+    memset(s->name, 0, sizeof(s->name));
+    strncpy(s->name, stage, sizeof(s->name) - 1);
+    s->ms = ms;
+
+    commitRecord(record, (quint32) size, RECORD_STAGE, stream, frame, timestamp());
+    return true;
+}
+
+//******************************************************************************************
+/*!
+ * \brief SessionRecorder::recordSessionFrame appends a frame of a live session with the frame
+ * format and the sampling of the recorder. JPEG frames are encoded with a quality of 95 : the
+ * replay processes close, not identical, images
+ * \return false if the frame should be recorded and is not
+ */
+bool SessionRecorder::recordSessionFrame(int stream, int frame, const cv::Mat &image)
+{
+    if (_frameFormat == FRAME_NONE || frame % _frameSampling != 0)
+        return true;
+    qint64 timestamp = this->timestamp();
+    if (_frameFormat == FRAME_RAW)
+        return recordFrame(stream, frame, image, timestamp);
+    if (isFull())
+        return false;
+
+    std::vector<uchar> buffer;
+    std::vector<int> params;
+    if (_frameFormat == FRAME_JPEG)
+    {
+        params.push_back(cv::IMWRITE_JPEG_QUALITY);
+        params.push_back(95);
+    }
+    if (!cv::imencode(_frameFormat == FRAME_JPEG ? ".jpg" : ".png", image, buffer, params))
+    {
+        SD_TRACE2("SessionRecorder : failed to encode the frame %1 of the stream %2", frame, stream);
+        return false;
+    }
+    return recordEncodedFrame(stream, frame, buffer.data(), buffer.size(), timestamp);
+}
+
+//******************************************************************************************
+
+SessionReplayer::SessionReplayer() :
+    _data(0),
+    _start(0)
+{
+}
+
+//******************************************************************************************
+
+SessionReplayer::~SessionReplayer()
+{
+    close();
+}
+
+//******************************************************************************************
+/*!
+ * \brief SessionReplayer::open maps a session log and indexes its records. Logs of unclosed
+ * sessions are read up to their last complete record
+ * \return false if the file is not a session log
+ */
+bool SessionReplayer::open(const QString &path)
+{
+    close();
+    _file.setFileName(path);
+    if (!_file.open(QIODevice::ReadOnly) || _file.size() < (qint64) sizeof(FileHeader))
+    {
+        SD_TRACE1("SessionReplayer::open : failed to open the log '%1'", path);
+        _file.close();
+        return false;
+    }
+    qint64 fileSize = _file.size();
+    _data = _file.map(0, fileSize);
+    const FileHeader * h = (const FileHeader *) _data;
+    if (!_data || memcmp(h->magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 || h->version != LOG_VERSION)
+    {
+        SD_TRACE1("SessionReplayer::open : '%1' is not a session log", path);
+        close();
+        return false;
+    }
+
+    qint64 offset = sizeof(FileHeader);
+    while (offset + (qint64) sizeof(RecordHeader) <= fileSize)
+    {
+        const RecordHeader * r = (const RecordHeader *) (_data + offset);
+        if (r->size < sizeof(RecordHeader) || offset + r->size > fileSize)
+            break;
+        const uchar * payload = _data + offset + sizeof(RecordHeader);
+
+        if (r->type == RECORD_RAW_FRAME || r->type == RECORD_ENCODED_FRAME)
+        {
+            FrameEntry e;
+            e.stream = r->stream;
+            e.frame = r->frame;
+            e.timestamp = r->timestamp;
+            e.encoded = r->type == RECORD_ENCODED_FRAME;
+            e.offset = offset + sizeof(RecordHeader);
+            e.size = r->size - sizeof(RecordHeader);
+            _frames << e;
+            if (!_streams.contains(e.stream))
+                _streams << e.stream;
+        }
+        else if (r->type == RECORD_STAGE)
+        {
+            const StageRecord * s = (const StageRecord *) payload;
+            _recordedStages << StageTiming(QString::fromLatin1(s->name, (int) strnlen(s->name, sizeof(s->name))), s->ms);
+        }
+        offset += r->size;
+    }
+
+    // Records are appended by several threads : restore the arrival order
+    std::stable_sort(_frames.begin(), _frames.end(), CompareTimestamps());
+    std::sort(_streams.begin(), _streams.end());
+    _start = _frames.isEmpty() ? 0 : _frames.first().timestamp;
+    return true;
+}
+
+//******************************************************************************************
+
+void SessionReplayer::close()
+{
+    if (_data)
+        _file.unmap((uchar *) _data);
+    _data = 0;
+    _file.close();
+    _frames.clear();
+    _streams.clear();
+    _recordedStages.clear();
+    _start = 0;
+}
+
+//******************************************************************************************
+/*!
+ * \brief SessionReplayer::frame decodes a recorded frame
+ * \param index frame index in the log, frames are in arrival order
+ * \return a copy of the frame, empty if it can not be decoded
+ */
+cv::Mat SessionReplayer::frame(int index) const
+{
+    const FrameEntry & e = _frames[index];
+    const uchar * payload = _data + e.offset;
+    if (e.encoded)
+    {
+        qint64 size;
+        memcpy(&size, payload, sizeof(qint64));
+        if (size < 0 || size > e.size - (qint64) sizeof(qint64))
+            return cv::Mat();
+        cv::Mat buffer(1, (int) size, CV_8U, (void *) (payload + sizeof(qint64)));
+        return cv::imdecode(buffer, cv::IMREAD_UNCHANGED);
+    }
+
+    const RawFrameHeader * f = (const RawFrameHeader *) payload;
+    cv::Mat image(f->rows, f->cols, f->type, (void *) (payload + sizeof(RawFrameHeader)));
+    if ((qint64) (image.total() * image.elemSize()) > e.size - (qint64) sizeof(RawFrameHeader))
+        return cv::Mat();
+    return image.clone();
+}
+
+//******************************************************************************************
+/*!
+ * \brief SessionReplayer::replay feeds the recorded frames to the target with their recorded timing
+ * \param target frame processing
+ * \param copies number of concurrent replays of each recorded stream. Replay stream ids are
+ * copy * streamCount + index of the recorded stream
+ * \param speed time factor, 2.0 replays twice faster than recorded
+ * \return recorded and replayed stage latencies
+ */
+SessionReplayer::Report SessionReplayer::replay(ReplayTarget *target, int copies, double speed)
+{
+    Report report;
+    if (!target || _frames.isEmpty())
+    {
+        SD_TRACE("SessionReplayer::replay : no target or no recorded frames");
+        return report;
+    }
+    copies = qMax(copies, 1);
+    if (speed <= 0.0)
+        speed = 1.0;
+
+    int count = copies * _streams.size();
+    QVector<QVector<StageTiming> > stages(count);
+    QVector<int> lateFrames(count, 0);
+
+    // Threads start before the first frame is due
+    QElapsedTimer timer;
+    timer.start();
+    qint64 start = timer.nsecsElapsed() + 10000000;
+    std::vector<std::thread> threads;
+    for (int c=0; c<copies; c++)
+    {
+        for (int s=0; s<_streams.size(); s++)
+        {
+            int k = c * _streams.size() + s;
+            threads.push_back(std::thread(&SessionReplayer::replayStream, this, target, _streams[s], k, speed,
+                                          std::cref(timer), start, stages.data() + k, lateFrames.data() + k));
+        }
+    }
+    for (size_t i=0; i<threads.size(); i++)
+        threads[i].join();
+
+    QVector<StageTiming> replayed;
+    for (int k=0; k<count; k++)
+    {
+        replayed += stages[k];
+        report.lateFrames += lateFrames[k];
+    }
+    report.frames = _frames.size() * copies;
+    report.recorded = computeStats(_recordedStages);
+    report.replayed = computeStats(replayed);
+    return report;
+}
+
+//******************************************************************************************
+
+void SessionReplayer::replayStream(ReplayTarget *target, int stream, int replayStream, double speed,
+                                   const QElapsedTimer &timer, qint64 start, QVector<StageTiming> *stages, int *lateFrames) const
+{
+    for (int i=0; i<_frames.size(); i++)
+    {
+        const FrameEntry & e = _frames[i];
+        if (e.stream != stream)
+            continue;
+
+        // Decoded before the arrival time : decoding is not part of the replayed processing
+        cv::Mat image = frame(i);
+        if (image.empty())
+        {
+            SD_TRACE2("SessionReplayer : failed to decode the frame %1 of the stream %2", e.frame, e.stream);
+            continue;
+        }
+
+        qint64 arrival = start + (qint64) ((e.timestamp - _start) / speed);
+        qint64 now = timer.nsecsElapsed();
+        if (now < arrival)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(arrival - now));
+
+        qint64 t0 = timer.nsecsElapsed();
+        double lateness = (t0 - arrival) * 1e-6;
+        if (lateness > 1.0)
+            (*lateFrames)++;
+        target->processFrame(replayStream, e.frame, image, stages);
+        double elapsed = (timer.nsecsElapsed() - t0) * 1e-6;
+
+        *stages << StageTiming("replay frame", elapsed);
+        *stages << StageTiming("replay lateness", qMax(lateness, 0.0));
+    }
+}
+
+//******************************************************************************************
+/*!
+ * \brief SessionReplayer::computeStats computes latency statistics per stage, stages are in
+ * the order of their first timing
+ */
+QVector<SessionReplayer::StageStats> SessionReplayer::computeStats(const QVector<StageTiming> &timings)
+{
+    QVector<QString> names;
+    QHash<QString, std::vector<double> > values;
+    foreach (const StageTiming & t, timings)
+    {
+        if (!values.contains(t.name))
+            names << t.name;
+        values[t.name].push_back(t.ms);
+    }
+
+    QVector<StageStats> stats;
+    foreach (const QString & name, names)
+    {
+        std::vector<double> & v = values[name];
+        std::sort(v.begin(), v.end());
+        StageStats s;
+        s.name = name;
+        s.count = (int) v.size();
+        double sum = 0.0;
+        for (size_t i=0; i<v.size(); i++)
+            sum += v[i];
+        s.mean = sum / v.size();
+        s.p50 = v[(v.size() - 1) / 2];
+        s.p95 = v[(size_t) ((v.size() - 1) * 0.95)];
+        s.max = v.back();
+        stats << s;
+    }
+    return stats;
+}
+
+//******************************************************************************************
+/*!
+ * \brief SessionReplayer::Report::trace prints the recorded and replayed latencies side by side
+ */
+void SessionReplayer::Report::trace() const
+{
+    SD_TRACE2("Replayed frames : %1, late frames : %2", frames, lateFrames);
+    SD_TRACE("Stage : recorded mean / p95 / max | replayed mean / p95 / max (ms)");
+    // Recorded stages, then the stages of the replay only
+    QVector<QString> names;
+    foreach (const StageStats & s, recorded)
+        names << s.name;
+    foreach (const StageStats & s, replayed)
+        if (!names.contains(s.name)) names << s.name;
+
+    foreach (const QString & name, names)
+    {
+        StageStats s, r;
+        foreach (const StageStats & t, recorded)
+            if (t.name == name) s = t;
+        foreach (const StageStats & t, replayed)
+            if (t.name == name) r = t;
+        SD_TRACE(QString("%1 : %2 / %3 / %4 | %5 / %6 / %7")
+                 .arg(name, -16)
+                 .arg(s.mean, 0, 'f', 2).arg(s.p95, 0, 'f', 2).arg(s.max, 0, 'f', 2)
+                 .arg(r.mean, 0, 'f', 2).arg(r.p95, 0, 'f', 2).arg(r.max, 0, 'f', 2));
+    }
+}
+
+//******************************************************************************************
+
+}
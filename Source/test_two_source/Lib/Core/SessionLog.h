@@ -0,0 +1,215 @@
+#ifndef SESSIONLOG_H
+#define SESSIONLOG_H
+
+// Std
+#include <vector>
+#include <atomic>
+
+// Qt
+#include <QString>
+#include <QVector>
+#include <QFile>
+#include <QElapsedTimer>
+
+// Opencv
+#include <opencv2/core.hpp>
+
+// Project
+#include "LibExport.h"
+
+namespace ImageCommon
+{
+
+//******************************************************************************************
+/*!
+ * \brief The SessionRecorder class appends the frames of a live session, their arrival times and
+ * the stage timings of their processing to a memory-mapped log file.
+ *
+ * The file is allocated with its capacity and mapped at open. Records are appended from any
+ * thread : space is reserved with an atomic offset and the record is copied in the mapping, there
+ * is no lock and no system call per record. Records which do not fit in the capacity are dropped.
+ * The file is truncated to the recorded size at close. The log of a session that is not closed
+ * (crash, kill) stays readable : a record is valid once its size is written, and it is written last.
+ *
+ * Timestamps are in nanoseconds since the open. Frames are recorded raw (cv::Mat data) or as
+ * received (encoded buffer), see SessionReplayer to read and replay the log.
+ *
+ * A live session records its frames with recordSessionFrame : frames are JPEG encoded by default
+ * (a raw 1080p stream fills 512 MB in a few seconds), PNG keeps them lossless and raw recording is
+ * opt-in. One frame on frameSampling is recorded, the stages of all frames are. The first dropped
+ * record is reported, see isFull.
+ */
+class DGV_DLL_EXPORT SessionRecorder
+{
+public:
+
+    enum FrameFormat {
+        FRAME_NONE,
+        FRAME_JPEG,
+        FRAME_PNG,
+        FRAME_RAW
+    };
+
+    SessionRecorder();
+    ~SessionRecorder();
+
+    bool open(const QString & path, qint64 capacity=512 * 1024 * 1024);
+    void close();
+    bool isOpen() const
+    { return _data != 0; }
+
+    qint64 timestamp() const;
+
+    bool recordFrame(int stream, int frame, const cv::Mat & image, qint64 timestamp=-1);
+    bool recordEncodedFrame(int stream, int frame, const uchar * data, size_t size, qint64 timestamp=-1);
+    bool recordStage(int stream, int frame, const char * stage, double ms);
+
+    bool recordSessionFrame(int stream, int frame, const cv::Mat & image);
+
+    //! Format of the frames recorded by recordSessionFrame, set before recording
+    void setFrameFormat(FrameFormat format)
+    { _frameFormat = format; }
+    FrameFormat getFrameFormat() const
+    { return _frameFormat; }
+    //! recordSessionFrame records one frame on sampling of each stream, set before recording
+    void setFrameSampling(int sampling)
+    { _frameSampling = qMax(sampling, 1); }
+    int getFrameSampling() const
+    { return _frameSampling; }
+
+    //! Bytes of the recorded records
+    qint64 size() const;
+    int droppedRecordCount() const
+    { return _dropped.load(); }
+    //! A record did not fit in the capacity, the following ones are dropped
+    bool isFull() const
+    { return _dropped.load() > 0; }
+
+private:
+    SessionRecorder(const SessionRecorder &);
+    SessionRecorder & operator=(const SessionRecorder &);
+
+    uchar * reserve(qint64 size);
+
+    QFile _file;
+    uchar * _data;
+    qint64 _capacity;
+    std::atomic<qint64> _offset;
+    std::atomic<int> _dropped;
+    QElapsedTimer _timer;
+    FrameFormat _frameFormat;
+    int _frameSampling;
+};
+
+//******************************************************************************************
+
+struct StageTiming
+{
+    StageTiming(const QString & name=QString(), double ms=0.0) :
+        name(name), ms(ms)
+    {}
+    QString name;
+    double ms;
+};
+
+//******************************************************************************************
+/*!
+ * \brief The ReplayTarget class processes the replayed frames : service, batch runner, ...
+ * processFrame is called from the stream threads, concurrently for different streams.
+ */
+class DGV_DLL_EXPORT ReplayTarget
+{
+public:
+    virtual ~ReplayTarget() {}
+    //! Processes the frame and appends the stage timings of the processing
+    virtual void processFrame(int stream, int frame, const cv::Mat & image, QVector<StageTiming> * stages) = 0;
+};
+
+//******************************************************************************************
+/*!
+ * \brief The SessionReplayer class reads a session log and feeds its frames to a replay target
+ * with the recorded timing.
+ *
+ * Each recorded stream is replayed by its own thread : a frame is given to the target at its
+ * recorded arrival time (relative to the first frame, divided by the speed factor), or as soon as
+ * the previous frame is processed if the target is late. Streams can be replayed several times
+ * concurrently (copies) to reproduce the contention of a busier table.
+ * The report compares the stage latencies of the session with the ones of the replay.
+ */
+class DGV_DLL_EXPORT SessionReplayer
+{
+public:
+
+    struct StageStats
+    {
+        StageStats() : count(0), mean(0.0), p50(0.0), p95(0.0), max(0.0) {}
+        QString name;
+        int count;
+        double mean;
+        double p50;
+        double p95;
+        double max;
+    };
+
+    struct Report
+    {
+        Report() : frames(0), lateFrames(0) {}
+        //! Stage latencies of the recorded session
+        QVector<StageStats> recorded;
+        //! Stage latencies of the replay, with the "replay frame" (processing time measured by
+        //! the replayer) and "replay lateness" (delay to the recorded arrival time) stages
+        QVector<StageStats> replayed;
+        int frames;
+        //! Frames given to the target after their arrival time (more than 1 ms)
+        int lateFrames;
+
+        void trace() const;
+    };
+
+    SessionReplayer();
+    ~SessionReplayer();
+
+    bool open(const QString & path);
+    void close();
+    int frameCount() const
+    { return _frames.size(); }
+    int streamCount() const
+    { return _streams.size(); }
+
+    cv::Mat frame(int index) const;
+
+    Report replay(ReplayTarget * target, int copies=1, double speed=1.0);
+
+private:
+    SessionReplayer(const SessionReplayer &);
+    SessionReplayer & operator=(const SessionReplayer &);
+
+    struct FrameEntry
+    {
+        int stream;
+        int frame;
+        qint64 timestamp;
+        bool encoded;
+        qint64 offset;
+        qint64 size;
+    };
+
+    void replayStream(ReplayTarget * target, int stream, int replayStream, double speed,
+                      const QElapsedTimer & timer, qint64 start, QVector<StageTiming> * stages, int * lateFrames) const;
+    static QVector<StageStats> computeStats(const QVector<StageTiming> & timings);
+
+    QFile _file;
+    const uchar * _data;
+    QVector<FrameEntry> _frames;
+    //! Arrival time of the first frame
+    qint64 _start;
+    //! Recorded stream ids
+    QVector<int> _streams;
+    QVector<StageTiming> _recordedStages;
+};
+
+//******************************************************************************************
+
+}
+
+#endif // SESSIONLOG_H
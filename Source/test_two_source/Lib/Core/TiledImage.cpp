@@ -0,0 +1,615 @@
+
+// Std
+#include <string.h>
+
+// Qt
+#include <QByteArray>
+
+// Opencv
+#include <opencv2/imgproc.hpp>
+
+// Project
+#include "Global.h"
+#include "TiledImage.h"
+
+namespace ImageCommon
+{
+
+//******************************************************************************************
+
+bool MatTiledImage::readRegion(const cv::Rect &region, cv::Mat *output) const
+{
+    if (!output)
+    {
+        SD_TRACE("MatTiledImage::readRegion : output is null");
+        return false;
+    }
+    cv::Rect r = region & cv::Rect(0, 0, _image.cols, _image.rows);
+    if (r.area() == 0 || _image.type() != CV_8U)
+        return false;
+    _image(r).copyTo(*output);
+    return true;
+}
+
+//******************************************************************************************
+
+namespace
+{
+
+enum TiffTag {
+    TAG_IMAGE_WIDTH=256,
+    TAG_IMAGE_LENGTH=257,
+    TAG_BITS_PER_SAMPLE=258,
+    TAG_COMPRESSION=259,
+    TAG_PHOTOMETRIC=262,
+    TAG_STRIP_OFFSETS=273,
+    TAG_SAMPLES_PER_PIXEL=277,
+    TAG_ROWS_PER_STRIP=278,
+    TAG_STRIP_BYTE_COUNTS=279,
+    TAG_PLANAR_CONFIG=284,
+    TAG_PREDICTOR=317,
+    TAG_TILE_WIDTH=322,
+    TAG_TILE_LENGTH=323,
+    TAG_TILE_OFFSETS=324,
+    TAG_TILE_BYTE_COUNTS=325,
+    TAG_SAMPLE_FORMAT=339
+};
+
+//! Maximal height of the tiles of a strip image, see TiffTiledImage::tileSize
+const int MAX_STRIP_ROWS = 256;
+
+enum TiffCompression {
+    COMPRESSION_NONE=1,
+    COMPRESSION_LZW=5,
+    COMPRESSION_ADOBE_DEFLATE=8,
+    COMPRESSION_PACKBITS=32773,
+    COMPRESSION_DEFLATE=32946
+};
+
+//******************************************************************************************
+
+int typeSize(int type)
+{
+    switch (type)
+    {
+    case 1: case 2: case 6: case 7:
+        return 1;
+    case 3: case 8:
+        return 2;
+    case 4: case 9: case 11: case 13:
+        return 4;
+    case 5: case 10: case 12: case 16: case 17: case 18:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+//******************************************************************************************
+/*!
+ * \brief The TiffParser struct reads the values of the TIFF structures in the file byte order
+ */
+struct TiffParser
+{
+    TiffParser(const uchar * data, quint64 size) :
+        data(data), size(size), littleEndian(true), bigTiff(false)
+    {}
+
+    quint64 read(quint64 offset, int n) const
+    {
+        if (offset + n > size)
+            return 0;
+        quint64 v = 0;
+        for (int i=0; i<n; i++)
+            v |= (quint64) data[offset + i] << (8 * (littleEndian ? i : n - 1 - i));
+        return v;
+    }
+
+    /*!
+     * \brief values reads the values of an IFD entry
+     * \return false if the entry values are outside of the file
+     */
+    bool values(quint64 entry, std::vector<quint64> * out) const
+    {
+        int type = (int) read(entry + 2, 2);
+        quint64 count = read(entry + 4, bigTiff ? 8 : 4);
+        int ts = typeSize(type);
+        int fieldSize = bigTiff ? 8 : 4;
+        quint64 fieldOffset = entry + (bigTiff ? 12 : 8);
+        if (ts == 0 || count == 0 || count > size / ts)
+            return false;
+        quint64 offset = count * ts <= (quint64) fieldSize ? fieldOffset : read(fieldOffset, fieldSize);
+        if (offset + count * ts > size)
+            return false;
+        out->resize(count);
+        for (quint64 i=0; i<count; i++)
+            (*out)[i] = read(offset + i * ts, ts);
+        return true;
+    }
+
+    const uchar * data;
+    quint64 size;
+    bool littleEndian;
+    bool bigTiff;
+};
+
+//******************************************************************************************
+/*!
+ * \brief lzwDecode decodes TIFF LZW data (MSB first codes, 9 to 12 bits, early change)
+ * \param skip number of decoded bytes to discard before the output
+ * \return number of bytes written to out, at most outSize
+ */
+size_t lzwDecode(const uchar * in, size_t inSize, uchar * out, size_t outSize, size_t skip=0)
+{
+    const int CLEAR = 256, EOI = 257;
+    std::vector<int> prefix(4096), length(4096);
+    std::vector<uchar> suffix(4096), first(4096);
+    for (int i=0; i<256; i++)
+    {
+        prefix[i] = -1;
+        suffix[i] = first[i] = (uchar) i;
+        length[i] = 1;
+    }
+
+    size_t pos = 0;
+    size_t inPos = 0;
+    quint32 buffer = 0;
+    int bits = 0;
+    int width = 9;
+    int next = 258;
+    int old = -1;
+    size_t total = skip + outSize;
+    while (pos < total)
+    {
+        while (bits < width && inPos < inSize)
+        {
+            buffer = (buffer << 8) | in[inPos++];
+            bits += 8;
+        }
+        if (bits < width)
+            break;
+        int code = (buffer >> (bits - width)) & ((1 << width) - 1);
+        bits -= width;
+
+        if (code == CLEAR)
+        {
+            width = 9;
+            next = 258;
+            old = -1;
+            continue;
+        }
+        if (code == EOI)
+            break;
+
+        int output = code;
+        uchar firstByte = 0;
+        if (old < 0)
+        {
+            if (code > 255)
+                break;
+        }
+        else if (code < next)
+        {
+            firstByte = first[code];
+        }
+        else if (code == next)
+        {
+            firstByte = first[old];
+        }
+        else
+        {
+            break;
+        }
+
+        if (old >= 0 && next < 4096)
+        {
+            prefix[next] = old;
+            suffix[next] = firstByte;
+            first[next] = first[old];
+            length[next] = length[old] + 1;
+            next++;
+            if (next >= (1 << width) - 1 && width < 12)
+                width++;
+        }
+
+        // Strings are written backward from their last byte
+        int len = length[output];
+        size_t end = pos + len;
+        for (int c = output; c >= 0; c = prefix[c])
+        {
+            end--;
+            if (end >= skip && end < total)
+                out[end - skip] = suffix[c];
+        }
+        pos = qMin(pos + len, total);
+        old = code;
+    }
+    return pos > skip ? pos - skip : 0;
+}
+
+//******************************************************************************************
+
+/*!
+ * \brief packBitsDecode decodes PackBits data
+ * \param skip number of decoded bytes to discard before the output
+ * \return number of bytes written to out, at most outSize
+ */
+size_t packBitsDecode(const uchar * in, size_t inSize, uchar * out, size_t outSize, size_t skip=0)
+{
+    size_t pos = 0;
+    size_t i = 0;
+    while (i < inSize && pos < outSize)
+    {
+        int n = (signed char) in[i++];
+        if (n >= 0)
+        {
+            size_t count = qMin((size_t) n + 1, inSize - i);
+            size_t skipped = qMin(count, skip);
+            count = qMin(count - skipped, outSize - pos);
+            memcpy(out + pos, in + i + skipped, count);
+            skip -= skipped;
+            pos += count;
+            i += n + 1;
+        }
+        else if (n != -128 && i < inSize)
+        {
+            size_t count = 1 - n;
+            size_t skipped = qMin(count, skip);
+            count = qMin(count - skipped, outSize - pos);
+            memset(out + pos, in[i++], count);
+            skip -= skipped;
+            pos += count;
+        }
+    }
+    return pos;
+}
+
+}
+
+//******************************************************************************************
+
+TiffTiledImage::TiffTiledImage() :
+    _data(0),
+    _fileSize(0),
+    _tiled(false),
+    _blocksAcross(0),
+    _samplesPerPixel(1),
+    _compression(COMPRESSION_NONE),
+    _predictor(1),
+    _minIsWhite(false)
+{
+}
+
+//******************************************************************************************
+
+TiffTiledImage::~TiffTiledImage()
+{
+    close();
+}
+
+//******************************************************************************************
+/*!
+ * \brief TiffTiledImage::isTiff checks the file extension
+ */
+bool TiffTiledImage::isTiff(const QString &path)
+{
+    return path.endsWith(".tif", Qt::CaseInsensitive) || path.endsWith(".tiff", Qt::CaseInsensitive);
+}
+
+//******************************************************************************************
+/*!
+ * \brief TiffTiledImage::open maps the file and reads the structure of its first image
+ * \return false if the file can not be read or the image format is not supported
+ */
+bool TiffTiledImage::open(const QString &path)
+{
+    close();
+    _file.setFileName(path);
+    if (!_file.open(QIODevice::ReadOnly))
+    {
+        SD_TRACE1("TiffTiledImage::open : failed to open the file '%1'", path);
+        return false;
+    }
+    _fileSize = _file.size();
+    _data = _fileSize > 0 ? _file.map(0, _fileSize) : 0;
+    if (!_data)
+    {
+        SD_TRACE1("TiffTiledImage::open : failed to map the file '%1'", path);
+        close();
+        return false;
+    }
+    if (!parse())
+    {
+        SD_TRACE1("TiffTiledImage::open : file '%1' is not a supported TIFF image", path);
+        close();
+        return false;
+    }
+    if (!_tiled && _compression != COMPRESSION_NONE && _blockSize.height > MAX_STRIP_ROWS)
+    {
+        SD_TRACE2("TiffTiledImage::open : '%1' has compressed strips of %2 rows, regions are decoded from the "
+                  "start of their strip (tile the image for a faster access)", path, _blockSize.height);
+    }
+    return true;
+}
+
+//******************************************************************************************
+
+void TiffTiledImage::close()
+{
+    if (_data)
+        _file.unmap(const_cast<uchar*>(_data));
+    _data = 0;
+    _fileSize = 0;
+    if (_file.isOpen())
+        _file.close();
+    _size = cv::Size();
+    _blockSize = cv::Size();
+    _offsets.clear();
+    _byteCounts.clear();
+}
+
+//******************************************************************************************
+
+bool TiffTiledImage::parse()
+{
+    TiffParser p(_data, _fileSize);
+    if (_fileSize < 8)
+        return false;
+    if (_data[0] == 'I' && _data[1] == 'I')
+        p.littleEndian = true;
+    else if (_data[0] == 'M' && _data[1] == 'M')
+        p.littleEndian = false;
+    else
+        return false;
+
+    int version = (int) p.read(2, 2);
+    quint64 ifd = 0;
+    if (version == 42)
+    {
+        ifd = p.read(4, 4);
+    }
+    else if (version == 43 && p.read(4, 2) == 8)
+    {
+        p.bigTiff = true;
+        ifd = p.read(8, 8);
+    }
+    else
+    {
+        return false;
+    }
+
+    int countSize = p.bigTiff ? 8 : 2;
+    int entrySize = p.bigTiff ? 20 : 12;
+    quint64 count = p.read(ifd, countSize);
+    if (ifd == 0 || count == 0 || ifd + countSize + count * entrySize > (quint64) _fileSize)
+        return false;
+
+    int width = 0, height = 0, tileWidth = 0, tileHeight = 0, rowsPerStrip = 0;
+    int planar = 1, photometric = 1, sampleFormat = 1;
+    std::vector<quint64> bits, stripOffsets, stripByteCounts, tileOffsets, tileByteCounts;
+    _samplesPerPixel = 1;
+    _compression = COMPRESSION_NONE;
+    _predictor = 1;
+    std::vector<quint64> v;
+    for (quint64 i=0; i<count; i++)
+    {
+        quint64 entry = ifd + countSize + i * entrySize;
+        int tag = (int) p.read(entry, 2);
+        if (!p.values(entry, &v))
+            continue;
+        switch (tag)
+        {
+        case TAG_IMAGE_WIDTH: width = (int) v[0]; break;
+        case TAG_IMAGE_LENGTH: height = (int) v[0]; break;
+        case TAG_BITS_PER_SAMPLE: bits = v; break;
+        case TAG_COMPRESSION: _compression = (int) v[0]; break;
+        case TAG_PHOTOMETRIC: photometric = (int) v[0]; break;
+        case TAG_STRIP_OFFSETS: stripOffsets = v; break;
+        case TAG_SAMPLES_PER_PIXEL: _samplesPerPixel = (int) v[0]; break;
+        case TAG_ROWS_PER_STRIP: rowsPerStrip = (int) v[0]; break;
+        case TAG_STRIP_BYTE_COUNTS: stripByteCounts = v; break;
+        case TAG_PLANAR_CONFIG: planar = (int) v[0]; break;
+        case TAG_PREDICTOR: _predictor = (int) v[0]; break;
+        case TAG_TILE_WIDTH: tileWidth = (int) v[0]; break;
+        case TAG_TILE_LENGTH: tileHeight = (int) v[0]; break;
+        case TAG_TILE_OFFSETS: tileOffsets = v; break;
+        case TAG_TILE_BYTE_COUNTS: tileByteCounts = v; break;
+        case TAG_SAMPLE_FORMAT: sampleFormat = (int) v[0]; break;
+        default: break;
+        }
+    }
+
+    // Format checks
+    if (width <= 0 || height <= 0)
+        return false;
+    for (size_t i=0; i<bits.size(); i++)
+    {
+        if (bits[i] != 8)
+            return false;
+    }
+    bool gray = (photometric == 0 || photometric == 1) && _samplesPerPixel == 1;
+    bool rgb = photometric == 2 && (_samplesPerPixel == 3 || _samplesPerPixel == 4);
+    if ((!gray && !rgb) || planar != 1 || sampleFormat != 1 || (_predictor != 1 && _predictor != 2))
+        return false;
+    if (_compression != COMPRESSION_NONE && _compression != COMPRESSION_LZW &&
+            _compression != COMPRESSION_ADOBE_DEFLATE && _compression != COMPRESSION_DEFLATE &&
+            _compression != COMPRESSION_PACKBITS)
+        return false;
+    _minIsWhite = photometric == 0;
+
+    // Blocks : tiles or strips
+    _tiled = tileWidth > 0 && tileHeight > 0 && !tileOffsets.empty();
+    if (_tiled)
+    {
+        _blockSize = cv::Size(tileWidth, tileHeight);
+        _offsets = tileOffsets;
+        _byteCounts = tileByteCounts;
+    }
+    else
+    {
+        _blockSize = cv::Size(width, rowsPerStrip > 0 ? qMin(rowsPerStrip, height) : height);
+        _offsets = stripOffsets;
+        _byteCounts = stripByteCounts;
+    }
+    _blocksAcross = (width + _blockSize.width - 1) / _blockSize.width;
+    quint64 blocks = (quint64) _blocksAcross * ((height + _blockSize.height - 1) / _blockSize.height);
+    if (_offsets.size() < blocks || _byteCounts.size() < blocks)
+        return false;
+    for (quint64 i=0; i<blocks; i++)
+    {
+        if (_offsets[i] + _byteCounts[i] > (quint64) _fileSize)
+            return false;
+    }
+    _size = cv::Size(width, height);
+    return true;
+}
+
+//******************************************************************************************
+/*!
+ * \brief TiffTiledImage::decodeBlock decodes rows of a tile or a strip into a gray image of the
+ * block width. The last strip can be shorter.
+ * \param index block index
+ * \param firstRow first decoded row in the block
+ * \param rowCount number of decoded rows, clipped to the block. Uncompressed rows are read
+ * directly, LZW and PackBits strips are decoded up to the last row only
+ */
+bool TiffTiledImage::decodeBlock(int index, int firstRow, int rowCount, cv::Mat *block) const
+{
+    int blockRows = _blockSize.height;
+    if (!_tiled)
+        blockRows = qMin(blockRows, _size.height - (index / _blocksAcross) * _blockSize.height);
+    int rows = qMin(rowCount, blockRows - firstRow);
+    if (firstRow < 0 || rows <= 0)
+        return false;
+    int rowSize = _blockSize.width * _samplesPerPixel;
+    size_t skip = (size_t) rowSize * firstRow;
+    size_t expected = (size_t) rowSize * rows;
+    const uchar * in = _data + _offsets[index];
+    size_t inSize = _byteCounts[index];
+
+    cv::Mat raw(rows, _blockSize.width, CV_8UC(_samplesPerPixel));
+    size_t decoded = 0;
+    switch (_compression)
+    {
+    case COMPRESSION_NONE:
+        decoded = skip < inSize ? qMin(expected, inSize - skip) : 0;
+        memcpy(raw.data, in + skip, decoded);
+        break;
+    case COMPRESSION_LZW:
+        decoded = lzwDecode(in, inSize, raw.data, expected, skip);
+        break;
+    case COMPRESSION_PACKBITS:
+        decoded = packBitsDecode(in, inSize, raw.data, expected, skip);
+        break;
+    case COMPRESSION_ADOBE_DEFLATE:
+    case COMPRESSION_DEFLATE:
+    {
+        // qUncompress expects the zlib stream prefixed by the expected size (big endian) and
+        // decodes the whole block
+        size_t blockSize = (size_t) rowSize * blockRows;
+        QByteArray z((int) inSize + 4, 0);
+        z[0] = (char) ((blockSize >> 24) & 0xFF);
+        z[1] = (char) ((blockSize >> 16) & 0xFF);
+        z[2] = (char) ((blockSize >> 8) & 0xFF);
+        z[3] = (char) (blockSize & 0xFF);
+        memcpy(z.data() + 4, in, inSize);
+        QByteArray out = qUncompress(z);
+        decoded = (size_t) out.size() > skip ? qMin(expected, out.size() - skip) : 0;
+        memcpy(raw.data, out.constData() + skip, decoded);
+        break;
+    }
+    default:
+        return false;
+    }
+    if (decoded == 0)
+    {
+        SD_TRACE2("TiffTiledImage::decodeBlock : failed to decode the rows of the block %1 from %2", index, firstRow);
+        return false;
+    }
+    if (decoded < expected)
+        memset(raw.data + decoded, 0, expected - decoded);
+
+    // Horizontal differencing
+    if (_predictor == 2)
+    {
+        for (int y=0; y<rows; y++)
+        {
+            uchar * r = raw.ptr<uchar>(y);
+            for (int x=_samplesPerPixel; x<rowSize; x++)
+                r[x] = (uchar) (r[x] + r[x - _samplesPerPixel]);
+        }
+    }
+
+    if (_samplesPerPixel == 3)
+        cv::cvtColor(raw, *block, cv::COLOR_RGB2GRAY);
+    else if (_samplesPerPixel == 4)
+        cv::cvtColor(raw, *block, cv::COLOR_RGBA2GRAY);
+    else if (_minIsWhite)
+        cv::bitwise_not(raw, *block);
+    else
+        *block = raw;
+    return true;
+}
+
+//******************************************************************************************
+/*!
+ * \brief TiffTiledImage::readRegion decodes the blocks intersecting the region. Thread-safe.
+ * \param region image region, clipped to the image
+ * \param output CV_8UC1 image of the clipped region size
+ * \return false if the region is empty or a block can not be decoded
+ */
+bool TiffTiledImage::readRegion(const cv::Rect &region, cv::Mat *output) const
+{
+    if (!output)
+    {
+        SD_TRACE("TiffTiledImage::readRegion : output is null");
+        return false;
+    }
+    if (!_data)
+    {
+        SD_TRACE("TiffTiledImage::readRegion : file is not opened");
+        return false;
+    }
+    cv::Rect r = region & cv::Rect(cv::Point(), _size);
+    if (r.area() == 0)
+        return false;
+
+    output->create(r.size(), CV_8U);
+    int bx0 = r.x / _blockSize.width;
+    int bx1 = (r.br().x - 1) / _blockSize.width;
+    int by0 = r.y / _blockSize.height;
+    int by1 = (r.br().y - 1) / _blockSize.height;
+    cv::Mat block;
+    for (int by=by0; by<=by1; by++)
+    {
+        // Only the rows of the region are decoded
+        int y0 = by * _blockSize.height;
+        int firstRow = qMax(r.y - y0, 0);
+        int rowCount = qMin(r.br().y - y0, _blockSize.height) - firstRow;
+        for (int bx=bx0; bx<=bx1; bx++)
+        {
+            if (!decodeBlock(by * _blocksAcross + bx, firstRow, rowCount, &block))
+                return false;
+            cv::Rect blockRect(bx * _blockSize.width, y0 + firstRow, block.cols, block.rows);
+            cv::Rect common = blockRect & r;
+            block(common - blockRect.tl()).copyTo((*output)(common - r.tl()));
+        }
+    }
+    return true;
+}
+
+//******************************************************************************************
+/*!
+ * \brief TiffTiledImage::tileSize returns the tile size, or the strip size with at most
+ * MAX_STRIP_ROWS rows : regions of a strip are decoded without the following rows
+ */
+cv::Size TiffTiledImage::tileSize() const
+{
+    if (!_tiled && _blockSize.height > MAX_STRIP_ROWS)
+        return cv::Size(_blockSize.width, MAX_STRIP_ROWS);
+    return _blockSize;
+}
+
+//******************************************************************************************
+
+}
@@ -0,0 +1,120 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+// Std
+#include <vector>
+
+// Qt
+#include <QString>
+#include <QFile>
+
+// Opencv
+#include <opencv2/core.hpp>
+
+// Project
+#include "LibExport.h"
+
+namespace ImageCommon
+{
+
+//******************************************************************************************
+/*!
+ * \brief The TiledImage class gives access to regions of an image without loading the whole image.
+ * readRegion can be called concurrently from several threads.
+ */
+class DGV_DLL_EXPORT TiledImage
+{
+public:
+    virtual ~TiledImage() {}
+
+    virtual cv::Size size() const = 0;
+    //! Native tile size. Regions aligned on tiles are read without redundant decoding
+    virtual cv::Size tileSize() const = 0;
+    //! Reads a region as a CV_8UC1 image. Region is clipped to the image
+    virtual bool readRegion(const cv::Rect & region, cv::Mat * output) const = 0;
+};
+
+//******************************************************************************************
+/*!
+ * \brief The MatTiledImage class is a tiled view on an image in memory
+ */
+class DGV_DLL_EXPORT MatTiledImage : public TiledImage
+{
+public:
+    MatTiledImage(const cv::Mat & image, const cv::Size & tileSize=cv::Size(256, 256)) :
+        _image(image),
+        _tileSize(tileSize)
+    {}
+
+    virtual cv::Size size() const
+    { return _image.size(); }
+    virtual cv::Size tileSize() const
+    { return _tileSize; }
+    virtual bool readRegion(const cv::Rect & region, cv::Mat * output) const;
+
+protected:
+    cv::Mat _image;
+    cv::Size _tileSize;
+};
+
+//******************************************************************************************
+/*!
+ * \brief The TiffTiledImage class reads tiles of a TIFF file on demand.
+ *
+ * The file is memory mapped and only the tiles (or the strip rows) intersecting a requested region
+ * are decoded, so the memory used does not depend on the image size. Compressed strips are decoded
+ * from their first row : large compressed strips (e.g. untiled single strip scans) are slow to
+ * read by regions, a warning is given at open.
+ *
+ * Supported : classic TIFF and BigTIFF, first image of the file, tiles or strips, 8 bits
+ * gray (min-is-black or min-is-white) or RGB(A) with contiguous samples, compressions none,
+ * LZW, Deflate and PackBits, horizontal predictor. RGB is converted to gray.
+ */
+class DGV_DLL_EXPORT TiffTiledImage : public TiledImage
+{
+public:
+    TiffTiledImage();
+    virtual ~TiffTiledImage();
+
+    bool open(const QString & path);
+    void close();
+    bool isOpen() const
+    { return _data != 0; }
+    bool isTiled() const
+    { return _tiled; }
+
+    virtual cv::Size size() const
+    { return _size; }
+    virtual cv::Size tileSize() const;
+    virtual bool readRegion(const cv::Rect & region, cv::Mat * output) const;
+
+    static bool isTiff(const QString & path);
+
+private:
+    TiffTiledImage(const TiffTiledImage &);
+    TiffTiledImage & operator=(const TiffTiledImage &);
+
+    bool parse();
+    bool decodeBlock(int index, int firstRow, int rowCount, cv::Mat * block) const;
+
+    QFile _file;
+    const uchar * _data;
+    qint64 _fileSize;
+
+    cv::Size _size;
+    cv::Size _blockSize;
+    bool _tiled;
+    int _blocksAcross;
+    int _samplesPerPixel;
+    int _compression;
+    int _predictor;
+    bool _minIsWhite;
+    std::vector<quint64> _offsets;
+    std::vector<quint64> _byteCounts;
+};
+
+//******************************************************************************************
+
+}
+
+#endif // TILEDIMAGE_H
@@ -0,0 +1,210 @@
+
+// Std
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Qt
+#include <QAtomicInt>
+#include <QVector>
+
+// Opencv
+#include <opencv2/core.hpp>
+
+// Project
+#include "Global.h"
+#include "WorkerIsolation.h"
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+namespace ImageCommon
+{
+
+//******************************************************************************************
+
+static QAtomicInt ISOLATION(0);
+static QAtomicInt NEXT_CORE(0);
+//! Incremented on each change of the isolation mode, pinned workers of a previous mode are unpinned
+static QAtomicInt GENERATION(0);
+//! OpenCV thread count of the caller, restored when the isolation mode is disabled
+static int PREVIOUS_THREADS = -1;
+//! Core of the calling worker thread, -1 if not pinned
+static thread_local int WORKER_CORE = -1;
+//! Isolation mode generation in which the calling worker thread was pinned
+static thread_local int WORKER_GENERATION = -1;
+
+//******************************************************************************************
+/*!
+ * \brief readAllowedCores returns the cores of the process affinity (taskset, cgroup cpuset, ...),
+ * all the cores if the affinity can not be read
+ */
+static QVector<int> readAllowedCores()
+{
+    QVector<int> cores;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int c=0; c<CPU_SETSIZE; c++)
+        {
+            if (CPU_ISSET(c, &set))
+                cores << c;
+        }
+    }
+#elif defined(WIN32)
+    DWORD_PTR processMask = 0, systemMask = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+    {
+        for (int c=0; c<(int) (8 * sizeof(DWORD_PTR)); c++)
+        {
+            if (processMask & (((DWORD_PTR) 1) << c))
+                cores << c;
+        }
+    }
+#endif
+    if (cores.isEmpty())
+    {
+        for (int c=0; c<qMax(cv::getNumberOfCPUs(), 1); c++)
+            cores << c;
+    }
+    return cores;
+}
+
+//******************************************************************************************
+/*!
+ * \brief allowedCores returns the cores the process may run on. They are read once, on the first
+ * call, and are then only read : the workers can use them without lock
+ */
+static const QVector<int> & allowedCores()
+{
+    static const QVector<int> cores = readAllowedCores();
+    return cores;
+}
+
+//******************************************************************************************
+/*!
+ * \brief setCurrentThreadCores sets the affinity of the calling thread to a set of cores
+ * \return false if the affinity can not be set (not supported, core not available)
+ */
+static bool setCurrentThreadCores(const QVector<int> & cores)
+{
+    if (cores.isEmpty())
+        return false;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    foreach (int c, cores)
+    {
+        if (c < 0 || c >= CPU_SETSIZE)
+            return false;
+        CPU_SET(c, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(WIN32)
+    DWORD_PTR mask = 0;
+    foreach (int c, cores)
+    {
+        if (c < 0 || c >= (int) (8 * sizeof(DWORD_PTR)))
+            return false;
+        mask |= ((DWORD_PTR) 1) << c;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    return false;
+#endif
+}
+
+//******************************************************************************************
+/*!
+ * \brief setWorkerIsolation enables or disables the worker isolation mode.
+ * Should be called before the workers start : OpenCV thread count is a global setting. The
+ * thread count set by the caller is restored when the mode is disabled, and the workers pinned
+ * in the previous mode are unpinned by their next pinWorkerThread call.
+ */
+void setWorkerIsolation(bool enabled)
+{
+    if (ISOLATION.fetchAndStoreOrdered(enabled ? 1 : 0) == (enabled ? 1 : 0))
+        return;
+    NEXT_CORE.store(0);
+    GENERATION.fetchAndAddOrdered(1);
+    if (enabled)
+    {
+        // 1 thread : parallel loops run sequentially on the calling thread
+        PREVIOUS_THREADS = cv::getNumThreads();
+        allowedCores();
+        cv::setNumThreads(1);
+    }
+    else
+    {
+        cv::setNumThreads(PREVIOUS_THREADS);
+    }
+}
+
+//******************************************************************************************
+
+bool isWorkerIsolation()
+{
+    return ISOLATION.load() != 0;
+}
+
+//******************************************************************************************
+/*!
+ * \brief workerCoreCount returns the number of cores the workers are pinned to in isolation mode :
+ * the cores of the process affinity
+ */
+int workerCoreCount()
+{
+    return allowedCores().size();
+}
+
+//******************************************************************************************
+/*!
+ * \brief pinWorkerThread pins the calling worker thread to a core in isolation mode. Workers get
+ * the cores of the process affinity in turn, a thread is pinned once per isolation mode. A thread
+ * pinned before the last mode change gets back the cores of the process affinity first.
+ * \return core of the calling thread, -1 if the thread is not pinned
+ */
+int pinWorkerThread()
+{
+    const QVector<int> & cores = allowedCores();
+    int generation = GENERATION.load();
+    if (WORKER_GENERATION != generation)
+    {
+        // The mode changed since the thread was pinned
+        if (WORKER_CORE >= 0 && !setCurrentThreadCores(cores))
+            SD_TRACE1("pinWorkerThread : failed to unpin the thread from the core %1", WORKER_CORE);
+        WORKER_CORE = -1;
+        WORKER_GENERATION = generation;
+    }
+    if (!isWorkerIsolation() || WORKER_CORE >= 0)
+        return WORKER_CORE;
+
+    if (cores.isEmpty())
+        return -1;
+    int core = cores[NEXT_CORE.fetchAndAddOrdered(1) % cores.size()];
+    if (!pinCurrentThread(core))
+    {
+        SD_TRACE1("pinWorkerThread : failed to pin the thread to the core %1", core);
+        return -1;
+    }
+    WORKER_CORE = core;
+    return core;
+}
+
+//******************************************************************************************
+/*!
+ * \brief pinCurrentThread sets the affinity of the calling thread to a single core
+ * \return false if the affinity can not be set (not supported, core not available)
+ */
+bool pinCurrentThread(int core)
+{
+    return setCurrentThreadCores(QVector<int>() << core);
+}
+
+//******************************************************************************************
+
+}
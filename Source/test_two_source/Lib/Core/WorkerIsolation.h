@@ -0,0 +1,39 @@
+#ifndef WORKERISOLATION_H
+#define WORKERISOLATION_H
+
+// Project
+#include "LibExport.h"
+
+namespace ImageCommon
+{
+
+//******************************************************************************************
+/*!
+ * Worker isolation mode : the application scheduler owns all the concurrency.
+ *
+ * OpenCV parallel loops share a single global thread pool and cv::setNumThreads is global, so a
+ * large job (e.g. AKAZE on a large card) can take all the cores while the small jobs of other
+ * frames wait. In isolation mode, OpenCV inner parallelism is disabled (cv::parallel_for_ runs
+ * on the calling thread, including the loops of this library) and each worker pins itself to
+ * its own core, among the cores allowed to the process, when it starts a task. The latency of
+ * a task then depends only on its own work. When the mode is disabled, the OpenCV thread count
+ * is restored and the pinned workers get back the cores of the process on their next task.
+ *
+ * Usage :
+ *  ImageCommon::setWorkerIsolation(true);
+ *  ... in each worker task :
+ *  ImageCommon::pinWorkerThread();
+ */
+
+void DGV_DLL_EXPORT setWorkerIsolation(bool enabled);
+bool DGV_DLL_EXPORT isWorkerIsolation();
+
+int DGV_DLL_EXPORT workerCoreCount();
+int DGV_DLL_EXPORT pinWorkerThread();
+bool DGV_DLL_EXPORT pinCurrentThread(int core);
+
+//******************************************************************************************
+
+}
+
+#endif // WORKERISOLATION_H
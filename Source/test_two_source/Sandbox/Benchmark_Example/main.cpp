@@ -0,0 +1,545 @@
+
+// Std
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cmath>
+
+// Qt
+#include <QString>
+#include <QStringList>
+#include <QDir>
+#include <QList>
+#include <QPair>
+#include <QVector>
+#include <QElapsedTimer>
+
+// Opencv
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+
+// Project
+#include "Core/Global.h"
+#include "Core/ImageCommon.h"
+#include "Core/ImageProcessing.h"
+#include "Core/Profiler.h"
+#include "Core/ImagePrefetcher.h"
+#include "3rdparty/AKAZEFeatures.h"
+#include "3rdparty/nldiffusion_functions.h"
+
+
+void help()
+{
+    SD_TRACE("Usage : Sandbox_Benchmark_Example image_data_path [repeats] [--counters] [--adversarial] [--scaling]");
+    SD_TRACE("  where image_data_path is a path with *.jpg, *.png, *.tif images");
+    SD_TRACE("  --counters reads hardware counters (Linux perf_event_open). Kernels run on a single thread");
+    SD_TRACE("             in this case, as the counters are those of the calling thread");
+    SD_TRACE("  --adversarial runs detectObjects on synthetic worst-case frames (noise, textures) with and");
+    SD_TRACE("             without the detection limits and reports the worst frame latencies");
+    SD_TRACE("  --scaling runs the frame pipeline and the key kernels with varying outer (frames in parallel)");
+    SD_TRACE("             and inner (cv::setNumThreads) thread counts and reports strong and weak scaling");
+    SD_TRACE("Example : Sandbox_Benchmark_Example C:/Temp/ 10 --counters");
+}
+
+//******************************************************************************************
+
+void benchFreqFilter(const cv::Mat & image, int repeats)
+{
+    int objectMinSize = 0.15 * (image.cols + image.rows) / 2;
+    int sx = (10.0/objectMinSize)*image.cols;
+    int sy = (10.0/objectMinSize)*image.rows;
+    cv::Mat freqMask = ImageProcessing::getCutGaussianKernel2D(sx, sy, 0.0, 0.0, 0.25);
+    cv::Mat out;
+    for (int i=0; i<repeats; i++)
+    {
+        ImageProcessing::freqFilter(image, out, freqMask, true);
+    }
+}
+
+//******************************************************************************************
+
+void benchNldStep(const cv::Mat & image, int repeats)
+{
+    cv::Mat Lt, Lx, Ly, Lflow, Lstep;
+    image.convertTo(Lt, CV_32F, 1.0/255.0);
+    cv::image_derivatives_scharr(Lt, Lx, 1, 0);
+    cv::image_derivatives_scharr(Lt, Ly, 0, 1);
+    float k = cv::compute_k_percentile(Lt, 0.7f, 1.0f, 300, 0, 0);
+    cv::pm_g2(Lx, Ly, Lflow, k);
+    Lstep = cv::Mat::zeros(Lt.size(), CV_32F);
+
+    // Reads Ld, c and writes Lstep, then Ld += Lstep : 6 float accesses per pixel
+    // 4 fluxes of 3 flops, 5 flops to combine, 1 flop to update
+    double npixels = Lt.total();
+    for (int i=0; i<repeats; i++)
+    {
+        PROFILE_ZONE("nld_step_scalar", 6.0 * 4.0 * npixels, 18.0 * npixels);
+        cv::nld_step_scalar(Lt, Lflow, Lstep, 0.25f);
+    }
+}
+
+//******************************************************************************************
+/*!
+ * \brief benchDiffusionSchemes compares the explicit FED cycles and the semi-implicit AOS steps
+ * on the nonlinear diffusion filtering. The difference is the RMS of the final levels
+ */
+void benchDiffusionSchemes(const cv::Mat & image, int repeats)
+{
+    cv::Mat fed, aos;
+    for (int i=0; i<repeats; i++)
+    {
+        {
+            PROFILE_ZONE("Diffusion FED", 0.0, 0.0);
+            ImageProcessing::nonlinearDiffusionFiltering(image, fed, ImageProcessing::DIFFUSION_FED);
+        }
+        {
+            PROFILE_ZONE("Diffusion AOS", 0.0, 0.0);
+            ImageProcessing::nonlinearDiffusionFiltering(image, aos, ImageProcessing::DIFFUSION_AOS);
+        }
+    }
+    double rms = cv::norm(fed, aos, cv::NORM_L2) / std::sqrt((double) fed.total());
+    SD_TRACE1("Diffusion AOS vs FED : RMS difference %1", rms);
+}
+
+//******************************************************************************************
+
+void benchHessian(const cv::Mat & image, int repeats)
+{
+    cv::Mat img32F;
+    image.convertTo(img32F, CV_32F, 1.0/255.0);
+
+    cv::AKAZEOptions options;
+    options.img_width = img32F.cols;
+    options.img_height = img32F.rows;
+    options.descriptor = cv::AKAZE::DESCRIPTOR_KAZE;
+    cv::AKAZEFeatures akaze(options);
+    akaze.Create_Nonlinear_Scale_Space(img32F);
+
+    std::vector<cv::Mat> evolution;
+    akaze.getNDEvolution(evolution);
+    double npixels = 0.0;
+    for (size_t i=0; i<evolution.size(); i++)
+        npixels += evolution[i].total();
+
+    // Multiscale derivatives : 5 separable filters (2 passes, 4 bytes in/out, ~2*3 taps) + 5 scalings
+    // Determinant : 3 planes read, 1 written, 3 flops
+    for (int i=0; i<repeats; i++)
+    {
+        PROFILE_ZONE("Hessian response", (5.0 * 16.0 + 5.0 * 8.0 + 16.0) * npixels, (5.0 * 12.0 + 5.0 + 3.0) * npixels);
+        akaze.Compute_Determinant_Hessian_Response();
+    }
+}
+
+//******************************************************************************************
+
+void benchDetectObjects(const cv::Mat & image, int repeats)
+{
+    ImageProcessing::Contours contours;
+    for (int i=0; i<repeats; i++)
+    {
+        ImageProcessing::detectObjects(image, &contours, 0.15, 1.0, cv::Mat(), ImageProcessing::ELLIPSE_LIKE, 2.0, false);
+    }
+}
+
+//******************************************************************************************
+/*!
+ * \brief benchPreFilters compares the pre-filters of detectObjects. Speed is measured on the
+ * pre-filter alone. Contour quality is the mean gradient magnitude of the image on the detected
+ * contours : contours on the object edges give high values, displaced or spurious contours low ones.
+ */
+void benchPreFilters(const cv::Mat & image, int repeats)
+{
+    cv::Mat gx, gy, gradient;
+    cv::Sobel(image, gx, CV_32F, 1, 0);
+    cv::Sobel(image, gy, CV_32F, 0, 1);
+    cv::magnitude(gx, gy, gradient);
+    cv::Rect bounds(0, 0, image.cols, image.rows);
+
+    const char * names[] = {"Pre-filter median", "Pre-filter guided", "Pre-filter bilateral grid", "Pre-filter diffusion"};
+    ImageProcessing::PreFilter initial = ImageProcessing::getDetectionPreFilter();
+    for (int f=ImageProcessing::PREFILTER_MEDIAN; f<=ImageProcessing::PREFILTER_DIFFUSION; f++)
+    {
+        ImageProcessing::PreFilter filter = (ImageProcessing::PreFilter) f;
+        cv::Mat out;
+        for (int i=0; i<repeats; i++)
+        {
+            PROFILE_ZONE(names[f], 2.0 * image.total(), 0.0);
+            ImageProcessing::preFilter(image, out, filter);
+        }
+
+        ImageProcessing::setDetectionPreFilter(filter);
+        ImageProcessing::Contours contours;
+        ImageProcessing::detectObjects(image, &contours, 0.15, 1.0, cv::Mat(), ImageProcessing::ELLIPSE_LIKE, 2.0, false);
+
+        double sum = 0.0;
+        int count = 0;
+        for (int i=0; i<contours.size(); i++)
+        {
+            for (size_t j=0; j<contours[i].size(); j++)
+            {
+                if (!bounds.contains(contours[i][j]))
+                    continue;
+                sum += gradient.at<float>(contours[i][j]);
+                count++;
+            }
+        }
+        SD_TRACE3("%1 : %2 objects, mean contour gradient %3", names[f], contours.size(), count > 0 ? sum / count : 0.0);
+    }
+    ImageProcessing::setDetectionPreFilter(initial);
+}
+
+//******************************************************************************************
+/*!
+ * \brief adversarialFrames generates worst-case frames for the detection : they give a lot of
+ * edges, contours and contour points. A clean frame with a few objects is the reference.
+ */
+QList<QPair<QString, cv::Mat> > adversarialFrames(const cv::Size & size)
+{
+    QList<QPair<QString, cv::Mat> > frames;
+    cv::RNG rng(12345);
+
+    cv::Mat clean(size, CV_8U, cv::Scalar(40));
+    for (int i=0; i<5; i++)
+    {
+        cv::Point c(size.width * (i + 1) / 6, size.height / 2);
+        cv::ellipse(clean, c, cv::Size(size.width / 16, size.height / 10), 0.0, 0.0, 360.0, cv::Scalar(220), -1);
+    }
+    frames << qMakePair(QString("clean"), clean);
+
+    cv::Mat noise(size, CV_8U);
+    rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+    frames << qMakePair(QString("uniform noise"), noise);
+
+    cv::Mat saltPepper(size, CV_8U, cv::Scalar(128));
+    for (int i=0; i<size.area() / 10; i++)
+        saltPepper.at<uchar>(rng.uniform(0, size.height), rng.uniform(0, size.width)) = rng.uniform(0, 2) ? 255 : 0;
+    frames << qMakePair(QString("salt and pepper"), saltPepper);
+
+    cv::Mat checker(size, CV_8U);
+    for (int y=0; y<size.height; y++)
+        for (int x=0; x<size.width; x++)
+            checker.at<uchar>(y, x) = ((x / 3 + y / 3) % 2) ? 230 : 20;
+    frames << qMakePair(QString("fine checkerboard"), checker);
+
+    cv::Mat dots(size, CV_8U, cv::Scalar(20));
+    for (int y=6; y<size.height; y+=12)
+        for (int x=6; x<size.width; x+=12)
+            cv::circle(dots, cv::Point(x, y), 4, cv::Scalar(230), -1);
+    frames << qMakePair(QString("dot grid"), dots);
+
+    cv::Mat lines(size, CV_8U, cv::Scalar(128));
+    for (int i=0; i<2000; i++)
+    {
+        cv::Point p1(rng.uniform(0, size.width), rng.uniform(0, size.height));
+        cv::Point p2(rng.uniform(0, size.width), rng.uniform(0, size.height));
+        cv::line(lines, p1, p2, cv::Scalar(rng.uniform(0, 256)), 1);
+    }
+    frames << qMakePair(QString("random lines"), lines);
+
+    return frames;
+}
+
+//******************************************************************************************
+/*!
+ * \brief benchAdversarial measures the worst latency of detectObjects on the adversarial frames,
+ * without and with the detection limits
+ */
+void benchAdversarial(const cv::Size & size, int repeats)
+{
+    QList<QPair<QString, cv::Mat> > frames = adversarialFrames(size);
+    ImageProcessing::DetectionLimits limits = ImageProcessing::getDetectionLimits();
+    ImageProcessing::Contours contours;
+
+    for (int l=0; l<2; l++)
+    {
+        ImageProcessing::setDetectionLimits(l == 0 ? ImageProcessing::DetectionLimits(0.0, 0, 0, 0) : limits);
+        SD_TRACE(l == 0 ? "Adversarial frames, no limits :" : "Adversarial frames, with limits :");
+        double worst = 0.0;
+        for (int f=0; f<frames.size(); f++)
+        {
+            ImageProcessing::resetDetectionCounters();
+            double maxMs = 0.0;
+            for (int i=0; i<repeats; i++)
+            {
+                double t = (double) cv::getTickCount();
+                ImageProcessing::detectObjects(frames[f].second, &contours, 0.05, 0.5, cv::Mat(), ImageProcessing::ELLIPSE_LIKE, 2.0, false);
+                maxMs = qMax(maxMs, ((double) cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency());
+            }
+            ImageProcessing::DetectionCounters c = ImageProcessing::getDetectionCounters();
+            SD_TRACE(QString("  %1 : max %2 ms, %3 objects, bail-outs edges/contours/points : %4/%5/%6")
+                     .arg(frames[f].first, -18).arg(maxMs, 0, 'f', 2).arg(contours.size())
+                     .arg(c.edgeDensityBailouts).arg(c.contoursBailouts).arg(c.pointsBailouts));
+            worst = qMax(worst, maxMs);
+        }
+        SD_TRACE1("  worst frame latency : %1 ms", worst);
+    }
+    ImageProcessing::setDetectionLimits(limits);
+}
+
+//******************************************************************************************
+// Thread scaling
+//******************************************************************************************
+
+typedef void (*FrameKernel)(const cv::Mat & image);
+
+/*!
+ * \brief describeKernel computes the AKAZE scale space, keypoints and descriptors of an image,
+ * as the pairs detector does for a card (parallel_for_ in the diffusion steps and the descriptors)
+ */
+void describeKernel(const cv::Mat & image)
+{
+    cv::Mat img32F;
+    image.convertTo(img32F, CV_32F, 1.0/255.0);
+    cv::AKAZEOptions options;
+    options.img_width = img32F.cols;
+    options.img_height = img32F.rows;
+    options.descriptor = cv::AKAZE::DESCRIPTOR_KAZE;
+    options.dthreshold = 0.0001f;
+    options.omax = 4;
+    options.nsublevels = 4;
+    cv::AKAZEFeatures akaze(options);
+    akaze.Create_Nonlinear_Scale_Space(img32F);
+    std::vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors;
+    akaze.Feature_Detection(keypoints);
+    akaze.Compute_Descriptors(keypoints, descriptors);
+}
+
+//******************************************************************************************
+/*!
+ * \brief nldKernel runs a diffusion step (conductivity and nld_step_scalar)
+ */
+void nldKernel(const cv::Mat & image)
+{
+    cv::Mat Lt, Lx, Ly, Lflow, Lstep;
+    image.convertTo(Lt, CV_32F, 1.0/255.0);
+    cv::image_derivatives_scharr(Lt, Lx, 1, 0);
+    cv::image_derivatives_scharr(Lt, Ly, 0, 1);
+    cv::pm_g2(Lx, Ly, Lflow, 0.02f);
+    Lstep = cv::Mat::zeros(Lt.size(), CV_32F);
+    cv::nld_step_scalar(Lt, Lflow, Lstep, 0.25f);
+}
+
+//******************************************************************************************
+/*!
+ * \brief pipelineKernel processes a frame end to end : card detection, then keypoints and
+ * descriptors of each card
+ */
+void pipelineKernel(const cv::Mat & image)
+{
+    ImageProcessing::Contours cards;
+    ImageProcessing::detectObjects(image, &cards, 0.15, 1.0, cv::Mat(), ImageProcessing::ELLIPSE_LIKE, 2.0, false);
+    cv::Rect bounds(cv::Point(), image.size());
+    for (int i=0; i<cards.size() && i<8; i++)
+    {
+        cv::Rect r = cv::boundingRect(cards[i]) & bounds;
+        if (r.area() > 0)
+            describeKernel(image(r));
+    }
+}
+
+//******************************************************************************************
+/*!
+ * \brief The ScalingWorker class is an outer thread : it takes the next frame until all frames
+ * are processed
+ */
+class ScalingWorker
+{
+public:
+    ScalingWorker(const QVector<cv::Mat> & images, int frames, FrameKernel kernel, std::atomic<int> * next) :
+        _images(images),
+        _frames(frames),
+        _kernel(kernel),
+        _next(next)
+    {}
+
+    void operator()() const
+    {
+        for (int i = (*_next)++; i < _frames; i = (*_next)++)
+            _kernel(_images[i % _images.size()]);
+    }
+
+protected:
+    const QVector<cv::Mat> & _images;
+    int _frames;
+    FrameKernel _kernel;
+    std::atomic<int> * _next;
+};
+
+//******************************************************************************************
+/*!
+ * \brief runFrames processes frames on outer threads, with inner threads for the OpenCV parallel loops
+ * \return wall time in seconds
+ */
+double runFrames(const QVector<cv::Mat> & images, int frames, FrameKernel kernel, int outer, int inner)
+{
+    cv::setNumThreads(inner);
+    std::atomic<int> next(0);
+    std::vector<std::thread> threads;
+    QElapsedTimer timer;
+    timer.start();
+    for (int t=0; t<outer; t++)
+        threads.push_back(std::thread(ScalingWorker(images, frames, kernel, &next)));
+    for (size_t t=0; t<threads.size(); t++)
+        threads[t].join();
+    return timer.nsecsElapsed() * 1e-9;
+}
+
+//******************************************************************************************
+/*!
+ * \brief benchScaling measures the strong and weak scaling of a kernel.
+ *
+ * Configurations are outer x inner threads, powers of 2 up to twice the number of cores in total.
+ * Strong scaling : fixed number of frames, speedup = T(1x1) / T(outer x inner).
+ * Weak scaling : frames proportional to the outer threads, efficiency = T(1 x inner) / T(outer x inner).
+ * Strong scaling efficiency is the speedup divided by the used cores, min(outer x inner, cores).
+ * Configurations with more threads than cores are flagged as oversubscribed.
+ */
+void benchScaling(const QString & name, const QVector<cv::Mat> & images, FrameKernel kernel, int repeats)
+{
+    int cores = cv::getNumberOfCPUs();
+    int strongFrames = qMax(images.size() * repeats, 2 * cores);
+    int weakFrames = qMax(repeats, 1);
+
+    // Warm up (allocations, thread pools)
+    runFrames(images, qMin(images.size(), cores), kernel, cores, 1);
+
+    SD_TRACE(QString("Scaling of '%1' on %2 cores : %3 frames (strong), %4 frames per outer thread (weak)")
+             .arg(name).arg(cores).arg(strongFrames).arg(weakFrames));
+    SD_TRACE("  outer x inner | strong : time (s), speedup, efficiency | weak : time (s), efficiency");
+
+    double strongRef = 0.0;
+    QVector<double> weakRef;
+    for (int inner=1; inner<=cores; inner*=2)
+    {
+        for (int outer=1; outer*inner<=2*cores; outer*=2)
+        {
+            int threads = outer * inner;
+            double strong = runFrames(images, strongFrames, kernel, outer, inner);
+            double weak = runFrames(images, weakFrames * outer, kernel, outer, inner);
+            if (outer == 1 && inner == 1)
+                strongRef = strong;
+            if (outer == 1)
+                weakRef << weak;
+
+            double speedup = strongRef / strong;
+            double strongEfficiency = speedup / qMin(threads, cores);
+            double weakEfficiency = weakRef.last() / weak;
+            SD_TRACE(QString("  %1 x %2 | %3, %4, %5 | %6, %7%8")
+                     .arg(outer, 3).arg(inner, -3)
+                     .arg(strong, 0, 'f', 3).arg(speedup, 0, 'f', 2).arg(strongEfficiency, 0, 'f', 2)
+                     .arg(weak, 0, 'f', 3).arg(weakEfficiency, 0, 'f', 2)
+                     .arg(threads > cores ? QString("  OVERSUBSCRIBED (%1 threads)").arg(threads) : QString()));
+        }
+    }
+    cv::setNumThreads(-1);
+}
+
+//******************************************************************************************
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        help();
+        return 0;
+    }
+
+    QStringList args;
+    for (int i=2; i<argc; i++)
+        args << QString(argv[i]);
+
+    bool useCounters = args.removeAll("--counters") > 0;
+    bool adversarial = args.removeAll("--adversarial") > 0;
+    bool scaling = args.removeAll("--scaling") > 0;
+    int repeats = args.isEmpty() ? 5 : args[0].toInt();
+    if (repeats < 1) repeats = 1;
+
+    // ----- LOAD IMAGES FROM PATH
+    QString path = QString(argv[1]);
+    QDir d(path);
+    if (!d.exists())
+    {
+        SD_TRACE1("Provided path '%1' is not found", path);
+        return 1;
+    }
+
+    QStringList files = d.entryList(QStringList() << "*.jpg" << "*.png" << "*.tif", QDir::Files);
+    if (files.isEmpty())
+    {
+        SD_TRACE1("No images found at path '%1'", path);
+        help();
+        return 1;
+    }
+
+    if (useCounters)
+    {
+        if (Profiler::countersAvailable())
+        {
+            cv::setNumThreads(1);
+            Profiler::setCountersEnabled(true);
+        }
+        else
+        {
+            SD_TRACE("Hardware counters are not available (check /proc/sys/kernel/perf_event_paranoid)");
+        }
+    }
+
+    Profiler::MachinePeak peak = Profiler::machinePeak();
+    Profiler::setEnabled(true);
+
+    // Loop on files :
+    ImageCommon::ImagePrefetcher prefetcher(ImageCommon::ImagePrefetcher::enumerate(path), 8);
+    QString file;
+    cv::Mat inImage;
+    QVector<cv::Mat> images;
+    while (prefetcher.next(&file, &inImage))
+    {
+        SD_TRACE1("Open file '%1'", file);
+        if (inImage.empty())
+            continue;
+
+        // Same working size as the application
+        int dim = qMax(inImage.rows, inImage.cols);
+        int limit = 700;
+        if (dim > limit)
+        {
+            cv::Mat out;
+            double f = limit* 1.0 / dim;
+            cv::resize(inImage, out, cv::Size(), f, f);
+            inImage = out;
+        }
+
+        // Scaling runs on all the images at the end
+        if (scaling)
+        {
+            images << inImage;
+            continue;
+        }
+
+        benchFreqFilter(inImage, repeats);
+        benchNldStep(inImage, repeats);
+        benchDiffusionSchemes(inImage, repeats);
+        benchHessian(inImage, repeats);
+        benchDetectObjects(inImage, repeats);
+        benchPreFilters(inImage, repeats);
+    }
+
+    if (adversarial)
+        benchAdversarial(cv::Size(700, 700), repeats);
+
+    if (scaling && !images.isEmpty())
+    {
+        // Profiler zones share a mutex, they would serialize the outer threads
+        Profiler::setEnabled(false);
+        benchScaling("pipeline", images, pipelineKernel, repeats);
+        benchScaling("nld_step_scalar", images, nldKernel, repeats);
+        benchScaling("AKAZE descriptors", images, describeKernel, repeats);
+        Profiler::setEnabled(true);
+    }
+
+    Profiler::report(peak);
+    return 0;
+}
@@ -0,0 +1,170 @@
+// Qt
+#include <QThread>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+
+// OpenCV
+#include <opencv2/core.hpp>
+
+// Tests
+#include "../../Common.h"
+#include "Core/Global.h"
+#include "AsyncPipeline.h"
+#include "AsyncPipelineTest.h"
+
+
+namespace Tests
+{
+
+//*************************************************************************
+
+void AsyncPipelineTest::detectCardsTest()
+{
+    QThreadPool pool;
+    DGV::AsyncPipeline pipeline(&pool);
+
+    // Frame without cards : finished with an empty result
+    cv::Mat frame(480, 640, CV_8UC3, cv::Scalar::all(0));
+    DGV::AsyncResult<DGV::FrameResult> r = pipeline.detectCardsAsync(frame);
+    pool.waitForDone();
+    QVERIFY(r.isFinished());
+    QVERIFY(!r.isCancelled());
+    QVERIFY(r.result().cards.isEmpty());
+
+    // Unsupported frame : cancelled
+    cv::Mat twoChannels(480, 640, CV_8UC2, cv::Scalar::all(0));
+    r = pipeline.detectCardsAsync(twoChannels);
+    pool.waitForDone();
+    QVERIFY(r.isFinished());
+    QVERIFY(r.isCancelled());
+}
+
+//*************************************************************************
+
+void AsyncPipelineTest::cancellationTest()
+{
+    QThreadPool pool;
+    DGV::AsyncPipeline pipeline(&pool);
+
+    // Cancelled before the start : the continuation gets the cancelled result
+    DGV::CancellationToken token;
+    token.cancel();
+    QAtomicInt called(0);
+    cv::Mat frame(480, 640, CV_8UC1, cv::Scalar::all(0));
+    DGV::AsyncResult<DGV::FrameResult> r = pipeline.detectCardsAsync(frame, 0, token);
+    r.then([&](const DGV::AsyncResult<DGV::FrameResult> & result)
+    {
+        if (result.isCancelled())
+            called.ref();
+    });
+    pool.waitForDone();
+    QVERIFY(r.isCancelled());
+    QVERIFY(called.load() == 1);
+
+    // Continuation given after the end
+    called.store(0);
+    r.then([&](const DGV::AsyncResult<DGV::FrameResult> &) { called.ref(); });
+    QVERIFY(called.load() == 1);
+}
+
+//*************************************************************************
+
+void AsyncPipelineTest::contextTest()
+{
+    QThreadPool pool;
+    DGV::AsyncPipeline pipeline(&pool);
+
+    // The continuation runs on the thread of the context, through its event loop
+    QObject context;
+    QAtomicInt called(0);
+    QAtomicPointer<QThread> thread(0);
+    cv::Mat frame(480, 640, CV_8UC1, cv::Scalar::all(0));
+    DGV::AsyncResult<DGV::FrameResult> r = pipeline.detectCardsAsync(frame, &context);
+    r.then([&](const DGV::AsyncResult<DGV::FrameResult> &)
+    {
+        called.ref();
+        thread.store(QThread::currentThread());
+    });
+    pool.waitForDone();
+    QVERIFY(r.isFinished());
+    QTRY_VERIFY(called.load() == 1);
+    QVERIFY(thread.load() == QThread::currentThread());
+}
+
+//*************************************************************************
+
+void AsyncPipelineTest::destroyedContextTest()
+{
+    // Context destroyed before the continuation runs : it is called with a cancelled result
+    QObject * context = new QObject;
+    QAtomicInt called(0), cancelled(0);
+    DGV::AsyncResult<int> r(context);
+    r.then([&](const DGV::AsyncResult<int> & done)
+    {
+        called.ref();
+        if (done.isCancelled()) cancelled.ref();
+    });
+    r.finish(1);
+    delete context;
+    QTRY_VERIFY(called.load() == 1);
+    QVERIFY(cancelled.load() == 1);
+
+    // Context destroyed before the end
+    context = new QObject;
+    DGV::AsyncResult<int> r2(context);
+    delete context;
+    r2.then([&](const DGV::AsyncResult<int> & done)
+    {
+        called.ref();
+        if (done.isCancelled()) cancelled.ref();
+    });
+    r2.finish(2);
+    QVERIFY(called.load() == 2);
+    QVERIFY(cancelled.load() == 2);
+    QVERIFY(r2.result() == 2);
+}
+
+//*************************************************************************
+
+void AsyncPipelineTest::matchTest()
+{
+    QThreadPool pool;
+    DGV::AsyncPipeline pipeline(&pool);
+
+    // Cards out of the frame : cancelled
+    DGV::FrameResult frame;
+    DGV::AsyncResult<DGV::PairResult> r = pipeline.matchAsync(frame, 0, 1);
+    pool.waitForDone();
+    QVERIFY(r.isFinished());
+    QVERIFY(r.isCancelled());
+}
+
+//*************************************************************************
+
+void AsyncPipelineTest::workerIsolationTest()
+{
+    // The pool settings are replaced in isolation mode and restored when it is disabled
+    QThreadPool pool;
+    pool.setMaxThreadCount(3);
+    pool.setExpiryTimeout(1000);
+    {
+        DGV::AsyncPipeline pipeline(&pool);
+        pipeline.setWorkerIsolation(true);
+        QVERIFY(pool.expiryTimeout() == -1);
+        pipeline.setWorkerIsolation(false);
+        QVERIFY(pool.maxThreadCount() == 3);
+        QVERIFY(pool.expiryTimeout() == 1000);
+
+        // Restored by the destructor
+        pipeline.setWorkerIsolation(true);
+    }
+    QVERIFY(pool.maxThreadCount() == 3);
+    QVERIFY(pool.expiryTimeout() == 1000);
+}
+
+//*************************************************************************
+
+}
+
+QTEST_MAIN(Tests::AsyncPipelineTest)
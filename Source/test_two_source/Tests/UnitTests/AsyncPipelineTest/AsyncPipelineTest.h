@@ -0,0 +1,32 @@
+#ifndef AsyncPipelineTest_H
+#define AsyncPipelineTest_H
+
+// Qt
+#include <QObject>
+#include <QtTest>
+
+// Project
+
+namespace Tests
+{
+
+//*************************************************************************
+
+class AsyncPipelineTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void detectCardsTest();
+    void cancellationTest();
+    void contextTest();
+    void destroyedContextTest();
+    void matchTest();
+    void workerIsolationTest();
+
+};
+
+//*************************************************************************
+
+} 
+
+#endif // AsyncPipelineTest_H
@@ -0,0 +1,123 @@
+// Opencv
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+// Tests
+#include "../../Common.h"
+#include "Core/Global.h"
+#include "CardDetector.h"
+#include "BasicPairsDetector.h"
+#include "FeatureCache.h"
+#include "BasicPairsDetectorTest.h"
+
+
+namespace Tests
+{
+
+//*************************************************************************
+
+//! Textured card with three square objects
+static cv::Mat texturedCard(DGV::ObjectTable & table)
+{
+    cv::Mat card(240, 240, CV_8U);
+    cv::RNG rng(12345);
+    rng.fill(card, cv::RNG::UNIFORM, 0, 256);
+    cv::GaussianBlur(card, card, cv::Size(0, 0), 1.5);
+
+    table.clear();
+    table.cardOffsets << 0;
+    cv::Point corners[] = {cv::Point(30, 30), cv::Point(140, 30), cv::Point(30, 140)};
+    for (int i=0; i<3; i++)
+    {
+        cv::Rect r(corners[i], cv::Size(70, 70));
+        DGV::ObjectTable::Object o;
+        o.cardId = 0;
+        o.contourOffset = (int) table.points.size();
+        o.contourLength = 4;
+        o.bbox = r;
+        o.label = -1;
+        table.points.push_back(r.tl());
+        table.points.push_back(cv::Point(r.br().x - 1, r.y));
+        table.points.push_back(r.br() - cv::Point(1, 1));
+        table.points.push_back(cv::Point(r.x, r.br().y - 1));
+        table.objects << o;
+    }
+    table.cardOffsets << table.objects.size();
+    return card;
+}
+
+//*************************************************************************
+
+void BasicPairsDetectorTest::indexCacheTest()
+{
+    DGV::ObjectTable table;
+    QVector<cv::Mat> cards(1, texturedCard(table));
+
+    DGV::BasicPairsDetector detector;
+    QVERIFY(detector.getIndexCacheLimit() == 64 * 1024 * 1024);
+    DGV::FeatureCache cache(detector.getExtractor());
+    cache.setCards(cards, &table);
+
+    // Each object is indexed once
+    QVERIFY(detector.setupRefObject(cache, 0));
+    QVERIFY(detector.trainedIndexCount() == 1);
+    QVERIFY(detector.indexCacheCount() == 1);
+    QVERIFY(detector.indexCacheBytes() > 0);
+    QVERIFY(detector.setupRefObject(cache, 1));
+    QVERIFY(detector.setupRefObject(cache, 0));
+    QVERIFY(detector.setupRefObject(cache, 1));
+    QVERIFY(detector.trainedIndexCount() == 2);
+    QVERIFY(detector.indexCacheCount() == 2);
+
+    // An object matches itself with its cached index
+    QVERIFY(detector.setupRefObject(cache, 0));
+    QVERIFY(detector.matchWithRefObject(cache, 0));
+    QVERIFY(detector.trainedIndexCount() == 2);
+
+    // New cards : the indices are not valid anymore
+    int generation = cache.generation();
+    cache.setCards(cards, &table);
+    QVERIFY(cache.generation() != generation);
+    QVERIFY(detector.setupRefObject(cache, 0));
+    QVERIFY(detector.trainedIndexCount() == 3);
+    QVERIFY(detector.indexCacheCount() == 1);
+}
+
+//*************************************************************************
+
+void BasicPairsDetectorTest::indexCacheEvictionTest()
+{
+    DGV::ObjectTable table;
+    QVector<cv::Mat> cards(1, texturedCard(table));
+
+    DGV::BasicPairsDetector detector;
+    DGV::FeatureCache cache(detector.getExtractor());
+    cache.setCards(cards, &table);
+
+    // Limit of a single index : the least recently used index is released
+    QVERIFY(detector.setupRefObject(cache, 0));
+    QVERIFY(detector.setupRefObject(cache, 1));
+    qint64 bytes = detector.indexCacheBytes();
+    QVERIFY(detector.indexCacheCount() == 2);
+    detector.clearIndexCache();
+    detector.setIndexCacheLimit(bytes - 1);
+
+    QVERIFY(detector.setupRefObject(cache, 0));
+    QVERIFY(detector.setupRefObject(cache, 1));
+    QVERIFY(detector.indexCacheCount() == 1);
+    QVERIFY(detector.indexCacheBytes() <= detector.getIndexCacheLimit());
+    int trained = detector.trainedIndexCount();
+
+    // Object 1 is kept, object 0 was released
+    QVERIFY(detector.setupRefObject(cache, 1));
+    QVERIFY(detector.trainedIndexCount() == trained);
+    QVERIFY(detector.setupRefObject(cache, 0));
+    QVERIFY(detector.trainedIndexCount() == trained + 1);
+    QVERIFY(detector.indexCacheCount() == 1);
+}
+
+//*************************************************************************
+
+}
+
+QTEST_MAIN(Tests::BasicPairsDetectorTest)
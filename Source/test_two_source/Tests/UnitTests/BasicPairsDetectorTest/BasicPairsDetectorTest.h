@@ -0,0 +1,28 @@
+#ifndef BasicPairsDetectorTest_H
+#define BasicPairsDetectorTest_H
+
+// Qt
+#include <QObject>
+#include <QtTest>
+
+// Project
+
+namespace Tests
+{
+
+//*************************************************************************
+
+class BasicPairsDetectorTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void indexCacheTest();
+    void indexCacheEvictionTest();
+
+};
+
+//*************************************************************************
+
+} 
+
+#endif // BasicPairsDetectorTest_H
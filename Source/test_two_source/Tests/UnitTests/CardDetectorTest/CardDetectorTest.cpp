@@ -0,0 +1,53 @@
+// Opencv
+#include <opencv2/core.hpp>
+
+// Tests
+#include "../../Common.h"
+#include "Core/Global.h"
+#include "CardDetector.h"
+#include "CardDetectorTest.h"
+
+
+namespace Tests
+{
+
+//*************************************************************************
+
+void CardDetectorTest::snapWorkingSizeTest()
+{
+    // Rounded up to the closest working size
+    QVERIFY(DGV::CardDetector::snapWorkingSize(10) == 64);
+    QVERIFY(DGV::CardDetector::snapWorkingSize(128) == 128);
+    QVERIFY(DGV::CardDetector::snapWorkingSize(200) == 240);
+    QVERIFY(DGV::CardDetector::snapWorkingSize(1000) == 640);
+
+    // Rounded down if the rounded up size is larger than the limit
+    QVERIFY(DGV::CardDetector::snapWorkingSize(200, 1000) == 240);
+    QVERIFY(DGV::CardDetector::snapWorkingSize(200, 240) == 240);
+    QVERIFY(DGV::CardDetector::snapWorkingSize(200, 200) == 192);
+    QVERIFY(DGV::CardDetector::snapWorkingSize(1000, 300) == 256);
+    QVERIFY(DGV::CardDetector::snapWorkingSize(10, 40) == 64);
+}
+
+//*************************************************************************
+
+void CardDetectorTest::estimateWorkingSizeTest()
+{
+    // Native size between two working sizes : the card is never upsampled
+    DGV::CardDetector detector(0.15, 1.0);
+    int nativeSizes[] = {200, 300, 500};
+    int expected[] = {192, 256, 256};
+    for (int i=0; i<3; i++)
+    {
+        cv::Mat card(nativeSizes[i], nativeSizes[i], CV_8U, cv::Scalar::all(255));
+        int size = detector.estimateWorkingSize(card);
+        QVERIFY(size <= nativeSizes[i]);
+        QVERIFY(size == expected[i]);
+    }
+}
+
+//*************************************************************************
+
+}
+
+QTEST_MAIN(Tests::CardDetectorTest)
@@ -0,0 +1,28 @@
+#ifndef CardDetectorTest_H
+#define CardDetectorTest_H
+
+// Qt
+#include <QObject>
+#include <QtTest>
+
+// Project
+
+namespace Tests
+{
+
+//*************************************************************************
+
+class CardDetectorTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void snapWorkingSizeTest();
+    void estimateWorkingSizeTest();
+
+};
+
+//*************************************************************************
+
+} 
+
+#endif // CardDetectorTest_H
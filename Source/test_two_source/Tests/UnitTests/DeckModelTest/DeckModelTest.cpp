@@ -0,0 +1,192 @@
+// Qt
+#include <QTemporaryDir>
+#include <QFile>
+#include <QTextStream>
+
+// Tests
+#include "../../Common.h"
+#include "Core/Global.h"
+#include "CardDetector.h"
+#include "DeckModel.h"
+#include "DeckModelTest.h"
+
+
+namespace Tests
+{
+
+//*************************************************************************
+
+//! Cards of the printed deck : 55 cards of the projective plane of order 7
+static QVector<QVector<int> > printedDeck()
+{
+    QVector<QVector<int> > cards = DGV::DeckModel::projectivePlane(7);
+    cards.resize(55);
+    return cards;
+}
+
+//! Adds a card of objects with the given labels to the table
+static void addCard(DGV::ObjectTable & table, const QVector<int> & labels)
+{
+    if (table.cardOffsets.isEmpty())
+        table.cardOffsets << 0;
+    foreach (int label, labels)
+    {
+        DGV::ObjectTable::Object o;
+        o.cardId = table.cardCount();
+        o.contourOffset = 0;
+        o.contourLength = 0;
+        o.label = label;
+        table.objects << o;
+    }
+    table.cardOffsets << table.objects.size();
+}
+
+//*************************************************************************
+
+void DeckModelTest::deckTest()
+{
+    DGV::DeckModel deck(printedDeck());
+    QVERIFY(deck.isValid());
+    QVERIFY(deck.cardCount() == 55);
+    QVERIFY(deck.symbolCount() == 57);
+
+    // Any two cards share one symbol, any two symbols of a card give the card
+    for (int i=0; i<deck.cardCount(); i++)
+    {
+        const QVector<int> & symbols = deck.cardSymbols(i);
+        QVERIFY(symbols.size() == 8);
+        QVERIFY(deck.cardFromSymbols(symbols[0], symbols[7]) == i);
+        for (int j=0; j<deck.cardCount(); j++)
+        {
+            int s = deck.commonSymbol(i, j);
+            QVERIFY(i == j ? s < 0 : deck.hasSymbol(i, s) && deck.hasSymbol(j, s));
+        }
+    }
+    QVERIFY(deck.commonSymbol(0, 55) < 0);
+    QVERIFY(deck.cardFromSymbols(3, 3) < 0);
+
+    // Two cards sharing two symbols : not a deck
+    QVector<QVector<int> > cards;
+    cards << (QVector<int>() << 0 << 1 << 2) << (QVector<int>() << 0 << 1 << 3);
+    QVERIFY(!DGV::DeckModel(cards).isValid());
+    QVERIFY(DGV::DeckModel::projectivePlane(6).isEmpty());
+}
+
+//*************************************************************************
+
+void DeckModelTest::loadTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.path() + "/deck.txt";
+
+    QVector<QVector<int> > cards = printedDeck();
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+        QTextStream stream(&file);
+        stream << "# card -> symbols\n";
+        for (int i=0; i<cards.size(); i++)
+        {
+            QStringList symbols;
+            foreach (int s, cards[i])
+                symbols << QString::number(s);
+            stream << symbols.join(i % 2 ? ", " : " ") << "\n\n";
+        }
+    }
+
+    DGV::DeckModel deck;
+    QVERIFY(!deck.isValid());
+    QVERIFY(deck.load(path));
+    QVERIFY(deck.cardCount() == 55);
+    QVERIFY(deck.commonSymbol(3, 40) == DGV::DeckModel(cards).commonSymbol(3, 40));
+    QVERIFY(!deck.load(dir.path() + "/missing.txt"));
+}
+
+//*************************************************************************
+
+void DeckModelTest::resolveCardsTest()
+{
+    DGV::DeckModel deck(printedDeck());
+    const QVector<int> & card10 = deck.cardSymbols(10);
+    const QVector<int> & card20 = deck.cardSymbols(20);
+
+    DGV::ObjectTable table;
+    // Two labels identify the card
+    addCard(table, QVector<int>() << -1 << card10[2] << -1 << card10[5]);
+    // All labels agree
+    addCard(table, card20);
+    // One label only
+    addCard(table, QVector<int>() << -1 << card10[2] << -1);
+    // Inconsistent labels
+    addCard(table, QVector<int>() << card10[0] << card10[1] << card20[0] << card20[1]);
+
+    QVector<int> cards;
+    deck.resolveCards(table, &cards);
+    QVERIFY(cards.size() == 4);
+    QVERIFY(cards[0] == 10);
+    QVERIFY(cards[1] == 20);
+    QVERIFY(cards[2] < 0);
+    QVERIFY(cards[3] < 0);
+}
+
+//*************************************************************************
+
+void DeckModelTest::commonObjectsTest()
+{
+    DGV::DeckModel deck(printedDeck());
+    int common = deck.commonSymbol(10, 20);
+    int other = deck.commonSymbol(10, 30);
+
+    // Labels of the card 30 do not include its symbol shared with the card 10
+    QVector<int> labels30;
+    foreach (int s, deck.cardSymbols(30))
+    {
+        if (s != other && labels30.size() < 2)
+            labels30 << s;
+    }
+
+    QVector<int> labels10, labels20;
+    labels10 << -1 << common << -1;
+    foreach (int s, deck.cardSymbols(10))
+    {
+        if (s != common && labels10.size() < 4)
+            labels10 << s;
+    }
+    labels20 << -1 << -1 << -1;
+    foreach (int s, deck.cardSymbols(20))
+    {
+        if (s != common && labels20.size() < 5)
+            labels20 << s;
+    }
+    labels20 << common;
+
+    DGV::ObjectTable table;
+    addCard(table, labels10);
+    addCard(table, labels20);
+    addCard(table, labels30);
+    addCard(table, QVector<int>() << -1 << -1);
+
+    QVector<int> cards;
+    deck.resolveCards(table, &cards);
+    QVERIFY(cards[0] == 10 && cards[1] == 20 && cards[2] == 30 && cards[3] < 0);
+
+    // Labelled cards : the common objects are given by the deck, no descriptor matching
+    int object1 = -1, object2 = -1;
+    QVERIFY(deck.commonObjects(table, cards, 0, 1, &object1, &object2));
+    QVERIFY(object1 == table.cardOffsets[0] + 1);
+    QVERIFY(object2 == table.cardOffsets[1] + 5);
+    QVERIFY(deck.commonObjects(table, cards, 1, 0, &object1, &object2));
+    QVERIFY(object1 == table.cardOffsets[1] + 5);
+
+    // Common symbol not labelled on both cards, or card not identified : objects are compared
+    QVERIFY(!deck.commonObjects(table, cards, 0, 2, &object1, &object2));
+    QVERIFY(!deck.commonObjects(table, cards, 0, 3, &object1, &object2));
+    QVERIFY(!DGV::DeckModel().commonObjects(table, cards, 0, 1, &object1, &object2));
+}
+
+//*************************************************************************
+
+}
+
+QTEST_MAIN(Tests::DeckModelTest)
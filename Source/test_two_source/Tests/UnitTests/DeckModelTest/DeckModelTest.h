@@ -0,0 +1,30 @@
+#ifndef DeckModelTest_H
+#define DeckModelTest_H
+
+// Qt
+#include <QObject>
+#include <QtTest>
+
+// Project
+
+namespace Tests
+{
+
+//*************************************************************************
+
+class DeckModelTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void deckTest();
+    void loadTest();
+    void resolveCardsTest();
+    void commonObjectsTest();
+
+};
+
+//*************************************************************************
+
+} 
+
+#endif // DeckModelTest_H
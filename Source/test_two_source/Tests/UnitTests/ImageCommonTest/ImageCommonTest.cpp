@@ -1,15 +1,25 @@
 
 // Std
 #include <vector>
+#include <thread>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Qt
+#include <QTemporaryDir>
 
 // OpenCV
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
 
 // Tests
 #include "../../Common.h"
 #include "Core/Global.h"
 #include "Core/ImageCommon.h"
+#include "Core/TiledImage.h"
+#include "Core/WorkerIsolation.h"
 #include "ImageCommonTest.h"
 
 
@@ -114,6 +124,94 @@ void ImageCommonTest::intersectWithEllipseTest()
 
 //*************************************************************************
 
+void ImageCommonTest::tiffTiledImageTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    cv::Mat in = generateBigObjects();
+    QString path = dir.path() + "/image.tif";
+    QVERIFY(cv::imwrite(path.toStdString(), in));
+    QVERIFY(ImageCommon::TiffTiledImage::isTiff(path));
+
+    ImageCommon::TiffTiledImage image;
+    QVERIFY(image.open(path));
+    QVERIFY(image.size() == in.size());
+
+    // Region over several strips, region clipped by the image
+    cv::Mat out;
+    cv::Rect r(50, 60, 300, 200);
+    QVERIFY(image.readRegion(r, &out));
+    QVERIFY(out.size() == r.size());
+    QVERIFY(cv::countNonZero(out != in(r)) == 0);
+
+    // Rows inside a strip, strip tiles are bounded
+    r = cv::Rect(10, in.rows / 2 + 1, in.cols - 20, 3);
+    QVERIFY(image.readRegion(r, &out));
+    QVERIFY(cv::countNonZero(out != in(r)) == 0);
+    QVERIFY(image.tileSize().height <= 256);
+
+    QVERIFY(image.readRegion(cv::Rect(in.cols - 20, in.rows - 30, 100, 100), &out));
+    QVERIFY(out.size() == cv::Size(20, 30));
+    QVERIFY(!image.readRegion(cv::Rect(in.cols, 0, 10, 10), &out));
+
+    // Not a TIFF file
+    QVERIFY(cv::imwrite((dir.path() + "/image.png").toStdString(), in));
+    QVERIFY(!image.open(dir.path() + "/image.png"));
+}
+
+//*************************************************************************
+
+static void pinTwice(int * cores)
+{
+    cores[0] = ImageCommon::pinWorkerThread();
+    cores[1] = ImageCommon::pinWorkerThread();
+}
+
+void ImageCommonTest::workerIsolationTest()
+{
+    // Disabled : nothing is pinned
+    QVERIFY(!ImageCommon::isWorkerIsolation());
+    QVERIFY(ImageCommon::pinWorkerThread() < 0);
+
+    // The thread count of the caller is restored
+    int threads = cv::getNumThreads();
+    cv::setNumThreads(3);
+    int custom = cv::getNumThreads();
+    ImageCommon::setWorkerIsolation(true);
+    QVERIFY(ImageCommon::isWorkerIsolation());
+    QVERIFY(cv::getNumThreads() == 1);
+    QVERIFY(ImageCommon::workerCoreCount() >= 1);
+
+#ifdef __linux__
+    // A worker is pinned once, to a single core
+    int cores[2] = {-1, -1};
+    std::thread worker(pinTwice, cores);
+    worker.join();
+    QVERIFY(cores[0] >= 0);
+    QVERIFY(cores[1] == cores[0]);
+
+    // A worker pinned in isolation mode gets back all the cores when the mode is disabled
+    QVERIFY(ImageCommon::pinWorkerThread() >= 0);
+    cpu_set_t set;
+    QVERIFY(sched_getaffinity(0, sizeof(set), &set) == 0);
+    QVERIFY(CPU_COUNT(&set) == 1);
+#endif
+
+    ImageCommon::setWorkerIsolation(false);
+    QVERIFY(!ImageCommon::isWorkerIsolation());
+    QVERIFY(cv::getNumThreads() == custom);
+    cv::setNumThreads(threads);
+
+    QVERIFY(ImageCommon::pinWorkerThread() < 0);
+#ifdef __linux__
+    QVERIFY(sched_getaffinity(0, sizeof(set), &set) == 0);
+    QVERIFY(CPU_COUNT(&set) == ImageCommon::workerCoreCount());
+#endif
+}
+
+//*************************************************************************
+
 }
 
 QTEST_MAIN(Tests::ImageCommonTest)
@@ -23,6 +23,9 @@ private slots:
 
     void intersectWithEllipseTest();
 
+    void tiffTiledImageTest();
+    void workerIsolationTest();
+
 private:
 
 };
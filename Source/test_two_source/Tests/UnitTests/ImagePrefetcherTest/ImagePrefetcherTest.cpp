@@ -0,0 +1,153 @@
+
+// Std
+#include <vector>
+#include <string.h>
+
+// Qt
+#include <QTemporaryDir>
+#include <QFile>
+
+// OpenCV
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+// Tests
+#include "../../Common.h"
+#include "Core/Global.h"
+#include "Core/ImagePrefetcher.h"
+#include "Core/JpegDecoder.h"
+#include "ImagePrefetcherTest.h"
+
+
+namespace Tests
+{
+
+//*************************************************************************
+
+void ImagePrefetcherTest::checkBackend(int backend)
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // Files of various sizes, one empty file and one missing file
+    QStringList files;
+    QList<QByteArray> contents;
+    for (int i=0; i<20; i++)
+    {
+        QByteArray data(i == 3 ? 0 : 1000 + i * 12345, 0);
+        for (int k=0; k<data.size(); k++)
+            data[k] = (char) ((k * 31 + i) & 0xFF);
+        QString path = dir.path() + QString("/file_%1.bin").arg(i);
+        QFile f(path);
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(data);
+        f.close();
+        files << path;
+        contents << data;
+    }
+    files << dir.path() + "/missing.bin";
+    contents << QByteArray();
+
+    ImageCommon::ImagePrefetcher prefetcher(files, 4, (ImageCommon::ImagePrefetcher::Backend) backend);
+    QString file;
+    std::vector<uchar> buffer;
+    bool ok = false;
+    int count = 0;
+    while (prefetcher.next(&file, &buffer, &ok))
+    {
+        QVERIFY(file == files[count]);
+        const QByteArray & expected = contents[count];
+        QVERIFY(ok == !expected.isEmpty());
+        if (ok)
+        {
+            QVERIFY((int) buffer.size() == expected.size());
+            QVERIFY(memcmp(&buffer[0], expected.constData(), buffer.size()) == 0);
+        }
+        count++;
+    }
+    QVERIFY(count == files.size());
+}
+
+//*************************************************************************
+
+void ImagePrefetcherTest::readThreadsTest()
+{
+    checkBackend(ImageCommon::ImagePrefetcher::READ_THREADS);
+}
+
+//*************************************************************************
+
+void ImagePrefetcherTest::ioUringTest()
+{
+    // Falls back to reading threads if io_uring is not available
+    checkBackend(ImageCommon::ImagePrefetcher::IO_URING);
+}
+
+//*************************************************************************
+
+void ImagePrefetcherTest::decodeTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    cv::Mat in = generateSimpleGeometries();
+    QString path = dir.path() + "/image.png";
+    QVERIFY(cv::imwrite(path.toStdString(), in));
+
+    ImageCommon::ImagePrefetcher prefetcher(ImageCommon::ImagePrefetcher::enumerate(dir.path()));
+    QVERIFY(prefetcher.fileCount() == 1);
+
+    QString file;
+    cv::Mat out;
+    QVERIFY(prefetcher.next(&file, &out));
+    QVERIFY(out.size() == in.size());
+    QVERIFY(cv::countNonZero(out != in) == 0);
+    QVERIFY(!prefetcher.next(&file, &out));
+}
+
+//*************************************************************************
+
+void ImagePrefetcherTest::jpegRestartTest()
+{
+    cv::Mat in = generateSimpleGeometries();
+    std::vector<uchar> data;
+    std::vector<int> params;
+    params.push_back(cv::IMWRITE_JPEG_QUALITY);
+    params.push_back(90);
+    params.push_back(cv::IMWRITE_JPEG_RST_INTERVAL);
+    params.push_back(4);
+    QVERIFY(cv::imencode(".jpg", in, data, params));
+
+    // Restart intervals are decoded in parallel, same output as libjpeg
+    bool parallel = false;
+    cv::Mat out = ImageCommon::decodeJpegGray(&data[0], data.size(), ImageCommon::JPEG_PARALLEL_RESTART, &parallel);
+    cv::Mat expected = cv::imdecode(data, cv::IMREAD_GRAYSCALE);
+    QVERIFY(parallel);
+    QVERIFY(out.size() == expected.size());
+    QVERIFY(cv::countNonZero(out != expected) == 0);
+
+    // Low and high qualities (large coefficients, range limiting), YCbCr images
+    cv::Mat channels[3] = {in, 255 - in, in / 2};
+    cv::Mat color;
+    cv::merge(channels, 3, color);
+    for (int q=10; q<=100; q+=45)
+    {
+        params[1] = q;
+        QVERIFY(cv::imencode(".jpg", q == 55 ? color : in, data, params));
+        out = ImageCommon::decodeJpegGray(&data[0], data.size(), ImageCommon::JPEG_PARALLEL_RESTART, &parallel);
+        QVERIFY(parallel);
+        QVERIFY(cv::countNonZero(out != cv::imdecode(data, cv::IMREAD_GRAYSCALE)) == 0);
+    }
+
+    // No restart markers : standard decoder
+    QVERIFY(cv::imencode(".jpg", in, data));
+    out = ImageCommon::decodeJpegGray(&data[0], data.size(), ImageCommon::JPEG_PARALLEL_RESTART, &parallel);
+    QVERIFY(!parallel);
+    QVERIFY(cv::countNonZero(out != cv::imdecode(data, cv::IMREAD_GRAYSCALE)) == 0);
+}
+
+//*************************************************************************
+
+}
+
+QTEST_MAIN(Tests::ImagePrefetcherTest)
@@ -0,0 +1,33 @@
+#ifndef ImagePrefetcherTest_H
+#define ImagePrefetcherTest_H
+
+// Qt
+#include <QObject>
+#include <QtTest>
+
+// Project
+
+namespace Tests
+{
+
+//*************************************************************************
+
+class ImagePrefetcherTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void readThreadsTest();
+    void ioUringTest();
+    void decodeTest();
+    void jpegRestartTest();
+
+private:
+    void checkBackend(int backend);
+
+};
+
+//*************************************************************************
+
+} 
+
+#endif // ImagePrefetcherTest_H
@@ -1,6 +1,7 @@
 
 // Std
 #include <vector>
+#include <cmath>
 
 // OpenCV
 #include <opencv2/core/core.hpp>
@@ -11,6 +12,7 @@
 #include "Core/Global.h"
 #include "Core/ImageCommon.h"
 #include "Core/ImageProcessing.h"
+#include "Core/TiledImage.h"
 #include "ImageProcessingTest.h"
 
 
@@ -236,6 +238,230 @@ void ImageProcessingTest::detectObjectsTest3()
 
 //*************************************************************************
 
+void ImageProcessingTest::detectObjectsTiledTest()
+{
+    cv::Mat in(1200, 1200, CV_8U, cv::Scalar::all(70));
+    cv::ellipse(in, cv::Point(200, 200), cv::Size(90, 120), 20, 0, 360, cv::Scalar::all(200), CV_FILLED);
+    cv::ellipse(in, cv::Point(950, 250), cv::Size(110, 95), -10, 0, 360, cv::Scalar::all(10), CV_FILLED);
+    cv::ellipse(in, cv::Point(250, 950), cv::Size(100, 100), 0, 0, 360, cv::Scalar::all(220), CV_FILLED);
+    cv::ellipse(in, cv::Point(950, 950), cv::Size(120, 80), 45, 0, 360, cv::Scalar::all(20), CV_FILLED);
+    // Object across the tile borders
+    cv::ellipse(in, cv::Point(600, 600), cv::Size(110, 90), 0, 0, 360, cv::Scalar::all(230), CV_FILLED);
+
+    ImageCommon::MatTiledImage image(in, cv::Size(100, 100));
+    ImageProcessing::Contours objects;
+    ImageProcessing::detectObjectsTiled(image, &objects, 100, 450,
+                                        ImageProcessing::ELLIPSE_LIKE, 0.7,
+                                        400, VERBOSE);
+    QVERIFY(5 == objects.size());
+
+    // Each object is given once, in image coordinates
+    bool found = false;
+    for (int i=0; i<objects.size(); i++)
+    {
+        cv::Rect brect = cv::boundingRect(objects[i]);
+        found |= brect.contains(cv::Point(600, 600));
+    }
+    QVERIFY(found);
+
+    // Large elongated object across the seam of two tiles : half-extent larger than maxSize/2
+    in.setTo(cv::Scalar::all(70));
+    cv::ellipse(in, cv::Point(790, 600), cv::Size(250, 110), 0, 0, 360, cv::Scalar::all(220), CV_FILLED);
+    ImageProcessing::detectObjectsTiled(image, &objects, 100, 450,
+                                        ImageProcessing::ELLIPSE_LIKE, 0.7,
+                                        400, VERBOSE);
+    QVERIFY(1 == objects.size());
+    cv::Rect brect = cv::boundingRect(objects[0]);
+    QVERIFY(brect.x < 560 && brect.br().x > 1020);
+}
+
+//*************************************************************************
+
+void ImageProcessingTest::detectObjectsMaskTest()
+{
+    cv::Mat in(1200, 1200, CV_8U, cv::Scalar::all(70));
+    cv::ellipse(in, cv::Point(200, 200), cv::Size(90, 120), 20, 0, 360, cv::Scalar::all(200), CV_FILLED);
+    cv::ellipse(in, cv::Point(950, 250), cv::Size(110, 95), -10, 0, 360, cv::Scalar::all(10), CV_FILLED);
+    cv::ellipse(in, cv::Point(250, 950), cv::Size(100, 100), 0, 0, 360, cv::Scalar::all(220), CV_FILLED);
+    cv::ellipse(in, cv::Point(950, 950), cv::Size(120, 80), 45, 0, 360, cv::Scalar::all(20), CV_FILLED);
+
+    // Two disjoint mask regions, processed as two crops
+    cv::Mat mask(in.size(), CV_8U, cv::Scalar::all(0));
+    cv::Rect r1(50, 50, 300, 300), r2(750, 750, 400, 400);
+    mask(r1).setTo(1);
+    mask(r2).setTo(1);
+
+    ImageProcessing::Contours objects;
+    ImageProcessing::detectObjects(in, &objects, 100.0 / 1200, 450.0 / 1200,
+                                   mask, ImageProcessing::ELLIPSE_LIKE, 0.7,
+                                   VERBOSE);
+    QVERIFY(2 == objects.size());
+    for (int i=0; i<objects.size(); i++)
+    {
+        cv::Rect brect = cv::boundingRect(objects[i]);
+        QVERIFY((brect & r1) == brect || (brect & r2) == brect);
+    }
+}
+
+//*************************************************************************
+
+void ImageProcessingTest::detectionLimitsTest()
+{
+    ImageProcessing::DetectionLimits initial = ImageProcessing::getDetectionLimits();
+    ImageProcessing::setDetectionLimits(ImageProcessing::DetectionLimits(0.5, 3, 10, 4));
+    ImageProcessing::resetDetectionCounters();
+
+    // Edge density
+    cv::Mat edges(100, 100, CV_8U, cv::Scalar::all(0));
+    QVERIFY(ImageProcessing::checkEdgeDensity(edges));
+    edges(cv::Rect(0, 0, 100, 60)).setTo(255);
+    QVERIFY(!ImageProcessing::checkEdgeDensity(edges));
+
+    // Contours and points counts
+    std::vector<std::vector<cv::Point> > contours(3, std::vector<cv::Point>(3));
+    QVERIFY(ImageProcessing::checkContours(contours));
+    contours[0].resize(5);
+    QVERIFY(!ImageProcessing::checkContours(contours));
+    contours.push_back(std::vector<cv::Point>(1));
+    QVERIFY(!ImageProcessing::checkContours(contours));
+
+    // Strongest keypoints are kept in their order, with their descriptors
+    std::vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors(10, 2, CV_32F);
+    float responses[] = {5, 1, 9, 0, 7, 3, 8, 2, 6, 4};
+    for (int i=0; i<10; i++)
+    {
+        keypoints.push_back(cv::KeyPoint((float) i, (float) i, 1.0f, -1.0f, responses[i]));
+        descriptors.row(i).setTo(cv::Scalar::all(i));
+    }
+    QVERIFY(ImageProcessing::capKeypoints(keypoints, &descriptors));
+    QVERIFY(keypoints.size() == 4 && descriptors.rows == 4);
+    int expected[] = {2, 4, 6, 8};
+    for (int i=0; i<4; i++)
+    {
+        QVERIFY(keypoints[i].pt.x == expected[i]);
+        QVERIFY(descriptors.at<float>(i, 1) == expected[i]);
+    }
+    QVERIFY(!ImageProcessing::capKeypoints(keypoints, &descriptors));
+
+    ImageProcessing::DetectionCounters c = ImageProcessing::getDetectionCounters();
+    QVERIFY(c.edgeMaps == 2);
+    QVERIFY(c.edgeDensityBailouts == 1);
+    QVERIFY(c.pointsBailouts == 1);
+    QVERIFY(c.contoursBailouts == 1);
+    QVERIFY(c.cappedKeypoints == 1);
+
+    // Noise frame : the detection stops after Canny
+    cv::Mat noise(400, 400, CV_8U);
+    cv::randu(noise, 0, 256);
+    ImageProcessing::setDetectionLimits(ImageProcessing::DetectionLimits(0.001, 0, 0, 0));
+    ImageProcessing::Contours objects;
+    ImageProcessing::detectObjects(noise, &objects, 0.0, 1.0);
+    QVERIFY(objects.isEmpty());
+    QVERIFY(ImageProcessing::getDetectionCounters().edgeDensityBailouts == 2);
+
+    ImageProcessing::setDetectionLimits(initial);
+}
+
+//*************************************************************************
+
+void ImageProcessingTest::edgePreservingFiltersTest()
+{
+    // Noisy step : the noise is smoothed, the step is kept
+    cv::Mat step(100, 100, CV_8U, cv::Scalar(40));
+    step(cv::Rect(50, 0, 50, 100)).setTo(220);
+    cv::Mat noise(step.size(), CV_8U);
+    cv::randu(noise, 0, 21);
+    cv::Mat noisy = step + noise - cv::Scalar::all(10);
+
+    cv::Mat guided, grid;
+    ImageProcessing::guidedFilter(noisy, guided);
+    ImageProcessing::bilateralGridFilter(noisy, grid);
+    QVERIFY(guided.type() == CV_8U && grid.type() == CV_8U);
+
+    cv::Rect left(0, 0, 45, 100), right(55, 0, 45, 100);
+    double maxNoise = cv::norm(noisy, step, cv::NORM_L2);
+    QVERIFY(cv::norm(guided, step, cv::NORM_L2) < maxNoise);
+    QVERIFY(cv::norm(grid, step, cv::NORM_L2) < maxNoise);
+    QVERIFY(std::abs(cv::mean(guided(left))[0] - 40.0) < 3.0);
+    QVERIFY(std::abs(cv::mean(guided(right))[0] - 220.0) < 3.0);
+    QVERIFY(std::abs(cv::mean(grid(left))[0] - 40.0) < 3.0);
+    QVERIFY(std::abs(cv::mean(grid(right))[0] - 220.0) < 3.0);
+    QVERIFY(grid.at<uchar>(50, 48) < 60 && grid.at<uchar>(50, 51) > 200);
+
+    // Pre-filter selection : geometries are detected with all the pre-filters
+    ImageProcessing::PreFilter initial = ImageProcessing::getDetectionPreFilter();
+    cv::Mat image = generateSimpleGeometries();
+    ImageProcessing::PreFilter filters[] = {ImageProcessing::PREFILTER_GUIDED, ImageProcessing::PREFILTER_BILATERAL_GRID};
+    for (int i=0; i<2; i++)
+    {
+        ImageProcessing::setDetectionPreFilter(filters[i]);
+        QVERIFY(ImageProcessing::getDetectionPreFilter() == filters[i]);
+        ImageProcessing::Contours objects;
+        ImageProcessing::detectObjects(image, &objects, 0.05, 0.95);
+        QVERIFY(!objects.isEmpty());
+    }
+    ImageProcessing::setDetectionPreFilter(initial);
+}
+
+//*************************************************************************
+
+#ifdef HAS_3RDPARTY
+void ImageProcessingTest::diffusionSchemesTest()
+{
+    // AOS and FED solve the same diffusion : AOS is less accurate but close to FED
+    cv::Mat image = generateSimpleGeometries();
+    cv::Mat input, fed, aos;
+    image.convertTo(input, CV_32F, 1.0 / 255.0);
+    ImageProcessing::nonlinearDiffusionFiltering(image, fed, ImageProcessing::DIFFUSION_FED);
+    ImageProcessing::nonlinearDiffusionFiltering(image, aos, ImageProcessing::DIFFUSION_AOS);
+    QVERIFY(aos.size() == fed.size() && aos.type() == fed.type());
+
+    // No NaN or infinite values
+    QVERIFY(cv::checkRange(aos));
+    QVERIFY(cv::checkRange(fed));
+
+    double n = std::sqrt((double) fed.total());
+    double diffusion = cv::norm(fed, input, cv::NORM_L2) / n;
+    double error = cv::norm(aos, fed, cv::NORM_L2) / n;
+    QVERIFY(error < 0.005);
+    QVERIFY(error < 0.2 * diffusion);
+}
+#endif
+
+//*************************************************************************
+
+void ImageProcessingTest::frameQualityTest()
+{
+    cv::Mat sharp = generateSimpleGeometries();
+    cv::Mat blurred;
+    cv::GaussianBlur(sharp, blurred, cv::Size(0, 0), 5.0);
+
+    ImageProcessing::FrameQuality q1, q2;
+    ImageProcessing::computeFrameQuality(sharp, cv::Mat(), &q1);
+    ImageProcessing::computeFrameQuality(blurred, cv::Mat(), &q2);
+    QVERIFY(q1.motion < 0.0);
+    QVERIFY(q1.sharpness > q2.sharpness);
+
+    // Same frame -> no motion, shifted frame -> motion
+    ImageProcessing::computeFrameQuality(sharp, sharp, &q1);
+    QVERIFY(q1.motion == 0.0);
+
+    cv::Mat shifted = cv::Mat::zeros(sharp.size(), sharp.type());
+    sharp(cv::Rect(10, 0, sharp.cols - 10, sharp.rows)).copyTo(shifted(cv::Rect(0, 0, sharp.cols - 10, sharp.rows)));
+    ImageProcessing::computeFrameQuality(shifted, sharp, &q1);
+    QVERIFY(q1.motion > 0.0);
+
+    // Dark frame
+    cv::Mat dark = cv::Mat::zeros(sharp.size(), CV_8U);
+    ImageProcessing::computeFrameQuality(dark, cv::Mat(), &q1);
+    QVERIFY(q1.meanIntensity < 1.0);
+    QVERIFY(q1.darkRatio > 0.99);
+    QVERIFY(q1.brightRatio == 0.0);
+}
+
+//*************************************************************************
+
 }
 
 QTEST_MAIN(Tests::ImageProcessingTest)
@@ -24,6 +24,15 @@ private slots:
     void detectObjectsTest1();
     void detectObjectsTest2();
     void detectObjectsTest3();
+    void detectObjectsTiledTest();
+    void detectObjectsMaskTest();
+    void detectionLimitsTest();
+    void edgePreservingFiltersTest();
+#ifdef HAS_3RDPARTY
+    void diffusionSchemesTest();
+#endif
+
+    void frameQualityTest();
 
 private:
 
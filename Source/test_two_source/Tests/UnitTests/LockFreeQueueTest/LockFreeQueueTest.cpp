@@ -0,0 +1,131 @@
+
+// Std
+#include <vector>
+
+// Qt
+#include <QThread>
+
+// Tests
+#include "Core/LockFreeQueue.h"
+#include "LockFreeQueueTest.h"
+
+
+namespace Tests
+{
+
+//*************************************************************************
+
+void LockFreeQueueTest::fifoTest()
+{
+    LockFreeQueue<int> queue(8);
+    for (int i=0; i<5; i++)
+        QVERIFY(queue.push(i));
+
+    int value = -1;
+    for (int i=0; i<5; i++)
+    {
+        QVERIFY(queue.pop(&value));
+        QVERIFY(value == i);
+    }
+    QVERIFY(!queue.pop(&value));
+}
+
+//*************************************************************************
+
+void LockFreeQueueTest::fullEmptyTest()
+{
+    LockFreeQueue<int> queue(5);
+    QVERIFY(queue.capacity() == 8);
+
+    int value = -1;
+    QVERIFY(!queue.pop(&value));
+
+    // Fill and empty several times to wrap around the cells
+    for (int r=0; r<3; r++)
+    {
+        for (int i=0; i<queue.capacity(); i++)
+            QVERIFY(queue.push(r * 100 + i));
+        QVERIFY(!queue.push(-1));
+        for (int i=0; i<queue.capacity(); i++)
+        {
+            QVERIFY(queue.pop(&value));
+            QVERIFY(value == r * 100 + i);
+        }
+        QVERIFY(!queue.pop(&value));
+    }
+}
+
+//*************************************************************************
+
+class Producer : public QThread
+{
+public:
+    Producer(LockFreeQueue<int> * queue, int first, int count) :
+        _queue(queue), _first(first), _count(count)
+    {}
+
+protected:
+    void run()
+    {
+        for (int i=0; i<_count; i++)
+        {
+            while (!_queue->push(_first + i))
+                yieldCurrentThread();
+        }
+    }
+
+    LockFreeQueue<int> * _queue;
+    int _first;
+    int _count;
+};
+
+//*************************************************************************
+
+void LockFreeQueueTest::multiProducersTest()
+{
+    const int producerCount = 4;
+    const int count = 10000;
+    LockFreeQueue<int> queue(64);
+
+    QList<Producer*> producers;
+    for (int p=0; p<producerCount; p++)
+    {
+        producers << new Producer(&queue, p * count, count);
+        producers.last()->start();
+    }
+
+    // Every value is received exactly once. Failures are checked once the producers are
+    // joined : a test function returning early would leave them running on the queue
+    std::vector<int> received(producerCount * count, 0);
+    int total = 0;
+    int invalid = 0;
+    int value = -1;
+    while (total < producerCount * count)
+    {
+        if (!queue.pop(&value))
+        {
+            QThread::yieldCurrentThread();
+            continue;
+        }
+        if (value >= 0 && value < producerCount * count)
+            received[value]++;
+        else
+            invalid++;
+        total++;
+    }
+
+    foreach (Producer * p, producers)
+        p->wait();
+    qDeleteAll(producers);
+
+    QVERIFY(invalid == 0);
+    for (size_t i=0; i<received.size(); i++)
+        QVERIFY(received[i] == 1);
+    QVERIFY(!queue.pop(&value));
+}
+
+//*************************************************************************
+
+}
+
+QTEST_MAIN(Tests::LockFreeQueueTest)
@@ -0,0 +1,31 @@
+#ifndef LockFreeQueueTest_H
+#define LockFreeQueueTest_H
+
+// Qt
+#include <QObject>
+#include <QtTest>
+
+// Project
+
+namespace Tests
+{
+
+//*************************************************************************
+
+class LockFreeQueueTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void fifoTest();
+    void fullEmptyTest();
+    void multiProducersTest();
+
+private:
+
+};
+
+//*************************************************************************
+
+} 
+
+#endif // LockFreeQueueTest_H
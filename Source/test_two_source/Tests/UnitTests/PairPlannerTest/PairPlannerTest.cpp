@@ -0,0 +1,185 @@
+// Qt
+#include <QPair>
+
+// Tests
+#include "../../Common.h"
+#include "Core/Global.h"
+#include "CardDetector.h"
+#include "DeckModel.h"
+#include "PairPlanner.h"
+#include "PairPlannerTest.h"
+
+
+namespace Tests
+{
+
+//*************************************************************************
+
+//! Adds a card of objects with the given labels to the table
+static void addCard(DGV::ObjectTable & table, const QVector<int> & labels)
+{
+    if (table.cardOffsets.isEmpty())
+        table.cardOffsets << 0;
+    foreach (int label, labels)
+    {
+        DGV::ObjectTable::Object o;
+        o.cardId = table.cardCount();
+        o.contourOffset = 0;
+        o.contourLength = 0;
+        o.label = label;
+        table.objects << o;
+    }
+    table.cardOffsets << table.objects.size();
+}
+
+//! Table of the cards of a deck, objects are labelled with their symbol
+static DGV::ObjectTable deckTable(const QVector<QVector<int> > & cards)
+{
+    DGV::ObjectTable table;
+    foreach (const QVector<int> & card, cards)
+        addCard(table, card);
+    return table;
+}
+
+//! Perfect matching : objects with the same label
+static bool matchByLabel(const DGV::ObjectTable & table, int card1, int card2, int * object1, int * object2)
+{
+    for (int i=table.cardOffsets[card1]; i<table.cardOffsets[card1+1]; i++)
+    {
+        for (int j=table.cardOffsets[card2]; j<table.cardOffsets[card2+1]; j++)
+        {
+            if (table.objects[i].label == table.objects[j].label)
+            {
+                *object1 = i;
+                *object2 = j;
+                return true;
+            }
+        }
+    }
+    *object1 = -1;
+    *object2 = -1;
+    return false;
+}
+
+//! Runs the planner with a perfect matching, returns the compared pairs
+static QVector<QPair<int, int> > plan(DGV::PairPlanner & planner, const DGV::ObjectTable & table)
+{
+    QVector<QPair<int, int> > compared;
+    planner.reset(table);
+    int card1, card2;
+    while (planner.nextPair(&card1, &card2))
+    {
+        compared << qMakePair(card1, card2);
+        int object1, object2;
+        matchByLabel(table, card1, card2, &object1, &object2);
+        planner.setResult(card1, card2, object1, object2);
+    }
+    return compared;
+}
+
+//*************************************************************************
+
+void PairPlannerTest::clustersTest()
+{
+    // Projective plane of order 3 : 13 cards, 4 cards per symbol
+    DGV::ObjectTable table = deckTable(DGV::DeckModel::projectivePlane(3));
+    DGV::PairPlanner planner;
+    plan(planner, table);
+    QVERIFY(planner.cardCount() == 13);
+
+    // Cards p < q < r < s of a symbol : (p,q), (p,r), (p,s) are compared, the others inferred
+    QVERIFY(planner.matchedCount() == 13 * 3);
+    QVERIFY(planner.inferredCount() == 13 * 3);
+
+    // All the pairs are resolved with objects of the same symbol
+    for (int i=0; i<13; i++)
+    {
+        for (int j=i+1; j<13; j++)
+        {
+            DGV::PairPlanner::PairState s = planner.state(i, j);
+            QVERIFY(s == DGV::PairPlanner::MATCHED || s == DGV::PairPlanner::INFERRED);
+            int object1, object2;
+            QVERIFY(planner.commonObjects(j, i, &object2, &object1));
+            QVERIFY(table.objects[object1].cardId == i && table.objects[object2].cardId == j);
+            QVERIFY(table.objects[object1].label == table.objects[object2].label);
+        }
+    }
+}
+
+//*************************************************************************
+
+void PairPlannerTest::orderTest()
+{
+    DGV::ObjectTable table = deckTable(DGV::DeckModel::projectivePlane(3));
+    DGV::PairPlanner planner;
+    QVector<QPair<int, int> > compared = plan(planner, table);
+    QVERIFY(compared.size() == planner.matchedCount());
+
+    // Star order : all the pairs of the first card, then the next pairs not inferred
+    for (int k=0; k<12; k++)
+        QVERIFY(compared[k] == qMakePair(0, k + 1));
+    // Cards 0, 1 and 2 share a symbol : (1, 2) is inferred
+    QVERIFY(compared[12] == qMakePair(1, 3));
+    QVERIFY(planner.state(1, 2) == DGV::PairPlanner::INFERRED);
+    for (int k=1; k<compared.size(); k++)
+    {
+        QVERIFY(compared[k].first < compared[k].second);
+        QVERIFY(compared[k-1] < compared[k]);
+        QVERIFY(planner.state(compared[k].first, compared[k].second) == DGV::PairPlanner::MATCHED);
+    }
+}
+
+//*************************************************************************
+
+void PairPlannerTest::conflictTest()
+{
+    // A-B : 1, A-C : 2, A-D : 3, B-C : 4, B-D : 5, C-D : 6
+    QVector<QVector<int> > cards(4);
+    cards[0] << 1 << 2 << 3;
+    cards[1] << 1 << 4 << 5;
+    cards[2] << 2 << 4 << 6;
+    cards[3] << 3 << 5 << 6;
+    DGV::ObjectTable table = deckTable(cards);
+
+    DGV::PairPlanner planner;
+    planner.reset(table);
+    int card1, card2, object1, object2;
+    for (int k=1; k<4; k++)
+    {
+        QVERIFY(planner.nextPair(&card1, &card2));
+        QVERIFY(card1 == 0 && card2 == k);
+        matchByLabel(table, card1, card2, &object1, &object2);
+        planner.setResult(card1, card2, object1, object2);
+    }
+
+    // Wrong match of B and C : objects of the symbols 1 and 2 would put two objects of A in
+    // the same cluster. The match is kept for its pair but not used for the inference
+    QVERIFY(planner.nextPair(&card1, &card2));
+    QVERIFY(card1 == 1 && card2 == 2);
+    planner.setResult(1, 2, table.cardOffsets[1], table.cardOffsets[2]);
+    QVERIFY(planner.state(1, 2) == DGV::PairPlanner::MATCHED);
+    QVERIFY(planner.commonObjects(1, 2, &object1, &object2));
+    QVERIFY(object1 == table.cardOffsets[1] && object2 == table.cardOffsets[2]);
+
+    // The next pairs are compared, not inferred from the wrong match
+    QVERIFY(planner.nextPair(&card1, &card2));
+    QVERIFY(card1 == 1 && card2 == 3);
+    planner.setResult(1, 3, -1, -1);
+    QVERIFY(planner.state(1, 3) == DGV::PairPlanner::NOT_FOUND);
+    QVERIFY(!planner.commonObjects(1, 3, &object1, &object2));
+
+    QVERIFY(planner.nextPair(&card1, &card2));
+    QVERIFY(card1 == 2 && card2 == 3);
+    matchByLabel(table, card1, card2, &object1, &object2);
+    planner.setResult(card1, card2, object1, object2);
+
+    QVERIFY(!planner.nextPair(&card1, &card2));
+    QVERIFY(planner.inferredCount() == 0);
+    QVERIFY(planner.matchedCount() == 5);
+}
+
+//*************************************************************************
+
+}
+
+QTEST_MAIN(Tests::PairPlannerTest)
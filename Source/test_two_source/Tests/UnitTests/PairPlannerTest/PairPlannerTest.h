@@ -0,0 +1,29 @@
+#ifndef PairPlannerTest_H
+#define PairPlannerTest_H
+
+// Qt
+#include <QObject>
+#include <QtTest>
+
+// Project
+
+namespace Tests
+{
+
+//*************************************************************************
+
+class PairPlannerTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void clustersTest();
+    void orderTest();
+    void conflictTest();
+
+};
+
+//*************************************************************************
+
+} 
+
+#endif // PairPlannerTest_H
@@ -0,0 +1,209 @@
+
+// Std
+#include <vector>
+
+// Qt
+#include <QTemporaryDir>
+#include <QAtomicInt>
+#include <QFileInfo>
+#include <QElapsedTimer>
+
+// OpenCV
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+// Tests
+#include "../../Common.h"
+#include "Core/Global.h"
+#include "Core/SessionLog.h"
+#include "SessionLogTest.h"
+
+
+namespace Tests
+{
+
+//*************************************************************************
+
+static cv::Mat testFrame(int i)
+{
+    cv::Mat frame(48, 64, CV_8U);
+    for (int y=0; y<frame.rows; y++)
+        for (int x=0; x<frame.cols; x++)
+            frame.at<uchar>(y, x) = (uchar) ((x * 7 + y * 13 + i * 31) & 0xFF);
+    return frame;
+}
+
+//*************************************************************************
+
+class CountingTarget : public ImageCommon::ReplayTarget
+{
+public:
+    virtual void processFrame(int stream, int frame, const cv::Mat & image, QVector<ImageCommon::StageTiming> * stages)
+    {
+        Q_UNUSED(frame);
+        if (!image.empty())
+            frames.ref();
+        streams.fetchAndOrOrdered(1 << stream);
+        *stages << ImageCommon::StageTiming("detect", 1.0);
+    }
+    QAtomicInt frames;
+    QAtomicInt streams;
+};
+
+//*************************************************************************
+
+void SessionLogTest::recordTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.path() + "/session.log";
+
+    ImageCommon::SessionRecorder recorder;
+    QVERIFY(recorder.open(path, 1024 * 1024));
+    QVERIFY(recorder.isOpen());
+
+    // Raw frames on two streams, one encoded frame, stage timings
+    for (int i=0; i<4; i++)
+    {
+        QVERIFY(recorder.recordFrame(i % 2, i / 2, testFrame(i), 1000000 * i));
+        QVERIFY(recorder.recordStage(i % 2, i / 2, "detect", 2.0 + i));
+    }
+    std::vector<uchar> png;
+    QVERIFY(cv::imencode(".png", testFrame(4), png));
+    QVERIFY(recorder.recordEncodedFrame(0, 2, &png[0], png.size(), 4000000));
+    QVERIFY(recorder.droppedRecordCount() == 0);
+    qint64 size = recorder.size();
+    recorder.close();
+    QVERIFY(QFileInfo(path).size() < 1024 * 1024);
+    QVERIFY(QFileInfo(path).size() > size);
+
+    ImageCommon::SessionReplayer replayer;
+    QVERIFY(replayer.open(path));
+    QVERIFY(replayer.frameCount() == 5);
+    QVERIFY(replayer.streamCount() == 2);
+    for (int i=0; i<5; i++)
+    {
+        cv::Mat frame = replayer.frame(i);
+        QVERIFY(frame.size() == cv::Size(64, 48) && frame.type() == CV_8U);
+        QVERIFY(cv::countNonZero(frame != testFrame(i)) == 0);
+    }
+
+    // Not a log
+    QFile other(dir.path() + "/other.log");
+    QVERIFY(other.open(QIODevice::WriteOnly));
+    other.write("not a session log");
+    other.close();
+    QVERIFY(!replayer.open(other.fileName()));
+}
+
+//*************************************************************************
+
+void SessionLogTest::capacityTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.path() + "/session.log";
+
+    // Room for two frames : following records are dropped, the log stays readable
+    ImageCommon::SessionRecorder recorder;
+    QVERIFY(recorder.open(path, 2 * (64 * 48 + 64) + 8));
+    int recorded = 0;
+    for (int i=0; i<5; i++)
+        recorded += recorder.recordFrame(0, i, testFrame(i)) ? 1 : 0;
+    QVERIFY(recorded == 2);
+    QVERIFY(recorder.droppedRecordCount() == 3);
+    QVERIFY(recorder.isFull());
+    recorder.close();
+
+    ImageCommon::SessionReplayer replayer;
+    QVERIFY(replayer.open(path));
+    QVERIFY(replayer.frameCount() == 2);
+}
+
+//*************************************************************************
+
+void SessionLogTest::sessionFrameTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.path() + "/session.log";
+
+    // Lossless encoded frames, one on two
+    ImageCommon::SessionRecorder recorder;
+    QVERIFY(recorder.getFrameFormat() == ImageCommon::SessionRecorder::FRAME_JPEG);
+    QVERIFY(recorder.open(path, 1024 * 1024));
+    recorder.setFrameFormat(ImageCommon::SessionRecorder::FRAME_PNG);
+    recorder.setFrameSampling(2);
+    for (int i=0; i<6; i++)
+        QVERIFY(recorder.recordSessionFrame(0, i, testFrame(i)));
+    recorder.close();
+
+    ImageCommon::SessionReplayer replayer;
+    QVERIFY(replayer.open(path));
+    QVERIFY(replayer.frameCount() == 3);
+    for (int i=0; i<3; i++)
+        QVERIFY(cv::countNonZero(replayer.frame(i) != testFrame(2 * i)) == 0);
+
+    // JPEG frames are close to the originals
+    QVERIFY(recorder.open(path, 1024 * 1024));
+    recorder.setFrameFormat(ImageCommon::SessionRecorder::FRAME_JPEG);
+    recorder.setFrameSampling(1);
+    QVERIFY(recorder.recordSessionFrame(0, 0, testFrame(0)));
+    recorder.close();
+    QVERIFY(replayer.open(path));
+    QVERIFY(replayer.frameCount() == 1);
+    cv::Mat frame = replayer.frame(0);
+    QVERIFY(frame.size() == cv::Size(64, 48));
+    QVERIFY(cv::norm(frame, testFrame(0), cv::NORM_L1) < 16.0 * frame.total());
+}
+
+//*************************************************************************
+
+void SessionLogTest::replayTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.path() + "/session.log";
+
+    ImageCommon::SessionRecorder recorder;
+    QVERIFY(recorder.open(path, 1024 * 1024));
+    for (int i=0; i<6; i++)
+    {
+        recorder.recordFrame(i % 2, i / 2, testFrame(i), 10000000 * i);
+        recorder.recordStage(i % 2, i / 2, "detect", 3.0);
+    }
+    recorder.close();
+
+    ImageCommon::SessionReplayer replayer;
+    QVERIFY(replayer.open(path));
+
+    // 2 copies of 2 streams, 50 ms of session replayed 5 times faster
+    CountingTarget target;
+    QElapsedTimer timer;
+    timer.start();
+    ImageCommon::SessionReplayer::Report report = replayer.replay(&target, 2, 5.0);
+    QVERIFY(timer.elapsed() >= 10);
+    QVERIFY(target.frames.load() == 12);
+    QVERIFY(target.streams.load() == 0xF);
+    QVERIFY(report.frames == 12);
+
+    QVERIFY(report.recorded.size() == 1);
+    QVERIFY(report.recorded[0].name == "detect");
+    QVERIFY(report.recorded[0].count == 6);
+    QVERIFY(report.recorded[0].mean == 3.0);
+
+    bool detect = false, frame = false, lateness = false;
+    foreach (const ImageCommon::SessionReplayer::StageStats & s, report.replayed)
+    {
+        detect = detect || (s.name == "detect" && s.count == 12 && s.max == 1.0);
+        frame = frame || (s.name == "replay frame" && s.count == 12);
+        lateness = lateness || (s.name == "replay lateness" && s.count == 12);
+    }
+    QVERIFY(detect && frame && lateness);
+}
+
+//*************************************************************************
+
+}
+
+QTEST_MAIN(Tests::SessionLogTest)
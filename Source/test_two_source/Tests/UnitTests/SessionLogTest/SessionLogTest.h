@@ -0,0 +1,30 @@
+#ifndef SessionLogTest_H
+#define SessionLogTest_H
+
+// Qt
+#include <QObject>
+#include <QtTest>
+
+// Project
+
+namespace Tests
+{
+
+//*************************************************************************
+
+class SessionLogTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void recordTest();
+    void capacityTest();
+    void sessionFrameTest();
+    void replayTest();
+
+};
+
+//*************************************************************************
+
+} 
+
+#endif // SessionLogTest_H